@@ -1,32 +1,277 @@
 #include "error_signaling.h"
 #include "stdbool.h"
+#include "stddef.h"
+#include "string.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
 
 #include "app.h"
 #include "leds.h"
 #include "chrono.h"
 #include "storage.h"
+#include "scoring.h"
+#include "game_mode.h"
+#include "history.h"
+#include "supervisor.h"
+#include "buzzer.h"
+#include "buttons.h"
 
-QueueHandle_t app_event_queue = NULL;
+#define APP_SNAPSHOT_MAGIC  0x4D415443
+
+_Static_assert(TEAM_COUNT <= SCORING_MAX_TEAMS, "The scoring engine cannot track every team");
+_Static_assert(APP_STATE_SETTINGS_CP_ECHO - APP_STATE_SETTINGS_CP_ALPHA == CONTROL_POINT_ECHO - CONTROL_POINT_ALPHA,
+               "One settings entry per control point");
+
+POOL_DEFINE(app_payload_pool, APP_PAYLOAD_BLOCK_SIZE, APP_PAYLOAD_BLOCK_COUNT);
 TimerHandle_t initial_setup_timer = NULL;
+TimerHandle_t match_timer = NULL;
 
 // GAME VARIABLES
 ControlPoint_t control_point = CONTROL_POINT_NONE;
+GameConfig_t game_config = GAME_CONFIG_DEFAULT();
 AppState_t current_state = APP_STATE_INIT;
-Chrono_t blue_chrono = CHRONO_DEFAULT();
-Chrono_t red_chrono = CHRONO_DEFAULT();
+uint16_t captures = 0;
+ScoringEngine_t scoring;
+ModeState_t mode_state = MODE_STATE_READY;
+Team_t mode_owner = TEAM_NONE;
+Team_t match_winner = TEAM_NONE;
+uint32_t match_start_ms = 0;
+bool countdown_lit = false;
+
+// CONFIG PUSHED DURING A MATCH: applied as a whole when the match ends
+static GameConfig_t pending_config;
+static bool config_pending = false;
+
+// STATUS SNAPSHOT: written by app_task alone, odd status_seq while writing
+static AppStatus_t status_snapshot;
+static uint32_t status_seq = 0;
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// LOOP TIME: longest busy iteration since the last app_take_loop_max_us()
+static uint32_t loop_max_us = 0;
+
+// REPLAY: app time comes from the trace instead of esp_timer
+static bool replaying = false;
+static uint32_t replay_clock_ms = 0;
+
+// MATCH SNAPSHOT: taken while running, kept across a watchdog or panic reset, not a power cycle
+typedef struct
+{
+    uint32_t magic;
+    uint32_t crc;                           // Of everything below
+    GameConfig_t config;                    // The match is played with it to the end
+    uint8_t mode_id;
+    uint8_t state;
+    uint8_t mode_state;
+    int8_t mode_owner;
+    uint16_t captures;
+    uint8_t chrono_running;                 // Team bits
+    uint32_t saved_ms;                      // app_now_ms() when taken
+    uint32_t elapsed_ms;                    // Match time when taken
+    uint32_t timer_left_ms;                 // Match timer left, 0 if not running
+    int64_t chrono_total_us[TEAM_COUNT];    // Running ones included up to saved_ms
+    ScoringEngine_t scoring;
+} AppSnapshot_t;
+
+static RTC_NOINIT_ATTR AppSnapshot_t snapshot;
+
+TeamState_t teams[TEAM_COUNT] =
+{
+    [TEAM_BLUE]   = { .chrono = CHRONO_DEFAULT(), .button_gpio = GPIO_BTN_BLUE,   .name = "BLUE" },
+    [TEAM_RED]    = { .chrono = CHRONO_DEFAULT(), .button_gpio = GPIO_BTN_RED,    .name = "RED" },
+#if TEAM_COUNT > 2
+    [TEAM_GREEN]  = { .chrono = CHRONO_DEFAULT(), .button_gpio = GPIO_BTN_GREEN,  .name = "GREEN" },
+#endif
+#if TEAM_COUNT > 3
+    [TEAM_YELLOW] = { .chrono = CHRONO_DEFAULT(), .button_gpio = GPIO_BTN_YELLOW, .name = "YELLOW" },
+#endif
+};
+
+#if CONFIG_DOMINION_GAME_MODE_RUNTIME
+const GameMode_t * game_mode = &game_mode_domination;
+#else
+// Resolved at build time: the tables are indexed directly
+#define game_mode (&GAME_MODE_COMPILED)
+#endif
 
 void initial_setup_timer_callback();
+void match_timer_callback();
+void match_timer_start();
+uint32_t app_now_ms();
+int64_t app_replay_clock_us();
+void app_tick();
+void app_handle_event(const AppEventMessage_t * message);
+void app_publish_status();
+void scoring_rules_from_config(ScoringRules_t * rules);
+void app_select_mode();
+void app_apply_config(const GameConfig_t * config);
+void app_settings_event(AppEvent_t event);
+void app_set_control_point(ControlPoint_t point);
+int8_t app_fault_state(void);
+void app_mode_dispatch(AppEvent_t event);
+void app_start_match();
+void app_sync_event(AppEvent_t event);
+ModeEvent_t app_mode_event(AppEvent_t event, Team_t * presser);
+void app_mode_capture(Team_t team);
+void app_mode_leds();
+void app_finish_match(int8_t winner);
+void app_reset_match();
+void app_save_snapshot();
+bool app_restore_snapshot();
+uint32_t app_snapshot_crc(const AppSnapshot_t * saved);
+uint32_t app_match_time_left_ms();
+void app_cue(BuzzerCue_t cue);
+
+uint32_t app_take_loop_max_us(void)
+{
+    return __atomic_exchange_n(&loop_max_us, 0, __ATOMIC_RELAXED);
+}
 
 AppState_t get_app_state(void)
 {
-    return current_state;
+    AppStatus_t status;
+    app_get_status(&status);
+    return status.state;
+}
+
+void app_get_status(AppStatus_t * status)
+{
+
+    uint32_t seq_before;
+    uint32_t seq_after;
+
+    do
+    {
+        seq_before = __atomic_load_n(&status_seq, __ATOMIC_ACQUIRE);
+        *status = status_snapshot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq_after = __atomic_load_n(&status_seq, __ATOMIC_RELAXED);
+    }
+    while ((seq_before & 1) || seq_before != seq_after);
+
+    status->seq = seq_before / 2;
+
+}
+
+esp_err_t app_replay(const AppTraceEntry_t * trace, size_t count, AppStatus_t * result)
+{
+
+    if((count > 0 && trace == NULL) || result == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    // Out of order, the time between two events would wrap to 49 days of ticks
+    for(size_t i = 1; i < count; i++)
+    {
+        if(trace[i].time_ms < trace[i - 1].time_ms)
+        {
+            ESP_LOGE(__func__, "Trace entry %u goes back in time: %lu after %lu ms", (unsigned)i,
+                     (unsigned long)trace[i].time_ms, (unsigned long)trace[i - 1].time_ms);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if(match_timer)
+        return ESP_ERR_INVALID_STATE;
+
+    replaying = true;
+    replay_clock_ms = count > 0 ? trace[0].time_ms : 0;
+    chrono_set_clock(app_replay_clock_us);
+
+    storage_get_game_config(&game_config);
+    config_pending = false;
+    control_point = CONTROL_POINT_NONE;
+    if(game_config.control_point > CONTROL_POINT_NONE && game_config.control_point < CONTROL_POINT_MAX)
+    {
+        control_point = game_config.control_point;
+    }
+    ScoringRules_t scoring_rules;
+    scoring_rules_from_config(&scoring_rules);
+    scoring_init(&scoring, &scoring_rules, TEAM_COUNT, app_now_ms());
+    app_reset_match();
+    current_state = APP_STATE_INIT;
+
+    uint32_t last_ms = replay_clock_ms;
+    bool valid = true;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        // The ticks the live task runs while waiting on an idle queue
+        while(trace[i].time_ms - last_ms >= SCORING_TICK_MS)
+        {
+            last_ms += SCORING_TICK_MS;
+            replay_clock_ms = last_ms;
+            app_tick();
+            valid &= app_check_invariants();
+        }
+
+        replay_clock_ms = trace[i].time_ms;
+        last_ms = replay_clock_ms;
+        app_tick();
+        AppEventMessage_t message = { .type = trace[i].event };
+        app_handle_event(&message);
+        valid &= app_check_invariants();
+    }
+
+    app_publish_status();
+    app_get_status(result);
+
+    chrono_set_clock(NULL);
+    replaying = false;
+
+    if(!valid)
+    {
+        ESP_LOGE(__func__, "The trace broke the match invariants");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+
+}
+
+void app_publish_status()
+{
+
+    AppStatus_t status =
+    {
+        .state = current_state,
+        .control_point = control_point,
+        .owner = (mode_state == MODE_STATE_HELD || mode_state == MODE_STATE_ARMED) ? mode_owner : TEAM_NONE,
+        .winner = current_state == APP_STATE_FINISHED ? match_winner : TEAM_NONE,
+        .captures = captures,
+        .time_left_s = (app_match_time_left_ms() + 999) / 1000,
+        .rules = scoring.rules,
+    };
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        status.seconds[team] = chrono_get_seconds(&teams[team].chrono);
+        status.points[team] = scoring_get_points(&scoring, team);
+    }
+
+    // Only this task takes the lock: it just keeps the write from being
+    // preempted, which would leave same-core readers spinning
+    portENTER_CRITICAL(&status_lock);
+    __atomic_store_n(&status_seq, status_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    status_snapshot = status;
+    __atomic_store_n(&status_seq, status_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&status_lock);
+
+    if(!replaying)
+    {
+        app_save_snapshot();
+    }
+
 }
 
 void app_task(void* arg)
 {
     
     current_state = APP_STATE_INIT;
+    fault_set_state_source(app_fault_state);
 
     esp_err_t storage_err = storage_get_control_point(&control_point);
     if(ESP_OK != storage_err)
@@ -37,10 +282,26 @@ void app_task(void* arg)
 
     ESP_LOGI(__func__, "CONTROL POINT: %s", control_point_to_string(control_point));
 
-    app_event_queue = xQueueCreate(10, sizeof(AppEventMessage_t));    
-    if (!app_event_queue) 
+    esp_err_t config_err = storage_get_game_config(&game_config);
+    if(ESP_OK != config_err)
+    {
+        ESP_LOGW(__func__, "No game config pushed yet, using defaults: %s", esp_err_to_name(config_err));
+    }
+
+    ESP_LOGI(__func__, "MATCH DURATION: %lus", (unsigned long)game_config.match_duration_s);
+
+    ScoringRules_t scoring_rules;
+    scoring_rules_from_config(&scoring_rules);
+    scoring_init(&scoring, &scoring_rules, TEAM_COUNT, app_now_ms());
+
+    app_select_mode();
+    ESP_LOGI(__func__, "GAME MODE: %s", game_mode->name);
+
+    pool_init(&app_payload_pool);
+
+    if (ESP_OK != app_event_init())
     {
-        ESP_LOGE(__func__, "Error creating app_event_queue");
+        ESP_LOGE(__func__, "Error creating the app event channel");
         signal_fatal_error(INIT_ERROR);
     }
 
@@ -59,651 +320,910 @@ void app_task(void* arg)
         current_state = APP_STATE_IDLE;
     }
 
+    // The real period is set from the game config when the match starts
+    match_timer = xTimerCreate("match", pdMS_TO_TICKS(1000), pdFALSE, NULL, match_timer_callback);
+    if(!match_timer)
+    {
+        ESP_LOGE(__func__, "Error creating match_timer");
+        signal_fatal_error(INIT_ERROR);
+    }
+
+    // Back from a reset in the middle of a match: no setup, play on
+    if(app_restore_snapshot() && initial_setup_timer)
+    {
+        xTimerStop(initial_setup_timer, 0);
+    }
+
+    button_set_press_thresholds(game_config.press_short_max_ms, game_config.press_medium_max_ms);
+
+    app_publish_status();
+
+    int liveness = supervisor_register("app", SUPERVISOR_APP_DEADLINE_MS);
+
     while (true) 
     {
         
         AppEventMessage_t event;
         
-        if (xQueueReceive(app_event_queue, &event, portMAX_DELAY)) 
+        // The timeout is the scoring tick: points accrue even when nothing happens
+        bool received = app_event_receive(&event, pdMS_TO_TICKS(SCORING_TICK_MS));
+        supervisor_checkin(liveness);
+        int64_t loop_start_us = esp_timer_get_time();
+        app_tick();
+
+        if (received) 
+        {
+#if CONFIG_DOMINION_APP_TRACE
+            ESP_LOGI("trace", "TRACE,%lu,%d", (unsigned long)app_now_ms(), event.type);
+#endif
+            app_handle_event(&event);
+            pool_release(&app_payload_pool, event.payload);
+        }
+
+#if CONFIG_DOMINION_APP_INVARIANTS
+        app_check_invariants();
+#endif
+
+        app_publish_status();
+
+        // The reader resets it: a late store only reports a longer window
+        uint32_t loop_us = (uint32_t)(esp_timer_get_time() - loop_start_us);
+        if (loop_us > __atomic_load_n(&loop_max_us, __ATOMIC_RELAXED))
+        {
+            __atomic_store_n(&loop_max_us, loop_us, __ATOMIC_RELAXED);
+        }
+    
+    }
+
+}
+
+void app_tick()
+{
+    ScoringPhase_t phase = scoring.phase;
+    scoring_tick(&scoring, app_now_ms());
+
+    // The capture delay ran out: the point is taken
+    if (phase == SCORING_PHASE_CONTESTED && scoring.phase == SCORING_PHASE_HELD)
+    {
+        app_cue(BUZZER_CUE_CAPTURE);
+    }
+
+    if (current_state == APP_STATE_RUNNING && game_mode->check_winner)
+    {
+        int8_t winner = game_mode->check_winner(&scoring, app_now_ms());
+        if (winner != TEAM_NONE)
+        {
+            app_finish_match(winner);
+        }
+    }
+}
+
+void app_handle_event(const AppEventMessage_t * message)
+{
+
+    AppEvent_t event = message->type;
+
+    // Config pushes are stored at once and applied between matches
+    if (event == APP_EVENT_CFG_UPDATED)
+    {
+        // The push comes with the config, NVS is only read without it
+        GameConfig_t config;
+        const GameConfig_t * pushed = pool_data(&app_payload_pool, message->payload);
+        if (pushed && message->payload_len == sizeof(GameConfig_t))
+        {
+            config = *pushed;
+        }
+        else
+        {
+            storage_get_game_config(&config);
+        }
+
+        // Rules, control point and mode of a match all stay as it started
+        if (current_state == APP_STATE_RUNNING)
+        {
+            pending_config = config;
+            config_pending = true;
+            ESP_LOGI(__func__, "CONFIG %lu DEFERRED TO THE END OF THE MATCH", (unsigned long)config.version);
+        }
+        else
+        {
+            app_apply_config(&config);
+        }
+        return;
+    }
+
+    // Scheduled by the master, whatever the mode
+    if (event >= APP_EVENT_SYNC_COUNTDOWN && event <= APP_EVENT_SYNC_END)
+    {
+        app_sync_event(event);
+        return;
+    }
+
+    switch (current_state) 
+    {
+        
+        case APP_STATE_INIT:
         {
 
-            switch (current_state) 
+            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event);
+
+            // A short or medium press of any team skips the setup window
+            if (APP_EVENT_IS_TEAM_BTN(event))
             {
-                
-                case APP_STATE_INIT:
+                ESP_LOGI(__func__, "%s press %d", teams[APP_EVENT_BTN_TEAM(event)].name, APP_EVENT_BTN_PRESS(event));
+                if (APP_EVENT_BTN_PRESS(event) != PRESS_LONG)
                 {
-                    
-                    switch (event.type)
+                    if(initial_setup_timer)
                     {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            current_state = APP_STATE_IDLE;
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            current_state = APP_STATE_IDLE;
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            current_state = APP_STATE_IDLE;
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            current_state = APP_STATE_IDLE;
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            current_state = APP_STATE_IDLE;
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");
-                            current_state = APP_STATE_IDLE;
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            if(initial_setup_timer)
-                            {
-                                xTimerStop(initial_setup_timer, 0);
-                            }
-                            current_state = APP_STATE_SETTINGS_CONTROL_POINT;
-                            ESP_LOGI(__func__, "SETTINGS - CONTROL POINT");
-                            break;
-                        }
-
-                        case APP_EVENT_TMR_INIT_SETUP:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Init setup timer expired! Entering APP_STATE_IDLE...");
-                            current_state = APP_STATE_IDLE;
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
-
+                        xTimerStop(initial_setup_timer, 0);
                     }
-                    
-                    break;
-
+                    current_state = APP_STATE_IDLE;
                 }
+                break;
+            }
+
+            switch (event)
+            {
 
-                case APP_STATE_IDLE:
+                case APP_EVENT_BTN_BOTH_SHORT:
+                case APP_EVENT_BTN_BOTH_MEDIUM:
                 {
-                    
-                    switch (event.type)
+                    ESP_LOGI(__func__, "Both short or medium press");
+                    if(initial_setup_timer)
                     {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            current_state = APP_STATE_RUNNING_BLUE;
-                            chrono_start(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_led_on(BLUE_LED);
-                            turn_led_off(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            current_state = APP_STATE_RUNNING_BLUE;
-                            chrono_start(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_led_on(BLUE_LED);
-                            turn_led_off(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            current_state = APP_STATE_RUNNING_RED;
-                            chrono_stop(&blue_chrono);
-                            chrono_start(&red_chrono);
-                            turn_led_off(BLUE_LED);
-                            turn_led_on(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            current_state = APP_STATE_RUNNING_RED;
-                            chrono_stop(&blue_chrono);
-                            chrono_start(&red_chrono);
-                            turn_led_off(BLUE_LED);
-                            turn_led_on(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
-
+                        xTimerStop(initial_setup_timer, 0);
                     }
-                    
+                    current_state = APP_STATE_IDLE;
                     break;
-
                 }
 
-                case APP_STATE_RUNNING_BLUE:
+                case APP_EVENT_BTN_BOTH_LONG:
                 {
-                    
-                    switch (event.type)
+                    ESP_LOGI(__func__, "Both long press");
+                    if(initial_setup_timer)
                     {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            current_state = APP_STATE_RUNNING_RED;
-                            chrono_stop(&blue_chrono);
-                            chrono_start(&red_chrono);
-                            turn_led_off(BLUE_LED);
-                            turn_led_on(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            current_state = APP_STATE_RUNNING_RED;
-                            chrono_stop(&blue_chrono);
-                            chrono_start(&red_chrono);
-                            turn_led_off(BLUE_LED);
-                            turn_led_on(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");
-                            current_state = APP_STATE_FINISHED;
-                            chrono_stop(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_all_leds_on();
-                            int blue_seconds = chrono_get_seconds(&blue_chrono);
-                            int red_seconds = chrono_get_seconds(&red_chrono);
-                            ESP_LOGI(__func__, "BLUE TEAM: %ds", blue_seconds);
-                            ESP_LOGI(__func__, "RED TEAM:  %ds", red_seconds);
-                            ESP_LOGI(__func__, "WIN %s TEAM!", blue_seconds >= red_seconds ? "BLUE" : "RED");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            current_state = APP_STATE_FINISHED;
-                            chrono_stop(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_all_leds_on();
-                            int blue_seconds = chrono_get_seconds(&blue_chrono);
-                            int red_seconds = chrono_get_seconds(&red_chrono);
-                            ESP_LOGI(__func__, "BLUE TEAM: %ds", blue_seconds);
-                            ESP_LOGI(__func__, "RED TEAM:  %ds", red_seconds);
-                            ESP_LOGI(__func__, "WIN %s TEAM!", blue_seconds >= red_seconds ? "BLUE" : "RED");
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
-
+                        xTimerStop(initial_setup_timer, 0);
                     }
-                    
+                    current_state = APP_STATE_SETTINGS_CONTROL_POINT;
+                    ESP_LOGI(__func__, "SETTINGS - CONTROL POINT");
                     break;
-
                 }
 
-                case APP_STATE_RUNNING_RED:
+                case APP_EVENT_TMR_INIT_SETUP:
                 {
-                    
-                    switch (event.type)
-                    {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            current_state = APP_STATE_RUNNING_BLUE;
-                            chrono_start(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_led_on(BLUE_LED);
-                            turn_led_off(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            current_state = APP_STATE_RUNNING_BLUE;
-                            chrono_start(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_led_on(BLUE_LED);
-                            turn_led_off(RED_LED);
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");
-                            current_state = APP_STATE_FINISHED;
-                            chrono_stop(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_all_leds_on();
-                            int blue_seconds = chrono_get_seconds(&blue_chrono);
-                            int red_seconds = chrono_get_seconds(&red_chrono);
-                            ESP_LOGI(__func__, "BLUE TEAM: %ds", blue_seconds);
-                            ESP_LOGI(__func__, "RED TEAM:  %ds", red_seconds);
-                            ESP_LOGI(__func__, "WIN %s TEAM!", blue_seconds >= red_seconds ? "BLUE" : "RED");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            current_state = APP_STATE_FINISHED;
-                            chrono_stop(&blue_chrono);
-                            chrono_stop(&red_chrono);
-                            turn_all_leds_on();
-                            int blue_seconds = chrono_get_seconds(&blue_chrono);
-                            int red_seconds = chrono_get_seconds(&red_chrono);
-                            ESP_LOGI(__func__, "BLUE TEAM: %ds", blue_seconds);
-                            ESP_LOGI(__func__, "RED TEAM:  %ds", red_seconds);
-                            ESP_LOGI(__func__, "WIN %s TEAM!", blue_seconds >= red_seconds ? "BLUE" : "RED");
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
-
-                    }
-                    
+                    ESP_LOGI(__func__, "Init setup timer expired! Entering APP_STATE_IDLE...");
+                    current_state = APP_STATE_IDLE;
                     break;
-
                 }
 
-                case APP_STATE_FINISHED:
+                default:
                 {
-                    
-                    switch (event.type)
-                    {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");
-                            current_state = APP_STATE_IDLE;
-                            chrono_reset(&blue_chrono);
-                            chrono_reset(&red_chrono);
-                            turn_all_leds_off();
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            current_state = APP_STATE_IDLE;
-                            chrono_reset(&blue_chrono);
-                            chrono_reset(&red_chrono);
-                            turn_all_leds_off();
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
+                    ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event);
+                    break;
+                }
 
-                    }
-                    
+            }
+
+            break;
+
+        }
+
+        case APP_STATE_IDLE:
+        case APP_STATE_RUNNING:
+        {
+            ESP_LOGI(__func__, "STATE, MODE STATE, EVENT: %d, %d, %d", current_state, mode_state, event);
+            app_mode_dispatch(event);
+            break;
+        }
+
+        case APP_STATE_FINISHED:
+        {
+
+            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event);
+
+            // The result stays on until a chord clears it
+            if (APP_EVENT_IS_TEAM_BTN(event))
+            {
+                ESP_LOGI(__func__, "%s press %d", teams[APP_EVENT_BTN_TEAM(event)].name, APP_EVENT_BTN_PRESS(event));
+                break;
+            }
+
+            switch (event)
+            {
+
+                case APP_EVENT_BTN_BOTH_SHORT:
+                {
+                    ESP_LOGI(__func__, "Both short press");
                     break;
+                }
 
+                case APP_EVENT_BTN_BOTH_MEDIUM:
+                case APP_EVENT_BTN_BOTH_LONG:
+                {
+                    ESP_LOGI(__func__, "Both medium or long press");
+                    current_state = APP_STATE_IDLE;
+                    app_reset_match();
+                    break;
                 }
 
-                case APP_STATE_SETTINGS_CONTROL_POINT:
+                default:
                 {
-                    switch (event.type)
-                    {
-                        
-                        case APP_EVENT_BTN_BLUE_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue short press");
-                            current_state = APP_STATE_SETTINGS_EXIT;
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BLUE_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Blue long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red short press");
-                            current_state = APP_STATE_SETTINGS_CP_ALPHA;
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red medium press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_RED_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Red long press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_SHORT:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both short press");
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_MEDIUM:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both medium press");                            
-                            current_state = APP_STATE_IDLE;
-                            break;
-                        }
-                        
-                        case APP_EVENT_BTN_BOTH_LONG:
-                        {
-                            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event.type);
-                            ESP_LOGI(__func__, "Both long press");
-                            current_state = APP_STATE_IDLE;
-                            break;
-                        }
-
-                        default:
-                        {
-                            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event.type);
-                            break;
-                        }
+                    ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event);
+                    break;
+                }
 
-                    }
-                    
+            }
+
+            break;
+
+        }
+
+        case APP_STATE_SETTINGS_CONTROL_POINT:
+        {
+
+            ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event);
+
+            // Blue short leaves, red short enters the control points, the
+            // other presses are ignored
+            if (APP_EVENT_IS_TEAM_BTN(event))
+            {
+                Team_t team = APP_EVENT_BTN_TEAM(event);
+                ESP_LOGI(__func__, "%s press %d", teams[team].name, APP_EVENT_BTN_PRESS(event));
+                if (APP_EVENT_BTN_PRESS(event) == PRESS_SHORT && team == TEAM_BLUE)
+                    current_state = APP_STATE_SETTINGS_EXIT;
+                else if (APP_EVENT_BTN_PRESS(event) == PRESS_SHORT && team == TEAM_RED)
+                    current_state = APP_STATE_SETTINGS_CP_ALPHA;
+                break;
+            }
+
+            switch (event)
+            {
+
+                case APP_EVENT_BTN_BOTH_SHORT:
+                {
+                    ESP_LOGI(__func__, "Both short press");
                     break;
+                }
 
+                case APP_EVENT_BTN_BOTH_MEDIUM:
+                case APP_EVENT_BTN_BOTH_LONG:
+                {
+                    ESP_LOGI(__func__, "Both medium or long press");
+                    current_state = APP_STATE_IDLE;
+                    break;
                 }
 
                 default:
                 {
-                    ESP_LOGE(__func__, "UNEXPECTED TRANSITION! WRONG STATE, EVENT: %d, %d", current_state, event.type);
+                    ESP_LOGE(__func__, "UNEXPECTED TRANSITION! STATE, WRONG EVENT: %d, %d", current_state, event);
                     break;
                 }
-                    
+
             }
-        
+
+            break;
+
         }
-    
+
+        case APP_STATE_SETTINGS_CP_ALPHA:
+        case APP_STATE_SETTINGS_CP_BRAVO:
+        case APP_STATE_SETTINGS_CP_CHARLIE:
+        case APP_STATE_SETTINGS_CP_DELTA:
+        case APP_STATE_SETTINGS_CP_ECHO:
+        case APP_STATE_SETTINGS_CP_EXIT:
+        case APP_STATE_SETTINGS_EXIT:
+        {
+            app_settings_event(event);
+            break;
+        }
+
+        default:
+        {
+            ESP_LOGE(__func__, "UNEXPECTED TRANSITION! WRONG STATE, EVENT: %d, %d", current_state, event);
+            break;
+        }
+            
+    }
+
+}
+
+// Settings menu entries: a blue short press moves to the next one, a red
+// short press selects it, a chord leaves the menu
+void app_settings_event(AppEvent_t event)
+{
+
+    ESP_LOGI(__func__, "STATE, EVENT: %d, %d", current_state, event);
+
+    if (event == APP_EVENT_BTN_BOTH_MEDIUM || event == APP_EVENT_BTN_BOTH_LONG)
+    {
+        current_state = APP_STATE_IDLE;
+        return;
+    }
+
+    if (current_state == APP_STATE_SETTINGS_EXIT)
+    {
+        if (event == APP_EVENT_BTN_BLUE_SHORT)
+            current_state = APP_STATE_SETTINGS_CONTROL_POINT;
+        else if (event == APP_EVENT_BTN_RED_SHORT)
+            current_state = APP_STATE_IDLE;
+        return;
+    }
+
+    // One entry per control point, then the way back
+    if (event == APP_EVENT_BTN_BLUE_SHORT)
+    {
+        current_state = current_state == APP_STATE_SETTINGS_CP_EXIT ? APP_STATE_SETTINGS_CP_ALPHA : current_state + 1;
+    }
+    else if (event == APP_EVENT_BTN_RED_SHORT)
+    {
+        if (current_state != APP_STATE_SETTINGS_CP_EXIT)
+        {
+            app_set_control_point(CONTROL_POINT_ALPHA + (current_state - APP_STATE_SETTINGS_CP_ALPHA));
+        }
+        current_state = APP_STATE_SETTINGS_CONTROL_POINT;
+    }
+
+}
+
+void app_set_control_point(ControlPoint_t point)
+{
+    esp_err_t ret = replaying ? ESP_OK : storage_set_control_point(point);
+    if (ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling storage_set_control_point: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    control_point = point;
+    game_config.control_point = (int8_t)point;
+    ESP_LOGI(__func__, "CONTROL POINT: %s", control_point_to_string(control_point));
+}
+
+void app_apply_config(const GameConfig_t * config)
+{
+    game_config = *config;
+    if (game_config.control_point > CONTROL_POINT_NONE && game_config.control_point < CONTROL_POINT_MAX)
+    {
+        control_point = game_config.control_point;
     }
+    ESP_LOGI(__func__, "CONFIG UPDATED: %s, %lus", control_point_to_string(control_point), (unsigned long)game_config.match_duration_s);
 
+    ScoringRules_t rules;
+    scoring_rules_from_config(&rules);
+    scoring_set_rules(&scoring, &rules, app_now_ms());
+    app_select_mode();
+    button_set_press_thresholds(game_config.press_short_max_ms, game_config.press_medium_max_ms);
+}
+
+void app_select_mode()
+{
+#if CONFIG_DOMINION_GAME_MODE_RUNTIME
+    const GameMode_t * mode = game_mode_get(game_config.game_mode);
+    if(mode == NULL)
+    {
+        ESP_LOGW(__func__, "Unknown game mode %d, keeping %s", game_config.game_mode, game_mode->name);
+        return;
+    }
+    game_mode = mode;
+#endif
+}
+
+void app_mode_dispatch(AppEvent_t event)
+{
+
+    Team_t presser = TEAM_NONE;
+    ModeEvent_t mode_event = app_mode_event(event, &presser);
+    if(mode_event >= MODE_EVENT_MAX)
+        return;
+
+    ModeRule_t rule = game_mode->rules[mode_state][mode_event];
+    if(rule.next == MODE_STATE_NONE)
+    {
+        ESP_LOGI(__func__, "Event %d ignored by %s", event, game_mode->name);
+        return;
+    }
+
+    // The first event the mode accepts starts the match
+    if(current_state == APP_STATE_IDLE)
+    {
+        app_start_match();
+    }
+
+    // Only the presses the mode accepts make the history
+    if(!replaying)
+    {
+        if(APP_EVENT_IS_TEAM_BTN(event))
+            history_press(presser, APP_EVENT_BTN_PRESS(event), app_now_ms());
+        else if(mode_event != MODE_EVENT_TIMER)
+            history_press(HISTORY_CHORD, event - APP_EVENT_BTN_BOTH_SHORT, app_now_ms());
+    }
+
+    mode_state = rule.next;
+
+    switch (rule.action)
+    {
+
+        case MODE_ACTION_CAPTURE:
+        {
+            app_mode_capture(presser);
+            break;
+        }
+
+        case MODE_ACTION_NEUTRALIZE:
+        {
+            if(mode_owner != TEAM_NONE)
+            {
+                chrono_stop(&teams[mode_owner].chrono);
+            }
+            mode_owner = TEAM_NONE;
+            scoring_neutralize(&scoring, app_now_ms());
+            break;
+        }
+
+        case MODE_ACTION_ARM:
+        {
+            ESP_LOGI(__func__, "BOMB ARMED BY %s: %ds", teams[presser].name, BOMB_FUSE_TIME_MS / 1000);
+            mode_owner = presser;
+            app_cue(BUZZER_CUE_CONTESTED);
+            if(match_timer)
+            {
+                xTimerChangePeriod(match_timer, pdMS_TO_TICKS(BOMB_FUSE_TIME_MS), 0);
+            }
+            break;
+        }
+
+        case MODE_ACTION_FINISH:
+        {
+            scoring_neutralize(&scoring, app_now_ms());
+            app_finish_match(scoring_get_leader(&scoring));
+            break;
+        }
+
+        case MODE_ACTION_WIN_PRESSER:
+        {
+            app_finish_match(presser);
+            break;
+        }
+
+        case MODE_ACTION_WIN_OWNER:
+        {
+            app_finish_match(mode_owner);
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+
+    }
+
+    app_mode_leds();
+
+}
+
+void app_start_match()
+{
+    ESP_LOGI(__func__, "MATCH STARTED: %s", game_mode->name);
+    current_state = APP_STATE_RUNNING;
+    match_start_ms = app_now_ms();
+    match_timer_start();
+
+    if(!replaying)
+    {
+        history_match_start(control_point, game_mode->id, TEAM_COUNT, match_start_ms);
+    }
+    app_cue(BUZZER_CUE_MATCH_START);
+}
+
+void app_sync_event(AppEvent_t event)
+{
+
+    switch (event)
+    {
+
+        case APP_EVENT_SYNC_COUNTDOWN:
+        {
+            // The team LEDs blink with the last seconds
+            if(current_state == APP_STATE_IDLE)
+            {
+                countdown_lit = !countdown_lit;
+                if(replaying)
+                    break;
+                if(countdown_lit)
+                    turn_all_leds_on();
+                else
+                    turn_all_leds_off();
+            }
+            break;
+        }
+
+        case APP_EVENT_SYNC_START:
+        {
+            if(current_state != APP_STATE_IDLE)
+            {
+                ESP_LOGW(__func__, "Scheduled start ignored in state %d", current_state);
+                break;
+            }
+            countdown_lit = false;
+            app_start_match();
+            app_mode_leds();
+            break;
+        }
+
+        case APP_EVENT_SYNC_END:
+        {
+            // Same as the match timer running out, each mode decides the winner
+            if(current_state == APP_STATE_RUNNING)
+            {
+                app_mode_dispatch(APP_EVENT_TMR_MATCH_END);
+            }
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+
+    }
+
+}
+
+ModeEvent_t app_mode_event(AppEvent_t event, Team_t * presser)
+{
+
+    if(event == APP_EVENT_TMR_MATCH_END)
+        return MODE_EVENT_TIMER;
+
+    if(APP_EVENT_IS_TEAM_BTN(event))
+    {
+        *presser = APP_EVENT_BTN_TEAM(event);
+        ModeEvent_t base = *presser == mode_owner ? MODE_EVENT_OWN_SHORT : MODE_EVENT_RIVAL_SHORT;
+        return base + APP_EVENT_BTN_PRESS(event);
+    }
+
+    if(event >= APP_EVENT_BTN_BOTH_SHORT && event <= APP_EVENT_BTN_BOTH_LONG)
+        return MODE_EVENT_CHORD_SHORT + (event - APP_EVENT_BTN_BOTH_SHORT);
+
+    return MODE_EVENT_MAX;
+
+}
+
+void app_mode_capture(Team_t team)
+{
+    captures++;
+    // Only the previous owner's chrono can be running
+    if(mode_owner != TEAM_NONE)
+    {
+        chrono_stop(&teams[mode_owner].chrono);
+    }
+    chrono_start(&teams[team].chrono);
+    mode_owner = team;
+    scoring_capture(&scoring, team, app_now_ms());
+    // With a capture delay the point is only contested for now
+    app_cue(scoring.phase == SCORING_PHASE_CONTESTED ? BUZZER_CUE_CONTESTED : BUZZER_CUE_CAPTURE);
+}
+
+void app_mode_leds()
+{
+    // A replay leaves the hardware alone
+    if(replaying)
+        return;
+
+    ModeLeds_t leds = game_mode->leds[mode_state];
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        if(leds == MODE_LEDS_ALL || (leds == MODE_LEDS_OWNER && team == mode_owner))
+            turn_led_on(team_leds[team]);
+        else
+            turn_led_off(team_leds[team]);
+    }
+}
+
+void app_finish_match(int8_t winner)
+{
+    current_state = APP_STATE_FINISHED;
+    mode_state = MODE_STATE_OVER;
+    match_winner = winner;
+    if(match_timer)
+    {
+        xTimerStop(match_timer, 0);
+    }
+    scoring_neutralize(&scoring, app_now_ms());
+    app_mode_leds();
+    app_cue(BUZZER_CUE_MATCH_END);
+
+    uint32_t seconds[TEAM_COUNT];
+    uint32_t points[TEAM_COUNT];
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        chrono_stop(&teams[team].chrono);
+        seconds[team] = chrono_get_seconds(&teams[team].chrono);
+        points[team] = scoring_get_points(&scoring, team);
+        ESP_LOGI(__func__, "%-6s TEAM: %lus, %lu points", teams[team].name, (unsigned long)seconds[team], (unsigned long)points[team]);
+    }
+
+    if(!replaying)
+    {
+        history_match_end(winner, seconds, points, TEAM_COUNT, app_now_ms());
+    }
+
+    // Held back during the match
+    if(config_pending)
+    {
+        config_pending = false;
+        app_apply_config(&pending_config);
+    }
+
+    if(winner == TEAM_NONE)
+        ESP_LOGI(__func__, "DRAW!");
+    else
+        ESP_LOGI(__func__, "WIN %s TEAM!", teams[winner].name);
+}
+
+void app_reset_match()
+{
+    captures = 0;
+    mode_owner = TEAM_NONE;
+    match_winner = TEAM_NONE;
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        chrono_stop(&teams[team].chrono);
+        chrono_reset(&teams[team].chrono);
+    }
+    scoring_reset(&scoring, app_now_ms());
+    mode_state = MODE_STATE_READY;
+    app_select_mode();
+    if(!replaying)
+    {
+        turn_all_leds_off();
+    }
+}
+
+void app_save_snapshot()
+{
+
+    // Only a match in play is worth resuming, a finished one waits for the next
+    if(current_state != APP_STATE_RUNNING)
+    {
+        snapshot.magic = 0;
+        return;
+    }
+
+    AppSnapshot_t next;
+    memset(&next, 0, sizeof(next));
+
+    next.magic = APP_SNAPSHOT_MAGIC;
+    next.config = game_config;
+    next.mode_id = game_mode->id;
+    next.state = current_state;
+    next.mode_state = mode_state;
+    next.mode_owner = mode_owner;
+    next.captures = captures;
+    next.saved_ms = app_now_ms();
+    next.elapsed_ms = next.saved_ms - match_start_ms;
+    next.scoring = scoring;
+
+    int64_t now_us = esp_timer_get_time();
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        const Chrono_t * chrono = &teams[team].chrono;
+        next.chrono_total_us[team] = chrono->time_total_us;
+        if(chrono->is_running)
+        {
+            next.chrono_total_us[team] += now_us - chrono->time_start_us;
+            next.chrono_running |= 1 << team;
+        }
+    }
+
+    next.timer_left_ms = app_match_time_left_ms();
+
+    next.crc = app_snapshot_crc(&next);
+
+    // A reset halfway through the copy leaves a bad CRC, never a mixed snapshot
+    memcpy(&snapshot, &next, sizeof(snapshot));
+
+}
+
+bool app_restore_snapshot()
+{
+
+    AppSnapshot_t saved;
+    memcpy(&saved, &snapshot, sizeof(saved));
+    snapshot.magic = 0;
+
+    // RTC memory holds garbage after a power cycle, and a software reset is
+    // asked for (an update, a fault reboot, the console): only a crash resumes
+    esp_reset_reason_t reason = esp_reset_reason();
+    if(reason != ESP_RST_TASK_WDT && reason != ESP_RST_INT_WDT && reason != ESP_RST_PANIC)
+        return false;
+
+    if(saved.magic != APP_SNAPSHOT_MAGIC)
+        return false;
+
+    if(saved.crc != app_snapshot_crc(&saved))
+    {
+        ESP_LOGW(__func__, "Match snapshot corrupted, starting over");
+        return false;
+    }
+
+    // The match resumes with its own config: one stored meanwhile waits for its end
+    GameConfig_t stored = game_config;
+    game_config = saved.config;
+    app_select_mode();
+    if(saved.mode_id != game_mode->id)
+    {
+        ESP_LOGW(__func__, "Game mode changed since the match snapshot, starting over");
+        game_config = stored;
+        app_select_mode();
+        return false;
+    }
+
+    if(stored.version != game_config.version || stored.control_point != game_config.control_point)
+    {
+        pending_config = stored;
+        config_pending = true;
+    }
+    if(game_config.control_point > CONTROL_POINT_NONE && game_config.control_point < CONTROL_POINT_MAX)
+    {
+        control_point = game_config.control_point;
+    }
+
+    // The time spent resetting is not played: scoring resumes where it stopped
+    uint32_t now = app_now_ms();
+    uint32_t shift = now - saved.saved_ms;
+
+    scoring = saved.scoring;
+    scoring.last_update_ms += shift;
+    scoring.contest_start_ms += shift;
+    scoring.held_since_ms += shift;
+
+    current_state = saved.state;
+    mode_state = saved.mode_state;
+    mode_owner = saved.mode_owner;
+    captures = saved.captures;
+    match_start_ms = now - saved.elapsed_ms;
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        Chrono_t * chrono = &teams[team].chrono;
+        chrono_stop(chrono);
+        chrono->time_total_us = saved.chrono_total_us[team];
+        if(saved.chrono_running & (1 << team))
+        {
+            chrono_start(chrono);
+        }
+    }
+
+    if(match_timer && saved.timer_left_ms > 0)
+    {
+        xTimerChangePeriod(match_timer, pdMS_TO_TICKS(saved.timer_left_ms), 0);
+    }
+
+    app_mode_leds();
+
+    ESP_LOGW(__func__, "MATCH RESTORED after reset reason %d: %lus played, %u captures, owner %d",
+             reason, (unsigned long)(saved.elapsed_ms / 1000), captures, mode_owner);
+
+    return true;
+
+}
+
+uint32_t app_snapshot_crc(const AppSnapshot_t * saved)
+{
+    size_t start = offsetof(AppSnapshot_t, crc) + sizeof(saved->crc);
+    return esp_rom_crc32_le(0, (const uint8_t *)saved + start, sizeof(AppSnapshot_t) - start);
+}
+
+bool app_check_invariants(void)
+{
+
+    bool valid = true;
+    bool in_match = current_state == APP_STATE_RUNNING || current_state == APP_STATE_FINISHED;
+    // Chronos floor to seconds, the match start to milliseconds
+    uint32_t match_s = in_match ? (app_now_ms() - match_start_ms) / 1000 + 1 : 0;
+    uint32_t total_s = 0;
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        total_s += chrono_get_seconds(&teams[team].chrono);
+
+        if(teams[team].chrono.is_running && (current_state != APP_STATE_RUNNING || team != mode_owner))
+        {
+            ESP_LOGE(__func__, "INVARIANT: %s chrono running, owner %d, state %d", teams[team].name, mode_owner, current_state);
+            valid = false;
+        }
+    }
+
+    if(total_s > match_s)
+    {
+        ESP_LOGE(__func__, "INVARIANT: %lus held in a %lus match", (unsigned long)total_s, (unsigned long)match_s);
+        valid = false;
+    }
+
+    if(current_state == APP_STATE_RUNNING && mode_state == MODE_STATE_HELD &&
+       (mode_owner == TEAM_NONE || !teams[mode_owner].chrono.is_running))
+    {
+        ESP_LOGE(__func__, "INVARIANT: point held but no chrono running, owner %d", mode_owner);
+        valid = false;
+    }
+
+    return valid;
+
+}
+
+void app_cue(BuzzerCue_t cue)
+{
+    // A replay runs a whole match in a blink
+    if(!replaying)
+    {
+        buzzer_play(cue);
+    }
+}
+
+int8_t app_fault_state(void)
+{
+    return (int8_t)get_app_state();
+}
+
+uint32_t app_now_ms()
+{
+    if(replaying)
+        return replay_clock_ms;
+
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+int64_t app_replay_clock_us()
+{
+    return (int64_t)replay_clock_ms * 1000;
+}
+
+void scoring_rules_from_config(ScoringRules_t * rules)
+{
+    *rules = SCORING_RULES_DEFAULT();
+    if(game_config.points_per_second > 0)
+    {
+        rules->points_per_second = game_config.points_per_second;
+    }
+    rules->capture_delay_ms = game_config.capture_delay_ms;
+    rules->hold_bonus_pct = game_config.hold_bonus_pct;
+}
+
+void match_timer_start()
+{
+    if(match_timer && game_config.match_duration_s > 0)
+    {
+        // Changing the period of a dormant timer also starts it
+        xTimerChangePeriod(match_timer, (TickType_t)game_config.match_duration_s * configTICK_RATE_HZ, 0);
+    }
+}
+
+uint32_t app_match_time_left_ms()
+{
+
+    if(!match_timer || !xTimerIsTimerActive(match_timer))
+        return 0;
+
+    // The bomb fuse changes the period: the timer knows what is left.
+    // An expired timer whose event is still queued counts as running
+    int32_t left = (int32_t)(xTimerGetExpiryTime(match_timer) - xTaskGetTickCount());
+    return left > 0 ? pdTICKS_TO_MS(left) : 1;
+
+}
+
+void match_timer_callback()
+{
+    AppEventMessage_t event = { .type = APP_EVENT_TMR_MATCH_END };
+    // Never block the timer service task
+    app_event_send(&event, 0);
 }
 
 void initial_setup_timer_callback()
 {
-    AppEventMessage_t event;
-    event.type = APP_EVENT_TMR_INIT_SETUP;
-    xQueueSend(app_event_queue, &event, APP_EVENT_ENQUEUE_TIMEOUT_MS);
+    AppEventMessage_t event = { .type = APP_EVENT_TMR_INIT_SETUP };
+    app_event_send(&event, 0);
 }
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "stdbool.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "app.h"
+
+static QueueHandle_t event_queues[APP_EVENT_PRIO_MAX];
+// One count per queued message
+static SemaphoreHandle_t events_pending = NULL;
+
+// The latest of each coalescing event waits here, its queue holds a placeholder
+static AppEventMessage_t coalesced[APP_EVENT_MAX];
+static bool coalesced_pending[APP_EVENT_MAX];
+
+static AppEventStats_t stats;
+static portMUX_TYPE channel_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint8_t queue_length[APP_EVENT_PRIO_MAX] =
+{
+    [APP_EVENT_PRIO_CONTROL] = APP_EVENT_QUEUE_LEN_CONTROL,
+    [APP_EVENT_PRIO_NETWORK] = APP_EVENT_QUEUE_LEN_NETWORK,
+};
+
+static void app_event_delivered(const AppEventMessage_t * message);
+
+AppEventPriority_t app_event_priority(AppEvent_t type)
+{
+    // Buttons and timers drive the match, the rest can wait
+    if (type == APP_EVENT_TMR_INIT_SETUP || type == APP_EVENT_TMR_MATCH_END ||
+        (type >= APP_EVENT_BTN_TEAM_BASE && type <= APP_EVENT_BTN_BOTH_LONG) ||
+        (type >= APP_EVENT_SYNC_COUNTDOWN && type <= APP_EVENT_SYNC_END))
+    {
+        return APP_EVENT_PRIO_CONTROL;
+    }
+
+    return APP_EVENT_PRIO_NETWORK;
+}
+
+bool app_event_coalesces(AppEvent_t type)
+{
+    // Each config update carries the whole config: only the last one matters
+    return type == APP_EVENT_CFG_UPDATED;
+}
+
+esp_err_t app_event_init(void)
+{
+
+    UBaseType_t max_pending = 0;
+
+    for (int prio = 0; prio < APP_EVENT_PRIO_MAX; prio++)
+    {
+        event_queues[prio] = xQueueCreate(queue_length[prio], sizeof(AppEventMessage_t));
+        if (!event_queues[prio])
+        {
+            ESP_LOGE(__func__, "Error creating event queue %d", prio);
+            return ESP_ERR_NO_MEM;
+        }
+        max_pending += queue_length[prio];
+    }
+
+    events_pending = xSemaphoreCreateCounting(max_pending, 0);
+    if (!events_pending)
+    {
+        ESP_LOGE(__func__, "Error creating events_pending");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+
+}
+
+esp_err_t app_event_send(const AppEventMessage_t * message, TickType_t wait)
+{
+
+    if (!events_pending)
+        return ESP_ERR_INVALID_STATE;
+
+    if (message->type >= APP_EVENT_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    AppEventPriority_t prio = app_event_priority(message->type);
+    AppEventMessage_t queued = *message;
+    queued.queued_tick = xTaskGetTickCount();
+
+    bool coalesces = app_event_coalesces(message->type);
+
+    if (coalesces)
+    {
+        PoolHandle_t superseded = POOL_HANDLE_NONE;
+        bool was_pending;
+
+        portENTER_CRITICAL(&channel_lock);
+        was_pending = coalesced_pending[message->type];
+        if (was_pending)
+        {
+            // Keep the first queued_tick: the latency is the one of the oldest update
+            superseded = coalesced[message->type].payload;
+            queued.queued_tick = coalesced[message->type].queued_tick;
+            stats.coalesced++;
+            stats.sent[prio]++;
+        }
+        coalesced[message->type] = queued;
+        coalesced_pending[message->type] = true;
+        portEXIT_CRITICAL(&channel_lock);
+
+        if (was_pending)
+        {
+            // Its slot in the queue is already taken
+            pool_release(&app_payload_pool, superseded);
+            return ESP_OK;
+        }
+    }
+
+    // A coalescing event queues a placeholder, the receiver takes the latest
+    // one from its slot: it keeps its place among the events of its class
+    if (pdTRUE != xQueueSend(event_queues[prio], &queued, wait))
+    {
+        PoolHandle_t orphan = POOL_HANDLE_NONE;
+
+        portENTER_CRITICAL(&channel_lock);
+        if (coalesces)
+        {
+            // A newer one may have replaced it meanwhile, its sender was told it was queued
+            if (coalesced[message->type].payload != message->payload)
+            {
+                orphan = coalesced[message->type].payload;
+            }
+            coalesced_pending[message->type] = false;
+        }
+        stats.dropped[prio]++;
+        portEXIT_CRITICAL(&channel_lock);
+
+        pool_release(&app_payload_pool, orphan);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    UBaseType_t depth = uxQueueMessagesWaiting(event_queues[prio]);
+
+    portENTER_CRITICAL(&channel_lock);
+    stats.sent[prio]++;
+    if (depth > stats.high_water[prio])
+    {
+        stats.high_water[prio] = depth;
+    }
+    portEXIT_CRITICAL(&channel_lock);
+
+    xSemaphoreGive(events_pending);
+
+    return ESP_OK;
+
+}
+
+bool app_event_receive(AppEventMessage_t * message, TickType_t wait)
+{
+
+    if (pdTRUE != xSemaphoreTake(events_pending, wait))
+        return false;
+
+    for (AppEventPriority_t prio = APP_EVENT_PRIO_CONTROL; prio < APP_EVENT_PRIO_MAX; prio++)
+    {
+        if (pdTRUE == xQueueReceive(event_queues[prio], message, 0))
+        {
+            if (app_event_coalesces(message->type))
+            {
+                portENTER_CRITICAL(&channel_lock);
+                *message = coalesced[message->type];
+                coalesced_pending[message->type] = false;
+                portEXIT_CRITICAL(&channel_lock);
+            }
+
+            app_event_delivered(message);
+            return true;
+        }
+    }
+
+    // The event of this count was taken along with an earlier one, between
+    // its sender's queueing and its give
+    return false;
+
+}
+
+void app_event_get_stats(AppEventStats_t * out)
+{
+    portENTER_CRITICAL(&channel_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&channel_lock);
+}
+
+static void app_event_delivered(const AppEventMessage_t * message)
+{
+
+    AppEventPriority_t prio = app_event_priority(message->type);
+    TickType_t latency = xTaskGetTickCount() - message->queued_tick;
+    uint32_t latency_ms = pdTICKS_TO_MS(latency);
+
+    int bucket = 0;
+    while (latency > 0 && bucket < APP_EVENT_LATENCY_BUCKETS - 1)
+    {
+        latency >>= 1;
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&channel_lock);
+    stats.latency_hist[prio][bucket]++;
+    if (latency_ms > stats.max_latency_ms[prio])
+    {
+        stats.max_latency_ms[prio] = latency_ms;
+    }
+    portEXIT_CRITICAL(&channel_lock);
+
+}
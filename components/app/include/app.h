@@ -1,9 +1,24 @@
+#pragma once
+
 #include "stdint.h"
+#include "stdbool.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "esp_err.h"
+#include "config.h"
+#include "chrono.h"
+#include "leds.h"
+#include "pool.h"
+#include "scoring.h"
 
 #define APP_EVENT_ENQUEUE_TIMEOUT_MS    100
+#define APP_EVENT_QUEUE_LEN_CONTROL     10
+#define APP_EVENT_QUEUE_LEN_NETWORK     10
+#define APP_EVENT_LATENCY_BUCKETS       8
+#define APP_PAYLOAD_BLOCK_SIZE          64
+#define APP_PAYLOAD_BLOCK_COUNT         8
 #define INITIAL_SETUP_TIME_MS           30000
+#define SCORING_TICK_MS                 1000
 
 typedef enum 
 {
@@ -19,37 +34,244 @@ typedef enum
     APP_STATE_SETTINGS_CP_EXIT,
     APP_STATE_SETTINGS_EXIT,
     // RUNNING
-    APP_STATE_RUNNING_BLUE,
-    APP_STATE_RUNNING_RED,
+    APP_STATE_RUNNING,
     // FINISHED
     APP_STATE_FINISHED,
 } AppState_t;
 
+typedef enum
+{
+    TEAM_NONE = -1,
+    TEAM_BLUE = 0,
+    TEAM_RED,
+    TEAM_GREEN,
+    TEAM_YELLOW,
+    TEAM_MAX
+} Team_t;
+
+_Static_assert(TEAM_COUNT >= 2 && TEAM_COUNT <= TEAM_MAX, "TEAM_COUNT out of range");
+
+typedef enum
+{
+    PRESS_SHORT,
+    PRESS_MEDIUM,
+    PRESS_LONG,
+    PRESS_KIND_MAX
+} PressKind_t;
+
 typedef enum 
 {
     // TIMERS
     APP_EVENT_TMR_INIT_SETUP,
-    // BUTTON PRESSION
+    APP_EVENT_TMR_MATCH_END,
+    // BUTTON PRESSION: PRESS_KIND_MAX events per team, see APP_EVENT_BTN()
+    APP_EVENT_BTN_TEAM_BASE,
+    APP_EVENT_BTN_BLUE_SHORT = APP_EVENT_BTN_TEAM_BASE,
+    APP_EVENT_BTN_BLUE_MEDIUM,
+    APP_EVENT_BTN_BLUE_LONG,
     APP_EVENT_BTN_RED_SHORT,
     APP_EVENT_BTN_RED_MEDIUM,
     APP_EVENT_BTN_RED_LONG,
-    APP_EVENT_BTN_BLUE_SHORT,
-    APP_EVENT_BTN_BLUE_MEDIUM,
-    APP_EVENT_BTN_BLUE_LONG,
-    APP_EVENT_BTN_BOTH_SHORT,
+    // Two or more buttons held together
+    APP_EVENT_BTN_BOTH_SHORT = APP_EVENT_BTN_TEAM_BASE + TEAM_COUNT * PRESS_KIND_MAX,
     APP_EVENT_BTN_BOTH_MEDIUM,
     APP_EVENT_BTN_BOTH_LONG,
+    // NETWORK
+    APP_EVENT_CFG_UPDATED,
+    // SCHEDULED BY THE MASTER, see matchsync.h
+    APP_EVENT_SYNC_COUNTDOWN,
+    APP_EVENT_SYNC_START,
+    APP_EVENT_SYNC_END,
     // ...
+    APP_EVENT_MAX
 } AppEvent_t;
 
+#define APP_EVENT_BTN(team, press)      ((AppEvent_t)(APP_EVENT_BTN_TEAM_BASE + (team) * PRESS_KIND_MAX + (press)))
+#define APP_EVENT_IS_TEAM_BTN(event)    ((event) >= APP_EVENT_BTN_TEAM_BASE && (event) < APP_EVENT_BTN_BOTH_SHORT)
+#define APP_EVENT_BTN_TEAM(event)       ((Team_t)(((event) - APP_EVENT_BTN_TEAM_BASE) / PRESS_KIND_MAX))
+#define APP_EVENT_BTN_PRESS(event)      ((PressKind_t)(((event) - APP_EVENT_BTN_TEAM_BASE) % PRESS_KIND_MAX))
+
+/**
+ * @brief Everything the firmware knows about a team, indexed by Team_t.
+ *
+ * The scores live next to each other in the scoring engine, the LEDs in
+ * team_leds.
+ */
+typedef struct
+{
+    Chrono_t chrono;            // Time spent holding the control point
+    uint8_t button_gpio;        // Its event bit is BTN_TEAM_EVENT(team)
+    const char * name;
+} TeamState_t;
+
 typedef struct 
 {
     AppEvent_t type;
-    uint8_t * data;
-    uint16_t data_len;
+    PoolHandle_t payload;       // Block of app_payload_pool, POOL_HANDLE_NONE if none
+    uint16_t payload_len;
+    TickType_t queued_tick;     // Set by app_event_send()
 } AppEventMessage_t;
 
-extern QueueHandle_t app_event_queue;
+/**
+ * @brief Priority classes of the app event channel, highest first.
+ */
+typedef enum
+{
+    APP_EVENT_PRIO_CONTROL,     // Buttons and timers
+    APP_EVENT_PRIO_NETWORK,     // Config pushes, telemetry
+    APP_EVENT_PRIO_MAX
+} AppEventPriority_t;
+
+/**
+ * @brief Counters of the app event channel, per priority class.
+ */
+typedef struct
+{
+    uint32_t sent[APP_EVENT_PRIO_MAX];
+    uint32_t dropped[APP_EVENT_PRIO_MAX];       // Queue still full after the wait
+    uint32_t coalesced;                         // Superseded before the app got them
+    uint32_t high_water[APP_EVENT_PRIO_MAX];    // Deepest queue seen
+    uint32_t max_latency_ms[APP_EVENT_PRIO_MAX];// Longest time from send to receive
+    // Send to receive latencies: bucket 0 within the tick, bucket b from
+    // 2^(b-1) to 2^b - 1 ticks, the last bucket everything longer
+    uint32_t latency_hist[APP_EVENT_PRIO_MAX][APP_EVENT_LATENCY_BUCKETS];
+} AppEventStats_t;
+
+/**
+ * @brief Snapshot of the match, published by the app task.
+ */
+typedef struct
+{
+    uint32_t seq;               // Publication number, grows by one per snapshot
+    AppState_t state;
+    int8_t control_point;       // ControlPoint_t
+    Team_t owner;
+    Team_t winner;              // Of the finished match, TEAM_NONE on a draw or before the end
+    uint16_t captures;
+    uint32_t time_left_s;       // Match or fuse time left, 0 without a running match timer
+    uint32_t seconds[TEAM_COUNT];
+    uint32_t points[TEAM_COUNT];
+    ScoringRules_t rules;       // Scoring the points, for a stand-in to score the whole field
+} AppStatus_t;
+
+/**
+ * @brief One recorded event: what the app task received, and when.
+ *
+ * With CONFIG_DOMINION_APP_TRACE the app task logs each event it receives
+ * as a "TRACE,<time_ms>,<event>" line, time_ms being app time since boot
+ * and event the AppEvent_t value, which is enough to rebuild the trace
+ * from a serial capture.
+ */
+typedef struct
+{
+    uint32_t time_ms;
+    uint8_t event;              // AppEvent_t
+} AppTraceEntry_t;
+
+
+/**
+ * @brief Payloads of the app events.
+ *
+ * The sender allocates a block, fills it and queues its handle; the app
+ * task releases it once the event is handled. If the send fails, the
+ * sender releases it.
+ */
+extern BlockPool_t app_payload_pool;
+extern TeamState_t teams[TEAM_COUNT];
+
+/**
+ * @brief Create the app event channel: one queue per priority class.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if a queue cannot be created.
+ */
+esp_err_t app_event_init(void);
+
+/**
+ * @brief Send an event to the app task.
+ *
+ * Control events (buttons, timers) are received before network events.
+ * A coalescing event takes a place in the queue of its class like any other,
+ * until it is received a newer one replaces it there without waiting and
+ * its payload is released. Not callable from ISRs.
+ *
+ * @param message Event to send, copied.
+ * @param wait Ticks to wait for room in the queue, 0 from timer callbacks.
+ * @return ESP_OK, ESP_ERR_TIMEOUT if dropped, ESP_ERR_INVALID_STATE before app_event_init().
+ *         On error the payload still belongs to the caller.
+ */
+esp_err_t app_event_send(const AppEventMessage_t * message, TickType_t wait);
+
+/**
+ * @brief Receive the next event, highest priority first.
+ *
+ * @param message Filled with the event.
+ * @param wait Ticks to wait for an event.
+ * @return true if an event was received.
+ */
+bool app_event_receive(AppEventMessage_t * message, TickType_t wait);
+
+AppEventPriority_t app_event_priority(AppEvent_t type);
+bool app_event_coalesces(AppEvent_t type);
+void app_event_get_stats(AppEventStats_t * stats);
 
 void app_task(void* arg);
-AppState_t get_app_state(void);
\ No newline at end of file
+AppState_t get_app_state(void);
+
+/**
+ * @brief Get the last snapshot published by the app task.
+ *
+ * The app task publishes a snapshot after every event and scoring tick
+ * under a sequence lock: readers on any core copy it without taking a lock
+ * and retry only if a publication overlapped, so they never block the game
+ * logic. Hold times and points are thus at most SCORING_TICK_MS old.
+ *
+ * @param status Filled with the snapshot.
+ */
+void app_get_status(AppStatus_t * status);
+
+/**
+ * @brief Longest app task iteration since the previous call, then start over.
+ *
+ * An iteration is the work after a wakeup: scoring tick, event handling and
+ * status publication, waiting for the next event excluded.
+ *
+ * @return Duration in microseconds.
+ */
+uint32_t app_take_loop_max_us(void);
+
+/**
+ * @brief Replay a recorded trace through the state machine under a virtual clock.
+ *
+ * The app starts from APP_STATE_INIT with the stored game configuration,
+ * the clock jumps from one event to the next and the scoring ticks the
+ * live task would have run in between are replayed too, so the result
+ * depends on the trace alone and a whole match runs in a fraction of its
+ * duration. Timers are not used: their expiries are events of the trace.
+ *
+ * It drives the same state as app_task(), so it runs instead of it, e.g.
+ * in a replay build, never next to it. It leaves the LEDs, the buzzer, the
+ * match history and the stored control point alone.
+ *
+ * @param trace Recorded events, in time order.
+ * @param count Number of events.
+ * @param result Status at the end of the trace, filled in on ESP_FAIL too.
+ * @return ESP_OK, ESP_FAIL if the trace broke the match invariants,
+ *         ESP_ERR_INVALID_ARG on bad arguments or a trace out of time
+ *         order, ESP_ERR_INVALID_STATE if app_task is running.
+ */
+esp_err_t app_replay(const AppTraceEntry_t * trace, size_t count, AppStatus_t * result);
+
+/**
+ * @brief Check the invariants of the match state, logging each violation.
+ *
+ * - the hold times of all teams add up to no more than the match duration;
+ * - only the team holding the point has its chrono running, and it does
+ *   while the mode has the point held;
+ * - nothing runs outside a match.
+ *
+ * With CONFIG_DOMINION_APP_INVARIANTS the app task checks them after every
+ * tick and event, app_replay() does in any case.
+ *
+ * @return true if every invariant holds.
+ */
+bool app_check_invariants(void);
\ No newline at end of file
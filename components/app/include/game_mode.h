@@ -0,0 +1,127 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "sdkconfig.h"
+
+#include "app.h"
+#include "scoring.h"
+
+/**
+ * @file game_mode.h
+ * @brief Rule sets the app plays while a match is running.
+ *
+ * A mode is a state table indexed by [mode state][mode event]: each entry
+ * gives the next mode state and the action the app performs (capture, arm,
+ * finish...), so dispatching an event is a single table lookup. Mode events
+ * are relative to the team holding the point (own/rival presses), which
+ * keeps the tables the same whatever the number of teams. The mode also
+ * maps its states to the LEDs and may supply a scoring hook, checked on
+ * every scoring tick, that ends the match early.
+ *
+ * The app starts a match on the first event the mode accepts in
+ * MODE_STATE_READY, and finishes it on the finishing actions.
+ */
+
+#define BOMB_FUSE_TIME_MS           45000
+#define TIMED_CAPTURE_HOLD_MS       120000
+
+typedef enum
+{
+    GAME_MODE_DOMINATION = 0,
+    GAME_MODE_KOTH,
+    GAME_MODE_BOMB,
+    GAME_MODE_TIMED_CAPTURE,
+    GAME_MODE_MAX
+} GameModeId_t;
+
+typedef enum
+{
+    MODE_STATE_NONE = 0,        // Table entries left out: the event is ignored
+    MODE_STATE_READY,
+    MODE_STATE_NEUTRAL,
+    MODE_STATE_HELD,
+    MODE_STATE_ARMED,
+    MODE_STATE_OVER,
+    MODE_STATE_MAX
+} ModeState_t;
+
+typedef enum
+{
+    MODE_EVENT_TIMER,           // APP_EVENT_TMR_MATCH_END
+    // Presses by the team holding the point
+    MODE_EVENT_OWN_SHORT,
+    MODE_EVENT_OWN_MEDIUM,
+    MODE_EVENT_OWN_LONG,
+    // Presses by any other team, or by anybody when nobody holds the point
+    MODE_EVENT_RIVAL_SHORT,
+    MODE_EVENT_RIVAL_MEDIUM,
+    MODE_EVENT_RIVAL_LONG,
+    // Two or more buttons held together
+    MODE_EVENT_CHORD_SHORT,
+    MODE_EVENT_CHORD_MEDIUM,
+    MODE_EVENT_CHORD_LONG,
+    MODE_EVENT_MAX
+} ModeEvent_t;
+
+typedef enum
+{
+    MODE_ACTION_NONE = 0,
+    MODE_ACTION_CAPTURE,        // The pressing team takes the point
+    MODE_ACTION_NEUTRALIZE,
+    MODE_ACTION_ARM,            // The pressing team arms, the match timer becomes the fuse
+    MODE_ACTION_FINISH,         // Finish, the team with the most points wins
+    MODE_ACTION_WIN_PRESSER,
+    MODE_ACTION_WIN_OWNER,
+} ModeAction_t;
+
+typedef struct
+{
+    uint8_t next;               // ModeState_t
+    uint8_t action;             // ModeAction_t
+} ModeRule_t;
+
+typedef enum
+{
+    MODE_LEDS_OFF = 0,
+    MODE_LEDS_OWNER,            // Only the LED of the team holding the point
+    MODE_LEDS_ALL,
+} ModeLeds_t;
+
+typedef struct
+{
+    GameModeId_t id;
+    const char * name;
+    const ModeRule_t (*rules)[MODE_EVENT_MAX];  // [MODE_STATE_MAX][MODE_EVENT_MAX]
+    const uint8_t * leds;                       // ModeLeds_t, [MODE_STATE_MAX]
+    int8_t (*check_winner)(const ScoringEngine_t * scoring, uint32_t now_ms);  // Team_t, NULL if none
+} GameMode_t;
+
+extern const GameMode_t game_mode_domination;
+extern const GameMode_t game_mode_koth;
+extern const GameMode_t game_mode_bomb;
+extern const GameMode_t game_mode_timed_capture;
+
+// LEDs shared by every mode
+extern const uint8_t game_mode_leds[MODE_STATE_MAX];
+
+#if CONFIG_DOMINION_GAME_MODE_KOTH
+#define GAME_MODE_COMPILED  game_mode_koth
+#elif CONFIG_DOMINION_GAME_MODE_BOMB
+#define GAME_MODE_COMPILED  game_mode_bomb
+#elif CONFIG_DOMINION_GAME_MODE_TIMED_CAPTURE
+#define GAME_MODE_COMPILED  game_mode_timed_capture
+#else
+#define GAME_MODE_COMPILED  game_mode_domination
+#endif
+
+/**
+ * @brief Get a mode by id.
+ *
+ * Only available with CONFIG_DOMINION_GAME_MODE_RUNTIME, the other builds
+ * link the compiled mode alone.
+ *
+ * @param id Mode id from the game configuration.
+ * @return The mode, NULL if the id is unknown.
+ */
+const GameMode_t * game_mode_get(GameModeId_t id);
@@ -0,0 +1,32 @@
+#include "stddef.h"
+
+#include "game_mode.h"
+
+const uint8_t game_mode_leds[MODE_STATE_MAX] =
+{
+    [MODE_STATE_READY]      = MODE_LEDS_OFF,
+    [MODE_STATE_NEUTRAL]    = MODE_LEDS_OFF,
+    [MODE_STATE_HELD]       = MODE_LEDS_OWNER,
+    [MODE_STATE_ARMED]      = MODE_LEDS_OWNER,
+    [MODE_STATE_OVER]       = MODE_LEDS_ALL,
+};
+
+#if CONFIG_DOMINION_GAME_MODE_RUNTIME
+
+static const GameMode_t * const game_modes[GAME_MODE_MAX] =
+{
+    [GAME_MODE_DOMINATION] = &game_mode_domination,
+    [GAME_MODE_KOTH] = &game_mode_koth,
+    [GAME_MODE_BOMB] = &game_mode_bomb,
+    [GAME_MODE_TIMED_CAPTURE] = &game_mode_timed_capture,
+};
+
+const GameMode_t * game_mode_get(GameModeId_t id)
+{
+    if(id >= GAME_MODE_MAX)
+        return NULL;
+
+    return game_modes[id];
+}
+
+#endif
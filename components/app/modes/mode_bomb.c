@@ -0,0 +1,26 @@
+#include "game_mode.h"
+
+// Any team holds to arm, the fuse runs on the match timer, another team holds
+// to defuse
+static const ModeRule_t bomb_rules[MODE_STATE_MAX][MODE_EVENT_MAX] =
+{
+    [MODE_STATE_READY] =
+    {
+        [MODE_EVENT_RIVAL_LONG]     = { MODE_STATE_ARMED,     MODE_ACTION_ARM },
+    },
+    [MODE_STATE_ARMED] =
+    {
+        [MODE_EVENT_RIVAL_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_WIN_PRESSER },
+        [MODE_EVENT_TIMER]          = { MODE_STATE_OVER,      MODE_ACTION_WIN_OWNER },
+        [MODE_EVENT_CHORD_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+    },
+};
+
+const GameMode_t game_mode_bomb =
+{
+    .id = GAME_MODE_BOMB,
+    .name = "BOMB DEFUSE",
+    .rules = bomb_rules,
+    .leds = game_mode_leds,
+    .check_winner = NULL,
+};
@@ -0,0 +1,28 @@
+#include "game_mode.h"
+
+// Any press captures the point, the team holding it longest wins
+static const ModeRule_t domination_rules[MODE_STATE_MAX][MODE_EVENT_MAX] =
+{
+    [MODE_STATE_READY] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+    },
+    [MODE_STATE_HELD] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_CHORD_MEDIUM]   = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_CHORD_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_TIMER]          = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+    },
+};
+
+const GameMode_t game_mode_domination =
+{
+    .id = GAME_MODE_DOMINATION,
+    .name = "DOMINATION",
+    .rules = domination_rules,
+    .leds = game_mode_leds,
+    .check_winner = NULL,
+};
@@ -0,0 +1,36 @@
+#include "game_mode.h"
+
+// The hill must be neutralized before another team can take it
+static const ModeRule_t koth_rules[MODE_STATE_MAX][MODE_EVENT_MAX] =
+{
+    [MODE_STATE_READY] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+    },
+    [MODE_STATE_NEUTRAL] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_CHORD_MEDIUM]   = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_CHORD_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_TIMER]          = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+    },
+    [MODE_STATE_HELD] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_NEUTRAL,   MODE_ACTION_NEUTRALIZE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_NEUTRAL,   MODE_ACTION_NEUTRALIZE },
+        [MODE_EVENT_CHORD_MEDIUM]   = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_CHORD_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_TIMER]          = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+    },
+};
+
+const GameMode_t game_mode_koth =
+{
+    .id = GAME_MODE_KOTH,
+    .name = "KING OF THE HILL",
+    .rules = koth_rules,
+    .leds = game_mode_leds,
+    .check_winner = NULL,
+};
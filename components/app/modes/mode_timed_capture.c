@@ -0,0 +1,37 @@
+#include "game_mode.h"
+
+// Captures as in domination, but holding the point uninterrupted for
+// TIMED_CAPTURE_HOLD_MS wins the match right away
+static const ModeRule_t timed_capture_rules[MODE_STATE_MAX][MODE_EVENT_MAX] =
+{
+    [MODE_STATE_READY] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+    },
+    [MODE_STATE_HELD] =
+    {
+        [MODE_EVENT_RIVAL_SHORT]    = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_RIVAL_MEDIUM]   = { MODE_STATE_HELD,      MODE_ACTION_CAPTURE },
+        [MODE_EVENT_CHORD_LONG]     = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+        [MODE_EVENT_TIMER]          = { MODE_STATE_OVER,      MODE_ACTION_FINISH },
+    },
+};
+
+static int8_t timed_capture_check_winner(const ScoringEngine_t * scoring, uint32_t now_ms)
+{
+    // A contested point keeps its owner but is not held anymore
+    if(scoring->phase != SCORING_PHASE_HELD || (now_ms - scoring->held_since_ms) < TIMED_CAPTURE_HOLD_MS)
+        return TEAM_NONE;
+
+    return scoring->owner;
+}
+
+const GameMode_t game_mode_timed_capture =
+{
+    .id = GAME_MODE_TIMED_CAPTURE,
+    .name = "TIMED CAPTURE",
+    .rules = timed_capture_rules,
+    .leds = game_mode_leds,
+    .check_winner = timed_capture_check_winner,
+};
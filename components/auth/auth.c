@@ -0,0 +1,358 @@
+#include "string.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/constant_time.h"
+
+#include "auth.h"
+#include "storage.h"
+
+typedef struct
+{
+    uint16_t node;
+    bool used;
+    uint32_t highest_seq;
+    uint64_t window;    // bit i set: highest_seq - i already seen
+} ReplayWindow_t;
+
+// Lowest sequence number a first frame from the node may carry, once its
+// window is gone. Kept in NVS so that a reboot of the receiver does not open
+// the frames captured before it
+typedef struct
+{
+    uint16_t node;
+    bool used;
+    uint32_t seq;
+} PeerFloor_t;
+
+#define AUTH_SEQ_EPOCH(seq)     ((seq) >> AUTH_SEQ_EPOCH_SHIFT)
+
+#define AUTH_SHA256_BLOCK_LEN   64
+#define AUTH_SHA256_LEN         32
+
+_Static_assert(AUTH_KEY_LEN <= AUTH_SHA256_BLOCK_LEN, "The auth key must fit in one SHA-256 block");
+
+// SHA-256 state after the key XOR ipad and key XOR opad blocks. Read-only
+// once set up: each message hashes on clones, so any task can sign or
+// verify without a lock.
+static mbedtls_sha256_context inner_primed;
+static mbedtls_sha256_context outer_primed;
+static bool auth_ready = false;
+
+static ReplayWindow_t replay_windows[AUTH_MAX_PEERS];
+static int replay_victim = 0;
+
+static PeerFloor_t peer_floors[AUTH_MAX_KNOWN_PEERS];
+static int floor_victim = 0;
+
+static uint32_t tx_epoch = 0;
+static uint32_t tx_counter = 0;
+static portMUX_TYPE tx_seq_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t auth_prime(mbedtls_sha256_context * primed, const uint8_t * key, uint8_t pad);
+static esp_err_t auth_compute(const uint8_t * data, size_t len, uint8_t tag[AUTH_TAG_LEN]);
+static PeerFloor_t * auth_find_floor(uint16_t node);
+static void auth_raise_floor(uint16_t node, uint32_t seq);
+
+esp_err_t auth_init(void)
+{
+
+    esp_err_t err = storage_next_boot_epoch(&tx_epoch);
+    if(ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error calling storage_next_boot_epoch: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // A boot starts with no window: the floors stand in for them
+    memset(replay_windows, 0, sizeof(replay_windows));
+    replay_victim = 0;
+    err = storage_get_peer_floors(peer_floors, sizeof(peer_floors));
+    if(ESP_OK != err)
+    {
+        if(ESP_ERR_NVS_NOT_FOUND != err)
+        {
+            ESP_LOGW(__func__, "Error calling storage_get_peer_floors: %s", esp_err_to_name(err));
+        }
+        memset(peer_floors, 0, sizeof(peer_floors));
+    }
+    floor_victim = 0;
+
+    uint8_t key[AUTH_KEY_LEN];
+    err = storage_get_auth_key(key);
+    if(ESP_OK != err)
+    {
+        ESP_LOGW(__func__, "Error calling storage_get_auth_key: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = auth_prime(&inner_primed, key, 0x36);
+    if(ESP_OK == err)
+    {
+        err = auth_prime(&outer_primed, key, 0x5c);
+    }
+
+    memset(key, 0, sizeof(key));
+
+    if(ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error priming the HMAC contexts");
+        return err;
+    }
+
+    auth_ready = true;
+    return ESP_OK;
+
+}
+
+static esp_err_t auth_prime(mbedtls_sha256_context * primed, const uint8_t * key, uint8_t pad)
+{
+    uint8_t block[AUTH_SHA256_BLOCK_LEN];
+    memset(block, pad, sizeof(block));
+    for(int i = 0; i < AUTH_KEY_LEN; i++)
+    {
+        block[i] ^= key[i];
+    }
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    int ret = mbedtls_sha256_starts(&ctx, 0);
+    if(ret == 0)
+    {
+        ret = mbedtls_sha256_update(&ctx, block, sizeof(block));
+    }
+
+    // The clone keeps the state in RAM, so freeing ctx releases the
+    // accelerator it may hold
+    mbedtls_sha256_init(primed);
+    if(ret == 0)
+    {
+        mbedtls_sha256_clone(primed, &ctx);
+    }
+    mbedtls_sha256_free(&ctx);
+    memset(block, 0, sizeof(block));
+
+    return ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t auth_compute(const uint8_t * data, size_t len, uint8_t tag[AUTH_TAG_LEN])
+{
+    uint8_t mac[AUTH_SHA256_LEN];
+    mbedtls_sha256_context ctx;
+
+    // H(key ^ ipad || data)
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &inner_primed);
+    int ret = mbedtls_sha256_update(&ctx, data, len);
+    if(ret == 0)
+    {
+        ret = mbedtls_sha256_finish(&ctx, mac);
+    }
+    mbedtls_sha256_free(&ctx);
+
+    // H(key ^ opad || inner digest)
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &outer_primed);
+    if(ret == 0)
+    {
+        ret = mbedtls_sha256_update(&ctx, mac, sizeof(mac));
+    }
+    if(ret == 0)
+    {
+        ret = mbedtls_sha256_finish(&ctx, mac);
+    }
+    mbedtls_sha256_free(&ctx);
+
+    if(ret != 0)
+        return ESP_FAIL;
+
+    memcpy(tag, mac, AUTH_TAG_LEN);
+    return ESP_OK;
+}
+
+bool auth_is_ready(void)
+{
+    return auth_ready;
+}
+
+esp_err_t auth_sign(const uint8_t * data, size_t len, uint8_t tag[AUTH_TAG_LEN])
+{
+    if(!auth_ready)
+        return ESP_ERR_INVALID_STATE;
+
+    return auth_compute(data, len, tag);
+}
+
+esp_err_t auth_verify(const uint8_t * data, size_t len, const uint8_t tag[AUTH_TAG_LEN])
+{
+    if(!auth_ready)
+        return ESP_ERR_INVALID_STATE;
+
+    uint8_t expected[AUTH_TAG_LEN];
+    esp_err_t err = auth_compute(data, len, expected);
+    if(ESP_OK != err)
+        return err;
+
+    return mbedtls_ct_memcmp(expected, tag, AUTH_TAG_LEN) == 0 ? ESP_OK : ESP_ERR_INVALID_MAC;
+}
+
+bool auth_check_replay(uint16_t src_node, uint32_t seq)
+{
+
+    ReplayWindow_t * entry = NULL;
+    for(int i = 0; i < AUTH_MAX_PEERS; i++)
+    {
+        if(replay_windows[i].used && replay_windows[i].node == src_node)
+        {
+            entry = &replay_windows[i];
+            break;
+        }
+    }
+
+    if(entry == NULL)
+    {
+        // No window: anything under the floor was seen before the window
+        // was lost to a reboot or to another sender
+        const PeerFloor_t * floor = auth_find_floor(src_node);
+        if(floor != NULL && seq < floor->seq)
+            return false;
+
+        // Unknown sender: take a free slot, or recycle one round-robin
+        for(int i = 0; i < AUTH_MAX_PEERS && entry == NULL; i++)
+        {
+            if(!replay_windows[i].used)
+                entry = &replay_windows[i];
+        }
+
+        if(entry == NULL)
+        {
+            entry = &replay_windows[replay_victim];
+            replay_victim = (replay_victim + 1) % AUTH_MAX_PEERS;
+            auth_raise_floor(entry->node, entry->highest_seq + 1);
+        }
+
+        entry->used = true;
+        entry->node = src_node;
+        entry->highest_seq = seq;
+        entry->window = 1;
+        auth_raise_floor(src_node, seq + 1);
+        return true;
+    }
+
+    if(seq > entry->highest_seq)
+    {
+        if(AUTH_SEQ_EPOCH(seq) > AUTH_SEQ_EPOCH(entry->highest_seq))
+        {
+            auth_raise_floor(src_node, seq + 1);
+        }
+
+        uint32_t shift = seq - entry->highest_seq;
+        entry->window = shift >= AUTH_REPLAY_WINDOW ? 1 : (entry->window << shift) | 1;
+        entry->highest_seq = seq;
+        return true;
+    }
+
+    uint32_t age = entry->highest_seq - seq;
+    if(age >= AUTH_REPLAY_WINDOW)
+        return false;
+
+    uint64_t bit = 1ULL << age;
+    if(entry->window & bit)
+        return false;
+
+    entry->window |= bit;
+    return true;
+
+}
+
+static PeerFloor_t * auth_find_floor(uint16_t node)
+{
+    for(int i = 0; i < AUTH_MAX_KNOWN_PEERS; i++)
+    {
+        if(peer_floors[i].used && peer_floors[i].node == node)
+            return &peer_floors[i];
+    }
+    return NULL;
+}
+
+static void auth_raise_floor(uint16_t node, uint32_t seq)
+{
+
+    PeerFloor_t * floor = auth_find_floor(node);
+    bool new_epoch = floor == NULL || AUTH_SEQ_EPOCH(seq) > AUTH_SEQ_EPOCH(floor->seq);
+
+    if(floor == NULL)
+    {
+        for(int i = 0; i < AUTH_MAX_KNOWN_PEERS && floor == NULL; i++)
+        {
+            if(!peer_floors[i].used)
+                floor = &peer_floors[i];
+        }
+
+        if(floor == NULL)
+        {
+            floor = &peer_floors[floor_victim];
+            floor_victim = (floor_victim + 1) % AUTH_MAX_KNOWN_PEERS;
+        }
+
+        floor->used = true;
+        floor->node = node;
+        floor->seq = 0;
+    }
+
+    if(seq <= floor->seq)
+        return;
+
+    floor->seq = seq;
+
+    // Stored once per sender boot: within an epoch the floor only moves in
+    // RAM, on the loss of a window
+    if(new_epoch)
+    {
+        esp_err_t err = storage_set_peer_floors(peer_floors, sizeof(peer_floors));
+        if(ESP_OK != err)
+        {
+            ESP_LOGW(__func__, "Error calling storage_set_peer_floors: %s", esp_err_to_name(err));
+        }
+    }
+
+}
+
+esp_err_t auth_next_seq(uint32_t * seq)
+{
+
+    while(true)
+    {
+        portENTER_CRITICAL(&tx_seq_lock);
+        if(tx_counter < AUTH_SEQ_COUNTER_MASK)
+        {
+            tx_counter++;
+            *seq = (tx_epoch << AUTH_SEQ_EPOCH_SHIFT) | tx_counter;
+            portEXIT_CRITICAL(&tx_seq_lock);
+            return ESP_OK;
+        }
+        portEXIT_CRITICAL(&tx_seq_lock);
+
+        // Counter space of this boot used up: move to the next epoch so
+        // that the sequence keeps increasing. Without it no frame goes out,
+        // a wrapped counter would be taken for a replay
+        uint32_t epoch;
+        esp_err_t err = storage_next_boot_epoch(&epoch);
+        if(ESP_OK != err)
+        {
+            ESP_LOGE(__func__, "Error calling storage_next_boot_epoch: %s", esp_err_to_name(err));
+            return err;
+        }
+
+        // Another task may have moved on first
+        portENTER_CRITICAL(&tx_seq_lock);
+        if(epoch > tx_epoch)
+        {
+            tx_epoch = epoch;
+            tx_counter = 0;
+        }
+        portEXIT_CRITICAL(&tx_seq_lock);
+    }
+
+}
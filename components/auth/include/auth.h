@@ -0,0 +1,100 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file auth.h
+ * @brief Message authentication for the node protocol.
+ *
+ * Frames are authenticated with HMAC-SHA256 truncated to AUTH_TAG_LEN bytes,
+ * keyed with the shared key provisioned in NVS. The key XOR ipad and key XOR
+ * opad blocks are hashed once at init; each message clones the two primed
+ * SHA-256 contexts, so it only costs its own blocks and the outer digest
+ * block. mbedtls runs them on the SHA accelerator of the targets that can
+ * resume a saved state; the ESP32 parallel engine cannot, and hashes the
+ * clones in software.
+ *
+ * Replays are rejected with a per-sender sliding window over the frame
+ * sequence numbers. Sequence numbers carry a boot epoch persisted in NVS in
+ * their upper bits, so they keep increasing across resets. A sender without a
+ * window, after a reboot of the receiver or the loss of its window to other
+ * senders, is held to a floor: the sequence number after the first one seen
+ * from its boot epoch, kept in NVS, or after the last one seen before the
+ * window was lost. Frames captured from an earlier boot of the sender are
+ * refused for good.
+ */
+
+#define AUTH_TAG_LEN            8
+#define AUTH_REPLAY_WINDOW      64
+#define AUTH_MAX_PEERS          32
+#define AUTH_MAX_KNOWN_PEERS    64      // Senders with a floor, in NVS
+
+#define AUTH_SEQ_EPOCH_SHIFT    16
+#define AUTH_SEQ_COUNTER_MASK   ((1UL << AUTH_SEQ_EPOCH_SHIFT) - 1)
+
+/**
+ * @brief Load the shared key from NVS and prepare the HMAC contexts.
+ *
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if no key is provisioned,
+ *         or other esp_err_t on internal error.
+ */
+esp_err_t auth_init(void);
+
+/**
+ * @brief Tell whether a key was loaded and frames can be signed and verified.
+ *
+ * @return true if auth_init() succeeded.
+ */
+bool auth_is_ready(void);
+
+/**
+ * @brief Compute the truncated tag of a message.
+ *
+ * Safe to call from any task.
+ *
+ * @param data Message bytes.
+ * @param len Message length.
+ * @param tag Output buffer of AUTH_TAG_LEN bytes.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no key is loaded.
+ */
+esp_err_t auth_sign(const uint8_t * data, size_t len, uint8_t tag[AUTH_TAG_LEN]);
+
+/**
+ * @brief Verify the truncated tag of a message in constant time.
+ *
+ * Safe to call from any task.
+ *
+ * @param data Message bytes.
+ * @param len Message length.
+ * @param tag Received tag of AUTH_TAG_LEN bytes.
+ * @return ESP_OK if the tag matches, ESP_ERR_INVALID_MAC if not,
+ *         ESP_ERR_INVALID_STATE if no key is loaded.
+ */
+esp_err_t auth_verify(const uint8_t * data, size_t len, const uint8_t tag[AUTH_TAG_LEN]);
+
+/**
+ * @brief Check a sequence number against the sender replay window and record it.
+ *
+ * Must only be called for frames whose tag was verified. The first frame of
+ * a new boot epoch of a sender stores its floor in NVS.
+ *
+ * @param src_node Sender node id.
+ * @param seq Frame sequence number.
+ * @return true if the frame is fresh, false if it is a replay or too old.
+ */
+bool auth_check_replay(uint16_t src_node, uint32_t seq);
+
+/**
+ * @brief Allocate the next outgoing sequence number.
+ *
+ * Strictly increasing across resets: when the counter of the boot epoch runs
+ * out, a new epoch is taken from NVS.
+ *
+ * @param seq Output sequence number.
+ * @return ESP_OK on success, or the storage error if the counter ran out and
+ *         no new epoch could be stored, in which case nothing may be sent.
+ */
+esp_err_t auth_next_seq(uint32_t * seq);
@@ -0,0 +1,241 @@
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "freertos/FreeRTOS.h"
+
+#include "battery.h"
+#include "app.h"
+#include "buzzer.h"
+#include "error_signaling.h"
+#include "config.h"
+
+#define BATTERY_ADC_ATTEN       ADC_ATTEN_DB_12     // Up to about 3.1 V at the pin
+#define BATTERY_FILTER_SHIFT    2                   // Each sample moves the voltage by 1/4 of the difference
+
+typedef struct
+{
+    uint16_t millivolts;
+    uint8_t soc_pct;
+} BatteryCurvePoint_t;
+
+// 1S Li-ion at the light load of a node, from full to cut-off
+static const BatteryCurvePoint_t discharge_curve[] =
+{
+    { 4200, 100 },
+    { 4100, 90 },
+    { 4000, 78 },
+    { 3900, 65 },
+    { 3800, 50 },
+    { 3750, 40 },
+    { 3700, 30 },
+    { 3650, 20 },
+    { 3600, 12 },
+    { 3500, 5 },
+    { 3300, 0 },
+};
+
+#define BATTERY_CURVE_LEN   (sizeof(discharge_curve) / sizeof(discharge_curve[0]))
+
+static adc_oneshot_unit_handle_t adc_unit = NULL;
+static adc_cali_handle_t adc_cali = NULL;
+
+static BatteryStatus_t status = { .soc_pct = BATTERY_PCT_UNKNOWN };
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t last_cue_us = 0;
+
+static esp_err_t battery_cali_init(void);
+static void battery_warn(const BatteryStatus_t * sample, bool entered);
+
+esp_err_t battery_init(void)
+{
+
+    adc_oneshot_unit_init_cfg_t unit_config =
+    {
+        .unit_id = ADC_UNIT_1,
+    };
+
+    esp_err_t ret = adc_oneshot_new_unit(&unit_config, &adc_unit);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling adc_oneshot_new_unit: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    adc_oneshot_chan_cfg_t channel_config =
+    {
+        .atten = BATTERY_ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+
+    ret = adc_oneshot_config_channel(adc_unit, BATTERY_ADC_CHANNEL, &channel_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling adc_oneshot_config_channel: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Not fatal: without eFuse values the nominal conversion is off by up to ~10%
+    ret = battery_cali_init();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGW(__func__, "No ADC calibration, using the nominal conversion: %s", esp_err_to_name(ret));
+    }
+
+    return battery_sample();
+
+}
+
+esp_err_t battery_sample(void)
+{
+
+    if(!adc_unit)
+        return ESP_ERR_INVALID_STATE;
+
+    // The ADC noise is a few LSB: the average of a burst is steady
+    int32_t raw_sum = 0;
+    for(int i = 0; i < BATTERY_OVERSAMPLE; i++)
+    {
+        int raw = 0;
+        esp_err_t ret = adc_oneshot_read(adc_unit, BATTERY_ADC_CHANNEL, &raw);
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error calling adc_oneshot_read: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        raw_sum += raw;
+    }
+    int raw = (raw_sum + BATTERY_OVERSAMPLE / 2) / BATTERY_OVERSAMPLE;
+
+    int pin_mv = 0;
+    if(!adc_cali || ESP_OK != adc_cali_raw_to_voltage(adc_cali, raw, &pin_mv))
+    {
+        pin_mv = raw * BATTERY_NOMINAL_FULL_SCALE_MV / 4095;
+    }
+    int32_t pack_mv = pin_mv * BATTERY_DIVIDER_RATIO;
+
+    BatteryStatus_t sample;
+    battery_get(&sample);
+    bool was_present = sample.present;
+    bool was_low = sample.low;
+
+    sample.samples++;
+    sample.calibrated = adc_cali != NULL;
+
+    // An empty or sagging pack still reads well over this: the node runs on USB, or the divider is missing
+    sample.present = pack_mv >= BATTERY_ABSENT_MV;
+    if(!sample.present)
+    {
+        sample.millivolts = 0;
+        sample.soc_pct = BATTERY_PCT_UNKNOWN;
+        sample.low = false;
+    }
+    else
+    {
+        // Radio bursts sag the pack for a moment, the filter keeps the estimate steady
+        if(!was_present)
+            sample.millivolts = pack_mv;
+        else
+            sample.millivolts += (pack_mv - (int32_t)sample.millivolts) >> BATTERY_FILTER_SHIFT;
+
+        // Under the bottom of the curve the pack is about to cut off, 0% and the warning goes on
+        sample.soc_pct = battery_soc_from_mv(sample.millivolts);
+
+        // Some hysteresis, or a pack around the threshold keeps beeping on and off
+        sample.low = was_low ? sample.soc_pct < BATTERY_LOW_CLEAR_PCT : sample.soc_pct < BATTERY_LOW_PCT;
+    }
+
+    portENTER_CRITICAL(&status_lock);
+    status = sample;
+    portEXIT_CRITICAL(&status_lock);
+
+    if(sample.low)
+    {
+        battery_warn(&sample, !was_low);
+    }
+
+    return ESP_OK;
+
+}
+
+void battery_get(BatteryStatus_t * out)
+{
+    portENTER_CRITICAL(&status_lock);
+    *out = status;
+    portEXIT_CRITICAL(&status_lock);
+}
+
+uint8_t battery_soc_from_mv(uint16_t millivolts)
+{
+
+    if(millivolts >= discharge_curve[0].millivolts)
+        return discharge_curve[0].soc_pct;
+
+    for(size_t i = 1; i < BATTERY_CURVE_LEN; i++)
+    {
+        const BatteryCurvePoint_t * high = &discharge_curve[i - 1];
+        const BatteryCurvePoint_t * low = &discharge_curve[i];
+        if(millivolts >= low->millivolts)
+        {
+            // Linear between the two points
+            return low->soc_pct + (uint32_t)(millivolts - low->millivolts) * (high->soc_pct - low->soc_pct) /
+                                  (high->millivolts - low->millivolts);
+        }
+    }
+
+    return 0;
+
+}
+
+static esp_err_t battery_cali_init(void)
+{
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t cali_config =
+    {
+        .unit_id = ADC_UNIT_1,
+        .chan = BATTERY_ADC_CHANNEL,
+        .atten = BATTERY_ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+    return adc_cali_create_scheme_curve_fitting(&cali_config, &adc_cali);
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_line_fitting_config_t cali_config =
+    {
+        .unit_id = ADC_UNIT_1,
+        .atten = BATTERY_ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+    return adc_cali_create_scheme_line_fitting(&cali_config, &adc_cali);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+
+}
+
+static void battery_warn(const BatteryStatus_t * sample, bool entered)
+{
+
+    int64_t now = esp_timer_get_time();
+
+    if(entered)
+    {
+        ESP_LOGW(__func__, "Battery low: %u mV, %u%%", sample->millivolts, sample->soc_pct);
+    }
+    else if(now - last_cue_us < (int64_t)BATTERY_CUE_PERIOD_MS * 1000)
+    {
+        return;
+    }
+
+    last_cue_us = now;
+    buzzer_play(BUZZER_CUE_LOW_BATTERY);
+
+    // During a match the LEDs belong to the game
+    if(get_app_state() == APP_STATE_IDLE)
+    {
+        signal_blink(RED_LED, BATTERY_BLINK_HALF_PERIOD_MS, BATTERY_SHOW_MS);
+    }
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file battery.h
+ * @brief Battery voltage and state of charge of a 1S Li-ion pack.
+ *
+ * The pack voltage is read through a divider on an ADC1 pin, averaging
+ * BATTERY_OVERSAMPLE conversions and converting them with the eFuse
+ * calibration. The state of charge comes from a typical discharge curve;
+ * a pack read under its bottom is empty, at 0%, and warns. A reading under
+ * BATTERY_ABSENT_MV is no battery at all, e.g. a node on USB: no charge is
+ * estimated and nothing warns.
+ *
+ * There is no sampling timer: the health monitor calls battery_sample()
+ * every HEALTH_PERIOD_MS, so the ADC adds no wakeup of its own. Below
+ * BATTERY_LOW_PCT the low battery cue plays every BATTERY_CUE_PERIOD_MS,
+ * and between matches the red LED blinks.
+ */
+
+#define BATTERY_PCT_UNKNOWN     0xFF
+
+typedef struct
+{
+    uint16_t millivolts;        // Filtered pack voltage, 0 before the first sample or without a battery
+    uint8_t soc_pct;            // State of charge, BATTERY_PCT_UNKNOWN before the first sample or without a battery
+    bool present;               // Read at or over BATTERY_ABSENT_MV
+    bool low;                   // Under BATTERY_LOW_PCT, until back over BATTERY_LOW_CLEAR_PCT
+    bool calibrated;            // eFuse calibration in use, else a nominal conversion
+    uint32_t samples;
+} BatteryStatus_t;
+
+/**
+ * @brief Set up the ADC channel and its calibration.
+ *
+ * @return ESP_OK on success, error code of the ADC driver otherwise.
+ */
+esp_err_t battery_init(void);
+
+/**
+ * @brief Read the battery and update the status. Not callable from ISRs.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE before battery_init(),
+ * error code of the ADC driver otherwise.
+ */
+esp_err_t battery_sample(void);
+
+/**
+ * @brief Get the last battery status.
+ *
+ * @param status Filled with the status.
+ */
+void battery_get(BatteryStatus_t * status);
+
+/**
+ * @brief State of charge of a pack voltage, from the discharge curve.
+ *
+ * @param millivolts Pack voltage.
+ *
+ * @return State of charge in percent.
+ */
+uint8_t battery_soc_from_mv(uint16_t millivolts);
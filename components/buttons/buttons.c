@@ -1,22 +1,40 @@
 #include "buttons.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "error_signaling.h"
+#include "supervisor.h"
 #include "app.h"
 
 EventGroupHandle_t button_event_group = NULL;
 
+static volatile uint32_t press_short_max_ms = PRESS_SHORT_MAX_MS;
+static volatile uint32_t press_medium_max_ms = PRESS_MEDIUM_MAX_MS;
+static volatile uint32_t dropped_events = 0;
+static volatile uint32_t isr_count = 0;
+
+// Buttons stuck at boot: ignored until released for BUTTON_UNMASK_MS
+static volatile uint32_t masked_bits = 0;
+static int64_t masked_since_us[TEAM_COUNT];
+
 void gpio_button_isr_handler(void* arg);
+static void button_check_masked(void);
 
 esp_err_t button_init()
 {
     
     esp_err_t ret = ESP_OK;
 
+    uint64_t pin_bit_mask = 0;
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        pin_bit_mask |= 1ULL << teams[team].button_gpio;
+    }
+
     gpio_config_t io_conf_btn = 
     {
-        .pin_bit_mask = (1ULL << GPIO_BTN_RED) | (1ULL << GPIO_BTN_BLUE),
+        .pin_bit_mask = pin_bit_mask,
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -30,10 +48,17 @@ esp_err_t button_init()
         return ret;
     }
 
-    if(gpio_get_level(GPIO_BTN_RED) == 0 || gpio_get_level(GPIO_BTN_BLUE) == 0)
+    // A stuck button is masked: the other teams still play
+    for(int team = 0; team < TEAM_COUNT; team++)
     {
-        ESP_LOGE(__func__, "BUTTON %s IS PRESSED AT STARTUP OR IS DAMAGED!", gpio_get_level(GPIO_BTN_RED) == 0 ? "RED" : "BLUE");
-        signal_fatal_error(BUTTON_ERROR);
+        if(gpio_get_level(teams[team].button_gpio) == 0)
+        {
+            ESP_LOGE(__func__, "BUTTON %s IS PRESSED AT STARTUP OR IS DAMAGED, MASKED!", teams[team].name);
+            masked_bits |= BTN_TEAM_EVENT(team);
+            masked_since_us[team] = esp_timer_get_time();
+            fault_record(BUTTON_ERROR, team);
+            fault_show(BUTTON_ERROR, team, FAULT_BUTTON_SHOW_MS);
+        }
     }
 
     button_event_group = xEventGroupCreate();
@@ -51,40 +76,43 @@ esp_err_t button_init()
         return ret;
     }
     
-    ret = gpio_isr_handler_add(GPIO_BTN_RED, gpio_button_isr_handler, (void*)GPIO_BTN_RED);
-    if(ESP_OK != ret)
-    {
-        ESP_LOGE(__func__, "Error calling gpio_isr_handler_add (RED): %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    ret = gpio_isr_handler_add(GPIO_BTN_BLUE, gpio_button_isr_handler, (void*)GPIO_BTN_BLUE);
-    if(ESP_OK != ret)
+    for(int team = 0; team < TEAM_COUNT; team++)
     {
-        ESP_LOGE(__func__, "Error calling gpio_isr_handler_add (BLUE): %s", esp_err_to_name(ret));
-        return ret;
+        ret = gpio_isr_handler_add(teams[team].button_gpio, gpio_button_isr_handler, (void*)(uintptr_t)team);
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error calling gpio_isr_handler_add (%s): %s", teams[team].name, esp_err_to_name(ret));
+            return ret;
+        }
     }
 
     return ret;
 
 }
 
+void button_set_press_thresholds(uint16_t short_max_ms, uint16_t medium_max_ms)
+{
+    // 0 keeps the firmware default
+    press_short_max_ms = short_max_ms ? short_max_ms : PRESS_SHORT_MAX_MS;
+    press_medium_max_ms = medium_max_ms ? medium_max_ms : PRESS_MEDIUM_MAX_MS;
+}
+
 void IRAM_ATTR gpio_button_isr_handler(void* arg)
 {
     
-    uint32_t gpio_num = (uint32_t)(uintptr_t)arg;
+    uint32_t team = (uint32_t)(uintptr_t)arg;
 
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    isr_count++;
 
-    if (gpio_num == GPIO_BTN_RED) 
-    {
-        xEventGroupSetBitsFromISR(button_event_group, BTN_RED_EVENT, &xHigherPriorityTaskWoken);
-    } 
-    else if (gpio_num == GPIO_BTN_BLUE) 
+    if (masked_bits & BTN_TEAM_EVENT(team))
     {
-        xEventGroupSetBitsFromISR(button_event_group, BTN_BLUE_EVENT, &xHigherPriorityTaskWoken);
+        return;
     }
 
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    xEventGroupSetBitsFromISR(button_event_group, BTN_TEAM_EVENT(team), &xHigherPriorityTaskWoken);
+
     if (xHigherPriorityTaskWoken) 
     {
         portYIELD_FROM_ISR();
@@ -92,120 +120,73 @@ void IRAM_ATTR gpio_button_isr_handler(void* arg)
 
 }
 
+static bool buttons_held(EventBits_t bits)
+{
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        if((bits & BTN_TEAM_EVENT(team)) && gpio_get_level(teams[team].button_gpio) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void button_task(void* arg)
 {
     
+    int liveness = supervisor_register("button", SUPERVISOR_BUTTON_DEADLINE_MS);
+
     for(;;)
     {
         
+        // Masked buttons are polled until they are released, the wait is
+        // bounded anyway to check in with the supervisor
         EventBits_t bits = xEventGroupWaitBits(button_event_group,
-                                               BTN_RED_EVENT | BTN_BLUE_EVENT,
+                                               BTN_ALL_EVENTS,
                                                pdFALSE,    // Do NOT clear bits on exit
                                                pdFALSE,    // Wait any
-                                               portMAX_DELAY);
-
-        
-        vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_DELAY_MS));
-        bits = xEventGroupGetBits(button_event_group);
+                                               pdMS_TO_TICKS(masked_bits ? BUTTON_MASK_POLL_MS : BUTTON_CHECKIN_MS));
 
-        bool red_pressed  = bits & BTN_RED_EVENT;
-        bool blue_pressed = bits & BTN_BLUE_EVENT;
+        supervisor_checkin(liveness);
 
-        TickType_t start_tick = xTaskGetTickCount();
+        if (masked_bits)
+        {
+            button_check_masked();
+        }
 
-        if (red_pressed && blue_pressed)
+        if ((bits & BTN_ALL_EVENTS) == 0)
         {
-            int times = 0;
-            do 
-            {
-                vTaskDelay(pdMS_TO_TICKS(PRESS_INTER_TIME_MS));
-                times++;
-            } 
-            while (gpio_get_level(GPIO_BTN_RED) == 0 && gpio_get_level(GPIO_BTN_BLUE) == 0 && times < PRESS_LONG_MAX_MS/PRESS_INTER_TIME_MS);
-            
-            TickType_t press_duration = xTaskGetTickCount() - start_tick;
-            uint32_t press_time_ms = pdTICKS_TO_MS(press_duration);
-
-            AppEventMessage_t message_event;
-
-            if (press_time_ms < PRESS_SHORT_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_BOTH_SHORT;
-            } 
-            else if (press_time_ms < PRESS_MEDIUM_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_BOTH_MEDIUM;
-            } 
-            else 
-            {
-                message_event.type = APP_EVENT_BTN_BOTH_LONG;
-            }
-
-            xQueueSend(app_event_queue, &message_event, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS));
-        
+            continue;
         }
-        else if (red_pressed)
+
+        vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_DELAY_MS));
+        bits = xEventGroupGetBits(button_event_group) & BTN_ALL_EVENTS;
+        if (bits == 0)
         {
-            int times = 0;
-            do 
-            {
-                vTaskDelay(pdMS_TO_TICKS(PRESS_INTER_TIME_MS));
-                times++;
-            } 
-            while (gpio_get_level(GPIO_BTN_RED) == 0 && times < PRESS_LONG_MAX_MS/PRESS_INTER_TIME_MS);
-
-            TickType_t press_duration = xTaskGetTickCount() - start_tick;
-            uint32_t press_time_ms = pdTICKS_TO_MS(press_duration);
-
-            AppEventMessage_t message_event;
-
-            if (press_time_ms < PRESS_SHORT_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_RED_SHORT;
-            } 
-            else if (press_time_ms < PRESS_MEDIUM_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_RED_MEDIUM;
-            } 
-            else 
-            {
-                message_event.type = APP_EVENT_BTN_RED_LONG;
-            }
-
-            xQueueSend(app_event_queue, &message_event, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS));
-        
+            continue;
         }
-        else if (blue_pressed)
+
+        TickType_t start_tick = xTaskGetTickCount();
+
+        // Held until any of the pressed buttons is released
+        int times = 0;
+        do 
         {
-            
-            int times = 0;
-            do 
-            {
-                vTaskDelay(pdMS_TO_TICKS(PRESS_INTER_TIME_MS));
-                times++;
-            }
-            while (gpio_get_level(GPIO_BTN_BLUE) == 0 && times < PRESS_LONG_MAX_MS/PRESS_INTER_TIME_MS);
-
-            TickType_t press_duration = xTaskGetTickCount() - start_tick;
-            uint32_t press_time_ms = pdTICKS_TO_MS(press_duration);
-
-            AppEventMessage_t message_event;
-
-            if (press_time_ms < PRESS_SHORT_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_BLUE_SHORT;
-            } 
-            else if (press_time_ms < PRESS_MEDIUM_MAX_MS) 
-            {
-                message_event.type = APP_EVENT_BTN_BLUE_MEDIUM;
-            } 
-            else 
-            {
-                message_event.type = APP_EVENT_BTN_BLUE_LONG;
-            }
-
-            xQueueSend(app_event_queue, &message_event, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS));
+            vTaskDelay(pdMS_TO_TICKS(PRESS_INTER_TIME_MS));
+            supervisor_checkin(liveness);
+            times++;
+        } 
+        while (buttons_held(bits) && times < PRESS_LONG_MAX_MS/PRESS_INTER_TIME_MS);
         
+        TickType_t press_duration = xTaskGetTickCount() - start_tick;
+
+        AppEventMessage_t message_event = { .type = button_classify(bits, pdTICKS_TO_MS(press_duration)) };
+
+        if (ESP_OK != app_event_send(&message_event, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS)))
+        {
+            dropped_events++;
+            ESP_LOGW(__func__, "App queue full, event %d dropped (%lu so far)", message_event.type, (unsigned long)dropped_events);
         }
 
         xEventGroupClearBits(button_event_group, bits);
@@ -213,3 +194,85 @@ void button_task(void* arg)
     }
 
 }
+
+AppEvent_t button_classify(uint32_t bits, uint32_t press_time_ms)
+{
+
+    bits &= BTN_ALL_EVENTS;
+    if (bits == 0)
+    {
+        return APP_EVENT_MAX;
+    }
+
+    PressKind_t press;
+
+    if (press_time_ms < press_short_max_ms) 
+    {
+        press = PRESS_SHORT;
+    } 
+    else if (press_time_ms < press_medium_max_ms) 
+    {
+        press = PRESS_MEDIUM;
+    } 
+    else 
+    {
+        press = PRESS_LONG;
+    }
+
+    // A single bit is a team button, more than one a chord
+    if ((bits & (bits - 1)) != 0)
+    {
+        return APP_EVENT_BTN_BOTH_SHORT + press;
+    }
+
+    return APP_EVENT_BTN(__builtin_ctz(bits), press);
+
+}
+
+uint32_t button_get_dropped_events(void)
+{
+    return dropped_events;
+}
+
+uint32_t button_get_isr_count(void)
+{
+    return isr_count;
+}
+
+static void button_check_masked(void)
+{
+
+    static int64_t released_since_us[TEAM_COUNT];
+    int64_t now = esp_timer_get_time();
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        if(!(masked_bits & BTN_TEAM_EVENT(team)))
+            continue;
+
+        if(gpio_get_level(teams[team].button_gpio) == 0)
+        {
+            released_since_us[team] = 0;
+            continue;
+        }
+
+        if(released_since_us[team] == 0)
+        {
+            released_since_us[team] = now;
+        }
+        else if(now - released_since_us[team] >= (int64_t)BUTTON_UNMASK_MS * 1000)
+        {
+            // Freed (dirt, a knock): the team plays again
+            masked_bits &= ~BTN_TEAM_EVENT(team);
+            released_since_us[team] = 0;
+            ESP_LOGW(__func__, "BUTTON %s RELEASED, UNMASKED", teams[team].name);
+            fault_recovered(BUTTON_ERROR, (uint32_t)((now - masked_since_us[team]) / 1000));
+        }
+    }
+
+}
+
+uint32_t button_get_masked(void)
+{
+    return masked_bits;
+}
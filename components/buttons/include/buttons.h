@@ -3,6 +3,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "config.h"
+#include "app.h"
 
 #define ESP_INTR_FLAG_DEFAULT 0
 
@@ -13,4 +14,32 @@
 
 extern EventGroupHandle_t button_event_group;
 esp_err_t button_init();
-void button_task(void* arg);
\ No newline at end of file
+void button_task(void* arg);
+void button_set_press_thresholds(uint16_t short_max_ms, uint16_t medium_max_ms);
+
+/**
+ * @brief Turn a debounced press into the app event it stands for.
+ *
+ * Pure function of its inputs and of the press thresholds, shared by
+ * button_task() and anything driving the button layer without hardware.
+ *
+ * @param bits BTN_TEAM_EVENT() bits of the buttons pressed, others are ignored.
+ * @param press_time_ms How long the buttons were held.
+ * @return Team or chord event, APP_EVENT_MAX if no button was pressed.
+ */
+AppEvent_t button_classify(uint32_t bits, uint32_t press_time_ms);
+
+/**
+ * @brief Number of button events dropped because the app queue was full.
+ */
+uint32_t button_get_dropped_events(void);
+
+/**
+ * @brief Number of button interrupts since boot, bounces included.
+ */
+uint32_t button_get_isr_count(void);
+
+/**
+ * @brief BTN_TEAM_EVENT() bits of the buttons masked because they were stuck at boot.
+ */
+uint32_t button_get_masked(void);
@@ -0,0 +1,206 @@
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+
+#include "buzzer.h"
+#include "config.h"
+
+#define BUZZER_MAX_NOTES        6
+#define BUZZER_LEDC_MODE        LEDC_LOW_SPEED_MODE
+#define BUZZER_LEDC_TIMER       LEDC_TIMER_0
+#define BUZZER_LEDC_CHANNEL     LEDC_CHANNEL_0
+#define BUZZER_DUTY_RESOLUTION  LEDC_TIMER_10_BIT
+#define BUZZER_DUTY_HALF        (1 << (BUZZER_DUTY_RESOLUTION - 1))
+
+typedef struct
+{
+    uint16_t freq_hz;           // 0 for a rest
+    uint16_t duration_ms;
+} BuzzerNote_t;
+
+typedef struct
+{
+    uint8_t priority;
+    uint8_t note_count;
+    BuzzerNote_t notes[BUZZER_MAX_NOTES];
+} BuzzerPattern_t;
+
+// Distinct rhythms rather than pitches: they have to carry across the field
+static const BuzzerPattern_t cue_patterns[BUZZER_CUE_MAX] =
+{
+    [BUZZER_CUE_LOW_BATTERY] = { .priority = 0, .note_count = 3, .notes = { { 800, 150 }, { 0, 150 }, { 600, 300 } } },
+    [BUZZER_CUE_CONTESTED]   = { .priority = 1, .note_count = 5, .notes = { { 2000, 60 }, { 0, 60 }, { 2000, 60 }, { 0, 60 }, { 2000, 60 } } },
+    [BUZZER_CUE_CAPTURE]     = { .priority = 2, .note_count = 5, .notes = { { 1200, 80 }, { 0, 40 }, { 1600, 80 }, { 0, 40 }, { 2000, 150 } } },
+    [BUZZER_CUE_MATCH_START] = { .priority = 3, .note_count = 5, .notes = { { 1000, 200 }, { 0, 100 }, { 1000, 200 }, { 0, 100 }, { 2000, 500 } } },
+    [BUZZER_CUE_MATCH_END]   = { .priority = 3, .note_count = 5, .notes = { { 2000, 300 }, { 0, 100 }, { 1500, 300 }, { 0, 100 }, { 1000, 800 } } },
+};
+
+static esp_timer_handle_t buzzer_timer = NULL;
+static portMUX_TYPE buzzer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Under buzzer_lock
+static BuzzerCue_t playing = BUZZER_CUE_NONE;
+static BuzzerCue_t waiting = BUZZER_CUE_NONE;
+static uint8_t note_index = 0;
+static int64_t note_end_us = 0;
+
+// Timer callback alone: the LEDC is only touched from there
+static uint16_t tone_hz = 0;
+
+static void buzzer_timer_callback(void * arg);
+static void buzzer_tone(uint16_t freq_hz);
+
+esp_err_t buzzer_init(void)
+{
+
+    ledc_timer_config_t timer_config =
+    {
+        .speed_mode = BUZZER_LEDC_MODE,
+        .duty_resolution = BUZZER_DUTY_RESOLUTION,
+        .timer_num = BUZZER_LEDC_TIMER,
+        .freq_hz = 2000,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+
+    esp_err_t ret = ledc_timer_config(&timer_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling ledc_timer_config: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ledc_channel_config_t channel_config =
+    {
+        .gpio_num = GPIO_BUZZER,
+        .speed_mode = BUZZER_LEDC_MODE,
+        .channel = BUZZER_LEDC_CHANNEL,
+        .timer_sel = BUZZER_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+    };
+
+    ret = ledc_channel_config(&channel_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling ledc_channel_config: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    const esp_timer_create_args_t step_timer_args =
+    {
+        .callback = buzzer_timer_callback,
+        .name = "buzzer",
+    };
+
+    ret = esp_timer_create(&step_timer_args, &buzzer_timer);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_timer_create: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return ESP_OK;
+
+}
+
+void buzzer_play(BuzzerCue_t cue)
+{
+
+    if(cue <= BUZZER_CUE_NONE || cue >= BUZZER_CUE_MAX || !buzzer_timer)
+        return;
+
+    bool start = false;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&buzzer_lock);
+    if(playing == BUZZER_CUE_NONE || cue_patterns[cue].priority >= cue_patterns[playing].priority)
+    {
+        // The cut cue is dropped, not resumed
+        playing = cue;
+        note_index = 0;
+        note_end_us = now + (int64_t)cue_patterns[cue].notes[0].duration_ms * 1000;
+        start = true;
+    }
+    else if(waiting == BUZZER_CUE_NONE || cue_patterns[cue].priority >= cue_patterns[waiting].priority)
+    {
+        waiting = cue;
+    }
+    portEXIT_CRITICAL(&buzzer_lock);
+
+    if(start)
+    {
+        // The callback works from the clock: running it once more is harmless.
+        // One running meanwhile may re-arm the timer for a note of the cut cue
+        // between the stop and the start: stopped again, or the new cue would
+        // wait for that note to end and skip its own first notes
+        esp_timer_stop(buzzer_timer);
+        esp_err_t ret;
+        while(ESP_ERR_INVALID_STATE == (ret = esp_timer_start_once(buzzer_timer, 0)))
+        {
+            esp_timer_stop(buzzer_timer);
+        }
+        if(ESP_OK != ret)
+        {
+            ESP_LOGW(__func__, "Error calling esp_timer_start_once: %s", esp_err_to_name(ret));
+        }
+    }
+
+}
+
+static void buzzer_timer_callback(void * arg)
+{
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&buzzer_lock);
+    // Notes end on their own schedule: a late call skips ahead, it does not stretch them
+    while(playing != BUZZER_CUE_NONE && now >= note_end_us)
+    {
+        if(++note_index >= cue_patterns[playing].note_count)
+        {
+            playing = waiting;
+            waiting = BUZZER_CUE_NONE;
+            note_index = 0;
+            if(playing == BUZZER_CUE_NONE)
+                break;
+        }
+        note_end_us += (int64_t)cue_patterns[playing].notes[note_index].duration_ms * 1000;
+    }
+
+    uint16_t freq_hz = playing != BUZZER_CUE_NONE ? cue_patterns[playing].notes[note_index].freq_hz : 0;
+    int64_t wait_us = playing != BUZZER_CUE_NONE ? note_end_us - now : 0;
+    portEXIT_CRITICAL(&buzzer_lock);
+
+    buzzer_tone(freq_hz);
+
+    // Silent and idle: nothing runs until the next cue
+    if(wait_us > 0)
+    {
+        esp_timer_start_once(buzzer_timer, wait_us);
+    }
+
+}
+
+static void buzzer_tone(uint16_t freq_hz)
+{
+
+    if(freq_hz == tone_hz)
+        return;
+
+    if(freq_hz != 0)
+    {
+        esp_err_t ret = ledc_set_freq(BUZZER_LEDC_MODE, BUZZER_LEDC_TIMER, freq_hz);
+        if(ESP_OK != ret)
+        {
+            ESP_LOGW(__func__, "Error calling ledc_set_freq: %s", esp_err_to_name(ret));
+            freq_hz = 0;
+        }
+    }
+
+    ledc_set_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL, freq_hz ? BUZZER_DUTY_HALF : 0);
+    ledc_update_duty(BUZZER_LEDC_MODE, BUZZER_LEDC_CHANNEL);
+
+    tone_hz = freq_hz;
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "stdint.h"
+#include "esp_err.h"
+
+/**
+ * @file buzzer.h
+ * @brief Audible cues on a passive buzzer, for players who cannot see the LEDs.
+ *
+ * A cue is a short sequence of tones from a fixed table, played by the LEDC
+ * peripheral and stepped by a one-shot esp_timer: buzzer_play() only takes
+ * note of the cue and returns, and nothing runs between two notes or while
+ * silent. A cue of higher or equal priority cuts the one playing, a lower
+ * one waits for it to end; only the highest waiting cue is kept.
+ *
+ * Before buzzer_init(), or without a buzzer, buzzer_play() does nothing.
+ */
+
+typedef enum
+{
+    BUZZER_CUE_NONE = -1,
+    BUZZER_CUE_LOW_BATTERY,
+    BUZZER_CUE_CONTESTED,
+    BUZZER_CUE_CAPTURE,
+    BUZZER_CUE_MATCH_START,
+    BUZZER_CUE_MATCH_END,
+    BUZZER_CUE_MAX
+} BuzzerCue_t;
+
+/**
+ * @brief Set up the LEDC channel of the buzzer, silent, and the step timer.
+ *
+ * @return ESP_OK on success, error code of the LEDC or esp_timer call otherwise.
+ */
+esp_err_t buzzer_init(void);
+
+/**
+ * @brief Queue a cue and return at once. Not callable from ISRs.
+ *
+ * @param cue Cue to play.
+ */
+void buzzer_play(BuzzerCue_t cue);
+
@@ -1,11 +1,18 @@
 #include "esp_timer.h"
 #include "chrono.h"
 
+static ChronoClock_t chrono_clock = esp_timer_get_time;
+
+void chrono_set_clock(ChronoClock_t clock)
+{
+    chrono_clock = clock ? clock : esp_timer_get_time;
+}
+
 void chrono_start(Chrono_t * chrono)
 {
     if (!chrono->is_running)
     {
-        chrono->time_start_us = esp_timer_get_time();
+        chrono->time_start_us = chrono_clock();
         chrono->is_running = true;
     }
 }
@@ -14,7 +21,7 @@ void chrono_stop(Chrono_t * chrono)
 {
     if (chrono->is_running)
     {
-        int64_t now = esp_timer_get_time();
+        int64_t now = chrono_clock();
         chrono->time_total_us += (now - chrono->time_start_us);
         chrono->is_running = false;
     }
@@ -24,14 +31,14 @@ void chrono_reset(Chrono_t * chrono)
 {
     chrono->time_total_us = 0;
     if (chrono->is_running)
-        chrono->time_start_us = esp_timer_get_time();
+        chrono->time_start_us = chrono_clock();
 }
 
 int chrono_get_seconds(Chrono_t * chrono)
 {
     if (chrono->is_running)
     {
-        int64_t now = esp_timer_get_time();
+        int64_t now = chrono_clock();
         return (chrono->time_total_us + (now - chrono->time_start_us)) / 1000000;
     }
     else
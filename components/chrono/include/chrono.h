@@ -1,3 +1,5 @@
+#pragma once
+
 #include "stdint.h"
 #include "stdbool.h"
 
@@ -34,6 +36,20 @@ typedef struct
  */
 #define CHRONO_DEFAULT() (Chrono_t){ .time_start_us = 0, .time_total_us = 0, .is_running = false }
 
+/**
+ * @brief Clock read by the stopwatches, in microseconds.
+ */
+typedef int64_t (*ChronoClock_t)(void);
+
+/**
+ * @brief Replace the clock of every stopwatch, e.g. with a virtual one to replay a match.
+ *
+ * Stopwatches running across the change mix both clocks: reset them afterwards.
+ *
+ * @param clock New clock, NULL to go back to esp_timer_get_time().
+ */
+void chrono_set_clock(ChronoClock_t clock);
+
 /**
  * @brief Start the stopwatch.
  *
@@ -0,0 +1,631 @@
+#include "stdio.h"
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "cli.h"
+#include "app.h"
+#include "buttons.h"
+#include "scoring.h"
+#include "pool.h"
+#include "history.h"
+#include "health.h"
+#include "supervisor.h"
+#include "network.h"
+#include "link.h"
+#include "matchsync.h"
+#include "storage.h"
+#if CONFIG_DOMINION_DISPLAY
+#include "display.h"
+#endif
+#include "error_signaling.h"
+#include "config.h"
+
+#define CLI_INJECT_MAX_COUNT        10000
+#define CLI_BENCH_ITERATIONS        10000
+#define CLI_BENCH_MAX_ITERATIONS    100000      // Well under a second per loop: the idle task waits meanwhile
+
+static const char * const cli_state_names[] =
+{
+    [APP_STATE_INIT] = "INIT",
+    [APP_STATE_IDLE] = "IDLE",
+    [APP_STATE_SETTINGS_CONTROL_POINT] = "SETTINGS",
+    [APP_STATE_SETTINGS_CP_ALPHA] = "SETTINGS ALPHA",
+    [APP_STATE_SETTINGS_CP_BRAVO] = "SETTINGS BRAVO",
+    [APP_STATE_SETTINGS_CP_CHARLIE] = "SETTINGS CHARLIE",
+    [APP_STATE_SETTINGS_CP_DELTA] = "SETTINGS DELTA",
+    [APP_STATE_SETTINGS_CP_ECHO] = "SETTINGS ECHO",
+    [APP_STATE_SETTINGS_CP_EXIT] = "SETTINGS CP EXIT",
+    [APP_STATE_SETTINGS_EXIT] = "SETTINGS EXIT",
+    [APP_STATE_RUNNING] = "RUNNING",
+    [APP_STATE_FINISHED] = "FINISHED",
+};
+
+static struct
+{
+    struct arg_int * event;
+    struct arg_int * count;
+    struct arg_int * rate;
+    struct arg_end * end;
+} inject_args;
+
+static struct
+{
+    struct arg_int * iterations;
+    struct arg_end * end;
+} bench_args;
+
+static struct
+{
+    struct arg_int * matches;
+    struct arg_int * from;
+    struct arg_int * control_point;
+    struct arg_end * end;
+} history_args;
+
+static struct
+{
+    struct arg_str * task;
+    struct arg_end * end;
+} hang_args;
+
+static struct
+{
+    struct arg_lit * reconnect;
+    struct arg_end * end;
+} wifi_args;
+
+// Private pool for the benchmark, app_payload_pool is left to the game path
+POOL_DEFINE(cli_bench_pool, APP_PAYLOAD_BLOCK_SIZE, APP_PAYLOAD_BLOCK_COUNT);
+
+static int cli_status(int argc, char ** argv);
+static int cli_stats(int argc, char ** argv);
+static int cli_health(int argc, char ** argv);
+static int cli_faults(int argc, char ** argv);
+static int cli_inject(int argc, char ** argv);
+static int cli_bench(int argc, char ** argv);
+static int cli_history(int argc, char ** argv);
+static int cli_liveness(int argc, char ** argv);
+static int cli_hang(int argc, char ** argv);
+static int cli_wifi(int argc, char ** argv);
+static int cli_sync(int argc, char ** argv);
+#if CONFIG_DOMINION_DISPLAY
+static int cli_display(int argc, char ** argv);
+#endif
+static void cli_bench_report(const char * name, int64_t start_us, uint32_t iterations);
+#if CONFIG_IDF_TARGET_LINUX
+static void cli_stdin_task(void * arg);
+#endif
+
+esp_err_t cli_init(void)
+{
+
+    inject_args.event = arg_int1(NULL, NULL, "<event>", "AppEvent_t value");
+    inject_args.count = arg_int0("n", "count", "<n>", "Number of events, 1 by default");
+    inject_args.rate = arg_int0("r", "rate", "<hz>", "Events per second, 10 by default, at most the tick rate");
+    inject_args.end = arg_end(3);
+
+    bench_args.iterations = arg_int0("n", "iterations", "<n>", "Iterations per benchmark");
+    bench_args.end = arg_end(1);
+
+    history_args.matches = arg_int0(NULL, NULL, "<matches>", "Number of matches, 1 by default");
+    history_args.from = arg_int0("f", "from", "<match>", "First match number, the most recent matches by default");
+    history_args.control_point = arg_int0("c", "cp", "<index>", "Only the matches played as this control point, 0 for ALPHA");
+    history_args.end = arg_end(3);
+
+    hang_args.task = arg_str1(NULL, NULL, "<task>", "Supervised task: button or app");
+    hang_args.end = arg_end(1);
+
+    wifi_args.reconnect = arg_lit0("r", "reconnect", "Drop the connection first, run again for the time");
+    wifi_args.end = arg_end(1);
+
+    const esp_console_cmd_t commands[] =
+    {
+        { .command = "status", .help = "Print the app state, hold times and points", .func = cli_status },
+        { .command = "stats", .help = "Print the event channel latencies, queue and pool usage", .func = cli_stats },
+        { .command = "health", .help = "Print the last health sample: stacks, heap, queues, loop time", .func = cli_health },
+        { .command = "faults", .help = "Print the persisted fault log and the masked buttons", .func = cli_faults },
+        { .command = "inject", .help = "Send synthetic events to the app task", .func = cli_inject, .argtable = &inject_args },
+        { .command = "bench", .help = "Time the button, scoring and pool hot paths", .func = cli_bench, .argtable = &bench_args },
+        { .command = "history", .help = "Print the last matches, or those from a match number, as HIST: lines", .func = cli_history, .argtable = &history_args },
+        { .command = "liveness", .help = "Print the supervised tasks and their check-in gaps", .func = cli_liveness },
+        { .command = "hang", .help = "Hang a supervised task to test the watchdog: the node resets", .func = cli_hang, .argtable = &hang_args },
+        { .command = "sync", .help = "Print the master clock offset and the scheduled start or end", .func = cli_sync },
+        { .command = "wifi", .help = "Print the reconnection times, radio wake-ups per hour and link to the master", .func = cli_wifi, .argtable = &wifi_args },
+#if CONFIG_DOMINION_DISPLAY
+        { .command = "display", .help = "Print the bytes sent to the OLED per refresh", .func = cli_display },
+#endif
+    };
+
+#if CONFIG_IDF_TARGET_LINUX
+    esp_console_config_t console_config = ESP_CONSOLE_CONFIG_DEFAULT();
+    esp_err_t ret = esp_console_init(&console_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_console_init: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#else
+    esp_console_repl_t * repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    repl_config.prompt = "node>";
+    repl_config.task_stack_size = CLI_TASK_STACK_DEPTH;
+    repl_config.task_priority = CLI_TASK_PRIORITY;
+
+    esp_err_t ret = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_console_new_repl_uart: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#endif
+
+    ret = esp_console_register_help_command();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_console_register_help_command: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        ret = esp_console_cmd_register(&commands[i]);
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error registering command %s: %s", commands[i].command, esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+#if CONFIG_IDF_TARGET_LINUX
+    if(pdPASS != xTaskCreate(cli_stdin_task, "cli", CLI_TASK_STACK_DEPTH, NULL, CLI_TASK_PRIORITY, NULL))
+    {
+        ESP_LOGE(__func__, "Error creating cli task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+#else
+    return esp_console_start_repl(repl);
+#endif
+
+}
+
+static int cli_status(int argc, char ** argv)
+{
+
+    AppStatus_t status;
+    app_get_status(&status);
+
+    AppState_t state = status.state;
+    printf("state %s, control point %d, owner %d, captures %u, %" PRIu32 "s left (snapshot %" PRIu32 ")\n",
+           state < sizeof(cli_state_names) / sizeof(cli_state_names[0]) ? cli_state_names[state] : "?",
+           status.control_point, status.owner, status.captures, status.time_left_s, status.seq);
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        printf("%-6s %6" PRIu32 "s held %8" PRIu32 " points\n", teams[team].name, status.seconds[team], status.points[team]);
+    }
+
+    return 0;
+
+}
+
+static int cli_stats(int argc, char ** argv)
+{
+
+    static const char * const prio_names[APP_EVENT_PRIO_MAX] = { "control", "network" };
+
+    AppEventStats_t stats;
+    app_event_get_stats(&stats);
+
+    for(int prio = 0; prio < APP_EVENT_PRIO_MAX; prio++)
+    {
+        printf("%-7s sent %" PRIu32 ", dropped %" PRIu32 ", queue high water %" PRIu32 ", max latency %" PRIu32 " ms\n",
+               prio_names[prio], stats.sent[prio], stats.dropped[prio], stats.high_water[prio], stats.max_latency_ms[prio]);
+
+        // One column per bucket, labelled with its upper bound
+        printf("        latency <=");
+        for(int bucket = 0; bucket < APP_EVENT_LATENCY_BUCKETS - 1; bucket++)
+        {
+            printf(" %6" PRIu32 "ms", (uint32_t)pdTICKS_TO_MS((1 << bucket) - 1));
+        }
+        printf("   longer\n                  ");
+        for(int bucket = 0; bucket < APP_EVENT_LATENCY_BUCKETS; bucket++)
+        {
+            printf(" %8" PRIu32, stats.latency_hist[prio][bucket]);
+        }
+        printf("\n");
+    }
+    printf("coalesced %" PRIu32 "\n", stats.coalesced);
+
+    PoolStats_t pool;
+    pool_get_stats(&app_payload_pool, &pool);
+    printf("payload pool %u/%u used, high water %u, alloc failures %" PRIu32 "\n",
+           pool.used, pool.block_count, pool.high_water, pool.alloc_failures);
+
+    printf("button events dropped %" PRIu32 "\n", button_get_dropped_events());
+
+    return 0;
+
+}
+
+static int cli_health(int argc, char ** argv)
+{
+
+    HealthReport_t report;
+    health_get_report(&report);
+
+    printf("sample %" PRIu32 " at %" PRIu32 "s, warnings 0x%02" PRIx32 "\n", report.samples, report.uptime_s, report.warnings);
+    printf("heap free %" PRIu32 ", minimum %" PRIu32 ", largest block %" PRIu32 "\n",
+           report.heap_free, report.heap_min_free, report.heap_largest_block);
+
+    printf("stack never used (bytes):\n");
+    for(int i = 0; i < report.task_count; i++)
+    {
+        if(report.tasks[i].stack_free != UINT32_MAX)
+            printf("  %-12s %" PRIu32 "\n", report.tasks[i].name, report.tasks[i].stack_free);
+    }
+
+    printf("queue peaks %" PRIu32 "/%d control, %" PRIu32 "/%d network, pool peak %u/%d\n",
+           report.queue_high_water[APP_EVENT_PRIO_CONTROL], APP_EVENT_QUEUE_LEN_CONTROL,
+           report.queue_high_water[APP_EVENT_PRIO_NETWORK], APP_EVENT_QUEUE_LEN_NETWORK,
+           report.pool_high_water, APP_PAYLOAD_BLOCK_COUNT);
+    printf("app loop %" PRIu32 " us last period, %" PRIu32 " us peak, button isr %" PRIu32 "\n",
+           report.loop_max_us, report.loop_peak_us, report.button_isr_count);
+    if(report.battery_mv)
+        printf("battery %u mV, %u%%\n", report.battery_mv, report.battery_pct);
+
+    return 0;
+
+}
+
+static int cli_faults(int argc, char ** argv)
+{
+
+    FaultLog_t log;
+    fault_get_log(&log);
+
+    printf("%" PRIu32 " faults logged%s, masked buttons 0x%02" PRIx32 "\n",
+           log.count, fault_is_degraded() ? ", degraded boot" : "", button_get_masked());
+
+    // Oldest first
+    uint32_t kept = log.count < FAULT_LOG_LEN ? log.count : FAULT_LOG_LEN;
+    for(uint32_t i = log.count - kept; i < log.count; i++)
+    {
+        const FaultRecord_t * record = &log.records[i % FAULT_LOG_LEN];
+        printf("#%" PRIu32 " %s detail %d at %" PRIu32 " ms, state %d, recovered in %" PRIu32 " ms, backtrace",
+               i + 1, app_error_to_string(record->code), record->detail, record->uptime_ms, record->state, record->recovery_ms);
+        for(int frame = 0; frame < FAULT_BACKTRACE_DEPTH && record->backtrace[frame]; frame++)
+        {
+            printf(" 0x%08" PRIx32, record->backtrace[frame]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+
+}
+
+static int cli_inject(int argc, char ** argv)
+{
+
+    if(arg_parse(argc, argv, (void **)&inject_args) != 0)
+    {
+        arg_print_errors(stderr, inject_args.end, argv[0]);
+        return 1;
+    }
+
+    int event = inject_args.event->ival[0];
+    int count = inject_args.count->count ? inject_args.count->ival[0] : 1;
+    int rate = inject_args.rate->count ? inject_args.rate->ival[0] : 10;
+
+    // One event per tick at most: a faster rate would be paced at the tick rate
+    if(event < 0 || event >= APP_EVENT_MAX || count < 1 || count > CLI_INJECT_MAX_COUNT || rate < 1 || rate > configTICK_RATE_HZ)
+    {
+        printf("event 0-%d, count 1-%d, rate 1-%d\n", APP_EVENT_MAX - 1, CLI_INJECT_MAX_COUNT, configTICK_RATE_HZ);
+        return 1;
+    }
+
+    TickType_t period = configTICK_RATE_HZ / rate;
+
+    int dropped = 0;
+    TickType_t wake = xTaskGetTickCount();
+
+    for(int i = 0; i < count; i++)
+    {
+        // Never wait: a full queue is what the injection is meant to show
+        AppEventMessage_t message = { .type = (AppEvent_t)event };
+        if(ESP_OK != app_event_send(&message, 0))
+        {
+            dropped++;
+        }
+
+        if(i + 1 < count)
+        {
+            vTaskDelayUntil(&wake, period);
+        }
+    }
+
+    printf("injected %d x event %d, %d dropped\n", count - dropped, event, dropped);
+
+    return 0;
+
+}
+
+static int cli_bench(int argc, char ** argv)
+{
+
+    if(arg_parse(argc, argv, (void **)&bench_args) != 0)
+    {
+        arg_print_errors(stderr, bench_args.end, argv[0]);
+        return 1;
+    }
+
+    int count = bench_args.iterations->count ? bench_args.iterations->ival[0] : CLI_BENCH_ITERATIONS;
+    if(count < 1 || count > CLI_BENCH_MAX_ITERATIONS)
+    {
+        printf("iterations 1-%d\n", CLI_BENCH_MAX_ITERATIONS);
+        return 1;
+    }
+    uint32_t iterations = (uint32_t)count;
+
+    // Results go through a volatile so the loops are not optimized out
+    volatile uint32_t sink = 0;
+    int64_t start;
+
+    start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        sink += button_classify(BTN_TEAM_EVENT(i % TEAM_COUNT), i % 4000);
+    }
+    cli_bench_report("button_classify", start, iterations);
+
+    start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        sink += app_event_priority((AppEvent_t)(i % APP_EVENT_MAX));
+    }
+    cli_bench_report("app_event_priority", start, iterations);
+
+    ScoringEngine_t engine;
+    ScoringRules_t rules = SCORING_RULES_DEFAULT();
+    scoring_init(&engine, &rules, TEAM_COUNT, 0);
+    scoring_capture(&engine, TEAM_BLUE, 0);
+
+    start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        scoring_tick(&engine, (i + 1) * SCORING_TICK_MS);
+    }
+    cli_bench_report("scoring_tick", start, iterations);
+    sink += scoring_get_points(&engine, TEAM_BLUE);
+
+    start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        scoring_capture(&engine, i % TEAM_COUNT, (iterations + i) * SCORING_TICK_MS);
+    }
+    cli_bench_report("scoring_capture", start, iterations);
+
+    pool_init(&cli_bench_pool);
+
+    start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        PoolHandle_t handle = pool_alloc(&cli_bench_pool);
+        sink += handle;
+        pool_release(&cli_bench_pool, handle);
+    }
+    cli_bench_report("pool_alloc+release", start, iterations);
+
+    (void)sink;
+
+    return 0;
+
+}
+
+static int cli_history(int argc, char ** argv)
+{
+
+    if(arg_parse(argc, argv, (void **)&history_args) != 0)
+    {
+        arg_print_errors(stderr, history_args.end, argv[0]);
+        return 1;
+    }
+
+    int matches = history_args.matches->count ? history_args.matches->ival[0] : 1;
+    int from = history_args.from->count ? history_args.from->ival[0] : 0;
+    int control_point = history_args.control_point->count ? history_args.control_point->ival[0] : HISTORY_ANY_CONTROL_POINT;
+    if(matches < 1 || matches > UINT8_MAX || from < 0 || control_point < 0 || (control_point >= CONTROL_POINT_MAX && control_point != HISTORY_ANY_CONTROL_POINT))
+    {
+        printf("matches 1-%d, control point 0-%d or %d for all\n", UINT8_MAX, CONTROL_POINT_MAX - 1, HISTORY_ANY_CONTROL_POINT);
+        return 1;
+    }
+
+    esp_err_t ret = history_export_uart(from, matches, control_point);
+    if(ESP_OK != ret)
+    {
+        printf("history export failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+
+    return 0;
+
+}
+
+static int cli_liveness(int argc, char ** argv)
+{
+
+    SupervisorTask_t tasks[SUPERVISOR_MAX_TASKS];
+    size_t count = supervisor_get_tasks(tasks, SUPERVISOR_MAX_TASKS);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        printf("%-8s deadline %5" PRIu32 " ms, last check-in %5" PRIu32 " ms ago, longest gap %5" PRIu32 " ms\n",
+               tasks[i].name, tasks[i].deadline_ms, tasks[i].since_checkin_ms, tasks[i].max_gap_ms);
+    }
+
+    return 0;
+
+}
+
+static int cli_hang(int argc, char ** argv)
+{
+
+    if(arg_parse(argc, argv, (void **)&hang_args) != 0)
+    {
+        arg_print_errors(stderr, hang_args.end, argv[0]);
+        return 1;
+    }
+
+    esp_err_t ret = supervisor_inject_hang(hang_args.task->sval[0]);
+    if(ESP_OK != ret)
+    {
+        printf("no supervised task %s\n", hang_args.task->sval[0]);
+        return 1;
+    }
+
+    // The supervisor logs the detection time, "faults" the recovery time after the reset
+    printf("%s hangs at its next check-in\n", hang_args.task->sval[0]);
+
+    return 0;
+
+}
+
+static int cli_wifi(int argc, char ** argv)
+{
+
+    if(arg_parse(argc, argv, (void **)&wifi_args) != 0)
+    {
+        arg_print_errors(stderr, wifi_args.end, argv[0]);
+        return 1;
+    }
+
+    if(wifi_args.reconnect->count > 0)
+    {
+        esp_err_t ret = network_wifi_reconnect();
+        if(ESP_OK != ret)
+        {
+            printf("cannot drop the connection: %s\n", esp_err_to_name(ret));
+            return 1;
+        }
+        printf("reconnecting\n");
+        return 0;
+    }
+
+    NetworkWifiStats_t stats;
+    network_get_wifi_stats(&stats);
+
+    printf("%" PRIu32 " connections, %" PRIu32 " to the cached access point, %" PRIu32 " cache misses, channel %u\n",
+           stats.connects, stats.fast_connects, stats.cache_misses, stats.channel);
+    printf("connection time: last %" PRIu32 " ms, average %" PRIu32 " ms, max %" PRIu32 " ms\n",
+           stats.last_connect_ms, stats.connects ? stats.total_connect_ms / stats.connects : 0, stats.max_connect_ms);
+
+    // Radio-on time itself takes a current probe: these are the wake-ups the firmware causes
+    int64_t uptime_s = esp_timer_get_time() / 1000000;
+    if(uptime_s > 0)
+    {
+        printf("modem sleep %s: %" PRId64 " frames/h, %" PRId64 " held for a beacon/h, beacons every %u TU%s\n",
+               stats.modem_sleep ? "on" : "off", (int64_t)stats.tx_frames * 3600 / uptime_s,
+               (int64_t)stats.tx_windows * 3600 / uptime_s,
+               stats.beacon_interval_tu ? stats.beacon_interval_tu : NETWORK_BEACON_INTERVAL_TU,
+               stats.beacon_interval_tu ? "" : " (not heard yet)");
+    }
+
+    LinkStats_t link;
+    link_get_stats(&link);
+
+    printf("master link: %d dBm, ", link.rssi);
+    if(link.loss_pct == LINK_LOSS_UNKNOWN)
+        printf("no ack yet, ");
+    else
+        printf("%u%% loss, %u ms round trip, ", link.loss_pct, link.rtt_ms);
+    printf("status every %u ms (%" PRIu32 " sent, %" PRIu32 " acked, %" PRIu32 " lost)\n",
+           link.period_ms, link.sent, link.acked, link.lost);
+
+    return 0;
+
+}
+
+static int cli_sync(int argc, char ** argv)
+{
+
+    MatchSyncStats_t stats;
+    matchsync_get_stats(&stats);
+
+    if(!stats.synced)
+    {
+        printf("no master clock yet\n");
+        return 0;
+    }
+
+    printf("offset %" PRId64 " us over %" PRIu32 " heartbeats, last one %" PRId64 " us above the minimum delay\n",
+           stats.offset_us, stats.samples, stats.last_delay_us);
+    if(stats.pending >= 0)
+    {
+        printf("match %s in %" PRId64 " ms\n", stats.pending == MATCH_SCHEDULE_START ? "start" : "end", stats.pending_in_us / 1000);
+    }
+    printf("last scheduled action fired %" PRId64 " us late, %" PRIu32 " app events lost to a full queue\n",
+           stats.last_late_us, stats.send_failures);
+
+    return 0;
+
+}
+
+#if CONFIG_DOMINION_DISPLAY
+static int cli_display(int argc, char ** argv)
+{
+
+    DisplayStats_t stats;
+    display_get_stats(&stats);
+
+    printf("%" PRIu32 " refreshes, %" PRIu32 " flushes, %" PRIu32 " pages, %" PRIu32 " bytes, %" PRIu32 " bus errors\n",
+           stats.refreshes, stats.flushes, stats.pages, stats.bytes, stats.bus_errors);
+    printf("last flush %" PRIu32 " bytes, %" PRIu32 " bytes per flush on average, %d for a full frame\n",
+           stats.last_bytes, stats.flushes ? stats.bytes / stats.flushes : 0, DISPLAY_PAGES * (4 + 1 + DISPLAY_WIDTH));
+
+    return 0;
+
+}
+#endif
+
+static void cli_bench_report(const char * name, int64_t start_us, uint32_t iterations)
+{
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    printf("%-20s %8" PRIu32 " runs %10" PRId64 " ns/run\n", name, iterations, elapsed_us * 1000 / iterations);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+static void cli_stdin_task(void * arg)
+{
+
+    char line[256];
+
+    while(fgets(line, sizeof(line), stdin))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '\0')
+            continue;
+
+        int cmd_ret;
+        esp_err_t ret = esp_console_run(line, &cmd_ret);
+        if(ESP_ERR_NOT_FOUND == ret)
+        {
+            printf("unknown command: %s\n", line);
+        }
+        else if(ESP_OK == ret && cmd_ret != 0)
+        {
+            printf("command returned %d\n", cmd_ret);
+        }
+    }
+
+    vTaskDelete(NULL);
+
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "esp_err.h"
+
+/**
+ * @file cli.h
+ * @brief Serial command console for querying and exercising a running node.
+ *
+ * An esp_console REPL on the console UART with commands to dump the app
+ * status, the event channel and pool statistics, the health sample, to
+ * inject synthetic app events at a given rate, to run microbenchmarks of
+ * the game path and to export the match history. Type "help" for the list.
+ *
+ * The REPL task runs at CLI_TASK_PRIORITY, below every task of the game
+ * path, and only reads their published state, so a busy console never
+ * delays a press. On the linux target the commands are read line by line
+ * from stdin instead, so a host run can be scripted with a pipe.
+ */
+
+/**
+ * @brief Register the commands and start the console task.
+ *
+ * Call once the app task is running, the injected events go to its channel.
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t cli_init(void);
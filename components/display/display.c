@@ -0,0 +1,364 @@
+#include "stdio.h"
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "driver/i2c_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "display.h"
+#include "app.h"
+#include "storage.h"
+#include "config.h"
+
+#define DISPLAY_CONTROL_CMD     0x00
+#define DISPLAY_CONTROL_DATA    0x40
+#define DISPLAY_GLYPH_WIDTH     5
+#define DISPLAY_CHAR_WIDTH      (DISPLAY_GLYPH_WIDTH + 1)
+#define DISPLAY_LINE_CHARS      (DISPLAY_WIDTH / DISPLAY_CHAR_WIDTH)
+#define DISPLAY_FIRST_GLYPH     ' '
+#define DISPLAY_LAST_GLYPH      'Z'
+
+#if CONFIG_DOMINION_DISPLAY_SH1106
+// 132 columns of RAM, the 128 visible ones centered
+#define DISPLAY_COLUMN_OFFSET   2
+#else
+#define DISPLAY_COLUMN_OFFSET   0
+#endif
+
+// Rows of the status screen
+#define DISPLAY_PAGE_HEADER     0
+#define DISPLAY_PAGE_TIME       2       // Double height: 2 and 3
+#define DISPLAY_PAGE_TEAMS      (DISPLAY_PAGES - TEAM_COUNT)
+
+_Static_assert(DISPLAY_PAGE_TEAMS > DISPLAY_PAGE_TIME + 1, "The team lines overlap the countdown");
+
+// 5x7 columns, LSB on top, from ' ' to 'Z': lowercase is drawn as uppercase
+static const uint8_t font5x7[][DISPLAY_GLYPH_WIDTH] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 }, // ' ' ! "
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, // # $ %
+    { 0x36, 0x49, 0x55, 0x22, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 }, { 0x00, 0x1C, 0x22, 0x41, 0x00 }, // & ' (
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 }, { 0x08, 0x2A, 0x1C, 0x2A, 0x08 }, { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // ) * +
+    { 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x60, 0x60, 0x00, 0x00 }, // , - .
+    { 0x20, 0x10, 0x08, 0x04, 0x02 }, { 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // / 0 1
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4B, 0x31 }, { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 2 3 4
+    { 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 5 6 7
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1E }, { 0x00, 0x36, 0x36, 0x00, 0x00 }, // 8 9 :
+    { 0x00, 0x56, 0x36, 0x00, 0x00 }, { 0x00, 0x08, 0x14, 0x22, 0x41 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, // ; < =
+    { 0x41, 0x22, 0x14, 0x08, 0x00 }, { 0x02, 0x01, 0x51, 0x09, 0x06 }, { 0x32, 0x49, 0x79, 0x41, 0x3E }, // > ? @
+    { 0x7E, 0x11, 0x11, 0x11, 0x7E }, { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // A B C
+    { 0x7F, 0x41, 0x41, 0x22, 0x1C }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, { 0x7F, 0x09, 0x09, 0x01, 0x01 }, // D E F
+    { 0x3E, 0x41, 0x41, 0x51, 0x32 }, { 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 }, // G H I
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 }, { 0x7F, 0x40, 0x40, 0x40, 0x40 }, // J K L
+    { 0x7F, 0x02, 0x04, 0x02, 0x7F }, { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // M N O
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, { 0x7F, 0x09, 0x19, 0x29, 0x46 }, // P Q R
+    { 0x46, 0x49, 0x49, 0x49, 0x31 }, { 0x01, 0x01, 0x7F, 0x01, 0x01 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // S T U
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x7F, 0x20, 0x18, 0x20, 0x7F }, { 0x63, 0x14, 0x08, 0x14, 0x63 }, // V W X
+    { 0x03, 0x04, 0x78, 0x04, 0x03 }, { 0x61, 0x51, 0x49, 0x45, 0x43 },                                   // Y Z
+};
+
+_Static_assert(sizeof(font5x7) / sizeof(font5x7[0]) == DISPLAY_LAST_GLYPH - DISPLAY_FIRST_GLYPH + 1, "Font table out of range");
+
+static const uint8_t display_init_commands[] =
+{
+    DISPLAY_CONTROL_CMD,
+    0xAE,               // Display off
+    0xD5, 0x80,         // Clock divider
+    0xA8, 0x3F,         // 64 rows
+    0xD3, 0x00,         // No vertical offset
+    0x40,               // Start line 0
+#if CONFIG_DOMINION_DISPLAY_SH1106
+    0xAD, 0x8B,         // DC-DC on
+#else
+    0x8D, 0x14,         // Charge pump on
+    0x20, 0x02,         // Page addressing, the SH1106 has no other
+#endif
+    0xA1,               // Column 127 on the left
+    0xC8,               // Row scan from the bottom
+    0xDA, 0x12,         // Alternative COM pins
+    0x81, 0xCF,         // Contrast
+    0xD9, 0xF1,         // Precharge
+    0xDB, 0x40,         // VCOMH level
+    0xA4,               // Show the RAM
+    0xA6,               // Not inverted
+    0xAF,               // Display on
+};
+
+// Owned by the display task alone, what the panel shows once flushed
+static uint8_t framebuffer[DISPLAY_PAGES][DISPLAY_WIDTH];
+// Columns changed since the last flush, [start, end), clean when start >= end
+static uint8_t dirty_start[DISPLAY_PAGES];
+static uint8_t dirty_end[DISPLAY_PAGES];
+
+static i2c_master_bus_handle_t display_bus = NULL;
+static i2c_master_dev_handle_t panel = NULL;
+
+static DisplayStats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void display_task(void * arg);
+static void display_render(const AppStatus_t * status);
+static void display_draw_line(uint8_t page, const char * text, uint8_t scale, bool center);
+static void display_put(uint8_t page, uint8_t col, uint8_t byte);
+static void display_flush(void);
+static const char * display_state_name(AppState_t state);
+
+esp_err_t display_init(void)
+{
+
+    i2c_master_bus_config_t bus_config =
+    {
+        .i2c_port = -1,
+        .sda_io_num = GPIO_I2C_SDA,
+        .scl_io_num = GPIO_I2C_SCL,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+
+    esp_err_t ret = i2c_new_master_bus(&bus_config, &display_bus);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling i2c_new_master_bus: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    i2c_device_config_t panel_config =
+    {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = DISPLAY_I2C_ADDR,
+        .scl_speed_hz = DISPLAY_I2C_FREQ_HZ,
+    };
+
+    ret = i2c_master_bus_add_device(display_bus, &panel_config, &panel);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling i2c_master_bus_add_device: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = i2c_master_transmit(panel, display_init_commands, sizeof(display_init_commands), DISPLAY_I2C_TIMEOUT_MS);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error initializing the panel: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // The panel RAM powers up with noise: the first flush clears all of it
+    for(int page = 0; page < DISPLAY_PAGES; page++)
+    {
+        dirty_start[page] = 0;
+        dirty_end[page] = DISPLAY_WIDTH;
+    }
+
+    BaseType_t task_error = xTaskCreate(display_task, "display", DISPLAY_TASK_STACK_DEPTH, NULL, DISPLAY_TASK_PRIORITY, NULL);
+    if(pdPASS != task_error)
+    {
+        ESP_LOGE(__func__, "Error creating the display task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+
+}
+
+void display_get_stats(DisplayStats_t * out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void display_task(void * arg)
+{
+
+    for(;;)
+    {
+
+        AppStatus_t status;
+        app_get_status(&status);
+
+        display_render(&status);
+        display_flush();
+
+        vTaskDelay(pdMS_TO_TICKS(DISPLAY_REFRESH_MS));
+
+    }
+
+}
+
+static void display_render(const AppStatus_t * status)
+{
+
+    char line[DISPLAY_LINE_CHARS + 1];
+
+    snprintf(line, sizeof(line), "%-15.15s%6s", control_point_to_string(status->control_point), display_state_name(status->state));
+    display_draw_line(DISPLAY_PAGE_HEADER, line, 1, false);
+
+    uint32_t left = status->time_left_s;
+    if(status->state != APP_STATE_RUNNING || left == 0)
+        snprintf(line, sizeof(line), "--:--");
+    else if(left >= 3600)
+        snprintf(line, sizeof(line), "%" PRIu32 ":%02" PRIu32 ":%02" PRIu32, left / 3600, left / 60 % 60, left % 60);
+    else
+        snprintf(line, sizeof(line), "%02" PRIu32 ":%02" PRIu32, left / 60, left % 60);
+    display_draw_line(DISPLAY_PAGE_TIME, line, 2, true);
+
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        uint32_t held = status->seconds[team];
+        snprintf(line, sizeof(line), "%c%-6s%4" PRIu32 ":%02" PRIu32 "%6" PRIu32,
+                 team == status->owner ? '*' : ' ', teams[team].name, held / 60 % 1000, held % 60, status->points[team] % 1000000);
+        display_draw_line(DISPLAY_PAGE_TEAMS + team, line, 1, false);
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.refreshes++;
+    portEXIT_CRITICAL(&stats_lock);
+
+}
+
+static void display_draw_line(uint8_t page, const char * text, uint8_t scale, bool center)
+{
+
+    // The whole row is redrawn, display_put() keeps the unchanged columns clean
+    uint8_t row[2][DISPLAY_WIDTH] = { 0 };
+
+    size_t length = strlen(text);
+    size_t width = length * DISPLAY_CHAR_WIDTH * scale;
+    size_t col = center && width < DISPLAY_WIDTH ? (DISPLAY_WIDTH - width) / 2 : 0;
+
+    for(size_t i = 0; i < length; i++)
+    {
+        char c = text[i];
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if(c < DISPLAY_FIRST_GLYPH || c > DISPLAY_LAST_GLYPH)
+            c = '?';
+
+        const uint8_t * glyph = font5x7[c - DISPLAY_FIRST_GLYPH];
+        for(int x = 0; x < DISPLAY_GLYPH_WIDTH; x++)
+        {
+            uint16_t column = glyph[x];
+            if(scale == 2)
+            {
+                // Every pixel doubled vertically, over two pages
+                uint16_t tall = 0;
+                for(int bit = 0; bit < 8; bit++)
+                {
+                    if(column & (1 << bit))
+                        tall |= 3 << (2 * bit);
+                }
+                column = tall;
+            }
+
+            for(int repeat = 0; repeat < scale && col < DISPLAY_WIDTH; repeat++, col++)
+            {
+                row[0][col] = column & 0xFF;
+                row[1][col] = column >> 8;
+            }
+        }
+        col += scale;
+        if(col >= DISPLAY_WIDTH)
+            break;
+    }
+
+    for(int part = 0; part < scale && page + part < DISPLAY_PAGES; part++)
+    {
+        for(int x = 0; x < DISPLAY_WIDTH; x++)
+        {
+            display_put(page + part, x, row[part][x]);
+        }
+    }
+
+}
+
+static void display_put(uint8_t page, uint8_t col, uint8_t byte)
+{
+
+    if(framebuffer[page][col] == byte)
+        return;
+
+    framebuffer[page][col] = byte;
+
+    if(dirty_start[page] >= dirty_end[page])
+    {
+        dirty_start[page] = col;
+        dirty_end[page] = col + 1;
+    }
+    else if(col < dirty_start[page])
+    {
+        dirty_start[page] = col;
+    }
+    else if(col >= dirty_end[page])
+    {
+        dirty_end[page] = col + 1;
+    }
+
+}
+
+static void display_flush(void)
+{
+
+    uint32_t bytes = 0;
+    uint32_t pages = 0;
+    esp_err_t ret = ESP_OK;
+
+    for(int page = 0; page < DISPLAY_PAGES && ESP_OK == ret; page++)
+    {
+        if(dirty_start[page] >= dirty_end[page])
+            continue;
+
+        // Page addressing: the column pointer moves on by itself after each byte
+        uint8_t col = dirty_start[page] + DISPLAY_COLUMN_OFFSET;
+        uint8_t length = dirty_end[page] - dirty_start[page];
+        uint8_t command[] = { DISPLAY_CONTROL_CMD, 0xB0 | page, col & 0x0F, 0x10 | (col >> 4) };
+        uint8_t data[1 + DISPLAY_WIDTH] = { DISPLAY_CONTROL_DATA };
+        memcpy(&data[1], &framebuffer[page][dirty_start[page]], length);
+
+        ret = i2c_master_transmit(panel, command, sizeof(command), DISPLAY_I2C_TIMEOUT_MS);
+        if(ESP_OK == ret)
+        {
+            ret = i2c_master_transmit(panel, data, 1 + length, DISPLAY_I2C_TIMEOUT_MS);
+        }
+
+        // A failed page stays dirty and goes again on the next refresh
+        if(ESP_OK == ret)
+        {
+            dirty_start[page] = dirty_end[page] = 0;
+            bytes += sizeof(command) + 1 + length;
+            pages++;
+        }
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    bool first_error = ESP_OK != ret && stats.bus_errors++ == 0;
+    if(bytes > 0)
+    {
+        stats.flushes++;
+        stats.pages += pages;
+        stats.bytes += bytes;
+        stats.last_bytes = bytes;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    // An unplugged panel fails every refresh: only the first one is logged
+    if(first_error)
+    {
+        ESP_LOGW(__func__, "Error writing to the panel: %s", esp_err_to_name(ret));
+    }
+
+}
+
+static const char * display_state_name(AppState_t state)
+{
+    switch(state)
+    {
+        case APP_STATE_INIT:        return "INIT";
+        case APP_STATE_IDLE:        return "READY";
+        case APP_STATE_RUNNING:     return "PLAY";
+        case APP_STATE_FINISHED:    return "END";
+        default:                    return "SETUP";
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "stdint.h"
+#include "esp_err.h"
+
+/**
+ * @file display.h
+ * @brief Status display on a 128x64 SSD1306 or SH1106 I2C OLED.
+ *
+ * The display task owns the panel and its framebuffer: every
+ * DISPLAY_REFRESH_MS it reads the status published by the app task, draws
+ * the control point, the state, the time left and each team's hold time and
+ * points into the framebuffer, and pushes to the panel only the columns of
+ * each page that changed. The app task never touches the bus.
+ *
+ * A typical second of play changes the countdown and one team line: about
+ * 100 bytes go over the bus instead of the 1064 of a full frame.
+ */
+
+#define DISPLAY_WIDTH   128
+#define DISPLAY_PAGES   8       // 8 pixel rows each
+
+typedef struct
+{
+    uint32_t refreshes;         // Status redraws
+    uint32_t flushes;           // Redraws that changed something
+    uint32_t pages;             // Page segments sent
+    uint32_t bytes;             // Command and data bytes sent, I2C addressing excluded
+    uint32_t last_bytes;        // Bytes of the last flush
+    uint32_t bus_errors;
+} DisplayStats_t;
+
+/**
+ * @brief Set up the I2C bus and the panel and start the display task.
+ *
+ * @return ESP_OK on success, error code of the I2C driver otherwise.
+ */
+esp_err_t display_init(void);
+
+/**
+ * @brief Get the transfer counters.
+ *
+ * @param stats Filled with the counters.
+ */
+void display_get_stats(DisplayStats_t * stats);
@@ -1,9 +1,65 @@
 #include "error_signaling.h"
+#include "string.h"
+#include "inttypes.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
-#include "stdbool.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "esp_debug_helpers.h"
+#endif
 #include "leds.h"
+#include "storage.h"
+#include "config.h"
+
+#define FAULT_RTC_MAGIC         0x464C5432
+#define FAULT_PENDING_MAX       4
+#define FAULT_BACKTRACE_SKIP    2       // fault_backtrace() and fault_record()
+
+typedef struct
+{
+    led_t first;
+    led_t second;
+    uint16_t half_period_ms;
+    bool alternate;             // One LED on at a time, else both together
+} FaultPattern_t;
+
+// Kept across software resets: survives the fault reboot, not a power cycle
+typedef struct
+{
+    uint32_t magic;
+    uint32_t reboots;               // Fault reboots in a row
+    uint32_t fault_to_reboot_ms;    // Time the last fatal fault was shown before rebooting
+    uint8_t code;                   // App_error_t of the last fatal fault
+    uint8_t pending_count;
+    FaultRecord_t pending[FAULT_PENDING_MAX];   // Raised before NVS was up, the first ones kept
+} FaultRebootState_t;
+
+// Team_t order
+static RTC_NOINIT_ATTR FaultRebootState_t reboot_state;
+static bool reboot_checked = false;
+static bool degraded = false;
+static bool recovering = false;
+
+static FaultLog_t fault_log;
+static bool log_loaded = false;
+static portMUX_TYPE fault_lock = portMUX_INITIALIZER_UNLOCKED;
+static FaultStateSource_t state_source = NULL;
+
+static esp_timer_handle_t pattern_timer = NULL;
+static FaultPattern_t pattern;
+static bool pattern_phase = false;
+static int64_t pattern_end_us = 0;
+
+static void fault_check_reboot(void);
+static void fault_persist(void);
+static void fault_backtrace(uint32_t * pcs);
+static void pattern_show(FaultPattern_t next, uint32_t duration_ms);
+static void pattern_timer_callback(void * arg);
 
 const char * app_error_to_string(App_error_t error)
 {
@@ -14,7 +70,19 @@ const char * app_error_to_string(App_error_t error)
             return "INITIALIZATION ERROR";
             break;
         }
-    
+
+        case BUTTON_ERROR:
+        {
+            return "BUTTON ERROR";
+            break;
+        }
+
+        case WATCHDOG_ERROR:
+        {
+            return "WATCHDOG ERROR";
+            break;
+        }
+
         default:
         {
             return "UNKNOWN ERROR";
@@ -25,70 +93,360 @@ const char * app_error_to_string(App_error_t error)
 
 }
 
-_Noreturn void signal_fatal_error(App_error_t error)
+esp_err_t fault_init(void)
 {
-    
-    ESP_LOGE(__func__, "A fatal error occurred: %s", app_error_to_string(error));
+
+    fault_check_reboot();
+
+    FaultLog_t stored = { 0 };
+    esp_err_t err = storage_get_fault_log(&stored, sizeof(stored));
+    if (ESP_OK != err && ESP_ERR_NVS_NOT_FOUND != err)
+    {
+        ESP_LOGE(__func__, "Error calling storage_get_fault_log: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Faults carried over a reboot or raised before NVS was up
+    portENTER_CRITICAL(&fault_lock);
+    fault_log = stored;
+    for (int i = 0; i < reboot_state.pending_count; i++)
+    {
+        fault_log.records[fault_log.count++ % FAULT_LOG_LEN] = reboot_state.pending[i];
+    }
+    bool changed = reboot_state.pending_count > 0;
+    reboot_state.pending_count = 0;
+    log_loaded = true;
+    portEXIT_CRITICAL(&fault_lock);
+
+    if (changed)
+    {
+        fault_persist();
+    }
+
+    if (fault_log.count > 0)
+    {
+        const FaultRecord_t * last = &fault_log.records[(fault_log.count - 1) % FAULT_LOG_LEN];
+        ESP_LOGI(__func__, "%" PRIu32 " faults logged, last: %s at %" PRIu32 " ms", fault_log.count,
+                 app_error_to_string(last->code), last->uptime_ms);
+    }
+
+    if (degraded)
+    {
+        ESP_LOGW(__func__, "Degraded boot after %s (%" PRIu32 " fault reboots in a row)",
+                 app_error_to_string(reboot_state.code), reboot_state.reboots);
+    }
+
+    return ESP_OK;
+
+}
+
+bool fault_is_degraded(void)
+{
+    return degraded;
+}
+
+void fault_set_state_source(FaultStateSource_t source)
+{
+    state_source = source;
+}
+
+void fault_record(App_error_t error, uint8_t detail)
+{
+
+    FaultRecord_t record =
+    {
+        .code = error,
+        .detail = detail,
+        .state = state_source ? state_source() : -1,
+        .uptime_ms = (uint32_t)(esp_timer_get_time() / 1000),
+    };
+    fault_backtrace(record.backtrace);
+
+    ESP_LOGE(__func__, "FAULT %s (%d) at %" PRIu32 " ms, state %d, backtrace 0x%08" PRIx32 " 0x%08" PRIx32,
+             app_error_to_string(error), detail, record.uptime_ms, record.state, record.backtrace[0], record.backtrace[1]);
+
+    fault_check_reboot();
+
+    portENTER_CRITICAL(&fault_lock);
+    bool loaded = log_loaded;
+    if (loaded)
+    {
+        fault_log.records[fault_log.count++ % FAULT_LOG_LEN] = record;
+    }
+    else if (reboot_state.pending_count < FAULT_PENDING_MAX)
+    {
+        // RTC memory: still there for fault_init() after a fault reboot
+        reboot_state.pending[reboot_state.pending_count++] = record;
+    }
+    portEXIT_CRITICAL(&fault_lock);
+
+    if (loaded)
+    {
+        fault_persist();
+    }
+
+}
+
+void fault_recovered(App_error_t error, uint32_t recovery_ms)
+{
+
+    bool found = false;
+
+    portENTER_CRITICAL(&fault_lock);
+    uint32_t kept = fault_log.count < FAULT_LOG_LEN ? fault_log.count : FAULT_LOG_LEN;
+    for (uint32_t i = 1; i <= kept && !found; i++)
+    {
+        FaultRecord_t * record = &fault_log.records[(fault_log.count - i) % FAULT_LOG_LEN];
+        if (record->code == error && record->recovery_ms == 0)
+        {
+            record->recovery_ms = recovery_ms ? recovery_ms : 1;
+            found = true;
+        }
+    }
+    bool loaded = log_loaded;
+    portEXIT_CRITICAL(&fault_lock);
+
+    ESP_LOGW(__func__, "Recovered from %s in %" PRIu32 " ms", app_error_to_string(error), recovery_ms);
+
+    if (found && loaded)
+    {
+        fault_persist();
+    }
+
+}
+
+void fault_mark_running(void)
+{
+
+    if (!recovering)
+        return;
+
+    recovering = false;
+
+    // The ROM and the bootloader run before esp_timer starts: a few hundred ms are missing
+    uint32_t boot_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    fault_recovered(reboot_state.code, reboot_state.fault_to_reboot_ms + boot_ms);
+
+    reboot_state.reboots = 0;
+
+}
+
+void fault_expect_reset(App_error_t error, uint32_t reset_in_ms)
+{
+
+    fault_check_reboot();
+
+    reboot_state.magic = FAULT_RTC_MAGIC;
+    reboot_state.reboots++;
+    reboot_state.code = error;
+    reboot_state.fault_to_reboot_ms = reset_in_ms;
+
+}
+
+void fault_get_log(FaultLog_t * log)
+{
+    portENTER_CRITICAL(&fault_lock);
+    *log = fault_log;
+    portEXIT_CRITICAL(&fault_lock);
+}
+
+void fault_show(App_error_t error, uint8_t detail, uint32_t duration_ms)
+{
+
+    FaultPattern_t next;
 
     switch (error)
     {
-        
         case INIT_ERROR:
         {
-            
-            turn_all_leds_off();
-
-            while(true)
-            {
-                turn_led_on(RED_LED);
-                turn_led_off(BLUE_LED);
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                turn_led_on(BLUE_LED);
-                turn_led_off(RED_LED);
-                vTaskDelay(pdMS_TO_TICKS(1000));
-            }
-            
+            next = (FaultPattern_t){ .first = RED_LED, .second = BLUE_LED, .half_period_ms = 1000, .alternate = true };
             break;
-        
         }
 
         case BUTTON_ERROR:
         {
-            
-            turn_all_leds_off();
+            // The LED of the stuck button alone, so the field staff know which one
+            led_t led = detail < TEAM_COUNT ? team_leds[detail] : RED_LED;
+            next = (FaultPattern_t){ .first = led, .second = detail < TEAM_COUNT ? led : BLUE_LED, .half_period_ms = 100, .alternate = false };
+            break;
+        }
 
-            while(true)
-            {
-                turn_led_on(RED_LED);
-                turn_led_on(BLUE_LED);
-                vTaskDelay(pdMS_TO_TICKS(100));
-                turn_led_off(BLUE_LED);
-                turn_led_off(RED_LED);
-                vTaskDelay(pdMS_TO_TICKS(100));
-            }
-            
+        default:
+        {
+            next = (FaultPattern_t){ .first = RED_LED, .second = BLUE_LED, .half_period_ms = 3000, .alternate = true };
             break;
-        
         }
+    }
+
+    pattern_show(next, duration_ms);
+
+}
+
+void signal_blink(led_t led, uint16_t half_period_ms, uint32_t duration_ms)
+{
+    pattern_show((FaultPattern_t){ .first = led, .second = led, .half_period_ms = half_period_ms, .alternate = false }, duration_ms);
+}
+
+_Noreturn void signal_fatal_error(App_error_t error)
+{
     
-        default:
+    ESP_LOGE(__func__, "A fatal error occurred: %s", app_error_to_string(error));
+
+    fault_check_reboot();
+
+    int64_t fault_us = esp_timer_get_time();
+
+    fault_record(error, FAULT_DETAIL_NONE);
+    fault_show(error, FAULT_DETAIL_NONE, 0);
+
+    if (reboot_state.magic == FAULT_RTC_MAGIC && reboot_state.reboots >= FAULT_MAX_REBOOTS)
+    {
+        ESP_LOGE(__func__, "%" PRIu32 " fault reboots in a row, giving up", reboot_state.reboots);
+
+        // The pattern runs on esp_timer, this task has nothing left to do
+        while (true)
         {
-            turn_all_leds_off();
+            vTaskSuspend(NULL);
+        }
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(FAULT_REBOOT_DELAY_MS));
+
+    reboot_state.magic = FAULT_RTC_MAGIC;
+    reboot_state.reboots++;
+    reboot_state.code = error;
+    reboot_state.fault_to_reboot_ms = (uint32_t)((esp_timer_get_time() - fault_us) / 1000);
+
+    esp_restart();
+
+}
+
+static void fault_check_reboot(void)
+{
+
+    if (reboot_checked)
+        return;
+
+    reboot_checked = true;
+
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    // RTC memory holds garbage after a power cycle. A reset that is not
+    // ours (OTA, console, a crash) leaves reboots at 0: no fault reboot
+    bool fault_reason = reason == ESP_RST_SW || reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_PANIC;
+    if (reboot_state.magic != FAULT_RTC_MAGIC || !fault_reason)
+    {
+        uint8_t pending_count = reboot_state.magic == FAULT_RTC_MAGIC ? reboot_state.pending_count : 0;
+        reboot_state.magic = FAULT_RTC_MAGIC;
+        reboot_state.reboots = 0;
+        reboot_state.pending_count = pending_count <= FAULT_PENDING_MAX ? pending_count : 0;
+        return;
+    }
+
+    degraded = reboot_state.reboots > 0;
+    recovering = degraded;
 
-            while(true)
+}
+
+static void fault_persist(void)
+{
+
+    FaultLog_t copy;
+    fault_get_log(&copy);
+
+    esp_err_t err = storage_set_fault_log(&copy, sizeof(copy));
+    if (ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error calling storage_set_fault_log: %s", esp_err_to_name(err));
+    }
+
+}
+
+static void __attribute__((noinline)) fault_backtrace(uint32_t * pcs)
+{
+
+    memset(pcs, 0, FAULT_BACKTRACE_DEPTH * sizeof(uint32_t));
+
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    esp_backtrace_frame_t frame;
+    esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+
+    for (int i = 0; i < FAULT_BACKTRACE_SKIP + FAULT_BACKTRACE_DEPTH; i++)
+    {
+        if (i >= FAULT_BACKTRACE_SKIP)
+        {
+            // Windowed return address to call site, as esp_cpu_process_stack_pc()
+            uint32_t pc = frame.pc;
+            if (pc & 0x80000000)
             {
-                turn_led_on(RED_LED);
-                turn_led_off(BLUE_LED);
-                vTaskDelay(pdMS_TO_TICKS(3000));
-                turn_led_on(BLUE_LED);
-                turn_led_off(RED_LED);
-                vTaskDelay(pdMS_TO_TICKS(3000));
+                pc = (pc & 0x3fffffff) | 0x40000000;
             }
-            
+            pcs[i - FAULT_BACKTRACE_SKIP] = pc - 3;
+        }
+
+        if (frame.next_pc == 0 || !esp_backtrace_get_next_frame(&frame))
             break;
-        
+    }
+#endif
+
+}
+
+static void pattern_show(FaultPattern_t next, uint32_t duration_ms)
+{
+
+    if (!pattern_timer)
+    {
+        const esp_timer_create_args_t timer_args =
+        {
+            .callback = pattern_timer_callback,
+            .name = "fault_leds",
+        };
+
+        esp_err_t err = esp_timer_create(&timer_args, &pattern_timer);
+        if (ESP_OK != err)
+        {
+            ESP_LOGE(__func__, "Error calling esp_timer_create: %s", esp_err_to_name(err));
+            return;
         }
-    
     }
 
-}
\ No newline at end of file
+    esp_timer_stop(pattern_timer);
+
+    pattern = next;
+    pattern_phase = false;
+    pattern_end_us = duration_ms ? esp_timer_get_time() + (int64_t)duration_ms * 1000 : 0;
+
+    turn_all_leds_off();
+    pattern_timer_callback(NULL);
+
+    esp_timer_start_periodic(pattern_timer, (uint64_t)pattern.half_period_ms * 1000);
+
+}
+
+static void pattern_timer_callback(void * arg)
+{
+
+    if (pattern_end_us && esp_timer_get_time() >= pattern_end_us)
+    {
+        esp_timer_stop(pattern_timer);
+        turn_all_leds_off();
+        return;
+    }
+
+    pattern_phase = !pattern_phase;
+    bool second_on = pattern.alternate ? !pattern_phase : pattern_phase;
+
+    if (pattern_phase)
+        turn_led_on(pattern.first);
+    else
+        turn_led_off(pattern.first);
+
+    if (pattern.second != pattern.first)
+    {
+        if (second_on)
+            turn_led_on(pattern.second);
+        else
+            turn_led_off(pattern.second);
+    }
+
+}
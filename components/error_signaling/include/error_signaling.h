@@ -1,7 +1,156 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+#include "leds.h"
+
+/**
+ * @file error_signaling.h
+ * @brief Fault recording, LED fault patterns and recovery.
+ *
+ * Every fault is appended to a small log persisted in NVS, with its uptime,
+ * the app state and the caller's backtrace. Faults raised before NVS is up
+ * are kept in RAM and written by fault_init().
+ *
+ * A recoverable fault (a button stuck at boot) masks the faulty input and
+ * the node keeps playing with the rest. signal_fatal_error() shows the LED
+ * pattern for FAULT_REBOOT_DELAY_MS and reboots; the next boot is degraded:
+ * the network side failing to start no longer stops the node, which plays
+ * standalone. After FAULT_MAX_REBOOTS fault reboots in a row the node stops
+ * rebooting and only shows the pattern. Patterns run on an esp_timer, they
+ * never keep a CPU busy.
+ *
+ * A task watchdog reset announced with fault_expect_reset() counts as a
+ * fault reboot too.
+ *
+ * The time from each fault to the node playing again is measured and
+ * stored in its record.
+ */
+
+#define FAULT_LOG_LEN           8
+#define FAULT_BACKTRACE_DEPTH   4
+#define FAULT_DETAIL_NONE       0xFF
+
 typedef enum 
 {
     INIT_ERROR,
     BUTTON_ERROR,
+    WATCHDOG_ERROR,
+    APP_ERROR_MAX
 } App_error_t ;
 
-void signal_fatal_error(App_error_t error);
\ No newline at end of file
+typedef struct
+{
+    uint8_t code;                               // App_error_t
+    uint8_t detail;                             // Code specific (the team of a stuck button), FAULT_DETAIL_NONE if none
+    int8_t state;                               // App state when raised, -1 before the app task runs
+    uint8_t reserved;
+    uint32_t uptime_ms;
+    uint32_t recovery_ms;                       // Fault to playing again, 0 until recovered
+    uint32_t backtrace[FAULT_BACKTRACE_DEPTH];  // Caller first, 0 past the last frame
+} FaultRecord_t;
+
+typedef struct
+{
+    uint32_t count;                             // Faults ever logged, the last FAULT_LOG_LEN are kept
+    FaultRecord_t records[FAULT_LOG_LEN];       // Ring, the newest at (count - 1) % FAULT_LOG_LEN
+} FaultLog_t;
+
+/**
+ * @brief Returns the app state stored in the fault records.
+ */
+typedef int8_t (*FaultStateSource_t)(void);
+
+/**
+ * @brief Load the persisted fault log, write the faults raised so far and
+ * report the recovery from a fault reboot.
+ *
+ * Call once NVS is initialized.
+ *
+ * @return ESP_OK on success, error code of the NVS access otherwise.
+ */
+esp_err_t fault_init(void);
+
+/**
+ * @brief Tell whether this boot follows a fault reboot.
+ *
+ * @return true in degraded mode.
+ */
+bool fault_is_degraded(void);
+
+/**
+ * @brief Set where the fault records take the app state from.
+ *
+ * @param source State getter, NULL to record -1.
+ */
+void fault_set_state_source(FaultStateSource_t source);
+
+/**
+ * @brief Log a fault, persisting it when NVS is up. Not callable from ISRs.
+ *
+ * @param error Fault code.
+ * @param detail Code specific detail, FAULT_DETAIL_NONE if none.
+ */
+void fault_record(App_error_t error, uint8_t detail);
+
+/**
+ * @brief Store the time to recovery of the last fault with this code.
+ *
+ * @param error Fault code.
+ * @param recovery_ms Time from the fault to normal operation.
+ */
+void fault_recovered(App_error_t error, uint32_t recovery_ms);
+
+/**
+ * @brief Node is up and playing: stores the time to recovery of the fault
+ * reboot that led to this boot, if any.
+ */
+void fault_mark_running(void);
+
+/**
+ * @brief Announce a reset the caller cannot do itself, e.g. a starved task
+ * watchdog, so that the next boot is a degraded fault reboot.
+ *
+ * @param error Fault code, already recorded.
+ * @param reset_in_ms Expected time to the reset, counted in the time to recovery.
+ */
+void fault_expect_reset(App_error_t error, uint32_t reset_in_ms);
+
+/**
+ * @brief Get a copy of the fault log.
+ *
+ * @param log Filled with the log.
+ */
+void fault_get_log(FaultLog_t * log);
+
+/**
+ * @brief Show the LED pattern of a fault without blocking.
+ *
+ * @param error Fault code.
+ * @param detail Code specific detail: a stuck button blinks its team LED.
+ * @param duration_ms How long to show it, 0 until the next pattern or reboot.
+ */
+void fault_show(App_error_t error, uint8_t detail, uint32_t duration_ms);
+
+/**
+ * @brief Blink an LED on the timer of the fault patterns, for a notice that
+ * is not a fault (a low battery). Replaces the pattern shown.
+ *
+ * @param led LED to blink.
+ * @param half_period_ms Time on, then off.
+ * @param duration_ms How long to blink, 0 until the next pattern or reboot.
+ */
+void signal_blink(led_t led, uint16_t half_period_ms, uint32_t duration_ms);
+
+/**
+ * @brief Record a fatal fault, show its pattern and reboot into degraded mode.
+ *
+ * After FAULT_MAX_REBOOTS fault reboots in a row the calling task is
+ * suspended instead and the pattern stays on.
+ *
+ * @param error Fault code.
+ */
+_Noreturn void signal_fatal_error(App_error_t error);
+
+const char * app_error_to_string(App_error_t error);
@@ -0,0 +1,491 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "failover.h"
+#include "network.h"
+#include "storage.h"
+#include "app.h"
+#include "auth.h"
+#include "battery.h"
+#include "link.h"
+#include "matchsync.h"
+#include "scoring.h"
+#include "config.h"
+
+_Static_assert(TEAM_COUNT <= PROTOCOL_MAX_TEAMS, "Node status cannot carry every team");
+
+// Scoreboard entries per frame: a signed frame has to fit in ESP-NOW to cross the mesh
+#define SCOREBOARD_FRAME_ENTRIES    ((uint8_t)((PROTOCOL_ESPNOW_FRAME_LEN - sizeof(FrameHeader_t) - AUTH_TAG_LEN - sizeof(ScoreboardPayload_t)) / \
+                                               sizeof(ScoreboardEntry_t)))
+_Static_assert(SCOREBOARD_FRAME_ENTRIES >= 1, "A scoreboard entry does not fit in an ESP-NOW frame");
+
+typedef struct
+{
+    bool valid;
+    uint16_t node_id;
+    uint32_t seq;
+    TickType_t last_seen;
+    NodeStatusPayload_t status;
+    ScoringEngine_t scoring;    // The point scored again here, with the points each team holds
+} ReplicaEntry_t;
+
+// Indexed by control point, so the election is a scan for the first live entry
+static ReplicaEntry_t replica[CONTROL_POINT_MAX];
+static portMUX_TYPE replica_lock = portMUX_INITIALIZER_UNLOCKED;
+static ScoringRules_t field_rules;
+
+static volatile TickType_t last_master_tick = 0;
+static volatile bool standin = false;
+static volatile bool master_returned = false;
+static TickType_t standin_since = 0;
+
+static void master_heartbeat_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void node_status_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void scoreboard_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void replica_store(uint16_t node_id, uint32_t seq, TickType_t seen, const NodeStatusPayload_t * status);
+static uint16_t failover_elect(TickType_t now);
+static TickType_t replica_timeout(const NodeStatusPayload_t * status);
+static uint32_t replica_time(const ReplicaEntry_t * entry, TickType_t tick);
+static void replica_score(ReplicaEntry_t * entry, const NodeStatusPayload_t * previous, bool fresh);
+static void replica_set_rules(const ScoringRules_t * rules, TickType_t now);
+static void failover_send_scoreboard(MessageType_t type, uint16_t dst_node, TickType_t now);
+
+esp_err_t failover_init(void)
+{
+
+    last_master_tick = xTaskGetTickCount();
+    field_rules = SCORING_RULES_DEFAULT();
+
+    esp_err_t ret = network_register_handler(MSG_MASTER_HEARTBEAT, master_heartbeat_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_MASTER_HEARTBEAT handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = network_register_handler(MSG_NODE_STATUS, node_status_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_NODE_STATUS handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = network_register_handler(MSG_SCOREBOARD, scoreboard_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_SCOREBOARD handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return link_init();
+
+}
+
+bool failover_is_standin(void)
+{
+    return standin;
+}
+
+void failover_task(void* arg)
+{
+
+    uint16_t node_id = network_get_node_id();
+    NodeStatusPayload_t last_sent = { .control_point = CONTROL_POINT_NONE };
+    TickType_t last_status_tick = 0;
+    uint8_t handback_left = 0;
+
+    for(;;)
+    {
+
+        vTaskDelay(pdMS_TO_TICKS(FAILOVER_POLL_MS));
+
+        TickType_t now = xTaskGetTickCount();
+        uint32_t period_ms = link_get_period_ms();
+        bool period_elapsed = (now - last_status_tick) >= pdMS_TO_TICKS(period_ms);
+
+        AppStatus_t app_status;
+        app_get_status(&app_status);
+        replica_set_rules(&app_status.rules, now);
+
+        BatteryStatus_t battery;
+        battery_get(&battery);
+
+        LinkStats_t link;
+        link_get_stats(&link);
+
+        NodeStatusPayload_t status =
+        {
+            .control_point = app_status.control_point,
+            .state = app_status.state,
+            .owner = app_status.owner,
+            .captures = app_status.captures,
+            .team_count = TEAM_COUNT,
+            .battery_mv = battery.millivolts,
+            .battery_pct = battery.soc_pct,
+            .rssi = link.rssi,
+            .loss_pct = link.loss_pct,
+            .rtt_ms = link.rtt_ms,
+            .period_ms = period_ms,
+        };
+
+        for(int team = 0; team < TEAM_COUNT; team++)
+        {
+            status.seconds[team] = app_status.seconds[team];
+            status.points[team] = app_status.points[team];
+        }
+
+        // Captures go out right away, the rest rides on the periodic status
+        bool changed = status.control_point != last_sent.control_point || status.state != last_sent.state ||
+                       status.owner != last_sent.owner || status.captures != last_sent.captures;
+
+        // Nothing urgent: hold the periodic frames for the next beacon and send them together
+        if(period_elapsed && !changed)
+        {
+            network_wait_tx_window();
+        }
+
+        if(changed || period_elapsed)
+        {
+            uint32_t seq;
+            if(ESP_OK == network_send_seq(NODE_ID_BROADCAST, MSG_NODE_STATUS, &status, sizeof(status), &seq))
+            {
+                last_sent = status;
+                link_sent(seq, changed);
+            }
+
+            last_status_tick = now;
+            replica_store(node_id, 0, now, &status);
+        }
+
+        if(master_returned)
+        {
+            master_returned = false;
+            handback_left = FAILOVER_HANDBACK_REPEAT;
+        }
+
+        // The handback is idempotent, repeat it in case a frame gets lost
+        if(handback_left > 0 && period_elapsed)
+        {
+            failover_send_scoreboard(MSG_REPLICA_HANDBACK, NODE_ID_MASTER, now);
+            handback_left--;
+        }
+
+        bool master_lost = (now - last_master_tick) > pdMS_TO_TICKS(MASTER_HEARTBEAT_TIMEOUT_MS);
+        bool elected = master_lost && failover_elect(now) == node_id;
+
+        if(elected && !standin)
+        {
+            standin = true;
+            standin_since = now;
+            ESP_LOGW(__func__, "Master silent for %" PRIu32 " ms, standing in", (uint32_t)pdTICKS_TO_MS(now - last_master_tick));
+        }
+        else if(!elected && standin && master_lost)
+        {
+            // A node with a lower control point showed up: it has the same replica
+            standin = false;
+            ESP_LOGW(__func__, "Stepping down for node 0x%04x", failover_elect(now));
+        }
+
+        if(standin && period_elapsed)
+        {
+            failover_send_scoreboard(MSG_SCOREBOARD, NODE_ID_BROADCAST, now);
+        }
+
+    }
+
+}
+
+static uint16_t failover_elect(TickType_t now)
+{
+
+    uint16_t elected = NODE_ID_BROADCAST;
+
+    portENTER_CRITICAL(&replica_lock);
+    for(int i = 0; i < CONTROL_POINT_MAX; i++)
+    {
+        if(replica[i].valid && (now - replica[i].last_seen) <= replica_timeout(&replica[i].status))
+        {
+            elected = replica[i].node_id;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&replica_lock);
+
+    return elected;
+
+}
+
+static TickType_t replica_timeout(const NodeStatusPayload_t * status)
+{
+
+    // Nodes on a poor link send less often, they are not dead for it
+    uint32_t timeout_ms = (uint32_t)status->period_ms * NODE_STATUS_TIMEOUT_PERIODS;
+    return pdMS_TO_TICKS(timeout_ms > NODE_STATUS_TIMEOUT_MS ? timeout_ms : NODE_STATUS_TIMEOUT_MS);
+
+}
+
+static void replica_store(uint16_t node_id, uint32_t seq, TickType_t seen, const NodeStatusPayload_t * status)
+{
+
+    if(status->control_point <= CONTROL_POINT_NONE || status->control_point >= CONTROL_POINT_MAX)
+        return;
+
+    ReplicaEntry_t * entry = &replica[status->control_point];
+
+    portENTER_CRITICAL(&replica_lock);
+    // Statuses of the same node may arrive out of order over different paths
+    bool fresh = !entry->valid || entry->node_id != node_id;
+    if(fresh || seq >= entry->seq)
+    {
+        NodeStatusPayload_t previous = entry->status;
+        entry->valid = true;
+        entry->node_id = node_id;
+        entry->seq = seq;
+        entry->last_seen = seen;
+        entry->status = *status;
+        replica_score(entry, &previous, fresh);
+    }
+    portEXIT_CRITICAL(&replica_lock);
+
+}
+
+static uint32_t replica_time(const ReplicaEntry_t * entry, TickType_t tick)
+{
+
+    // Statuses are stamped by the network and the failover task: an engine
+    // never goes back in time, or the points would wrap
+    uint32_t now_ms = pdTICKS_TO_MS(tick);
+    return (int32_t)(now_ms - entry->scoring.last_update_ms) > 0 ? now_ms : entry->scoring.last_update_ms;
+
+}
+
+static void replica_score(ReplicaEntry_t * entry, const NodeStatusPayload_t * previous, bool fresh)
+{
+
+    const NodeStatusPayload_t * status = &entry->status;
+
+    // A new node or a new match: pick up the points the node scored so far
+    bool restarted = fresh || status->captures < previous->captures;
+    for(int team = 0; team < PROTOCOL_MAX_TEAMS; team++)
+    {
+        restarted = restarted || status->points[team] < previous->points[team];
+    }
+
+    int8_t owner = status->state == APP_STATE_RUNNING ? status->owner : TEAM_NONE;
+    uint32_t now_ms = pdTICKS_TO_MS(entry->last_seen);
+    ScoringEngine_t * engine = &entry->scoring;
+
+    if(restarted)
+    {
+        // The node already settled the capture it reports: no contest here
+        ScoringRules_t settled = field_rules;
+        settled.capture_delay_ms = 0;
+        scoring_init(engine, &settled, status->team_count, now_ms);
+        for(int team = 0; team < engine->team_count; team++)
+        {
+            scoring_set_points(engine, team, status->points[team], now_ms);
+        }
+        scoring_capture(engine, owner, now_ms);
+        scoring_set_rules(engine, &field_rules, now_ms);
+    }
+    else
+    {
+        now_ms = replica_time(entry, entry->last_seen);
+        int8_t target = engine->phase == SCORING_PHASE_CONTESTED ? engine->challenger : engine->owner;
+        if(owner == TEAM_NONE && engine->phase != SCORING_PHASE_NEUTRAL)
+            scoring_neutralize(engine, now_ms);
+        else if(owner != TEAM_NONE && owner != target)
+            scoring_capture(engine, owner, now_ms);
+        else
+            scoring_tick(engine, now_ms);
+    }
+
+    // The multi-point bonus: every point of the field scored at the rate of its holder
+    uint8_t held[SCORING_MAX_TEAMS] = { 0 };
+    for(int i = 0; i < CONTROL_POINT_MAX; i++)
+    {
+        const ScoringEngine_t * point = &replica[i].scoring;
+        if(replica[i].valid && point->phase == SCORING_PHASE_HELD && point->owner >= 0 && point->owner < SCORING_MAX_TEAMS)
+            held[point->owner]++;
+    }
+    for(int i = 0; i < CONTROL_POINT_MAX; i++)
+    {
+        if(!replica[i].valid)
+            continue;
+
+        for(int team = 0; team < replica[i].scoring.team_count; team++)
+        {
+            scoring_set_points_held(&replica[i].scoring, team, held[team], replica_time(&replica[i], entry->last_seen));
+        }
+    }
+
+}
+
+static void replica_set_rules(const ScoringRules_t * rules, TickType_t now)
+{
+
+    if(0 == memcmp(rules, &field_rules, sizeof(*rules)))
+        return;
+
+    portENTER_CRITICAL(&replica_lock);
+    field_rules = *rules;
+    for(int i = 0; i < CONTROL_POINT_MAX; i++)
+    {
+        if(replica[i].valid)
+            scoring_set_rules(&replica[i].scoring, rules, replica_time(&replica[i], now));
+    }
+    portEXIT_CRITICAL(&replica_lock);
+
+}
+
+static void failover_send_scoreboard(MessageType_t type, uint16_t dst_node, TickType_t now)
+{
+
+    ScoreboardEntry_t entries[CONTROL_POINT_MAX];
+    uint8_t entry_count = 0;
+    uint32_t seconds[PROTOCOL_MAX_TEAMS] = { 0 };
+    uint32_t points[PROTOCOL_MAX_TEAMS] = { 0 };
+
+    portENTER_CRITICAL(&replica_lock);
+    for(int i = 0; i < CONTROL_POINT_MAX; i++)
+    {
+        if(!replica[i].valid)
+            continue;
+
+        ScoreboardEntry_t * entry = &entries[entry_count++];
+        entry->node_id = replica[i].node_id;
+        entry->status = replica[i].status;
+        entry->age_ms = pdTICKS_TO_MS(now - replica[i].last_seen);
+
+        scoring_tick(&replica[i].scoring, replica_time(&replica[i], now));
+        for(int team = 0; team < PROTOCOL_MAX_TEAMS; team++)
+        {
+            seconds[team] += replica[i].status.seconds[team];
+            points[team] += scoring_get_points(&replica[i].scoring, team);
+        }
+    }
+    portEXIT_CRITICAL(&replica_lock);
+
+    ESP_LOGI(__func__, "SCOREBOARD (%d points)", entry_count);
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        ESP_LOGI(__func__, "%-6s %" PRIu32 "s %" PRIu32 "pts", teams[team].name, seconds[team], points[team]);
+    }
+
+    uint8_t payload[sizeof(ScoreboardPayload_t) + SCOREBOARD_FRAME_ENTRIES * sizeof(ScoreboardEntry_t)];
+    ScoreboardPayload_t * board = (ScoreboardPayload_t *)payload;
+    board->aggregator_node = network_get_node_id();
+    board->standin_ms = pdTICKS_TO_MS(now - standin_since);
+    memcpy(board->points, points, sizeof(board->points));
+
+    // A frame per SCOREBOARD_FRAME_ENTRIES points, an empty scoreboard still goes
+    uint8_t sent = 0;
+    do
+    {
+        board->entry_count = entry_count - sent < SCOREBOARD_FRAME_ENTRIES ? entry_count - sent : SCOREBOARD_FRAME_ENTRIES;
+        memcpy(payload + sizeof(ScoreboardPayload_t), &entries[sent], board->entry_count * sizeof(ScoreboardEntry_t));
+
+        uint16_t payload_len = sizeof(ScoreboardPayload_t) + board->entry_count * sizeof(ScoreboardEntry_t);
+        esp_err_t err = network_send(dst_node, type, payload, payload_len);
+        if(ESP_OK != err)
+        {
+            ESP_LOGW(__func__, "Error sending the scoreboard: %s", esp_err_to_name(err));
+        }
+        sent += board->entry_count;
+    } while(sent < entry_count);
+
+}
+
+static void master_heartbeat_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->src_node != NODE_ID_MASTER)
+        return;
+
+    last_master_tick = xTaskGetTickCount();
+
+    // Older masters send no clock
+    if(header->payload_len == sizeof(MasterHeartbeatPayload_t))
+    {
+        MasterHeartbeatPayload_t heartbeat;
+        memcpy(&heartbeat, payload, sizeof(heartbeat));
+        matchsync_master_time(heartbeat.time_us, network_get_rx_time_us());
+    }
+
+    if(standin)
+    {
+        standin = false;
+        master_returned = true;
+        ESP_LOGW(__func__, "Master is back, handing the replica over");
+    }
+
+}
+
+static void node_status_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len != sizeof(NodeStatusPayload_t))
+    {
+        ESP_LOGW(__func__, "Node status with bad length: %d", header->payload_len);
+        return;
+    }
+
+    NodeStatusPayload_t status;
+    memcpy(&status, payload, sizeof(status));
+
+    replica_store(header->src_node, header->seq, xTaskGetTickCount(), &status);
+
+    // In place of the master, so that the nodes keep measuring their link
+    if(standin)
+    {
+        link_ack(header->src_node, header->seq);
+    }
+
+}
+
+static void scoreboard_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len < sizeof(ScoreboardPayload_t))
+        return;
+
+    const ScoreboardPayload_t * board = (const ScoreboardPayload_t *)payload;
+    if(header->payload_len != sizeof(ScoreboardPayload_t) + board->entry_count * sizeof(ScoreboardEntry_t))
+    {
+        ESP_LOGW(__func__, "Scoreboard with bad length: %d", header->payload_len);
+        return;
+    }
+
+    const ScoreboardEntry_t * entries = (const ScoreboardEntry_t *)(payload + sizeof(ScoreboardPayload_t));
+    TickType_t now = xTaskGetTickCount();
+
+    // Fill in the points this node cannot hear directly, keeping their age so
+    // that dead nodes still expire from the election
+    for(int i = 0; i < board->entry_count; i++)
+    {
+        ScoreboardEntry_t entry;
+        memcpy(&entry, &entries[i], sizeof(entry));
+
+        int8_t cp = entry.status.control_point;
+        if(cp <= CONTROL_POINT_NONE || cp >= CONTROL_POINT_MAX)
+            continue;
+
+        portENTER_CRITICAL(&replica_lock);
+        bool stale = !replica[cp].valid || (now - replica[cp].last_seen) > replica_timeout(&replica[cp].status);
+        if(stale && pdMS_TO_TICKS(entry.age_ms) <= replica_timeout(&entry.status))
+        {
+            // No sequence number here: the next status from the node itself wins
+            replica[cp].valid = true;
+            replica[cp].node_id = entry.node_id;
+            replica[cp].seq = 0;
+            replica[cp].last_seen = now - pdMS_TO_TICKS(entry.age_ms);
+            replica[cp].status = entry.status;
+            replica_score(&replica[cp], &entry.status, true);
+        }
+        portEXIT_CRITICAL(&replica_lock);
+    }
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file failover.h
+ * @brief Score aggregation when the master goes missing.
+ *
+ * Every node broadcasts its MSG_NODE_STATUS on each capture and every
+ * NODE_STATUS_PERIOD_MS, more seldom on a poor link (see link.h), and keeps
+ * the last status heard from each control point: a compact replica of the whole field. When no MSG_MASTER_HEARTBEAT
+ * arrives for MASTER_HEARTBEAT_TIMEOUT_MS, the live node with the lowest
+ * control point stands in: it broadcasts the scoreboard built from its
+ * replica until the master is back, then hands the replica over to it.
+ * Every node scores the points of its replica again with the scoring engine,
+ * with the points each team holds across the field, so that the totals of the
+ * scoreboard include the multi-point bonus the nodes cannot see on their own.
+ * Every node applies the same rule to the same statuses, so the election
+ * needs no extra exchange.
+ */
+
+/**
+ * @brief Register the failover message handlers.
+ *
+ * Must be called after network_init().
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t failover_init(void);
+
+/**
+ * @brief Failover task: publishes the node status and runs the election.
+ *
+ * @param arg Unused.
+ */
+void failover_task(void* arg);
+
+/**
+ * @brief Tell whether this node is currently standing in for the master.
+ *
+ * @return true if standing in.
+ */
+bool failover_is_standin(void);
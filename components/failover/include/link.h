@@ -0,0 +1,74 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file link.h
+ * @brief Quality of the link to the master, and the status period it allows.
+ *
+ * The master acknowledges every MSG_NODE_STATUS with a MSG_STATUS_ACK. From
+ * the acks the node keeps a smoothed round trip and loss rate, and samples
+ * the signal of the access point. On a poor link the status period doubles,
+ * up to NODE_STATUS_PERIOD_MAX_MS: fewer frames, each carrying every change
+ * since the last, leave the retries some room. On a good link it comes back
+ * to NODE_STATUS_PERIOD_MS step by step. Captures do not wait for the period,
+ * and until one of them is acknowledged the period is NODE_STATUS_PERIOD_MS:
+ * a capture lost on a poor link is not held a long period.
+ *
+ * Until the first ack, from a master that does not send any, the period
+ * stays at NODE_STATUS_PERIOD_MS.
+ */
+
+#define LINK_LOSS_UNKNOWN   0xFF
+
+typedef struct
+{
+    int8_t rssi;            // dBm, 0 when not associated
+    uint8_t loss_pct;       // Smoothed, LINK_LOSS_UNKNOWN before the first ack
+    uint16_t rtt_ms;        // Smoothed
+    uint16_t period_ms;     // Status period in use
+    uint32_t sent;
+    uint32_t acked;
+    uint32_t lost;          // Not acknowledged within LINK_ACK_TIMEOUT_MS
+} LinkStats_t;
+
+/**
+ * @brief Register the MSG_STATUS_ACK handler.
+ *
+ * @return ESP_OK on success, error code of network_register_handler() otherwise.
+ */
+esp_err_t link_init(void);
+
+/**
+ * @brief Note a status sent, to be acknowledged, and adapt the period.
+ *
+ * @param seq Sequence number of the status frame.
+ * @param changed The status carries a change the master has not seen yet.
+ */
+void link_sent(uint32_t seq, bool changed);
+
+/**
+ * @brief Get the status period for the current link quality.
+ *
+ * Also counts as lost the statuses whose ack is overdue.
+ *
+ * @return Period in milliseconds.
+ */
+uint32_t link_get_period_ms(void);
+
+/**
+ * @brief Acknowledge the status of another node, in place of the master.
+ *
+ * @param node_id Sender of the status.
+ * @param seq Sequence number of the status frame.
+ */
+void link_ack(uint16_t node_id, uint32_t seq);
+
+/**
+ * @brief Get the link counters and estimates.
+ *
+ * @param stats Filled with the counters.
+ */
+void link_get_stats(LinkStats_t * stats);
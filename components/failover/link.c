@@ -0,0 +1,230 @@
+#include "string.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "link.h"
+#include "network.h"
+#include "config.h"
+
+#define LINK_PENDING_MAX    4       // Statuses awaiting their ack, captures can come in bursts
+#define LINK_EWMA_SHIFT     4       // Each sample moves the estimates by 1/16 of the difference
+
+typedef struct
+{
+    bool used;
+    uint32_t seq;
+    int64_t sent_us;
+} LinkPending_t;
+
+// Under link_lock: the failover task sends, the network task takes the acks
+static LinkPending_t pending[LINK_PENDING_MAX];
+static LinkStats_t stats = { .loss_pct = LINK_LOSS_UNKNOWN, .period_ms = NODE_STATUS_PERIOD_MS };
+static int32_t loss_q8 = 0;         // Percent, 8 fractional bits
+static int32_t rtt_q8 = 0;          // Milliseconds, 8 fractional bits
+static bool acked_once = false;
+static bool change_unacked = false;     // The statuses from change_seq on carry a change
+static uint32_t change_seq = 0;
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void status_ack_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void link_expire(int64_t now);
+static void link_sample_loss(bool lost);
+static void link_adapt(void);
+
+esp_err_t link_init(void)
+{
+
+    esp_err_t ret = network_register_handler(MSG_STATUS_ACK, status_ack_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_STATUS_ACK handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return ret;
+
+}
+
+void link_sent(uint32_t seq, bool changed)
+{
+
+    int8_t rssi = network_get_rssi();
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&link_lock);
+    link_expire(now);
+
+    // A free slot, or else the oldest, given up as lost
+    LinkPending_t * slot = &pending[0];
+    for(int i = 0; i < LINK_PENDING_MAX; i++)
+    {
+        if(!pending[i].used)
+        {
+            slot = &pending[i];
+            break;
+        }
+        if(pending[i].sent_us < slot->sent_us)
+        {
+            slot = &pending[i];
+        }
+    }
+
+    if(slot->used && acked_once)
+    {
+        stats.lost++;
+        link_sample_loss(true);
+    }
+
+    slot->used = true;
+    slot->seq = seq;
+    slot->sent_us = now;
+
+    if(changed && !change_unacked)
+    {
+        change_unacked = true;
+        change_seq = seq;
+    }
+
+    stats.sent++;
+    stats.rssi = rssi;
+    link_adapt();
+    portEXIT_CRITICAL(&link_lock);
+
+}
+
+uint32_t link_get_period_ms(void)
+{
+
+    int64_t now = esp_timer_get_time();
+
+    // A change not acknowledged yet goes again at the shortest period
+    portENTER_CRITICAL(&link_lock);
+    link_expire(now);
+    uint32_t period_ms = change_unacked ? NODE_STATUS_PERIOD_MS : stats.period_ms;
+    portEXIT_CRITICAL(&link_lock);
+
+    return period_ms;
+
+}
+
+void link_ack(uint16_t node_id, uint32_t seq)
+{
+
+    StatusAckPayload_t ack = { .seq = seq };
+
+    esp_err_t err = network_send(node_id, MSG_STATUS_ACK, &ack, sizeof(ack));
+    if(ESP_OK != err)
+    {
+        ESP_LOGW(__func__, "Error acknowledging node 0x%04x: %s", node_id, esp_err_to_name(err));
+    }
+
+}
+
+void link_get_stats(LinkStats_t * out)
+{
+    portENTER_CRITICAL(&link_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&link_lock);
+}
+
+static void status_ack_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len != sizeof(StatusAckPayload_t) || header->dst_node != network_get_node_id())
+        return;
+
+    StatusAckPayload_t ack;
+    memcpy(&ack, payload, sizeof(ack));
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&link_lock);
+    // The same ack comes over every transport: the first one counts
+    for(int i = 0; i < LINK_PENDING_MAX; i++)
+    {
+        if(!pending[i].used || pending[i].seq != ack.seq)
+            continue;
+
+        pending[i].used = false;
+        int32_t rtt_ms = (int32_t)((now - pending[i].sent_us) / 1000);
+
+        // Losses before the first ack are a master that does not ack, not the link
+        if(!acked_once)
+        {
+            acked_once = true;
+            loss_q8 = 0;
+            rtt_q8 = rtt_ms << 8;
+        }
+        else
+        {
+            rtt_q8 += ((rtt_ms << 8) - rtt_q8) >> LINK_EWMA_SHIFT;
+        }
+
+        // Every status is a whole snapshot: a later one has the change too
+        if(change_unacked && (int32_t)(ack.seq - change_seq) >= 0)
+            change_unacked = false;
+
+        stats.acked++;
+        stats.rtt_ms = (rtt_q8 + 128) >> 8;
+        link_sample_loss(false);
+        break;
+    }
+    portEXIT_CRITICAL(&link_lock);
+
+}
+
+// Under link_lock
+static void link_expire(int64_t now)
+{
+
+    for(int i = 0; i < LINK_PENDING_MAX; i++)
+    {
+        if(!pending[i].used || now - pending[i].sent_us < (int64_t)LINK_ACK_TIMEOUT_MS * 1000)
+            continue;
+
+        pending[i].used = false;
+        if(acked_once)
+        {
+            stats.lost++;
+            link_sample_loss(true);
+        }
+    }
+
+}
+
+// Under link_lock
+static void link_sample_loss(bool lost)
+{
+
+    loss_q8 += ((lost ? 100 << 8 : 0) - loss_q8) >> LINK_EWMA_SHIFT;
+    stats.loss_pct = (loss_q8 + 128) >> 8;
+
+}
+
+// Under link_lock, once per status sent
+static void link_adapt(void)
+{
+
+    if(!acked_once)
+        return;
+
+    // Without association, relayed over ESP-NOW, the signal is unknown and left out
+    bool rssi_known = stats.rssi != 0;
+    bool poor = stats.loss_pct >= LINK_LOSS_POOR_PCT || stats.rtt_ms >= LINK_RTT_POOR_MS ||
+                (rssi_known && stats.rssi < LINK_RSSI_POOR_DBM);
+    bool good = stats.loss_pct <= LINK_LOSS_GOOD_PCT && stats.rtt_ms <= LINK_RTT_GOOD_MS &&
+                (!rssi_known || stats.rssi >= LINK_RSSI_GOOD_DBM);
+
+    // Back off fast, come back slowly
+    if(poor)
+    {
+        stats.period_ms = stats.period_ms * 2 > NODE_STATUS_PERIOD_MAX_MS ? NODE_STATUS_PERIOD_MAX_MS : stats.period_ms * 2;
+    }
+    else if(good && stats.period_ms > NODE_STATUS_PERIOD_MS)
+    {
+        stats.period_ms = stats.period_ms - NODE_STATUS_PERIOD_MS < NODE_STATUS_PERIOD_STEP_MS ?
+                          NODE_STATUS_PERIOD_MS : stats.period_ms - NODE_STATUS_PERIOD_STEP_MS;
+    }
+
+}
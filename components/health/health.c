@@ -0,0 +1,179 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "health.h"
+#include "buttons.h"
+#include "pool.h"
+#include "battery.h"
+#include "config.h"
+
+// Tasks of the firmware, the timer service task runs the sampler itself
+static const char * const health_task_names[] =
+{
+    "button", "app", "network", "failover", "udp_rx", "ota", "console_repl", "display", "supervisor", "Tmr Svc",
+};
+
+_Static_assert(sizeof(health_task_names) / sizeof(health_task_names[0]) <= HEALTH_TASK_MAX, "Too many tasks to sample");
+
+static const uint8_t health_queue_length[APP_EVENT_PRIO_MAX] =
+{
+    [APP_EVENT_PRIO_CONTROL] = APP_EVENT_QUEUE_LEN_CONTROL,
+    [APP_EVENT_PRIO_NETWORK] = APP_EVENT_QUEUE_LEN_NETWORK,
+};
+
+static TimerHandle_t health_timer = NULL;
+static HealthReport_t report;
+static portMUX_TYPE report_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void health_timer_callback(TimerHandle_t timer);
+static uint32_t health_check(const HealthReport_t * sample);
+
+esp_err_t health_init(void)
+{
+
+    health_sample();
+
+    health_timer = xTimerCreate("health", pdMS_TO_TICKS(HEALTH_PERIOD_MS), pdTRUE, NULL, health_timer_callback);
+    if(!health_timer)
+    {
+        ESP_LOGE(__func__, "Error creating health_timer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if(pdPASS != xTimerStart(health_timer, 0))
+    {
+        ESP_LOGE(__func__, "Error starting health_timer");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+
+}
+
+void health_sample(void)
+{
+
+    HealthReport_t sample;
+    health_get_report(&sample);
+
+    sample.samples++;
+    sample.uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    sample.heap_free = esp_get_free_heap_size();
+    sample.heap_min_free = esp_get_minimum_free_heap_size();
+    sample.heap_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    sample.task_count = sizeof(health_task_names) / sizeof(health_task_names[0]);
+    for(int i = 0; i < sample.task_count; i++)
+    {
+        TaskHandle_t task = xTaskGetHandle(health_task_names[i]);
+        sample.tasks[i].name = health_task_names[i];
+        sample.tasks[i].stack_free = task ? uxTaskGetStackHighWaterMark(task) : UINT32_MAX;
+    }
+
+    AppEventStats_t events;
+    app_event_get_stats(&events);
+    memcpy(sample.queue_high_water, events.high_water, sizeof(sample.queue_high_water));
+
+    PoolStats_t pool;
+    pool_get_stats(&app_payload_pool, &pool);
+    sample.pool_high_water = pool.high_water;
+
+    sample.button_isr_count = button_get_isr_count();
+
+    // The battery rides on this timer rather than waking the CPU on its own
+    BatteryStatus_t battery;
+    battery_sample();
+    battery_get(&battery);
+    sample.battery_mv = battery.millivolts;
+    sample.battery_pct = battery.soc_pct;
+
+    sample.loop_max_us = app_take_loop_max_us();
+    if(sample.loop_max_us > sample.loop_peak_us)
+    {
+        sample.loop_peak_us = sample.loop_max_us;
+    }
+
+    uint32_t raised = health_check(&sample) & ~sample.warnings;
+    sample.warnings |= raised;
+
+    portENTER_CRITICAL(&report_lock);
+    report = sample;
+    portEXIT_CRITICAL(&report_lock);
+
+    // Each warning is logged once, the figures keep being reported below
+    if(raised & HEALTH_WARN_STACK)
+    {
+        for(int i = 0; i < sample.task_count; i++)
+        {
+            if(sample.tasks[i].stack_free < HEALTH_STACK_WARN_BYTES)
+                ESP_LOGW(__func__, "Task %s down to %" PRIu32 " bytes of stack", sample.tasks[i].name, sample.tasks[i].stack_free);
+        }
+    }
+    if(raised & HEALTH_WARN_HEAP)
+        ESP_LOGW(__func__, "Free heap down to %" PRIu32 " bytes", sample.heap_min_free);
+    if(raised & HEALTH_WARN_QUEUE)
+        ESP_LOGW(__func__, "Event queues filled up to %" PRIu32 "/%d and %" PRIu32 "/%d",
+                 sample.queue_high_water[APP_EVENT_PRIO_CONTROL], APP_EVENT_QUEUE_LEN_CONTROL,
+                 sample.queue_high_water[APP_EVENT_PRIO_NETWORK], APP_EVENT_QUEUE_LEN_NETWORK);
+    if(raised & HEALTH_WARN_POOL)
+        ESP_LOGW(__func__, "Payload pool exhausted: %d blocks in use", sample.pool_high_water);
+    if(raised & HEALTH_WARN_LOOP)
+        ESP_LOGW(__func__, "App loop iteration took %" PRIu32 " us", sample.loop_peak_us);
+
+    ESP_LOGD(__func__, "heap %" PRIu32 "/%" PRIu32 ", loop %" PRIu32 " us, isr %" PRIu32,
+             sample.heap_free, sample.heap_min_free, sample.loop_max_us, sample.button_isr_count);
+
+}
+
+void health_get_report(HealthReport_t * out)
+{
+    portENTER_CRITICAL(&report_lock);
+    *out = report;
+    portEXIT_CRITICAL(&report_lock);
+}
+
+static void health_timer_callback(TimerHandle_t timer)
+{
+    health_sample();
+}
+
+static uint32_t health_check(const HealthReport_t * sample)
+{
+
+    uint32_t warnings = 0;
+
+    for(int i = 0; i < sample->task_count; i++)
+    {
+        if(sample->tasks[i].stack_free < HEALTH_STACK_WARN_BYTES)
+            warnings |= HEALTH_WARN_STACK;
+    }
+
+    if(sample->heap_min_free < HEALTH_HEAP_WARN_BYTES)
+        warnings |= HEALTH_WARN_HEAP;
+
+    for(int prio = 0; prio < APP_EVENT_PRIO_MAX; prio++)
+    {
+        if(sample->queue_high_water[prio] * 100 >= (uint32_t)health_queue_length[prio] * HEALTH_QUEUE_WARN_PCT)
+            warnings |= HEALTH_WARN_QUEUE;
+    }
+
+    if(sample->pool_high_water >= APP_PAYLOAD_BLOCK_COUNT)
+        warnings |= HEALTH_WARN_POOL;
+
+    if(sample->loop_peak_us >= HEALTH_LOOP_WARN_US)
+        warnings |= HEALTH_WARN_LOOP;
+
+    // battery_sample() warns by itself, with the cue
+    if(sample->battery_pct != BATTERY_PCT_UNKNOWN && sample->battery_pct < BATTERY_LOW_PCT)
+        warnings |= HEALTH_WARN_BATTERY;
+
+    return warnings;
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "stdint.h"
+#include "esp_err.h"
+
+#include "app.h"
+
+/**
+ * @file health.h
+ * @brief Periodic sampler of the node resource margins.
+ *
+ * Every HEALTH_PERIOD_MS a timer collects the stack high-water marks of the
+ * firmware tasks, the heap figures, the event queue and payload pool peaks,
+ * the button interrupt count, the longest app task iteration and the battery
+ * into a HealthReport_t. Crossing a threshold of config.h logs a warning once,
+ * before the margin runs out; the report is also printed by the console.
+ */
+
+#define HEALTH_TASK_MAX     10
+
+typedef enum
+{
+    HEALTH_WARN_STACK   = 1 << 0,   // A task has less than HEALTH_STACK_WARN_BYTES of stack left
+    HEALTH_WARN_HEAP    = 1 << 1,   // The free heap went below HEALTH_HEAP_WARN_BYTES
+    HEALTH_WARN_QUEUE   = 1 << 2,   // An event queue filled up to HEALTH_QUEUE_WARN_PCT
+    HEALTH_WARN_POOL    = 1 << 3,   // Every payload block was in use at once
+    HEALTH_WARN_LOOP    = 1 << 4,   // An app task iteration took HEALTH_LOOP_WARN_US or more
+    HEALTH_WARN_BATTERY = 1 << 5,   // The battery went below BATTERY_LOW_PCT
+} HealthWarning_t;
+
+typedef struct
+{
+    const char * name;
+    uint32_t stack_free;        // Bytes never used, UINT32_MAX if the task is not running
+} HealthTask_t;
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t uptime_s;
+    uint32_t heap_free;
+    uint32_t heap_min_free;                     // Lowest since boot
+    uint32_t heap_largest_block;
+    uint8_t task_count;
+    HealthTask_t tasks[HEALTH_TASK_MAX];
+    uint32_t queue_high_water[APP_EVENT_PRIO_MAX];
+    uint8_t pool_high_water;
+    uint32_t button_isr_count;
+    uint16_t battery_mv;                        // 0 without a battery monitor or a battery
+    uint8_t battery_pct;                        // BATTERY_PCT_UNKNOWN without a battery monitor or a battery
+    uint32_t loop_max_us;                       // Longest app iteration of the last period
+    uint32_t loop_peak_us;                      // Longest since boot
+    uint32_t warnings;                          // HealthWarning_t bits raised so far
+} HealthReport_t;
+
+/**
+ * @brief Start the sampling timer.
+ *
+ * Call once the firmware tasks are created, so that the first sample sees
+ * them all.
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t health_init(void);
+
+/**
+ * @brief Take a sample now, as the timer does.
+ */
+void health_sample(void);
+
+/**
+ * @brief Get the last sample.
+ *
+ * @param report Filled with the report.
+ */
+void health_get_report(HealthReport_t * report);
@@ -0,0 +1,778 @@
+#include "string.h"
+#include "inttypes.h"
+#include "stdio.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "history.h"
+#include "network.h"
+#include "storage.h"
+
+#define HISTORY_SECTOR_SIZE         4096
+#define HISTORY_PAGE_SIZE           256
+#define HISTORY_MAGIC               0x54534948      // "HIST"
+#define HISTORY_MAX_TEAMS           4
+#define HISTORY_RECORD_MAX          (2 + 5 + HISTORY_MAX_TEAMS * 10)
+#define HISTORY_MAX_SECTORS         64
+
+#define HISTORY_TYPE_MATCH_START    0x10
+#define HISTORY_TYPE_PRESS          0x20
+#define HISTORY_TYPE_CHORD          0x30
+#define HISTORY_TYPE_MATCH_END      0x40
+#define HISTORY_PADDING             0xFF
+
+#define HISTORY_ROUND_UP(x, align)  ((((x) + (align) - 1) / (align)) * (align))
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;               // Grows by one per sector written, the highest is the newest
+} HistorySectorHeader_t;
+
+typedef struct
+{
+    bool used;
+    uint8_t first_control_point;    // Control point of first_match
+    uint16_t control_points;        // Bit per control point with records in the sector
+    uint32_t first_match;           // Match in progress where the sector starts, 0 if unknown
+    uint32_t last_match;            // Last match started in the sector, first_match if none
+} HistorySectorIndex_t;
+
+typedef struct
+{
+    uint32_t from_match;
+    uint32_t to_match;
+    uint8_t control_point;          // HISTORY_ANY_CONTROL_POINT for all
+} HistoryQuery_t;
+
+typedef struct
+{
+    uint16_t dst_node;
+    uint16_t chunk;
+    HistoryChunkPayload_t header;
+    uint8_t data[HISTORY_CHUNK_DATA_MAX];
+} HistoryChunker_t;
+
+static const esp_partition_t * partition = NULL;
+static uint16_t sector_count = 0;
+static SemaphoreHandle_t history_lock = NULL;
+
+// WRITER: page_buffer holds the bytes going to write_offset
+static uint16_t write_sector = 0;
+static uint32_t write_seq = 0;
+static uint32_t write_offset = 0;
+static uint8_t page_buffer[HISTORY_PAGE_SIZE];
+static uint16_t page_fill = 0;
+// Cleared by a flash error: the ring stays as it is until the next boot scan
+static bool recording = false;
+
+static uint32_t match_number = 0;
+static uint8_t match_control_point = 0;
+static uint32_t last_record_ms = 0;
+
+// Under history_lock: built by the scan at boot, lets a query skip the sectors it has nothing in
+static HistorySectorIndex_t sector_index[HISTORY_MAX_SECTORS];
+
+static void history_request_handler(const FrameHeader_t * header, const uint8_t * payload);
+static esp_err_t history_append(const uint8_t * record, size_t len);
+static void history_stop(esp_err_t err);
+static esp_err_t history_flush_locked(void);
+static esp_err_t history_format_sector(uint16_t sector, uint32_t seq);
+static esp_err_t history_find_write_offset(void);
+static esp_err_t history_walk(uint16_t end_sector, uint32_t end_offset, const uint8_t * tail, size_t tail_len,
+                              const HistoryQuery_t * query, HistorySink_t visit, void * ctx);
+static esp_err_t history_read(size_t base, uint32_t pos, uint8_t * out, size_t len, uint32_t flash_end, const uint8_t * tail);
+static size_t history_record_len(const uint8_t * record, size_t avail);
+static uint32_t history_delta(uint32_t now_ms);
+static size_t varint_put(uint8_t * out, uint32_t value);
+static size_t varint_get(const uint8_t * in, size_t avail, uint32_t * value);
+
+esp_err_t history_init(void)
+{
+
+    history_lock = xSemaphoreCreateMutex();
+    if(!history_lock)
+    {
+        ESP_LOGE(__func__, "Error creating history_lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_partition_t * found = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE, HISTORY_PARTITION_LABEL);
+    if(!found)
+    {
+        ESP_LOGW(__func__, "No %s partition, matches are not recorded", HISTORY_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    sector_count = found->size / HISTORY_SECTOR_SIZE;
+    if(sector_count > HISTORY_MAX_SECTORS)
+    {
+        ESP_LOGW(__func__, "Only the first %d of %d sectors are used", HISTORY_MAX_SECTORS, sector_count);
+        sector_count = HISTORY_MAX_SECTORS;
+    }
+
+    bool resumed = false;
+    for(uint16_t sector = 0; sector < sector_count; sector++)
+    {
+        HistorySectorHeader_t header;
+        esp_err_t ret = esp_partition_read(found, (size_t)sector * HISTORY_SECTOR_SIZE, &header, sizeof(header));
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error calling esp_partition_read: %s", esp_err_to_name(ret));
+            return ret;
+        }
+
+        if(header.magic == HISTORY_MAGIC && (!resumed || (int32_t)(header.seq - write_seq) > 0))
+        {
+            resumed = true;
+            write_sector = sector;
+            write_seq = header.seq;
+        }
+    }
+
+    partition = found;
+
+    esp_err_t ret = resumed ? history_find_write_offset() : history_format_sector(0, 1);
+    if(ESP_OK != ret)
+    {
+        partition = NULL;
+        return ret;
+    }
+
+    // The match numbers go on from the last one recorded
+    ret = history_walk(write_sector, write_offset, NULL, 0, NULL, NULL, NULL);
+    if(ESP_OK != ret)
+    {
+        partition = NULL;
+        return ret;
+    }
+
+    recording = true;
+
+    ret = network_register_handler(MSG_HISTORY_REQUEST, history_request_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_HISTORY_REQUEST handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(__func__, "History: %d sectors, writing sector %d at %" PRIu32 ", %" PRIu32 " matches",
+             sector_count, write_sector, write_offset, match_number);
+
+    return ESP_OK;
+
+}
+
+void history_match_start(uint8_t control_point, uint8_t game_mode, uint8_t team_count, uint32_t now_ms)
+{
+
+    if(!partition)
+        return;
+
+    uint8_t record[HISTORY_RECORD_MAX];
+    size_t len = 0;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+
+    if(!recording)
+    {
+        xSemaphoreGive(history_lock);
+        return;
+    }
+
+    record[len++] = HISTORY_TYPE_MATCH_START | (control_point & 0x0F);
+    len += varint_put(&record[len], ++match_number);
+    record[len++] = game_mode;
+    record[len++] = team_count;
+    len += varint_put(&record[len], now_ms / 1000);
+    last_record_ms = now_ms;
+    match_control_point = control_point & 0x0F;
+
+    if(ESP_OK == history_append(record, len))
+    {
+        // Records never span two sectors: the start is in the one written now
+        sector_index[write_sector].last_match = match_number;
+        sector_index[write_sector].control_points |= 1 << match_control_point;
+
+        // Written at once: after a watchdog reset the match resumes, and its
+        // presses go on after this start instead of after the previous match
+        esp_err_t ret = history_flush_locked();
+        if(ESP_OK != ret)
+        {
+            history_stop(ret);
+        }
+    }
+
+    xSemaphoreGive(history_lock);
+
+}
+
+void history_press(int8_t team, uint8_t press, uint32_t now_ms)
+{
+
+    if(!partition)
+        return;
+
+    uint8_t record[HISTORY_RECORD_MAX];
+    size_t len = 0;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+
+    if(!recording)
+    {
+        xSemaphoreGive(history_lock);
+        return;
+    }
+
+    if(team == HISTORY_CHORD)
+        record[len++] = HISTORY_TYPE_CHORD | (press & 0x03);
+    else
+        record[len++] = HISTORY_TYPE_PRESS | ((team & 0x03) << 2) | (press & 0x03);
+    len += varint_put(&record[len], history_delta(now_ms));
+
+    history_append(record, len);
+
+    xSemaphoreGive(history_lock);
+
+}
+
+void history_match_end(int8_t winner, const uint32_t * seconds, const uint32_t * points, uint8_t team_count, uint32_t now_ms)
+{
+
+    if(!partition)
+        return;
+
+    uint8_t record[HISTORY_RECORD_MAX];
+    size_t len = 0;
+
+    if(team_count > HISTORY_MAX_TEAMS)
+        team_count = HISTORY_MAX_TEAMS;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+
+    if(!recording)
+    {
+        xSemaphoreGive(history_lock);
+        return;
+    }
+
+    record[len++] = HISTORY_TYPE_MATCH_END | ((winner + 1) & 0x0F);
+    record[len++] = team_count;
+    len += varint_put(&record[len], history_delta(now_ms));
+    for(int team = 0; team < team_count; team++)
+    {
+        len += varint_put(&record[len], seconds[team]);
+        len += varint_put(&record[len], points[team]);
+    }
+
+    if(ESP_OK == history_append(record, len))
+    {
+        esp_err_t ret = history_flush_locked();
+        if(ESP_OK != ret)
+        {
+            history_stop(ret);
+        }
+    }
+
+    xSemaphoreGive(history_lock);
+
+}
+
+esp_err_t history_export(uint32_t from_match, uint8_t match_count, uint8_t control_point, HistorySink_t sink, void * ctx)
+{
+
+    if(!partition)
+        return ESP_ERR_INVALID_STATE;
+
+    // The filter is a bit of a mask
+    if(control_point >= CONTROL_POINT_MAX && control_point != HISTORY_ANY_CONTROL_POINT)
+        return ESP_ERR_INVALID_ARG;
+
+    if(match_count == 0)
+        return ESP_OK;
+
+    // Export what is recorded now, the app task keeps appending meanwhile.
+    // The page not written yet is read from RAM: flushing it would pad the
+    // rest of a flash page in the middle of a match
+    uint8_t tail[HISTORY_PAGE_SIZE];
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    uint16_t end_sector = write_sector;
+    uint32_t end_offset = write_offset;
+    size_t tail_len = page_fill;
+    memcpy(tail, page_buffer, tail_len);
+    if(from_match == 0)
+    {
+        // The most recent matches, the one in progress included
+        from_match = match_number >= match_count ? match_number - match_count + 1 : 1;
+    }
+    xSemaphoreGive(history_lock);
+
+    HistoryQuery_t query =
+    {
+        .from_match = from_match,
+        .to_match = from_match > UINT32_MAX - match_count ? UINT32_MAX : from_match + match_count - 1,
+        .control_point = control_point,
+    };
+
+    return history_walk(end_sector, end_offset, tail, tail_len, &query, sink, ctx);
+
+}
+
+static esp_err_t history_uart_sink(const uint8_t * data, size_t len, void * ctx)
+{
+    printf("HIST:");
+    for(size_t i = 0; i < len; i++)
+    {
+        printf("%02x", data[i]);
+    }
+    printf("\n");
+    return ESP_OK;
+}
+
+esp_err_t history_export_uart(uint32_t from_match, uint8_t match_count, uint8_t control_point)
+{
+    return history_export(from_match, match_count, control_point, history_uart_sink, NULL);
+}
+
+static esp_err_t history_send_chunk(HistoryChunker_t * chunker, bool last)
+{
+
+    uint8_t frame[sizeof(HistoryChunkPayload_t) + HISTORY_CHUNK_DATA_MAX];
+
+    chunker->header.chunk = chunker->chunk++;
+    chunker->header.last = last ? 1 : 0;
+    memcpy(frame, &chunker->header, sizeof(chunker->header));
+    memcpy(frame + sizeof(chunker->header), chunker->data, chunker->header.data_len);
+
+    esp_err_t ret = network_send(chunker->dst_node, MSG_HISTORY_CHUNK, frame, sizeof(chunker->header) + chunker->header.data_len);
+    chunker->header.data_len = 0;
+
+    return ret;
+
+}
+
+static esp_err_t history_chunk_sink(const uint8_t * data, size_t len, void * ctx)
+{
+
+    HistoryChunker_t * chunker = ctx;
+
+    if(chunker->header.data_len + len > HISTORY_CHUNK_DATA_MAX)
+    {
+        esp_err_t ret = history_send_chunk(chunker, false);
+        if(ESP_OK != ret)
+            return ret;
+    }
+
+    memcpy(&chunker->data[chunker->header.data_len], data, len);
+    chunker->header.data_len += len;
+
+    return ESP_OK;
+
+}
+
+static void history_request_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len != sizeof(HistoryRequestPayload_t))
+    {
+        ESP_LOGW(__func__, "History request with bad length: %d", header->payload_len);
+        return;
+    }
+
+    HistoryRequestPayload_t request;
+    memcpy(&request, payload, sizeof(request));
+
+    if(request.control_point >= CONTROL_POINT_MAX && request.control_point != HISTORY_ANY_CONTROL_POINT)
+    {
+        ESP_LOGW(__func__, "History request for unknown control point %u", request.control_point);
+        return;
+    }
+
+    HistoryChunker_t chunker = { .dst_node = header->src_node };
+
+    // Taken before the export: a match started meanwhile is sent again next time, never skipped
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    chunker.header.last_match = match_number;
+    xSemaphoreGive(history_lock);
+
+    esp_err_t ret = history_export(request.from_match, request.match_count, request.control_point, history_chunk_sink, &chunker);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGW(__func__, "Error exporting the history: %s", esp_err_to_name(ret));
+    }
+
+    // Always close the export, even empty, so the requester stops waiting
+    ret = history_send_chunk(&chunker, true);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGW(__func__, "Error sending the last history chunk: %s", esp_err_to_name(ret));
+    }
+
+}
+
+static esp_err_t history_append(const uint8_t * record, size_t len)
+{
+
+    if(!recording)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t ret = ESP_OK;
+
+    // Records never span two sectors: each sector starts on a whole record
+    if(write_offset + page_fill + len > HISTORY_SECTOR_SIZE)
+    {
+        ret = history_flush_locked();
+        if(ESP_OK == ret)
+        {
+            ret = history_format_sector((write_sector + 1) % sector_count, write_seq + 1);
+        }
+    }
+
+    while(ESP_OK == ret && len > 0)
+    {
+        size_t room = HISTORY_PAGE_SIZE - (write_offset % HISTORY_PAGE_SIZE) - page_fill;
+        size_t copy = len < room ? len : room;
+
+        memcpy(&page_buffer[page_fill], record, copy);
+        page_fill += copy;
+        record += copy;
+        len -= copy;
+
+        if(copy == room)
+        {
+            ret = history_flush_locked();
+        }
+    }
+
+    if(ESP_OK != ret)
+    {
+        history_stop(ret);
+    }
+
+    return ret;
+
+}
+
+static void history_stop(esp_err_t err)
+{
+    // Where the next record would go is not known any more: appending on
+    // could overwrite a sector or cut a record in two
+    ESP_LOGE(__func__, "History not recorded until the next boot: %s", esp_err_to_name(err));
+    recording = false;
+    page_fill = 0;
+}
+
+static esp_err_t history_flush_locked(void)
+{
+
+    if(page_fill == 0)
+        return ESP_OK;
+
+    esp_err_t ret = esp_partition_write(partition, (size_t)write_sector * HISTORY_SECTOR_SIZE + write_offset, page_buffer, page_fill);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_partition_write: %s", esp_err_to_name(ret));
+    }
+
+    // The rest of a partial page stays erased, the next batch starts on the next page
+    write_offset = HISTORY_ROUND_UP(write_offset + page_fill, HISTORY_PAGE_SIZE);
+    page_fill = 0;
+
+    return ret;
+
+}
+
+static esp_err_t history_format_sector(uint16_t sector, uint32_t seq)
+{
+
+    size_t base = (size_t)sector * HISTORY_SECTOR_SIZE;
+
+    esp_err_t ret = esp_partition_erase_range(partition, base, HISTORY_SECTOR_SIZE);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_partition_erase_range: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    HistorySectorHeader_t header = { .magic = HISTORY_MAGIC, .seq = seq };
+    ret = esp_partition_write(partition, base, &header, sizeof(header));
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_partition_write: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    write_sector = sector;
+    write_seq = seq;
+    write_offset = sizeof(header);
+    page_fill = 0;
+
+    // The match in progress goes on in the new sector
+    sector_index[sector] = (HistorySectorIndex_t)
+    {
+        .used = true,
+        .first_control_point = match_control_point,
+        .control_points = match_number ? 1 << match_control_point : 0,
+        .first_match = match_number,
+        .last_match = match_number,
+    };
+
+    return ESP_OK;
+
+}
+
+static esp_err_t history_find_write_offset(void)
+{
+
+    uint8_t page[HISTORY_PAGE_SIZE];
+    size_t base = (size_t)write_sector * HISTORY_SECTOR_SIZE;
+
+    // Batches end on a page boundary: resume after the last page written
+    write_offset = sizeof(HistorySectorHeader_t);
+    page_fill = 0;
+
+    for(int index = HISTORY_SECTOR_SIZE / HISTORY_PAGE_SIZE - 1; index >= 0; index--)
+    {
+        esp_err_t ret = esp_partition_read(partition, base + (size_t)index * HISTORY_PAGE_SIZE, page, sizeof(page));
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error calling esp_partition_read: %s", esp_err_to_name(ret));
+            return ret;
+        }
+
+        size_t start = index == 0 ? sizeof(HistorySectorHeader_t) : 0;
+        for(size_t i = start; i < sizeof(page); i++)
+        {
+            if(page[i] != HISTORY_PADDING)
+            {
+                write_offset = (uint32_t)(index + 1) * HISTORY_PAGE_SIZE;
+                return ESP_OK;
+            }
+        }
+    }
+
+    return ESP_OK;
+
+}
+
+static esp_err_t history_walk(uint16_t end_sector, uint32_t end_offset, const uint8_t * tail, size_t tail_len,
+                              const HistoryQuery_t * query, HistorySink_t visit, void * ctx)
+{
+
+    uint8_t window[HISTORY_PAGE_SIZE + HISTORY_RECORD_MAX];
+    uint32_t match = 0;
+    uint8_t control_point = 0;
+
+    // Oldest sector first: the one after the newest, around the ring
+    for(uint16_t n = 1; n <= sector_count; n++)
+    {
+        uint16_t sector = (end_sector + n) % sector_count;
+        size_t base = (size_t)sector * HISTORY_SECTOR_SIZE;
+        uint32_t flash_end = sector == end_sector ? end_offset : HISTORY_SECTOR_SIZE;
+        uint32_t limit = sector == end_sector ? end_offset + tail_len : HISTORY_SECTOR_SIZE;
+
+        if(query)
+        {
+            xSemaphoreTake(history_lock, portMAX_DELAY);
+            HistorySectorIndex_t entry = sector_index[sector];
+            xSemaphoreGive(history_lock);
+
+            // Match numbers only grow around the ring: past the query, the rest is newer still
+            if(!entry.used || entry.last_match < query->from_match)
+                continue;
+            if(entry.first_match > query->to_match)
+                break;
+            if(query->control_point != HISTORY_ANY_CONTROL_POINT && !(entry.control_points & (1 << query->control_point)))
+                continue;
+
+            match = entry.first_match;
+            control_point = entry.first_control_point;
+        }
+
+        HistorySectorHeader_t header;
+        esp_err_t ret = esp_partition_read(partition, base, &header, sizeof(header));
+        if(ESP_OK != ret)
+            return ret;
+
+        if(header.magic != HISTORY_MAGIC)
+            continue;
+
+        if(!query)
+        {
+            // Boot scan, without a query: index the sector
+            sector_index[sector] = (HistorySectorIndex_t)
+            {
+                .used = true,
+                .first_control_point = control_point,
+                .control_points = match ? 1 << control_point : 0,
+                .first_match = match,
+                .last_match = match,
+            };
+        }
+
+        uint32_t pos = sizeof(header);
+        uint32_t window_start = 0;
+        uint32_t window_end = 0;
+
+        while(pos < limit)
+        {
+            bool short_window = pos + HISTORY_RECORD_MAX > window_end && window_end < limit;
+            if(pos < window_start || pos >= window_end || short_window)
+            {
+                window_start = pos;
+                window_end = pos + (limit - pos < sizeof(window) ? limit - pos : sizeof(window));
+                ret = history_read(base, pos, window, window_end - window_start, flash_end, tail);
+                if(ESP_OK != ret)
+                    return ret;
+            }
+
+            const uint8_t * record = &window[pos - window_start];
+            size_t len = history_record_len(record, window_end - pos);
+            if(len == 0)
+            {
+                // Padding, or a batch cut short by a reset: go on from the next page
+                pos = HISTORY_ROUND_UP(pos + 1, HISTORY_PAGE_SIZE);
+                continue;
+            }
+
+            if((record[0] & 0xF0) == HISTORY_TYPE_MATCH_START)
+            {
+                varint_get(&record[1], len - 1, &match);
+                control_point = record[0] & 0x0F;
+
+                if(!query)
+                {
+                    // Boot scan: index the sector and keep the last match
+                    sector_index[sector].last_match = match;
+                    sector_index[sector].control_points |= 1 << control_point;
+                    match_number = match;
+                    match_control_point = control_point;
+                }
+            }
+
+            bool wanted = query && match >= query->from_match && match <= query->to_match &&
+                          (query->control_point == HISTORY_ANY_CONTROL_POINT || control_point == query->control_point);
+            if(visit && wanted)
+            {
+                ret = visit(record, len, ctx);
+                if(ESP_OK != ret)
+                    return ret;
+            }
+
+            pos += len;
+        }
+    }
+
+    return ESP_OK;
+
+}
+
+// Flash up to flash_end, then the page in RAM that goes there
+static esp_err_t history_read(size_t base, uint32_t pos, uint8_t * out, size_t len, uint32_t flash_end, const uint8_t * tail)
+{
+
+    size_t from_flash = pos >= flash_end ? 0 : (flash_end - pos < len ? flash_end - pos : len);
+
+    if(from_flash > 0)
+    {
+        esp_err_t ret = esp_partition_read(partition, base + pos, out, from_flash);
+        if(ESP_OK != ret)
+            return ret;
+    }
+
+    if(len > from_flash)
+    {
+        memcpy(out + from_flash, tail + (pos + from_flash - flash_end), len - from_flash);
+    }
+
+    return ESP_OK;
+
+}
+
+static size_t history_record_len(const uint8_t * record, size_t avail)
+{
+
+    size_t pos = 1;
+    size_t varints = 0;
+    uint32_t value;
+
+    switch(record[0] & 0xF0)
+    {
+        case HISTORY_TYPE_MATCH_START:
+        {
+            // Match number, then mode and team count, then uptime
+            size_t len = varint_get(&record[pos], avail - pos, &value);
+            if(len == 0 || pos + len + 2 > avail)
+                return 0;
+            pos += len + 2;
+            varints = 1;
+            break;
+        }
+
+        case HISTORY_TYPE_PRESS:
+        case HISTORY_TYPE_CHORD:
+        {
+            varints = 1;
+            break;
+        }
+
+        case HISTORY_TYPE_MATCH_END:
+        {
+            if(avail < 2 || record[1] > HISTORY_MAX_TEAMS)
+                return 0;
+            varints = 1 + 2 * record[1];
+            pos = 2;
+            break;
+        }
+
+        default:
+        {
+            return 0;
+        }
+    }
+
+    for(size_t i = 0; i < varints; i++)
+    {
+        size_t len = varint_get(&record[pos], avail - pos, &value);
+        if(len == 0)
+            return 0;
+        pos += len;
+    }
+
+    return pos;
+
+}
+
+static uint32_t history_delta(uint32_t now_ms)
+{
+    // Deciseconds, carrying the remainder so that the deltas add up to the match time
+    uint32_t delta = (now_ms - last_record_ms) / 100;
+    last_record_ms += delta * 100;
+    return delta;
+}
+
+static size_t varint_put(uint8_t * out, uint32_t value)
+{
+    size_t len = 0;
+    while(value >= 0x80)
+    {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+static size_t varint_get(const uint8_t * in, size_t avail, uint32_t * value)
+{
+    *value = 0;
+    for(size_t i = 0; i < avail && i < 5; i++)
+    {
+        *value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if(!(in[i] & 0x80))
+            return i + 1;
+    }
+    return 0;
+}
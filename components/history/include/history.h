@@ -0,0 +1,115 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+#include "esp_err.h"
+
+/**
+ * @file history.h
+ * @brief Match history ring in the "history" flash partition.
+ *
+ * Every match is logged as a start record, one record per accepted press and
+ * an end record with the final hold times and points. Times are deltas from
+ * the previous record in deciseconds, varint-encoded, so a press costs 2 or
+ * 3 bytes. Records are batched in RAM and written a flash page at a time,
+ * the start and the end of a match at once, so a reset in the middle of a
+ * match loses at most a page of presses; the partition is a ring of
+ * sectors, the oldest one is erased when the ring wraps.
+ *
+ * Record format (first byte: type in the high nibble):
+ * - 0x1c MATCH_START: c = control point, then varint match number,
+ *   game mode byte, team count byte, varint uptime in seconds.
+ * - 0x2x PRESS: x = team << 2 | press kind, then varint delta.
+ * - 0x3x CHORD: x = press kind, then varint delta.
+ * - 0x4w MATCH_END: w = winner + 1 (0 on a draw), then team count byte,
+ *   varint delta and for each team varint seconds held, varint points.
+ * - 0xFF: unused until the next flash page.
+ *
+ * Match numbers only grow around the ring. For each sector, RAM keeps the
+ * match in progress where it starts, the last match started in it and the
+ * control points of its matches, rebuilt by the scan at boot. An export of
+ * a few matches reads only the sectors holding them, so the master can pull
+ * the new matches of every node after each one without rereading the ring.
+ *
+ * tools/history_to_csv.py decodes an export or a partition image to CSV.
+ */
+
+#define HISTORY_PARTITION_LABEL     "history"
+#define HISTORY_PARTITION_SUBTYPE   0x40
+
+#define HISTORY_CHORD               (-1)
+#define HISTORY_ANY_CONTROL_POINT   0xFF
+
+/**
+ * @brief Receives an export, a few whole records at a time.
+ */
+typedef esp_err_t (*HistorySink_t)(const uint8_t * data, size_t len, void * ctx);
+
+/**
+ * @brief Find the partition, resume after the last record and register the
+ * MSG_HISTORY_REQUEST handler.
+ *
+ * Without the partition the node plays normally and records nothing.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without the partition, or the error of the flash access.
+ */
+esp_err_t history_init(void);
+
+/**
+ * @brief Log the start of a match and write it to flash.
+ *
+ * @param control_point ControlPoint_t of the node.
+ * @param game_mode GameModeId_t played.
+ * @param team_count Teams playing.
+ * @param now_ms Current app time in milliseconds.
+ */
+void history_match_start(uint8_t control_point, uint8_t game_mode, uint8_t team_count, uint32_t now_ms);
+
+/**
+ * @brief Log a press accepted by the game mode.
+ *
+ * @param team Team_t of the button, HISTORY_CHORD for a chord.
+ * @param press PressKind_t.
+ * @param now_ms Current app time in milliseconds.
+ */
+void history_press(int8_t team, uint8_t press, uint32_t now_ms);
+
+/**
+ * @brief Log the end of a match and write it to flash.
+ *
+ * @param winner Team_t of the winner, -1 on a draw.
+ * @param seconds Time held by each team.
+ * @param points Points of each team.
+ * @param team_count Number of entries of seconds and points.
+ * @param now_ms Current app time in milliseconds.
+ */
+void history_match_end(int8_t winner, const uint32_t * seconds, const uint32_t * points, uint8_t team_count, uint32_t now_ms);
+
+/**
+ * @brief Stream the records of a range of matches, oldest first.
+ *
+ * Records not written to flash yet are read from RAM, so an export in the
+ * middle of a match costs no flash. Matches already overwritten by the ring
+ * are left out.
+ *
+ * @param from_match First match number, 0 for the most recent match_count matches, the one in progress included.
+ * @param match_count Number of match numbers from from_match.
+ * @param control_point Only the matches played as this ControlPoint_t, HISTORY_ANY_CONTROL_POINT for all.
+ * @param sink Receives the records.
+ * @param ctx Passed to the sink.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without the partition, ESP_ERR_INVALID_ARG for an unknown control point, or the first sink or flash error.
+ */
+esp_err_t history_export(uint32_t from_match, uint8_t match_count, uint8_t control_point, HistorySink_t sink, void * ctx);
+
+/**
+ * @brief Print the records of a range of matches on the console.
+ *
+ * One "HIST:<hex>" line per record, the input of tools/history_to_csv.py.
+ *
+ * @param from_match First match number, 0 for the most recent ones.
+ * @param match_count Number of match numbers.
+ * @param control_point ControlPoint_t, HISTORY_ANY_CONTROL_POINT for all.
+ * @return See history_export().
+ */
+esp_err_t history_export_uart(uint32_t from_match, uint8_t match_count, uint8_t control_point);
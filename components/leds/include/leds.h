@@ -1,3 +1,5 @@
+#pragma once
+
 #include "config.h"
 #include "esp_err.h"
 
@@ -5,11 +7,19 @@ typedef enum
 {
     BLUE_LED = GPIO_LED_BLUE,
     RED_LED = GPIO_LED_RED,
+    GREEN_LED = GPIO_LED_GREEN,
+    YELLOW_LED = GPIO_LED_YELLOW,
 } led_t ;
 
 #define OFF     0
 #define ON      1
 
+/**
+ * @brief LED of each team, indexed by team id (Team_t), the only mapping
+ * from teams to LEDs.
+ */
+extern const led_t team_leds[TEAM_COUNT];
+
 esp_err_t led_init();
 esp_err_t turn_led_on(led_t led);
 esp_err_t turn_led_off(led_t led);
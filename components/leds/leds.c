@@ -2,14 +2,34 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 
+const led_t team_leds[TEAM_COUNT] =
+{
+    BLUE_LED,
+    RED_LED,
+#if TEAM_COUNT > 2
+    GREEN_LED,
+#endif
+#if TEAM_COUNT > 3
+    YELLOW_LED,
+#endif
+};
+
+static esp_err_t set_all_leds(int level);
+
 esp_err_t led_init()
 {
 
     esp_err_t ret = ESP_OK;
 
+    uint64_t pin_bit_mask = 0;
+    for(size_t i = 0; i < TEAM_COUNT; i++)
+    {
+        pin_bit_mask |= 1ULL << team_leds[i];
+    }
+
     gpio_config_t io_conf_led = 
     {
-        .pin_bit_mask = (1ULL << GPIO_LED_RED) | (1ULL << GPIO_LED_BLUE),
+        .pin_bit_mask = pin_bit_mask,
         .mode = GPIO_MODE_OUTPUT,
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -23,18 +43,14 @@ esp_err_t led_init()
         return ret;
     }
 
-    ret = gpio_set_level(GPIO_LED_RED, 0);
-    if(ESP_OK != ret)
-    {
-        ESP_LOGE(__func__, "Error calling gpio_set_level(%d): %s", GPIO_LED_RED, esp_err_to_name(ret));
-        return ret;
-    }
-
-    ret = gpio_set_level(GPIO_LED_BLUE, 0);
-    if(ESP_OK != ret)
+    for(size_t i = 0; i < TEAM_COUNT; i++)
     {
-        ESP_LOGE(__func__, "Error calling gpio_set_level(%d): %s", GPIO_LED_BLUE, esp_err_to_name(ret));
-        return ret;
+        ret = gpio_set_level(team_leds[i], 0);
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error calling gpio_set_level(%d): %s", team_leds[i], esp_err_to_name(ret));
+            return ret;
+        }
     }
 
     return ret;
@@ -53,14 +69,20 @@ esp_err_t turn_led_off(led_t led)
 
 esp_err_t turn_all_leds_off()
 {
-    esp_err_t ret = gpio_set_level(BLUE_LED, OFF);
-    ret = ret | gpio_set_level(RED_LED, OFF);
-    return ret;
+    return set_all_leds(OFF);
 }
 
 esp_err_t turn_all_leds_on()
 {
-    esp_err_t ret = gpio_set_level(BLUE_LED, ON);
-    ret = ret | gpio_set_level(RED_LED, ON);
+    return set_all_leds(ON);
+}
+
+static esp_err_t set_all_leds(int level)
+{
+    esp_err_t ret = ESP_OK;
+    for(size_t i = 0; i < TEAM_COUNT; i++)
+    {
+        ret = ret | gpio_set_level(team_leds[i], level);
+    }
     return ret;
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file matchsync.h
+ * @brief Match start and end at the same instant on every node.
+ *
+ * Every master heartbeat carries the master clock. Taken at reception, it
+ * gives the offset of the local clock plus the delay of that heartbeat: the
+ * smallest of the last MATCHSYNC_WINDOW is the estimate, as a delay only
+ * ever adds. Every node is left with about the same minimum delay, so the
+ * nodes agree with each other even closer than with the master.
+ *
+ * A MSG_MATCH_SCHEDULE turns the instant it carries into local time and
+ * arms a one-shot esp_timer for it. When it fires, the app task gets an
+ * APP_EVENT_SYNC_START or APP_EVENT_SYNC_END; before a start it gets an
+ * APP_EVENT_SYNC_COUNTDOWN every second of the countdown.
+ */
+
+typedef struct
+{
+    bool synced;                // At least one heartbeat with the master clock
+    uint32_t samples;           // Heartbeats with the master clock
+    int64_t offset_us;          // Local clock minus master clock, minimum delay included
+    int64_t last_delay_us;      // Delay of the last heartbeat above the minimum
+    int8_t pending;             // MatchScheduleAction_t armed, -1 if none
+    int64_t pending_in_us;      // Time left before it, when read
+    int64_t last_late_us;       // Timer callback behind its instant, last action
+    uint32_t send_failures;     // App events the queue had no room for, a start or end then retried
+} MatchSyncStats_t;
+
+/**
+ * @brief Create the schedule timer and register the MSG_MATCH_SCHEDULE handler.
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t matchsync_init(void);
+
+/**
+ * @brief Take a sample of the master clock.
+ *
+ * Called from the network task on every master heartbeat.
+ *
+ * @param master_us Master clock in the heartbeat.
+ * @param rx_us Local time the heartbeat was received.
+ */
+void matchsync_master_time(uint64_t master_us, int64_t rx_us);
+
+/**
+ * @brief Get the timebase estimate and the pending action.
+ *
+ * @param stats Filled with the counters.
+ */
+void matchsync_get_stats(MatchSyncStats_t * stats);
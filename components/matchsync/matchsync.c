@@ -0,0 +1,251 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "matchsync.h"
+#include "network.h"
+#include "app.h"
+#include "config.h"
+
+static esp_timer_handle_t schedule_timer = NULL;
+static portMUX_TYPE sync_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Under sync_lock: network task
+static int64_t offsets_us[MATCHSYNC_WINDOW];
+static uint32_t samples = 0;
+static int64_t offset_us = 0;
+static int64_t last_delay_us = 0;
+
+// Under sync_lock: armed by the network task, stepped by the timer
+static int8_t pending = -1;
+static int64_t pending_at_us = 0;           // Local clock
+static uint8_t countdown_left = 0;
+static int64_t last_late_us = 0;
+static uint32_t send_failures = 0;
+
+static void schedule_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void schedule_timer_callback(void * arg);
+
+esp_err_t matchsync_init(void)
+{
+
+    const esp_timer_create_args_t schedule_timer_args =
+    {
+        .callback = schedule_timer_callback,
+        .name = "matchsync",
+    };
+
+    esp_err_t ret = esp_timer_create(&schedule_timer_args, &schedule_timer);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_timer_create: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = network_register_handler(MSG_MATCH_SCHEDULE, schedule_handler);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering MSG_MATCH_SCHEDULE handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return ret;
+
+}
+
+void matchsync_master_time(uint64_t master_us, int64_t rx_us)
+{
+
+    int64_t sample = rx_us - (int64_t)master_us;
+
+    portENTER_CRITICAL(&sync_lock);
+    // The master rebooted: its clock starts over, and so does the window
+    if(samples > 0 && (sample - offset_us > (int64_t)MATCHSYNC_RESYNC_MS * 1000 ||
+                       offset_us - sample > (int64_t)MATCHSYNC_RESYNC_MS * 1000))
+    {
+        samples = 0;
+    }
+
+    offsets_us[samples % MATCHSYNC_WINDOW] = sample;
+    samples++;
+
+    uint32_t count = samples < MATCHSYNC_WINDOW ? samples : MATCHSYNC_WINDOW;
+    int64_t best = offsets_us[0];
+    for(uint32_t i = 1; i < count; i++)
+    {
+        if(offsets_us[i] < best)
+            best = offsets_us[i];
+    }
+
+    offset_us = best;
+    last_delay_us = sample - best;
+    portEXIT_CRITICAL(&sync_lock);
+
+}
+
+void matchsync_get_stats(MatchSyncStats_t * stats)
+{
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&sync_lock);
+    stats->synced = samples > 0;
+    stats->samples = samples;
+    stats->offset_us = offset_us;
+    stats->last_delay_us = last_delay_us;
+    stats->pending = pending;
+    stats->pending_in_us = pending >= 0 ? pending_at_us - now : 0;
+    stats->last_late_us = last_late_us;
+    stats->send_failures = send_failures;
+    portEXIT_CRITICAL(&sync_lock);
+
+}
+
+static void schedule_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->src_node != NODE_ID_MASTER || header->payload_len != sizeof(MatchSchedulePayload_t))
+        return;
+
+    MatchSchedulePayload_t schedule;
+    memcpy(&schedule, payload, sizeof(schedule));
+
+    if(schedule.action == MATCH_SCHEDULE_CANCEL)
+    {
+        portENTER_CRITICAL(&sync_lock);
+        bool was_pending = pending >= 0;
+        pending = -1;
+        portEXIT_CRITICAL(&sync_lock);
+
+        esp_timer_stop(schedule_timer);
+        if(was_pending)
+        {
+            ESP_LOGI(__func__, "Scheduled action cancelled");
+        }
+        return;
+    }
+
+    if(schedule.action != MATCH_SCHEDULE_START && schedule.action != MATCH_SCHEDULE_END)
+        return;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&sync_lock);
+    bool synced = samples > 0;
+    int64_t at_us = (int64_t)schedule.at_us + offset_us;
+    portEXIT_CRITICAL(&sync_lock);
+
+    if(!synced)
+    {
+        ESP_LOGW(__func__, "No master clock yet, ignoring the schedule");
+        return;
+    }
+
+    if(now - at_us > (int64_t)MATCHSYNC_LATE_MAX_MS * 1000)
+    {
+        ESP_LOGW(__func__, "Scheduled instant %" PRId64 " ms ago, ignoring", (now - at_us) / 1000);
+        return;
+    }
+
+    // A countdown never starts in the past, nor runs longer than allowed
+    int64_t left_s = at_us > now ? (at_us - now) / 1000000 : 0;
+    uint8_t countdown = schedule.action == MATCH_SCHEDULE_START ? schedule.countdown_s : 0;
+    if(countdown > MATCHSYNC_COUNTDOWN_MAX_S)
+        countdown = MATCHSYNC_COUNTDOWN_MAX_S;
+    if(countdown > left_s)
+        countdown = (uint8_t)left_s;
+
+    esp_timer_stop(schedule_timer);
+
+    portENTER_CRITICAL(&sync_lock);
+    // Repeats of the same schedule only move it by the offset estimate
+    bool repeat = pending == schedule.action && (at_us - pending_at_us < 1000 && pending_at_us - at_us < 1000);
+    pending = schedule.action;
+    pending_at_us = at_us;
+    countdown_left = countdown;
+    int64_t next_us = at_us - (int64_t)countdown * 1000000;
+    portEXIT_CRITICAL(&sync_lock);
+
+    // If the callback re-armed the timer in between, this start fails and its own stands
+    esp_timer_start_once(schedule_timer, next_us > now ? next_us - now : 0);
+
+    if(!repeat)
+    {
+        ESP_LOGI(__func__, "Match %s in %" PRId64 " ms", schedule.action == MATCH_SCHEDULE_START ? "start" : "end",
+                 (at_us - now) / 1000);
+    }
+
+}
+
+static void schedule_timer_callback(void * arg)
+{
+
+    int64_t now = esp_timer_get_time();
+    AppEventMessage_t event = { 0 };
+    int64_t next_us = 0;
+    int8_t action = -1;
+    int64_t action_at_us = 0;
+
+    portENTER_CRITICAL(&sync_lock);
+    if(pending < 0)
+    {
+        portEXIT_CRITICAL(&sync_lock);
+        return;
+    }
+
+    if(countdown_left > 0)
+    {
+        countdown_left--;
+        event.type = APP_EVENT_SYNC_COUNTDOWN;
+        next_us = pending_at_us - (int64_t)countdown_left * 1000000;
+    }
+    else
+    {
+        event.type = pending == MATCH_SCHEDULE_START ? APP_EVENT_SYNC_START : APP_EVENT_SYNC_END;
+        action = pending;
+        action_at_us = pending_at_us;
+        pending = -1;
+    }
+    portEXIT_CRITICAL(&sync_lock);
+
+    // Never block the esp_timer task
+    esp_err_t ret = app_event_send(&event, 0);
+
+    // A start or end the queue had no room for goes again shortly, unless
+    // rescheduled meanwhile. A lost countdown blink is not worth it
+    bool retry = false;
+    portENTER_CRITICAL(&sync_lock);
+    if(ESP_OK != ret)
+    {
+        send_failures++;
+        if(action >= 0 && pending < 0)
+        {
+            pending = action;
+            pending_at_us = action_at_us;
+            retry = true;
+        }
+    }
+    else if(action >= 0)
+    {
+        last_late_us = now - action_at_us;
+    }
+    portEXIT_CRITICAL(&sync_lock);
+
+    // Logged once per action, not on every retry
+    if(ESP_OK != ret && (action < 0 || now - action_at_us < MATCHSYNC_RETRY_MS * 1000))
+    {
+        ESP_LOGW(__func__, "Error sending app event %d: %s", event.type, esp_err_to_name(ret));
+    }
+
+    if(retry)
+    {
+        esp_timer_start_once(schedule_timer, MATCHSYNC_RETRY_MS * 1000);
+    }
+    else if(next_us)
+    {
+        esp_timer_start_once(schedule_timer, next_us > now ? next_us - now : 0);
+    }
+
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "stdbool.h"
+#include "esp_err.h"
+#include "protocol.h"
+
+/**
+ * @file network.h
+ * @brief Authenticated frame link between the node and the master.
+ *
+ * Frames travel over the backends declared in transport.h; nodes out of the
+ * access point range are reached through neighbours relaying over ESP-NOW.
+ *
+ * The station remembers the access point of its last connection in NVS and
+ * goes straight to it on the next one, without scanning; the IP lease is
+ * renewed rather than requested anew (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+ * With CONFIG_DOMINION_WIFI_MODEM_SLEEP the radio sleeps between DTIM beacons.
+ */
+
+typedef struct
+{
+    uint32_t connects;          // Connections up to the IP address
+    uint32_t fast_connects;     // Of which straight to the cached access point
+    uint32_t cache_misses;      // Cached access point gone, fell back to a scan
+    uint32_t last_connect_ms;   // From the drop, or the start, to the IP address
+    uint32_t max_connect_ms;
+    uint32_t total_connect_ms;
+    uint32_t tx_windows;        // Transmissions held for the next beacon
+    uint32_t tx_frames;         // Frames handed to at least one transport, relays included
+    uint16_t beacon_interval_tu; // Announced by the access point, 0 until a beacon is heard
+    uint8_t channel;
+    bool modem_sleep;
+} NetworkWifiStats_t;
+
+/**
+ * @brief Callback invoked from the network task for every valid frame of a given type.
+ *
+ * @param header Header of the received frame.
+ * @param payload Pointer to the frame payload (header->payload_len bytes).
+ */
+typedef void (*network_handler_t)(const FrameHeader_t * header, const uint8_t * payload);
+
+/**
+ * @brief Start the Wi-Fi station and prepare the network layer.
+ *
+ * Requires NVS to be initialized (see storage_init()).
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t network_init(void);
+
+/**
+ * @brief Network task: receives frames and dispatches them to the registered handlers.
+ *
+ * @param arg Unused.
+ */
+void network_task(void* arg);
+
+/**
+ * @brief Register the handler for a message type, replacing any previous one.
+ *
+ * @param type Message type to handle.
+ * @param handler Callback, NULL to unregister.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if type is out of range.
+ */
+esp_err_t network_register_handler(MessageType_t type, network_handler_t handler);
+
+/**
+ * @brief Send a frame to the master.
+ *
+ * The frame is sent on every transport that is up and may be relayed up to
+ * CONFIG_DOMINION_RELAY_HOPS times by other nodes.
+ *
+ * @param type Message type.
+ * @param payload Payload bytes, may be NULL if payload_len is 0.
+ * @param payload_len Number of payload bytes.
+ * @return ESP_OK if at least one transport took the frame, ESP_ERR_INVALID_STATE if none is up,
+ *         ESP_ERR_INVALID_SIZE if the payload does not fit in a frame.
+ */
+esp_err_t network_send_to_master(MessageType_t type, const void * payload, uint16_t payload_len);
+
+/**
+ * @brief Send a frame to a node, or to the master and every node.
+ *
+ * Same as network_send_to_master() with an explicit recipient. Broadcast
+ * frames reach the master as well.
+ *
+ * @param dst_node Recipient node id, NODE_ID_MASTER or NODE_ID_BROADCAST.
+ * @param type Message type.
+ * @param payload Payload bytes, may be NULL if payload_len is 0.
+ * @param payload_len Number of payload bytes.
+ * @return See network_send_to_master().
+ */
+esp_err_t network_send(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len);
+
+/**
+ * @brief Same as network_send(), also giving the sequence number of the frame.
+ *
+ * For matching a reply to the frame.
+ *
+ * @param dst_node Recipient node id, NODE_ID_MASTER or NODE_ID_BROADCAST.
+ * @param type Message type.
+ * @param payload Payload bytes, may be NULL if payload_len is 0.
+ * @param payload_len Number of payload bytes.
+ * @param seq Set to the sequence number of the frame, may be NULL.
+ * @return See network_send_to_master().
+ */
+esp_err_t network_send_seq(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len, uint32_t * seq);
+
+/**
+ * @brief Get the time the frame being handled was received.
+ *
+ * Taken when the transport delivered it, before the receive queue. Only
+ * meaningful from a network_handler_t.
+ *
+ * @return esp_timer_get_time() at reception.
+ */
+int64_t network_get_rx_time_us(void);
+
+/**
+ * @brief Get the identifier of this node, derived from its Wi-Fi MAC address.
+ *
+ * @return Node id, never NODE_ID_MASTER nor NODE_ID_BROADCAST.
+ */
+uint16_t network_get_node_id(void);
+
+/**
+ * @brief Wait until the radio is awake for the next beacon, to transmit then.
+ *
+ * In modem sleep every frame sent between two beacons wakes the radio once
+ * more: a task with frames that can wait up to a beacon interval calls this
+ * and sends them all right after. The interval is the one the access point
+ * announces in its beacons, NETWORK_BEACON_INTERVAL_TU until one is heard.
+ * Returns at once without modem sleep or connection, or when the interval is
+ * above NETWORK_BEACON_INTERVAL_MAX_TU. One caller at a time.
+ */
+void network_wait_tx_window(void);
+
+/**
+ * @brief Get the connection and transmission counters.
+ *
+ * @param stats Filled with the counters.
+ */
+void network_get_wifi_stats(NetworkWifiStats_t * stats);
+
+/**
+ * @brief Get the signal strength of the access point.
+ *
+ * @return RSSI in dBm, 0 when not associated.
+ */
+int8_t network_get_rssi(void);
+
+/**
+ * @brief Drop the connection to the access point; it comes back on its own.
+ *
+ * For measuring the reconnection time, see network_get_wifi_stats().
+ *
+ * @return ESP_OK on success, error code of the Wi-Fi driver otherwise.
+ */
+esp_err_t network_wifi_reconnect(void);
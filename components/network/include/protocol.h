@@ -0,0 +1,269 @@
+#pragma once
+
+#include "stdint.h"
+
+/**
+ * @file protocol.h
+ * @brief Wire format of the frames exchanged between nodes and the master.
+ *
+ * All multi-byte fields are little-endian and all structures are packed.
+ * Every frame starts with a FrameHeader_t followed by payload_len bytes.
+ * Frames with FRAME_FLAG_AUTH set end with an AUTH_TAG_LEN bytes tag
+ * computed over header and payload (see auth.h), with ttl taken as 0 so that
+ * relays can decrement it without re-signing.
+ */
+
+#define PROTOCOL_MAGIC          0xD7
+#define PROTOCOL_VERSION        11
+#define PROTOCOL_MAX_FRAME_LEN  512
+#define PROTOCOL_ESPNOW_FRAME_LEN   250     // ESP_NOW_MAX_DATA_LEN: a longer frame only goes over UDP
+
+#define OTA_URL_MAX_LEN         96
+#define PROTOCOL_MAX_TEAMS      4
+
+#define NODE_ID_MASTER          0x0000
+#define NODE_ID_BROADCAST       0xFFFF
+
+// FRAME FLAGS
+#define FRAME_FLAG_AUTH         (1 << 0)
+
+typedef enum
+{
+    MSG_NONE = 0,
+    // PROVISIONING
+    MSG_CONFIG_PUSH,
+    MSG_CONFIG_ACK,
+    // OTA
+    MSG_OTA_ANNOUNCE,
+    MSG_OTA_STATUS,
+    // FAILOVER
+    MSG_MASTER_HEARTBEAT,   // Broadcast by the master
+    MSG_NODE_STATUS,
+    MSG_SCOREBOARD,
+    MSG_REPLICA_HANDBACK,
+    // HISTORY
+    MSG_HISTORY_REQUEST,
+    MSG_HISTORY_CHUNK,
+    // LINK
+    MSG_STATUS_ACK,
+    // MATCH
+    MSG_MATCH_SCHEDULE,
+    // ...
+    MSG_TYPE_MAX
+} MessageType_t;
+
+/**
+ * @brief Header common to every frame.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t magic;          /**< PROTOCOL_MAGIC. */
+    uint8_t version;        /**< PROTOCOL_VERSION. */
+    uint8_t type;           /**< MessageType_t. */
+    uint8_t flags;          /**< FRAME_FLAG_* bits. */
+    uint8_t ttl;            /**< Relay hops left, not covered by the tag. */
+    uint16_t src_node;      /**< Sender node id, NODE_ID_MASTER for the master. */
+    uint16_t dst_node;      /**< Recipient node id or NODE_ID_BROADCAST. */
+    uint32_t seq;           /**< Per-sender sequence number. */
+    uint16_t payload_len;   /**< Number of payload bytes following the header. */
+} FrameHeader_t;
+
+/**
+ * @brief Control point assigned to a single node inside a config push.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t node_id;
+    int8_t control_point;   /**< ControlPoint_t. */
+} ConfigAssignment_t;
+
+/**
+ * @brief MSG_CONFIG_PUSH payload, broadcast once to the whole fleet.
+ *
+ * The fixed part is followed by assignment_count ConfigAssignment_t entries.
+ * Like every frame it is authenticated by the frame tag.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t config_version;
+    uint32_t match_duration_s;
+    uint16_t press_short_max_ms;
+    uint16_t press_medium_max_ms;
+    uint16_t points_per_second;     /**< 0 for the firmware default. */
+    uint16_t capture_delay_ms;
+    uint16_t hold_bonus_pct;
+    uint8_t game_mode;              /**< GameModeId_t. */
+    uint8_t assignment_count;
+} ConfigPushPayload_t;
+
+typedef enum
+{
+    CONFIG_ACK_OK = 0,
+    CONFIG_ACK_STALE,
+    CONFIG_ACK_INVALID,
+    CONFIG_ACK_STORAGE_ERROR,
+} ConfigAckStatus_t;
+
+/**
+ * @brief MSG_CONFIG_ACK payload, unicast back to the master.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t config_version;    /**< Version the node is running after the push. */
+    uint8_t status;             /**< ConfigAckStatus_t. */
+} ConfigAckPayload_t;
+
+/**
+ * @brief MSG_OTA_ANNOUNCE payload: a delta patch is available on the master.
+ *
+ * The patch transforms the image whose SHA-256 is base_sha256 into the new
+ * firmware. Nodes running a different image ignore the announce.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t firmware_version;      /**< Opaque id of the new firmware, echoed in status reports. */
+    uint8_t base_sha256[32];        /**< SHA-256 of the app image the patch applies to. */
+    uint32_t patch_size;            /**< Patch size in bytes. */
+    char url[OTA_URL_MAX_LEN];      /**< NUL terminated http:// URL of the patch, Range requests supported. */
+} OtaAnnouncePayload_t;
+
+typedef enum
+{
+    OTA_STATUS_STARTED = 0,
+    OTA_STATUS_PROGRESS,
+    OTA_STATUS_DONE,
+    OTA_STATUS_REJECTED_BUSY,
+    OTA_STATUS_REJECTED_BASE,
+    OTA_STATUS_FAILED,
+} OtaStatus_t;
+
+/**
+ * @brief MSG_OTA_STATUS payload, unicast back to the master.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t firmware_version;      /**< Version from the announce. */
+    uint8_t status;                 /**< OtaStatus_t. */
+    uint32_t patch_offset;          /**< Patch bytes applied so far. */
+    uint32_t bytes_transferred;     /**< Bytes received over the wire, retried chunks included. */
+} OtaStatusPayload_t;
+
+/**
+ * @brief MSG_MASTER_HEARTBEAT payload.
+ *
+ * Nodes derive the master timebase from it: the heartbeat delayed the least
+ * gives the closest offset between the two clocks.
+ */
+typedef struct __attribute__((packed))
+{
+    uint64_t time_us;           /**< Master clock when the heartbeat is sent. */
+} MasterHeartbeatPayload_t;
+
+typedef enum
+{
+    MATCH_SCHEDULE_START = 0,
+    MATCH_SCHEDULE_END,
+    MATCH_SCHEDULE_CANCEL,      /**< Drop the pending start or end, at_us is ignored. */
+} MatchScheduleAction_t;
+
+/**
+ * @brief MSG_MATCH_SCHEDULE payload, broadcast by the master.
+ *
+ * Every node starts or ends its match at the same instant of the master
+ * timebase. The master repeats the frame until that instant: a node re-arms
+ * for the last one heard.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t action;             /**< MatchScheduleAction_t. */
+    uint64_t at_us;             /**< Instant, master clock. */
+    uint8_t countdown_s;        /**< Seconds of LED countdown before a start, 0 for none. */
+} MatchSchedulePayload_t;
+
+/**
+ * @brief MSG_NODE_STATUS payload, broadcast by every node.
+ *
+ * Sent on every capture and periodically otherwise, so that it doubles as
+ * the node heartbeat. Scores are cumulative, so the latest status of a node
+ * supersedes all the previous ones.
+ */
+typedef struct __attribute__((packed))
+{
+    int8_t control_point;       /**< ControlPoint_t. */
+    uint8_t state;              /**< AppState_t. */
+    int8_t owner;               /**< Team_t holding the point, TEAM_NONE if nobody. */
+    uint16_t captures;          /**< Captures since the match started. */
+    uint8_t team_count;         /**< Teams playing, the rest of the arrays is zero. */
+    uint32_t seconds[PROTOCOL_MAX_TEAMS];   /**< Time held by each team, indexed by Team_t. */
+    uint32_t points[PROTOCOL_MAX_TEAMS];    /**< Points scored by each team, indexed by Team_t. */
+    uint16_t battery_mv;        /**< Pack voltage, 0 without a battery monitor or a battery. */
+    uint8_t battery_pct;        /**< State of charge, 0xFF without a battery monitor or a battery. */
+    int8_t rssi;                /**< Access point signal in dBm, 0 when not associated. */
+    uint8_t loss_pct;           /**< Statuses left without MSG_STATUS_ACK, smoothed, 0xFF before the first ack. */
+    uint16_t rtt_ms;            /**< Status to MSG_STATUS_ACK round trip, smoothed. */
+    uint16_t period_ms;         /**< Current status period: the node is lost after 3 periods of silence. */
+} NodeStatusPayload_t;
+
+/**
+ * @brief MSG_STATUS_ACK payload, unicast to the sender of a MSG_NODE_STATUS.
+ *
+ * Sent by the master, or by the node standing in for it. Nodes time the
+ * round trip and count the statuses left unacknowledged to pace their own.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t seq;               /**< Sequence number of the acknowledged status frame. */
+} StatusAckPayload_t;
+
+/**
+ * @brief Entry of a scoreboard: last status heard from a control point.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t node_id;
+    NodeStatusPayload_t status;
+    uint32_t age_ms;            /**< Time since the status was received. */
+} ScoreboardEntry_t;
+
+/**
+ * @brief MSG_SCOREBOARD and MSG_REPLICA_HANDBACK payload.
+ *
+ * Broadcast by the node standing in for a missing master, and sent to the
+ * master once it is back. The fixed part, with the field totals scored by the
+ * stand-in, is followed by entry_count ScoreboardEntry_t entries. A scoreboard too long for one ESP-NOW frame
+ * goes in several, each with some of the entries: receivers merge them by
+ * control point.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t aggregator_node;   /**< Node that built the scoreboard. */
+    uint32_t standin_ms;        /**< Time spent standing in so far. */
+    uint32_t points[PROTOCOL_MAX_TEAMS];    /**< Points of each team over the whole field, multi-point bonus included. */
+    uint8_t entry_count;
+} ScoreboardPayload_t;
+
+/**
+ * @brief MSG_HISTORY_REQUEST payload, sent by the master to a node.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t match_count;        /**< Number of match numbers to export. */
+    uint32_t from_match;        /**< First match number, 0 for the most recent match_count matches. */
+    uint8_t control_point;      /**< Only the matches played as this ControlPoint_t, 0xFF for all. */
+} HistoryRequestPayload_t;
+
+#define HISTORY_CHUNK_DATA_MAX  240
+
+/**
+ * @brief MSG_HISTORY_CHUNK payload, unicast back to the requester.
+ *
+ * The fixed part is followed by data_len bytes of history records, whole
+ * records only, in the format decoded by tools/history_to_csv.py.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t chunk;             /**< Chunk index, from 0. */
+    uint8_t last;               /**< 1 on the final chunk of the export. */
+    uint8_t data_len;
+    uint32_t last_match;        /**< Newest match number on the node, the next export starts after it. */
+} HistoryChunkPayload_t;
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "stddef.h"
+#include "stdint.h"
+#include "stdbool.h"
+#include "esp_err.h"
+
+/**
+ * @file transport.h
+ * @brief Backends carrying protocol frames between nodes and master.
+ *
+ * A transport only moves opaque frames: authentication, duplicate
+ * suppression and relaying are done once, above it, by the network layer.
+ * Received frames are handed to network_receive() from whatever context the
+ * backend runs in.
+ */
+
+typedef enum
+{
+    TRANSPORT_UDP,
+    TRANSPORT_ESPNOW,
+    TRANSPORT_MAX
+} TransportId_t;
+
+typedef struct
+{
+    const char * name;
+    size_t max_frame_len;                                               /**< Largest frame the backend can carry. */
+    esp_err_t (*start)(void);                                           /**< Called once the Wi-Fi driver is started. */
+    bool (*is_up)(void);                                                /**< Whether frames can be sent right now. */
+    esp_err_t (*send)(const uint8_t * frame, size_t len, uint16_t dst_node); /**< Recipient from the frame header. */
+} Transport_t;
+
+extern const Transport_t transport_udp;
+extern const Transport_t transport_espnow;
+
+/**
+ * @brief Hand a received frame to the network layer.
+ *
+ * The frame is copied, so the caller may reuse its buffer. Safe to call from
+ * any task, including the Wi-Fi task running the ESP-NOW callbacks.
+ *
+ * @param transport Backend the frame arrived on.
+ * @param frame Frame bytes.
+ * @param len Frame length.
+ */
+void network_receive(TransportId_t transport, const uint8_t * frame, size_t len);
+
+/**
+ * @brief Block until the node is associated and has an IP address.
+ */
+void network_wait_connected(void);
+
+/**
+ * @brief Tell whether the node is associated and has an IP address.
+ *
+ * @return true if connected.
+ */
+bool network_is_connected(void);
@@ -0,0 +1,840 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "sdkconfig.h"
+
+#include "network.h"
+#include "transport.h"
+#include "auth.h"
+#include "storage.h"
+#include "config.h"
+
+#define NETWORK_CONNECTED_BIT   (1 << 0)
+#define WIFI_CACHE_MAGIC        0x57494649
+
+// Beacon frame: frame control, then the BSSID and the beacon interval of the access point
+#define BEACON_FRAME_CONTROL    0x80
+#define BEACON_BSSID_OFFSET     16
+#define BEACON_INTERVAL_OFFSET  32
+
+// Access point of the last connection, so that the next one skips the scan
+typedef struct
+{
+    uint32_t magic;
+    char ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+} NetworkWifiCache_t;
+
+typedef struct
+{
+    TransportId_t transport;
+    uint16_t len;
+    int64_t rx_us;                          // Taken by the backend, before any queueing
+    uint8_t data[PROTOCOL_MAX_FRAME_LEN];
+} NetworkRxFrame_t;
+
+static EventGroupHandle_t network_event_group = NULL;
+static QueueHandle_t network_rx_queue = NULL;
+static network_handler_t network_handlers[MSG_TYPE_MAX] = { 0 };
+
+static const Transport_t * const transports[TRANSPORT_MAX] =
+{
+#if CONFIG_DOMINION_TRANSPORT_UDP
+    [TRANSPORT_UDP] = &transport_udp,
+#endif
+#if CONFIG_DOMINION_TRANSPORT_ESPNOW && !CONFIG_IDF_TARGET_LINUX
+    [TRANSPORT_ESPNOW] = &transport_espnow,
+#endif
+};
+
+static uint16_t node_id = 0;
+static uint32_t rx_dropped = 0;
+static int64_t dispatch_rx_us = 0;
+
+// Frames of no bytes in the receive queue are requests to the network task
+#define NETWORK_REQUEST_SAVE_CACHE      TRANSPORT_MAX
+#define NETWORK_REQUEST_STOP_SNIFFER    (TRANSPORT_MAX + 1)
+static const NetworkRxFrame_t wifi_cache_request = { .transport = NETWORK_REQUEST_SAVE_CACHE, .len = 0 };
+static const NetworkRxFrame_t sniffer_stop_request = { .transport = NETWORK_REQUEST_STOP_SNIFFER, .len = 0 };
+
+// Written by the event loop task under wifi_lock, read by the network task and the sniffer
+static NetworkWifiCache_t wifi_cache = { 0 };
+
+// Event loop task alone
+static bool wifi_cache_locked = false;         // Station configured for the cached access point
+static uint8_t wifi_fast_failures = 0;
+static int64_t wifi_connect_start_us = 0;
+
+static NetworkWifiStats_t wifi_stats = { 0 };
+static portMUX_TYPE wifi_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_timer_handle_t tx_window_timer = NULL;
+static SemaphoreHandle_t tx_window_sem = NULL;
+
+static esp_err_t network_wifi_start(void);
+#if !CONFIG_IDF_TARGET_LINUX
+static void network_wifi_configure(bool use_cache);
+static void network_wifi_save_cache(void);
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+static void network_sniffer_start(void);
+static void network_sniffer_stop(void);
+static void sniffer_callback(void * buf, wifi_promiscuous_pkt_type_t type);
+static void tx_window_callback(void * arg);
+#endif
+static void network_dispatch(NetworkRxFrame_t * rx);
+static void network_relay(NetworkRxFrame_t * rx);
+static esp_err_t network_transmit(const uint8_t * frame, size_t len, uint16_t dst_node);
+
+esp_err_t network_init(void)
+{
+
+    esp_err_t ret = ESP_OK;
+
+    network_event_group = xEventGroupCreate();
+    if(network_event_group == NULL)
+    {
+        ESP_LOGE(__func__, "Error creating network_event_group");
+        return ESP_FAIL;
+    }
+
+    network_rx_queue = xQueueCreate(NETWORK_RX_QUEUE_LEN, sizeof(NetworkRxFrame_t));
+    if(network_rx_queue == NULL)
+    {
+        ESP_LOGE(__func__, "Error creating network_rx_queue");
+        return ESP_FAIL;
+    }
+
+    uint8_t mac[6];
+    ret = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_read_mac: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    node_id = ((uint16_t)mac[4] << 8) | mac[5];
+    if(node_id == NODE_ID_MASTER || node_id == NODE_ID_BROADCAST)
+    {
+        node_id ^= 0x0001;
+    }
+
+    ESP_LOGI(__func__, "NODE ID: 0x%04x", node_id);
+
+    ret = network_wifi_start();
+    if(ESP_OK != ret)
+    {
+        return ret;
+    }
+
+    for(int i = 0; i < TRANSPORT_MAX; i++)
+    {
+        if(transports[i] == NULL)
+        {
+            continue;
+        }
+
+        ret = transports[i]->start();
+        if(ESP_OK != ret)
+        {
+            ESP_LOGE(__func__, "Error starting transport %s: %s", transports[i]->name, esp_err_to_name(ret));
+            return ret;
+        }
+
+        ESP_LOGI(__func__, "TRANSPORT %s STARTED", transports[i]->name);
+    }
+
+    return ret;
+
+}
+
+static esp_err_t network_wifi_start(void)
+{
+
+#if CONFIG_IDF_TARGET_LINUX
+
+    // Host build: no radio, the host network is always up
+    xEventGroupSetBits(network_event_group, NETWORK_CONNECTED_BIT);
+    return ESP_OK;
+
+#else
+
+    esp_err_t ret = esp_netif_init();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_netif_init: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_event_loop_create_default();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_event_loop_create_default: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if(esp_netif_create_default_wifi_sta() == NULL)
+    {
+        ESP_LOGE(__func__, "Error creating the default Wi-Fi station");
+        return ESP_FAIL;
+    }
+
+    wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
+    ret = esp_wifi_init(&init_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_init: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL, NULL);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering WIFI_EVENT handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL, NULL);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error registering IP_EVENT handler: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_wifi_set_mode(WIFI_MODE_STA);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_set_mode: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // A cache of another network, or none yet: scan
+    if(ESP_OK != storage_get_wifi_cache(&wifi_cache, sizeof(wifi_cache)) || wifi_cache.magic != WIFI_CACHE_MAGIC ||
+       strncmp(wifi_cache.ssid, CONFIG_DOMINION_WIFI_SSID, sizeof(wifi_cache.ssid)) != 0)
+    {
+        memset(&wifi_cache, 0, sizeof(wifi_cache));
+    }
+
+    network_wifi_configure(wifi_cache.magic == WIFI_CACHE_MAGIC);
+
+    const esp_timer_create_args_t window_timer_args =
+    {
+        .callback = tx_window_callback,
+        .name = "tx_window",
+    };
+
+    ret = esp_timer_create(&window_timer_args, &tx_window_timer);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_timer_create: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    tx_window_sem = xSemaphoreCreateBinary();
+    if(tx_window_sem == NULL)
+    {
+        ESP_LOGE(__func__, "Error creating tx_window_sem");
+        return ESP_FAIL;
+    }
+
+    ret = esp_wifi_start();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_start: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // The station wakes for each DTIM beacon and transmits at will in between
+#if CONFIG_DOMINION_WIFI_MODEM_SLEEP
+    wifi_stats.modem_sleep = true;
+#endif
+    ret = esp_wifi_set_ps(wifi_stats.modem_sleep ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_set_ps: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return ret;
+
+#endif
+
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+static void network_wifi_configure(bool use_cache)
+{
+
+    wifi_config_t wifi_config =
+    {
+        .sta =
+        {
+            .ssid = CONFIG_DOMINION_WIFI_SSID,
+            .password = CONFIG_DOMINION_WIFI_PASSWORD,
+            .channel = CONFIG_DOMINION_WIFI_CHANNEL,
+            .scan_method = WIFI_FAST_SCAN,
+            .threshold.authmode = sizeof(CONFIG_DOMINION_WIFI_PASSWORD) > 1 ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN,
+        },
+    };
+
+    // One probe on one channel for one access point, instead of a scan
+    if(use_cache)
+    {
+        wifi_config.sta.bssid_set = true;
+        portENTER_CRITICAL(&wifi_lock);
+        memcpy(wifi_config.sta.bssid, wifi_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = wifi_cache.channel;
+        portEXIT_CRITICAL(&wifi_lock);
+    }
+
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_set_config: %s", esp_err_to_name(ret));
+        use_cache = false;
+    }
+
+    wifi_cache_locked = use_cache;
+    wifi_fast_failures = 0;
+
+}
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+
+    if(event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+    {
+        wifi_connect_start_us = esp_timer_get_time();
+        esp_wifi_connect();
+    }
+    else if(event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        wifi_event_sta_connected_t * event = (wifi_event_sta_connected_t *)event_data;
+        wifi_fast_failures = 0;
+
+        // First connection or another access point: the network task stores it,
+        // the event task has too little stack for NVS. Its beacon interval is
+        // heard anew
+        portENTER_CRITICAL(&wifi_lock);
+        wifi_stats.channel = event->channel;
+        bool new_ap = wifi_cache.magic != WIFI_CACHE_MAGIC || wifi_cache.channel != event->channel ||
+                      memcmp(wifi_cache.bssid, event->bssid, sizeof(wifi_cache.bssid)) != 0;
+        if(new_ap)
+        {
+            wifi_cache.magic = WIFI_CACHE_MAGIC;
+            strncpy(wifi_cache.ssid, CONFIG_DOMINION_WIFI_SSID, sizeof(wifi_cache.ssid));
+            memcpy(wifi_cache.bssid, event->bssid, sizeof(wifi_cache.bssid));
+            wifi_cache.channel = event->channel;
+            wifi_stats.beacon_interval_tu = 0;
+        }
+        bool interval_known = wifi_stats.beacon_interval_tu != 0;
+        portEXIT_CRITICAL(&wifi_lock);
+
+        if(new_ap)
+        {
+            xQueueSend(network_rx_queue, &wifi_cache_request, 0);
+        }
+
+        // Only the periodic frames held for a beacon need its interval
+        if(wifi_stats.modem_sleep && !interval_known)
+        {
+            network_sniffer_start();
+        }
+    }
+    else if(event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        wifi_event_sta_disconnected_t * event = (wifi_event_sta_disconnected_t *)event_data;
+
+        // The outage is timed from the drop, not from each retry
+        if(network_is_connected())
+        {
+            ESP_LOGW(__func__, "Wi-Fi disconnected, reconnecting...");
+            xEventGroupClearBits(network_event_group, NETWORK_CONNECTED_BIT);
+            wifi_connect_start_us = esp_timer_get_time();
+        }
+
+        // The access point was replaced or moved to another channel: back to a scan
+        if(wifi_cache_locked &&
+           (event->reason == WIFI_REASON_NO_AP_FOUND || ++wifi_fast_failures >= NETWORK_FAST_CONNECT_RETRIES))
+        {
+            ESP_LOGW(__func__, "Cached access point not found, scanning");
+            portENTER_CRITICAL(&wifi_lock);
+            memset(&wifi_cache, 0, sizeof(wifi_cache));
+            wifi_stats.cache_misses++;
+            portEXIT_CRITICAL(&wifi_lock);
+
+            network_wifi_configure(false);
+        }
+
+        esp_wifi_connect();
+    }
+    else if(event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        ip_event_got_ip_t * event = (ip_event_got_ip_t *)event_data;
+        uint32_t connect_ms = (uint32_t)((esp_timer_get_time() - wifi_connect_start_us) / 1000);
+
+        portENTER_CRITICAL(&wifi_lock);
+        wifi_stats.connects++;
+        wifi_stats.fast_connects += wifi_cache_locked;
+        wifi_stats.last_connect_ms = connect_ms;
+        wifi_stats.total_connect_ms += connect_ms;
+        if(connect_ms > wifi_stats.max_connect_ms)
+            wifi_stats.max_connect_ms = connect_ms;
+        portEXIT_CRITICAL(&wifi_lock);
+
+        ESP_LOGI(__func__, "Got IP: " IPSTR " in %" PRIu32 " ms%s", IP2STR(&event->ip_info.ip), connect_ms,
+                 wifi_cache_locked ? " (cached access point)" : "");
+        xEventGroupSetBits(network_event_group, NETWORK_CONNECTED_BIT);
+    }
+
+}
+
+static void network_wifi_save_cache(void)
+{
+
+    NetworkWifiCache_t cache;
+    portENTER_CRITICAL(&wifi_lock);
+    cache = wifi_cache;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    esp_err_t ret = storage_set_wifi_cache(&cache, sizeof(cache));
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling storage_set_wifi_cache: %s", esp_err_to_name(ret));
+    }
+
+}
+
+// Event loop task: management frames to sniffer_callback() until a beacon of
+// the access point is heard. The radio stays awake meanwhile, a beacon
+// interval or so
+static void network_sniffer_start(void)
+{
+
+    const wifi_promiscuous_filter_t filter = { .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT };
+    esp_err_t ret = esp_wifi_set_promiscuous_filter(&filter);
+    if(ESP_OK == ret)
+    {
+        ret = esp_wifi_set_promiscuous_rx_cb(sniffer_callback);
+    }
+    if(ESP_OK == ret)
+    {
+        ret = esp_wifi_set_promiscuous(true);
+    }
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error starting the beacon sniffer: %s", esp_err_to_name(ret));
+    }
+
+}
+
+// Network task, on the request of sniffer_callback(): the Wi-Fi task cannot
+// call the driver from its own callback
+static void network_sniffer_stop(void)
+{
+
+    esp_err_t ret = esp_wifi_set_promiscuous(false);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_wifi_set_promiscuous: %s", esp_err_to_name(ret));
+    }
+
+}
+
+// Wi-Fi task: the interval of a beacon of our access point, then the sniffer
+// is stopped. Should the request not fit the queue, the next beacon sends it again
+static void sniffer_callback(void * buf, wifi_promiscuous_pkt_type_t type)
+{
+
+    const wifi_promiscuous_pkt_t * pkt = (const wifi_promiscuous_pkt_t *)buf;
+    const uint8_t * frame = pkt->payload;
+    if(type != WIFI_PKT_MGMT || pkt->rx_ctrl.sig_len < BEACON_INTERVAL_OFFSET + 2 || frame[0] != BEACON_FRAME_CONTROL)
+        return;
+
+    uint16_t interval_tu = frame[BEACON_INTERVAL_OFFSET] | frame[BEACON_INTERVAL_OFFSET + 1] << 8;
+    if(interval_tu == 0)
+        return;
+
+    portENTER_CRITICAL(&wifi_lock);
+    bool ours = memcmp(&frame[BEACON_BSSID_OFFSET], wifi_cache.bssid, sizeof(wifi_cache.bssid)) == 0;
+    if(ours)
+        wifi_stats.beacon_interval_tu = interval_tu;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    if(ours)
+    {
+        xQueueSend(network_rx_queue, &sniffer_stop_request, 0);
+    }
+
+}
+
+static void tx_window_callback(void * arg)
+{
+    xSemaphoreGive(tx_window_sem);
+}
+
+#endif
+
+void network_wait_tx_window(void)
+{
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+    // Without power save the radio is up anyway
+    if(!wifi_stats.modem_sleep || tx_window_timer == NULL || !network_is_connected())
+        return;
+
+    portENTER_CRITICAL(&wifi_lock);
+    uint16_t interval_tu = wifi_stats.beacon_interval_tu;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    if(interval_tu == 0)
+        interval_tu = NETWORK_BEACON_INTERVAL_TU;
+
+    // Too long a wait for frames meant to go out once a period
+    if(interval_tu > NETWORK_BEACON_INTERVAL_MAX_TU)
+        return;
+
+    int64_t tsf_us = esp_wifi_get_tsf_time(WIFI_IF_STA);
+    if(tsf_us <= 0)
+        return;
+
+    // Beacons go out when the access point TSF crosses a multiple of the
+    // interval: the station is awake for it, and the frames ride on that wake
+    const int64_t beacon_us = (int64_t)interval_tu * 1024;
+    int64_t wait_us = beacon_us - tsf_us % beacon_us + NETWORK_TX_WINDOW_OFFSET_US;
+
+    xSemaphoreTake(tx_window_sem, 0);
+    if(ESP_OK != esp_timer_start_once(tx_window_timer, wait_us))
+        return;
+
+    xSemaphoreTake(tx_window_sem, pdMS_TO_TICKS(wait_us / 1000) + 2);
+
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_stats.tx_windows++;
+    portEXIT_CRITICAL(&wifi_lock);
+
+#endif
+
+}
+
+void network_get_wifi_stats(NetworkWifiStats_t * stats)
+{
+    portENTER_CRITICAL(&wifi_lock);
+    *stats = wifi_stats;
+    portEXIT_CRITICAL(&wifi_lock);
+}
+
+int8_t network_get_rssi(void)
+{
+
+#if CONFIG_IDF_TARGET_LINUX
+    return 0;
+#else
+    wifi_ap_record_t ap;
+    if(!network_is_connected() || ESP_OK != esp_wifi_sta_get_ap_info(&ap))
+        return 0;
+
+    return ap.rssi;
+#endif
+
+}
+
+esp_err_t network_wifi_reconnect(void)
+{
+
+#if CONFIG_IDF_TARGET_LINUX
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    // The disconnect event reconnects, and times it
+    return esp_wifi_disconnect();
+#endif
+
+}
+
+void network_wait_connected(void)
+{
+    xEventGroupWaitBits(network_event_group, NETWORK_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+bool network_is_connected(void)
+{
+    return (xEventGroupGetBits(network_event_group) & NETWORK_CONNECTED_BIT) != 0;
+}
+
+void network_receive(TransportId_t transport, const uint8_t * frame, size_t len)
+{
+
+    // One staging buffer per backend: each backend delivers from a single
+    // context, and the Wi-Fi task running the ESP-NOW callback has little stack
+    static NetworkRxFrame_t staging[TRANSPORT_MAX];
+
+    if(transport >= TRANSPORT_MAX || len < sizeof(FrameHeader_t) || len > PROTOCOL_MAX_FRAME_LEN)
+    {
+        return;
+    }
+
+    staging[transport].transport = transport;
+    staging[transport].len = len;
+    staging[transport].rx_us = esp_timer_get_time();
+    memcpy(staging[transport].data, frame, len);
+
+    if(pdPASS != xQueueSend(network_rx_queue, &staging[transport], 0))
+    {
+        rx_dropped++;
+    }
+
+}
+
+void network_task(void* arg)
+{
+
+    static NetworkRxFrame_t rx;
+
+    for(;;)
+    {
+        if(!xQueueReceive(network_rx_queue, &rx, portMAX_DELAY))
+        {
+            continue;
+        }
+
+        if(rx.len == 0)
+        {
+#if !CONFIG_IDF_TARGET_LINUX
+            if(rx.transport == NETWORK_REQUEST_SAVE_CACHE)
+                network_wifi_save_cache();
+            else
+                network_sniffer_stop();
+#endif
+            continue;
+        }
+
+        dispatch_rx_us = rx.rx_us;
+        network_dispatch(&rx);
+    }
+
+}
+
+static void network_dispatch(NetworkRxFrame_t * rx)
+{
+
+    uint8_t * frame = rx->data;
+    int len = rx->len;
+    FrameHeader_t * header = (FrameHeader_t *)frame;
+
+    if(header->magic != PROTOCOL_MAGIC || header->version != PROTOCOL_VERSION)
+    {
+        ESP_LOGW(__func__, "Dropping frame with bad magic/version: 0x%02x/%d", header->magic, header->version);
+        return;
+    }
+
+    if(!(header->flags & FRAME_FLAG_AUTH) || header->payload_len != len - sizeof(FrameHeader_t) - AUTH_TAG_LEN)
+    {
+        ESP_LOGW(__func__, "Dropping unauthenticated frame or frame with bad length: %d/%d", header->payload_len, len);
+        return;
+    }
+
+    // Our own frame, echoed back by a broadcast or by a relay
+    if(header->src_node == node_id)
+    {
+        return;
+    }
+
+    bool for_me = header->dst_node == node_id || header->dst_node == NODE_ID_BROADCAST;
+    if(!for_me && CONFIG_DOMINION_RELAY_HOPS == 0)
+    {
+        return;
+    }
+
+    // The tag is computed with ttl = 0
+    uint8_t ttl = header->ttl;
+    header->ttl = 0;
+
+    int signed_len = sizeof(FrameHeader_t) + header->payload_len;
+    if(ESP_OK != auth_verify(frame, signed_len, frame + signed_len))
+    {
+        ESP_LOGW(__func__, "Dropping frame with bad tag from 0x%04x", header->src_node);
+        return;
+    }
+
+    header->ttl = ttl;
+
+    // Also suppresses the copies of a frame arriving over several paths
+    if(!auth_check_replay(header->src_node, header->seq))
+    {
+        ESP_LOGD(__func__, "Dropping duplicate frame from 0x%04x, seq %lu", header->src_node, (unsigned long)header->seq);
+        return;
+    }
+
+    if(header->dst_node != node_id && ttl > 0)
+    {
+        network_relay(rx);
+    }
+
+    if(!for_me)
+    {
+        return;
+    }
+
+    if(header->type >= MSG_TYPE_MAX || network_handlers[header->type] == NULL)
+    {
+        ESP_LOGW(__func__, "No handler for message type %d", header->type);
+        return;
+    }
+
+    network_handlers[header->type](header, frame + sizeof(FrameHeader_t));
+
+}
+
+static void network_relay(NetworkRxFrame_t * rx)
+{
+
+    FrameHeader_t * header = (FrameHeader_t *)rx->data;
+    const Transport_t * espnow = transports[TRANSPORT_ESPNOW];
+    const Transport_t * udp = transports[TRANSPORT_UDP];
+
+    header->ttl--;
+
+    // Re-broadcast to the nodes around
+    if(espnow != NULL && espnow->is_up() && rx->len <= espnow->max_frame_len)
+    {
+        espnow->send(rx->data, rx->len, header->dst_node);
+    }
+
+    // Uplink for the nodes out of the access point range. Not the broadcasts:
+    // every relay in range of the access point would send its own copy
+    bool for_master = header->dst_node == NODE_ID_MASTER;
+    if(for_master && rx->transport != TRANSPORT_UDP && udp != NULL && udp->is_up())
+    {
+        udp->send(rx->data, rx->len, header->dst_node);
+    }
+
+}
+
+static esp_err_t network_transmit(const uint8_t * frame, size_t len, uint16_t dst_node)
+{
+
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+
+    // Every backend that is up gets a copy: receivers drop duplicates, and
+    // the frame gets through as long as one path works
+    for(int i = 0; i < TRANSPORT_MAX; i++)
+    {
+        if(transports[i] == NULL || !transports[i]->is_up() || len > transports[i]->max_frame_len)
+        {
+            continue;
+        }
+
+        if(ESP_OK == transports[i]->send(frame, len, dst_node))
+        {
+            ret = ESP_OK;
+        }
+    }
+
+    if(ESP_OK == ret)
+    {
+        portENTER_CRITICAL(&wifi_lock);
+        wifi_stats.tx_frames++;
+        portEXIT_CRITICAL(&wifi_lock);
+    }
+
+    return ret;
+
+}
+
+esp_err_t network_register_handler(MessageType_t type, network_handler_t handler)
+{
+    if(type <= MSG_NONE || type >= MSG_TYPE_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    network_handlers[type] = handler;
+    return ESP_OK;
+}
+
+esp_err_t network_send_to_master(MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    return network_send(NODE_ID_MASTER, type, payload, payload_len);
+}
+
+esp_err_t network_send(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    return network_send_seq(dst_node, type, payload, payload_len, NULL);
+}
+
+esp_err_t network_send_seq(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len, uint32_t * seq)
+{
+
+    if(payload_len > PROTOCOL_MAX_FRAME_LEN - sizeof(FrameHeader_t) - AUTH_TAG_LEN)
+        return ESP_ERR_INVALID_SIZE;
+
+    uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    FrameHeader_t * header = (FrameHeader_t *)frame;
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->type = type;
+    header->flags = 0;
+    header->ttl = 0;
+    header->src_node = node_id;
+    header->dst_node = dst_node;
+    header->payload_len = payload_len;
+
+    uint32_t frame_seq;
+    esp_err_t seq_err = auth_next_seq(&frame_seq);
+    if(ESP_OK != seq_err)
+    {
+        ESP_LOGE(__func__, "Error calling auth_next_seq: %s", esp_err_to_name(seq_err));
+        return seq_err;
+    }
+    header->seq = frame_seq;
+
+    if(payload_len > 0)
+    {
+        memcpy(frame + sizeof(FrameHeader_t), payload, payload_len);
+    }
+
+    size_t frame_len = sizeof(FrameHeader_t) + payload_len;
+
+    // Without a key the frame goes out unsigned, the master decides what to do with it
+    if(auth_is_ready())
+    {
+        header->flags |= FRAME_FLAG_AUTH;
+        esp_err_t err = auth_sign(frame, frame_len, frame + frame_len);
+        if(ESP_OK != err)
+        {
+            ESP_LOGE(__func__, "Error calling auth_sign: %s", esp_err_to_name(err));
+            return err;
+        }
+        frame_len += AUTH_TAG_LEN;
+    }
+
+    header->ttl = CONFIG_DOMINION_RELAY_HOPS;
+
+    if(seq)
+    {
+        *seq = header->seq;
+    }
+
+    return network_transmit(frame, frame_len, dst_node);
+
+}
+
+int64_t network_get_rx_time_us(void)
+{
+    return dispatch_rx_us;
+}
+
+uint16_t network_get_node_id(void)
+{
+    return node_id;
+}
@@ -0,0 +1,87 @@
+#include "string.h"
+#include "esp_log.h"
+#include "esp_now.h"
+
+#include "transport.h"
+#include "protocol.h"
+
+_Static_assert(PROTOCOL_ESPNOW_FRAME_LEN == ESP_NOW_MAX_DATA_LEN, "Frame limit of the other components");
+
+static const uint8_t espnow_broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static bool espnow_started = false;
+
+static esp_err_t espnow_start(void);
+static bool espnow_is_up(void);
+static esp_err_t espnow_send(const uint8_t * frame, size_t len, uint16_t dst_node);
+static void espnow_recv_cb(const esp_now_recv_info_t * info, const uint8_t * data, int len);
+
+const Transport_t transport_espnow =
+{
+    .name = "espnow",
+    .max_frame_len = ESP_NOW_MAX_DATA_LEN,
+    .start = espnow_start,
+    .is_up = espnow_is_up,
+    .send = espnow_send,
+};
+
+static esp_err_t espnow_start(void)
+{
+
+    esp_err_t ret = esp_now_init();
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_now_init: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_now_register_recv_cb(espnow_recv_cb);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_now_register_recv_cb: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // Channel 0: follow the channel the station is on
+    esp_now_peer_info_t peer =
+    {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, espnow_broadcast_mac, ESP_NOW_ETH_ALEN);
+
+    ret = esp_now_add_peer(&peer);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_now_add_peer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    espnow_started = true;
+    return ESP_OK;
+
+}
+
+static bool espnow_is_up(void)
+{
+    return espnow_started;
+}
+
+static esp_err_t espnow_send(const uint8_t * frame, size_t len, uint16_t dst_node)
+{
+    if(!espnow_started)
+        return ESP_ERR_INVALID_STATE;
+
+    if(len > ESP_NOW_MAX_DATA_LEN)
+        return ESP_ERR_INVALID_SIZE;
+
+    // Everything is broadcast: the master listens like any other peer and
+    // the header tells who the frame is for
+    return esp_now_send(espnow_broadcast_mac, frame, len);
+}
+
+static void espnow_recv_cb(const esp_now_recv_info_t * info, const uint8_t * data, int len)
+{
+    // Runs in the Wi-Fi task: just copy the frame out
+    network_receive(TRANSPORT_ESPNOW, data, len);
+}
@@ -0,0 +1,174 @@
+#include "string.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "transport.h"
+#include "protocol.h"
+#include "config.h"
+
+#define UDP_RETRY_DELAY_MS  1000
+
+static int udp_socket = -1;
+// Written by the receive task, read by the senders
+static struct sockaddr_in master_addr;
+static bool master_addr_known = false;
+static portMUX_TYPE master_addr_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t udp_start(void);
+static bool udp_is_up(void);
+static esp_err_t udp_send(const uint8_t * frame, size_t len, uint16_t dst_node);
+static esp_err_t udp_open_socket(void);
+static void udp_rx_task(void* arg);
+
+const Transport_t transport_udp =
+{
+    .name = "udp",
+    .max_frame_len = PROTOCOL_MAX_FRAME_LEN,
+    .start = udp_start,
+    .is_up = udp_is_up,
+    .send = udp_send,
+};
+
+static esp_err_t udp_start(void)
+{
+    BaseType_t task_error = xTaskCreate(udp_rx_task, "udp_rx", UDP_RX_TASK_STACK_DEPTH, NULL, NETWORK_TASK_PRIORITY, NULL);
+    return pdPASS == task_error ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static bool udp_is_up(void)
+{
+    return udp_socket >= 0 && network_is_connected();
+}
+
+static esp_err_t udp_open_socket(void)
+{
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sock < 0)
+    {
+        ESP_LOGE(__func__, "Error creating socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    // Broadcast to reach the other nodes, reuse so that several simulated
+    // nodes can share the port on a host
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in local_addr =
+    {
+        .sin_family = AF_INET,
+        .sin_port = htons(NODE_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    if(bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+    {
+        ESP_LOGE(__func__, "Error binding socket: errno %d", errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    udp_socket = sock;
+    return ESP_OK;
+
+}
+
+static void udp_rx_task(void* arg)
+{
+
+    static uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+
+    for(;;)
+    {
+
+        network_wait_connected();
+
+        if(udp_socket < 0 && ESP_OK != udp_open_socket())
+        {
+            vTaskDelay(pdMS_TO_TICKS(UDP_RETRY_DELAY_MS));
+            continue;
+        }
+
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(udp_socket, frame, sizeof(frame), 0, (struct sockaddr *)&from, &from_len);
+        if(len < 0)
+        {
+            ESP_LOGE(__func__, "Error calling recvfrom: errno %d", errno);
+            close(udp_socket);
+            udp_socket = -1;
+            continue;
+        }
+
+        // The master always sends from its own port, nodes from theirs: frames
+        // relayed by other nodes must not redirect our uplink
+        if(from.sin_port == htons(MASTER_UDP_PORT))
+        {
+            portENTER_CRITICAL(&master_addr_lock);
+            master_addr = from;
+            master_addr_known = true;
+            portEXIT_CRITICAL(&master_addr_lock);
+        }
+
+        network_receive(TRANSPORT_UDP, frame, len);
+
+    }
+
+}
+
+static esp_err_t udp_send(const uint8_t * frame, size_t len, uint16_t dst_node)
+{
+
+    if(!udp_is_up())
+        return ESP_ERR_INVALID_STATE;
+
+    struct sockaddr_in dest =
+    {
+        .sin_family = AF_INET,
+        .sin_port = htons(dst_node == NODE_ID_MASTER ? MASTER_UDP_PORT : NODE_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_BROADCAST),
+    };
+
+    struct sockaddr_in master;
+    portENTER_CRITICAL(&master_addr_lock);
+    bool master_known = master_addr_known;
+    master = master_addr;
+    portEXIT_CRITICAL(&master_addr_lock);
+
+    // Until the master is known, its frames are broadcast on the master port
+    if(dst_node == NODE_ID_MASTER && master_known)
+    {
+        dest = master;
+    }
+
+    int sent = sendto(udp_socket, frame, len, 0, (struct sockaddr *)&dest, sizeof(dest));
+    if(sent < 0)
+    {
+        ESP_LOGE(__func__, "Error calling sendto: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    // Broadcasts are for the master too, which listens on its own port
+    if(dst_node == NODE_ID_BROADCAST)
+    {
+        dest.sin_port = htons(MASTER_UDP_PORT);
+        if(master_known)
+        {
+            dest = master;
+        }
+
+        sent = sendto(udp_socket, frame, len, 0, (struct sockaddr *)&dest, sizeof(dest));
+        if(sent < 0)
+        {
+            ESP_LOGE(__func__, "Error calling sendto: errno %d", errno);
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+
+/**
+ * @file ota.h
+ * @brief Over-the-air firmware update from delta patches served by the master.
+ *
+ * The master announces a patch built with esp_delta_ota against the image the
+ * node is running. The node downloads it in OTA_CHUNK_SIZE Range requests,
+ * applies it on the fly into the inactive OTA slot and reboots into it.
+ * A chunk that fails is requested again from the last applied byte, so a
+ * flaky link costs retries, not restarts. The new image must pass
+ * app_init() once, otherwise the bootloader rolls back to the previous slot.
+ */
+
+/**
+ * @brief Register the OTA announce handler.
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t ota_init(void);
+
+/**
+ * @brief Confirm or reject a freshly updated image after app_init().
+ *
+ * Does nothing unless the running image is pending verification. On failure
+ * the image is marked invalid and the device reboots into the previous one.
+ *
+ * @param init_result Result of app_init().
+ */
+void ota_confirm_boot(esp_err_t init_result);
@@ -0,0 +1,327 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "esp_delta_ota.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "ota.h"
+#include "network.h"
+#include "app.h"
+#include "config.h"
+
+#define OTA_PROGRESS_EVERY_CHUNKS   8
+#define OTA_REBOOT_DELAY_MS         500
+
+typedef struct
+{
+    OtaAnnouncePayload_t announce;
+    const esp_partition_t * running;
+    const esp_partition_t * target;
+    esp_ota_handle_t ota_handle;
+    uint32_t patch_offset;
+    uint32_t bytes_transferred;
+} OtaSession_t;
+
+static OtaSession_t session;
+static volatile bool ota_busy = false;
+static uint8_t chunk_buffer[OTA_CHUNK_SIZE];
+
+static void ota_announce_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void ota_task(void* arg);
+static esp_err_t ota_run_session(void);
+static esp_err_t ota_fetch_chunk(esp_http_client_handle_t client, esp_delta_ota_handle_t delta);
+static esp_err_t delta_read_cb(uint8_t * buf, size_t size, int src_offset);
+static esp_err_t delta_write_cb(const uint8_t * buf, size_t size, void * user_data);
+static void send_ota_status(uint32_t firmware_version, OtaStatus_t status);
+
+esp_err_t ota_init(void)
+{
+    const esp_partition_t * running = esp_ota_get_running_partition();
+    ESP_LOGI(__func__, "Running from partition %s", running ? running->label : "?");
+
+    return network_register_handler(MSG_OTA_ANNOUNCE, ota_announce_handler);
+}
+
+void ota_confirm_boot(esp_err_t init_result)
+{
+
+    esp_ota_img_states_t state;
+    if(ESP_OK != esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) || state != ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        return;
+    }
+
+    if(ESP_OK == init_result)
+    {
+        ESP_LOGI(__func__, "New firmware initialized OK, cancelling rollback");
+        esp_ota_mark_app_valid_cancel_rollback();
+    }
+    else
+    {
+        ESP_LOGE(__func__, "New firmware failed to initialize, rolling back!");
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+
+}
+
+static void ota_announce_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len != sizeof(OtaAnnouncePayload_t))
+    {
+        ESP_LOGW(__func__, "OTA announce with bad length: %d", header->payload_len);
+        return;
+    }
+
+    const OtaAnnouncePayload_t * announce = (const OtaAnnouncePayload_t *)payload;
+
+    if(announce->url[OTA_URL_MAX_LEN - 1] != '\0' || announce->patch_size == 0)
+    {
+        ESP_LOGW(__func__, "Malformed OTA announce");
+        return;
+    }
+
+    // Never update during a match
+    AppState_t state = get_app_state();
+    if(ota_busy || state == APP_STATE_RUNNING)
+    {
+        send_ota_status(announce->firmware_version, OTA_STATUS_REJECTED_BUSY);
+        return;
+    }
+
+    // The patch is only valid against the image it was built from; this also
+    // makes repeated announces a no-op once the node has updated
+    uint8_t running_sha[32];
+    const esp_partition_t * running = esp_ota_get_running_partition();
+    if(ESP_OK != esp_partition_get_sha256(running, running_sha) || memcmp(running_sha, announce->base_sha256, sizeof(running_sha)) != 0)
+    {
+        send_ota_status(announce->firmware_version, OTA_STATUS_REJECTED_BASE);
+        return;
+    }
+
+    memset(&session, 0, sizeof(session));
+    session.announce = *announce;
+    session.running = running;
+    ota_busy = true;
+
+    BaseType_t task_error = xTaskCreate(ota_task, "ota", OTA_TASK_STACK_DEPTH, NULL, OTA_TASK_PRIORITY, NULL);
+    if(pdPASS != task_error)
+    {
+        ESP_LOGE(__func__, "Error creating ota task");
+        ota_busy = false;
+        send_ota_status(announce->firmware_version, OTA_STATUS_FAILED);
+    }
+
+}
+
+static void ota_task(void* arg)
+{
+
+    ESP_LOGI(__func__, "Starting OTA %" PRIu32 ": %" PRIu32 " bytes from %s",
+             session.announce.firmware_version, session.announce.patch_size, session.announce.url);
+
+    send_ota_status(session.announce.firmware_version, OTA_STATUS_STARTED);
+
+    esp_err_t err = ota_run_session();
+    if(ESP_OK == err)
+    {
+        ESP_LOGI(__func__, "OTA done, %" PRIu32 " bytes transferred. Rebooting...", session.bytes_transferred);
+        send_ota_status(session.announce.firmware_version, OTA_STATUS_DONE);
+        vTaskDelay(pdMS_TO_TICKS(OTA_REBOOT_DELAY_MS));
+        esp_restart();
+    }
+
+    ESP_LOGE(__func__, "OTA failed at %" PRIu32 "/%" PRIu32 ": %s", session.patch_offset, session.announce.patch_size, esp_err_to_name(err));
+    send_ota_status(session.announce.firmware_version, OTA_STATUS_FAILED);
+
+    ota_busy = false;
+    vTaskDelete(NULL);
+
+}
+
+static esp_err_t ota_run_session(void)
+{
+
+    session.target = esp_ota_get_next_update_partition(NULL);
+    if(session.target == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = esp_ota_begin(session.target, OTA_WITH_SEQUENTIAL_WRITES, &session.ota_handle);
+    if(ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error calling esp_ota_begin: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    esp_delta_ota_cfg_t delta_config =
+    {
+        .user_data = &session,
+        .read_cb = delta_read_cb,
+        .write_cb = delta_write_cb,
+    };
+
+    esp_delta_ota_handle_t delta = esp_delta_ota_init(&delta_config);
+    if(delta == NULL)
+    {
+        esp_ota_abort(session.ota_handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_http_client_config_t http_config =
+    {
+        .url = session.announce.url,
+        .timeout_ms = OTA_HTTP_TIMEOUT_MS,
+        .keep_alive_enable = true,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if(client == NULL)
+    {
+        esp_delta_ota_deinit(delta);
+        esp_ota_abort(session.ota_handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    int retries = 0;
+    int chunks = 0;
+    err = ESP_OK;
+
+    while(session.patch_offset < session.announce.patch_size)
+    {
+
+        err = ota_fetch_chunk(client, delta);
+        if(ESP_OK == err)
+        {
+            retries = 0;
+            if(++chunks % OTA_PROGRESS_EVERY_CHUNKS == 0)
+            {
+                send_ota_status(session.announce.firmware_version, OTA_STATUS_PROGRESS);
+            }
+            continue;
+        }
+
+        // A patch that does not apply will not get better by retrying
+        if(ESP_ERR_INVALID_STATE == err || ++retries > OTA_CHUNK_MAX_RETRIES)
+        {
+            break;
+        }
+
+        ESP_LOGW(__func__, "Chunk at %" PRIu32 " failed (%s), retry %d", session.patch_offset, esp_err_to_name(err), retries);
+        vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_DELAY_MS));
+
+    }
+
+    esp_http_client_cleanup(client);
+
+    if(ESP_OK == err)
+    {
+        err = esp_delta_ota_finalize(delta);
+    }
+
+    esp_delta_ota_deinit(delta);
+
+    if(ESP_OK != err)
+    {
+        esp_ota_abort(session.ota_handle);
+        return err;
+    }
+
+    // Validates the image checksum and hash before accepting it
+    err = esp_ota_end(session.ota_handle);
+    if(ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error calling esp_ota_end: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return esp_ota_set_boot_partition(session.target);
+
+}
+
+static esp_err_t ota_fetch_chunk(esp_http_client_handle_t client, esp_delta_ota_handle_t delta)
+{
+
+    uint32_t end = session.patch_offset + OTA_CHUNK_SIZE;
+    if(end > session.announce.patch_size)
+    {
+        end = session.announce.patch_size;
+    }
+
+    char range[40];
+    snprintf(range, sizeof(range), "bytes=%" PRIu32 "-%" PRIu32, session.patch_offset, end - 1);
+    esp_http_client_set_header(client, "Range", range);
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if(ESP_OK != err)
+    {
+        return err;
+    }
+
+    esp_http_client_fetch_headers(client);
+    if(esp_http_client_get_status_code(client) != 206)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    while(session.patch_offset < end)
+    {
+
+        int len = esp_http_client_read(client, (char *)chunk_buffer, end - session.patch_offset);
+        if(len <= 0)
+        {
+            // Whatever was applied so far stays applied, the retry resumes from here
+            esp_http_client_close(client);
+            return ESP_ERR_TIMEOUT;
+        }
+
+        session.bytes_transferred += len;
+
+        if(ESP_OK != esp_delta_ota_feed_patch(delta, chunk_buffer, len))
+        {
+            esp_http_client_close(client);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        session.patch_offset += len;
+
+    }
+
+    esp_http_client_close(client);
+    return ESP_OK;
+
+}
+
+static esp_err_t delta_read_cb(uint8_t * buf, size_t size, int src_offset)
+{
+    if(src_offset < 0 || src_offset + size > session.running->size)
+        return ESP_ERR_INVALID_ARG;
+
+    return esp_partition_read(session.running, src_offset, buf, size);
+}
+
+static esp_err_t delta_write_cb(const uint8_t * buf, size_t size, void * user_data)
+{
+    OtaSession_t * ota_session = (OtaSession_t *)user_data;
+    return esp_ota_write(ota_session->ota_handle, buf, size);
+}
+
+static void send_ota_status(uint32_t firmware_version, OtaStatus_t status)
+{
+    OtaStatusPayload_t report =
+    {
+        .firmware_version = firmware_version,
+        .status = status,
+        .patch_offset = session.patch_offset,
+        .bytes_transferred = session.bytes_transferred,
+    };
+
+    network_send_to_master(MSG_OTA_STATUS, &report, sizeof(report));
+}
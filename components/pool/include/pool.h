@@ -0,0 +1,129 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @file pool.h
+ * @brief Fixed-size block pool with reference counting, usable from tasks and ISRs.
+ *
+ * Blocks come from a free list and go back to it when their last reference
+ * is released, both in constant time under a spinlock. A payload is thus
+ * filled once by the driver that receives it and passed by handle to its
+ * consumers, with no copy and no heap traffic. The storage is static,
+ * declared with POOL_DEFINE().
+ */
+
+/**
+ * @brief Handle of a block, POOL_HANDLE_NONE for no block.
+ *
+ * Handles start at 1, so a zero-initialized message carries no block.
+ */
+typedef uint8_t PoolHandle_t;
+
+#define POOL_HANDLE_NONE    0
+#define POOL_MAX_BLOCKS     254
+
+typedef struct
+{
+    uint16_t block_size;
+    uint8_t block_count;
+    uint8_t free_head;          /**< First free block handle, POOL_HANDLE_NONE if exhausted. */
+    uint8_t used;
+    uint8_t high_water;         /**< Most blocks ever in use at once. */
+    uint32_t alloc_failures;
+    uint8_t * storage;          /**< block_count * block_size bytes. */
+    uint8_t * next_free;        /**< Free list links, by block index. */
+    uint8_t * refs;             /**< Reference counts, by block index. */
+    portMUX_TYPE lock;
+} BlockPool_t;
+
+/**
+ * @brief Occupancy of a pool.
+ */
+typedef struct
+{
+    uint8_t block_count;
+    uint8_t used;
+    uint8_t high_water;
+    uint32_t alloc_failures;
+} PoolStats_t;
+
+/**
+ * @brief Define a pool and its static storage.
+ *
+ * The pool must be initialized with pool_init() before use.
+ *
+ * @param name Name of the BlockPool_t variable.
+ * @param size Bytes per block.
+ * @param count Number of blocks, up to POOL_MAX_BLOCKS.
+ */
+#define POOL_DEFINE(name, size, count)                                                  \
+    _Static_assert((count) > 0 && (count) <= POOL_MAX_BLOCKS, "Bad block count");       \
+    static uint8_t name##_storage[(count) * (size)] __attribute__((aligned(4)));        \
+    static uint8_t name##_next_free[(count)];                                           \
+    static uint8_t name##_refs[(count)];                                                \
+    BlockPool_t name =                                                                  \
+    {                                                                                   \
+        .block_size = (size),                                                           \
+        .block_count = (count),                                                         \
+        .storage = name##_storage,                                                      \
+        .next_free = name##_next_free,                                                  \
+        .refs = name##_refs,                                                            \
+        .lock = portMUX_INITIALIZER_UNLOCKED,                                           \
+    }
+
+/**
+ * @brief Put every block of the pool back in the free list.
+ *
+ * @param pool Pool to initialize.
+ */
+void pool_init(BlockPool_t * pool);
+
+/**
+ * @brief Take a block, with one reference.
+ *
+ * Safe from ISRs.
+ *
+ * @param pool Pool to allocate from.
+ * @return Handle of the block, POOL_HANDLE_NONE if the pool is exhausted.
+ */
+PoolHandle_t pool_alloc(BlockPool_t * pool);
+
+/**
+ * @brief Add a reference to a block, e.g. before handing it to a second consumer.
+ *
+ * Safe from ISRs.
+ *
+ * @param pool Pool of the block.
+ * @param handle Block handle, POOL_HANDLE_NONE is ignored.
+ */
+void pool_retain(BlockPool_t * pool, PoolHandle_t handle);
+
+/**
+ * @brief Drop a reference to a block, freeing it with the last one.
+ *
+ * Safe from ISRs.
+ *
+ * @param pool Pool of the block.
+ * @param handle Block handle, POOL_HANDLE_NONE is ignored.
+ */
+void pool_release(BlockPool_t * pool, PoolHandle_t handle);
+
+/**
+ * @brief Get the memory of a block.
+ *
+ * @param pool Pool of the block.
+ * @param handle Block handle.
+ * @return block_size bytes, NULL for POOL_HANDLE_NONE or an invalid handle.
+ */
+void * pool_data(BlockPool_t * pool, PoolHandle_t handle);
+
+/**
+ * @brief Get the occupancy of a pool.
+ *
+ * @param pool Pool to query.
+ * @param stats Filled with the current counters.
+ */
+void pool_get_stats(BlockPool_t * pool, PoolStats_t * stats);
@@ -0,0 +1,117 @@
+#include "esp_log.h"
+
+#include "pool.h"
+
+static bool pool_valid_handle(const BlockPool_t * pool, PoolHandle_t handle)
+{
+    return handle != POOL_HANDLE_NONE && handle <= pool->block_count;
+}
+
+void pool_init(BlockPool_t * pool)
+{
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+
+    // Block i links to handle i + 2, i.e. to the next block
+    for(int i = 0; i < pool->block_count; i++)
+    {
+        pool->next_free[i] = (i + 1 < pool->block_count) ? i + 2 : POOL_HANDLE_NONE;
+        pool->refs[i] = 0;
+    }
+
+    pool->free_head = 1;
+    pool->used = 0;
+    pool->high_water = 0;
+    pool->alloc_failures = 0;
+
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+
+}
+
+PoolHandle_t pool_alloc(BlockPool_t * pool)
+{
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+
+    PoolHandle_t handle = pool->free_head;
+    if(handle == POOL_HANDLE_NONE)
+    {
+        pool->alloc_failures++;
+    }
+    else
+    {
+        pool->free_head = pool->next_free[handle - 1];
+        pool->refs[handle - 1] = 1;
+        pool->used++;
+        if(pool->used > pool->high_water)
+        {
+            pool->high_water = pool->used;
+        }
+    }
+
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+
+    return handle;
+
+}
+
+void pool_retain(BlockPool_t * pool, PoolHandle_t handle)
+{
+
+    if(!pool_valid_handle(pool, handle))
+        return;
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    if(pool->refs[handle - 1] > 0 && pool->refs[handle - 1] < UINT8_MAX)
+    {
+        pool->refs[handle - 1]++;
+    }
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+
+}
+
+void pool_release(BlockPool_t * pool, PoolHandle_t handle)
+{
+
+    if(!pool_valid_handle(pool, handle))
+        return;
+
+    bool double_free = false;
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    if(pool->refs[handle - 1] == 0)
+    {
+        double_free = true;
+    }
+    else if(--pool->refs[handle - 1] == 0)
+    {
+        pool->next_free[handle - 1] = pool->free_head;
+        pool->free_head = handle;
+        pool->used--;
+    }
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+
+    if(double_free)
+    {
+        ESP_EARLY_LOGE(__func__, "Block %d released while free", handle);
+    }
+
+}
+
+void * pool_data(BlockPool_t * pool, PoolHandle_t handle)
+{
+    if(!pool_valid_handle(pool, handle))
+        return NULL;
+
+    return pool->storage + (size_t)(handle - 1) * pool->block_size;
+}
+
+void pool_get_stats(BlockPool_t * pool, PoolStats_t * stats)
+{
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    stats->block_count = pool->block_count;
+    stats->used = pool->used;
+    stats->high_water = pool->high_water;
+    stats->alloc_failures = pool->alloc_failures;
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+}
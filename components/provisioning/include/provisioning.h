@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esp_err.h"
+#include "storage.h"
+
+/**
+ * @file provisioning.h
+ * @brief Fleet-wide configuration push handling on the node side.
+ *
+ * The master broadcasts a single authenticated MSG_CONFIG_PUSH frame carrying
+ * the shared match parameters and one control point assignment per node. Each
+ * node picks its own assignment, stores it atomically in NVS and answers with
+ * a MSG_CONFIG_ACK. The app applies it as a whole between matches: a push
+ * during a match takes effect when the match ends. Retries from the master
+ * are idempotent: a push with the version already applied is acked again
+ * without touching the flash, unless another control point was picked in the
+ * settings menu since, in which case the assignment is stored again.
+ */
+
+/**
+ * @brief Load the stored configuration and register the config push handler.
+ *
+ * Must be called after storage_init() and network_init().
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t provisioning_init(void);
+
+/**
+ * @brief Get the configuration stored on this node, the one the app plays
+ * the next match with.
+ *
+ * @param config Pointer to configuration output variable.
+ */
+void provisioning_get_config(GameConfig_t * config);
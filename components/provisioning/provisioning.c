@@ -0,0 +1,195 @@
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "provisioning.h"
+#include "network.h"
+#include "app.h"
+#include "game_mode.h"
+
+_Static_assert(sizeof(GameConfig_t) <= APP_PAYLOAD_BLOCK_SIZE, "GameConfig_t does not fit in an app payload block");
+
+static GameConfig_t current_config = GAME_CONFIG_DEFAULT();
+static portMUX_TYPE config_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void config_push_handler(const FrameHeader_t * header, const uint8_t * payload);
+static void send_config_ack(uint32_t config_version, ConfigAckStatus_t status);
+
+// The stored config, the control point picked in the settings menu included
+static esp_err_t config_load(void)
+{
+
+    GameConfig_t config;
+    esp_err_t err = storage_get_game_config(&config);
+    if(ESP_OK != err && ESP_ERR_NVS_NOT_FOUND != err)
+    {
+        ESP_LOGE(__func__, "Error calling storage_get_game_config: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    portENTER_CRITICAL(&config_lock);
+    current_config = config;
+    portEXIT_CRITICAL(&config_lock);
+
+    return ESP_OK;
+
+}
+
+esp_err_t provisioning_init(void)
+{
+
+    esp_err_t err = config_load();
+    if(ESP_OK != err)
+    {
+        return err;
+    }
+
+    GameConfig_t config;
+    provisioning_get_config(&config);
+    ESP_LOGI(__func__, "CONFIG VERSION: %" PRIu32, config.version);
+
+    return network_register_handler(MSG_CONFIG_PUSH, config_push_handler);
+
+}
+
+void provisioning_get_config(GameConfig_t * config)
+{
+    portENTER_CRITICAL(&config_lock);
+    *config = current_config;
+    portEXIT_CRITICAL(&config_lock);
+}
+
+static void config_push_handler(const FrameHeader_t * header, const uint8_t * payload)
+{
+
+    if(header->payload_len < sizeof(ConfigPushPayload_t))
+    {
+        ESP_LOGW(__func__, "Config push too short: %d", header->payload_len);
+        return;
+    }
+
+    const ConfigPushPayload_t * push = (const ConfigPushPayload_t *)payload;
+    size_t expected_len = sizeof(ConfigPushPayload_t) + push->assignment_count * sizeof(ConfigAssignment_t);
+
+    if(header->payload_len != expected_len)
+    {
+        ESP_LOGW(__func__, "Config push length mismatch: %d/%d", header->payload_len, (int)expected_len);
+        return;
+    }
+
+    // Find the assignment addressed to this node, if any
+    uint16_t own_id = network_get_node_id();
+    const ConfigAssignment_t * assignment = NULL;
+    const ConfigAssignment_t * assignments = (const ConfigAssignment_t *)(payload + sizeof(ConfigPushPayload_t));
+    for(int i = 0; i < push->assignment_count; i++)
+    {
+        if(assignments[i].node_id == own_id)
+        {
+            assignment = &assignments[i];
+            break;
+        }
+    }
+
+    if(assignment == NULL)
+    {
+        return;
+    }
+
+    // Read back: the settings menu stores its control point without us
+    esp_err_t err = config_load();
+    GameConfig_t config;
+    provisioning_get_config(&config);
+    if(ESP_OK != err)
+    {
+        send_config_ack(config.version, CONFIG_ACK_STORAGE_ERROR);
+        return;
+    }
+
+    if(push->config_version < config.version)
+    {
+        ESP_LOGW(__func__, "Stale config push: %" PRIu32 " < %" PRIu32, push->config_version, config.version);
+        send_config_ack(config.version, CONFIG_ACK_STALE);
+        return;
+    }
+
+    if(push->config_version == config.version && assignment->control_point == config.control_point)
+    {
+        // Retry from the master: the config is already stored, just ack again.
+        // With another control point picked in the menu since, it is stored again
+        send_config_ack(config.version, CONFIG_ACK_OK);
+        return;
+    }
+
+    if(assignment->control_point <= CONTROL_POINT_NONE || assignment->control_point >= CONTROL_POINT_MAX
+       || push->game_mode >= GAME_MODE_MAX
+       || (push->press_short_max_ms != 0 && push->press_medium_max_ms != 0 && push->press_short_max_ms >= push->press_medium_max_ms))
+    {
+        ESP_LOGW(__func__, "Invalid config push %" PRIu32, push->config_version);
+        send_config_ack(config.version, CONFIG_ACK_INVALID);
+        return;
+    }
+
+    GameConfig_t new_config =
+    {
+        .version = push->config_version,
+        .control_point = assignment->control_point,
+        .match_duration_s = push->match_duration_s,
+        .press_short_max_ms = push->press_short_max_ms,
+        .press_medium_max_ms = push->press_medium_max_ms,
+        .points_per_second = push->points_per_second,
+        .capture_delay_ms = push->capture_delay_ms,
+        .hold_bonus_pct = push->hold_bonus_pct,
+        .game_mode = push->game_mode,
+    };
+
+    err = storage_set_game_config(&new_config);
+    if(ESP_OK != err)
+    {
+        ESP_LOGE(__func__, "Error calling storage_set_game_config: %s", esp_err_to_name(err));
+        send_config_ack(config.version, CONFIG_ACK_STORAGE_ERROR);
+        return;
+    }
+
+    portENTER_CRITICAL(&config_lock);
+    current_config = new_config;
+    portEXIT_CRITICAL(&config_lock);
+
+    ESP_LOGI(__func__, "Stored config %" PRIu32 ": CONTROL POINT %s, DURATION %" PRIu32 "s",
+             new_config.version, control_point_to_string(new_config.control_point), new_config.match_duration_s);
+
+    // The app applies it between matches. Without a free block it reads the
+    // config back from NVS. Updates coalesce: the app only gets the latest one
+    AppEventMessage_t event = { .type = APP_EVENT_CFG_UPDATED };
+    event.payload = pool_alloc(&app_payload_pool);
+    GameConfig_t * pushed = pool_data(&app_payload_pool, event.payload);
+    if(pushed)
+    {
+        *pushed = new_config;
+        event.payload_len = sizeof(new_config);
+    }
+
+    if(ESP_OK != app_event_send(&event, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS)))
+    {
+        // Before the app task starts it reads the stored config anyway
+        pool_release(&app_payload_pool, event.payload);
+    }
+
+    send_config_ack(new_config.version, CONFIG_ACK_OK);
+
+}
+
+static void send_config_ack(uint32_t config_version, ConfigAckStatus_t status)
+{
+    ConfigAckPayload_t ack =
+    {
+        .config_version = config_version,
+        .status = status,
+    };
+
+    esp_err_t err = network_send_to_master(MSG_CONFIG_ACK, &ack, sizeof(ack));
+    if(ESP_OK != err)
+    {
+        ESP_LOGW(__func__, "Error sending config ack: %s", esp_err_to_name(err));
+    }
+}
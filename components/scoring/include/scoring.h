@@ -0,0 +1,175 @@
+#pragma once
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/**
+ * @file scoring.h
+ * @brief Incremental domination scoring: points accrue while a team holds a control point.
+ *
+ * Scores are fixed-point and updated only when something changes (a capture,
+ * a rule change, a tick): the points accrued since the previous update are
+ * elapsed time times the current rate of the holder, so no history is kept
+ * and an update costs the same at any point of the match. Time is passed in
+ * by the caller in milliseconds, which keeps the engine free of any platform
+ * dependency: the master runs the same code with its own clock.
+ */
+
+#define SCORING_MAX_TEAMS   4
+#define SCORING_TEAM_NONE   (-1)
+
+/**
+ * @brief Fractional bits of the fixed-point scores.
+ *
+ * Scores are stored as points * 1000 * 2^SCORING_FRAC_BITS, i.e. in
+ * fixed-point point-milliseconds, so that an accrual is a single
+ * multiplication with no rounding.
+ */
+#define SCORING_FRAC_BITS   16
+
+/**
+ * @brief Scoring rules, usually taken from the game configuration.
+ */
+typedef struct
+{
+    uint16_t points_per_second;     /**< Points per second for holding a single control point. */
+    uint16_t capture_delay_ms;      /**< Time a capture stays contested before the team gets the point, 0 for immediate. */
+    uint16_t hold_bonus_pct;        /**< Rate bonus for each control point held beyond the first, in percent. */
+} ScoringRules_t;
+
+/**
+ * @brief Macro to initialize a ScoringRules_t instance with default values.
+ */
+#define SCORING_RULES_DEFAULT() (ScoringRules_t){ .points_per_second = 1, .capture_delay_ms = 0, .hold_bonus_pct = 0 }
+
+typedef enum
+{
+    SCORING_PHASE_NEUTRAL,      /**< Nobody holds the point. */
+    SCORING_PHASE_CONTESTED,    /**< A team is capturing the point, nobody scores. */
+    SCORING_PHASE_HELD,         /**< The owner scores. */
+} ScoringPhase_t;
+
+/**
+ * @brief Scoring state of one team.
+ *
+ * Kept together so that an accrual touches a single cache line.
+ */
+typedef struct
+{
+    uint64_t score;                 /**< Fixed-point point-milliseconds. */
+    uint64_t rate;                  /**< Cached fixed-point points per second, bonus included. */
+    uint8_t points_held;            /**< Control points held by the team, for the bonus. */
+} ScoringTeam_t;
+
+/**
+ * @brief State of the scoring engine for one control point.
+ */
+typedef struct
+{
+    ScoringRules_t rules;
+    ScoringPhase_t phase;
+    int8_t owner;                               /**< Team holding the point, SCORING_TEAM_NONE if none. */
+    int8_t challenger;                          /**< Team capturing the point while contested. */
+    uint32_t contest_start_ms;                  /**< When the current contest started. */
+    uint32_t held_since_ms;                     /**< When the owner got the point. */
+    uint32_t last_update_ms;                    /**< Time up to which the scores are accrued. */
+    uint8_t team_count;                         /**< Teams playing, up to SCORING_MAX_TEAMS. */
+    ScoringTeam_t teams[SCORING_MAX_TEAMS];
+} ScoringEngine_t;
+
+/**
+ * @brief Initialize the engine: zero scores, point neutral.
+ *
+ * @param engine Engine to initialize.
+ * @param rules Scoring rules.
+ * @param team_count Teams playing, clamped to SCORING_MAX_TEAMS.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_init(ScoringEngine_t * engine, const ScoringRules_t * rules, uint8_t team_count, uint32_t now_ms);
+
+/**
+ * @brief Zero the scores and make the point neutral, keeping the rules.
+ *
+ * @param engine Engine to reset.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_reset(ScoringEngine_t * engine, uint32_t now_ms);
+
+/**
+ * @brief Change the rules, from now on.
+ *
+ * The points accrued so far keep the previous rate.
+ *
+ * @param engine Engine to update.
+ * @param rules New scoring rules.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_set_rules(ScoringEngine_t * engine, const ScoringRules_t * rules, uint32_t now_ms);
+
+/**
+ * @brief A team captures the point.
+ *
+ * With a capture delay the point becomes contested and the team gets it once
+ * the delay has passed without another capture. A capture by the owner
+ * while contested secures the point back.
+ *
+ * @param engine Engine to update.
+ * @param team Capturing team.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_capture(ScoringEngine_t * engine, int8_t team, uint32_t now_ms);
+
+/**
+ * @brief Make the point neutral, e.g. at the end of the match.
+ *
+ * @param engine Engine to update.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_neutralize(ScoringEngine_t * engine, uint32_t now_ms);
+
+/**
+ * @brief Set how many control points a team holds, for the multi-point bonus.
+ *
+ * @param engine Engine to update.
+ * @param team Team.
+ * @param count Control points held, the bonus applies from the second one.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_set_points_held(ScoringEngine_t * engine, int8_t team, uint8_t count, uint32_t now_ms);
+
+/**
+ * @brief Set the score of a team, e.g. to pick up the points a node reported.
+ *
+ * @param engine Engine to update.
+ * @param team Team.
+ * @param points Score of the team, in whole points.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_set_points(ScoringEngine_t * engine, int8_t team, uint32_t points, uint32_t now_ms);
+
+/**
+ * @brief Accrue the points up to now and settle an expired contest.
+ *
+ * Call it periodically: the scores read in between lag by at most the tick.
+ *
+ * @param engine Engine to update.
+ * @param now_ms Current time in milliseconds.
+ */
+void scoring_tick(ScoringEngine_t * engine, uint32_t now_ms);
+
+/**
+ * @brief Get the score of a team, in whole points, as of the last update.
+ *
+ * @param engine Engine to query.
+ * @param team Team.
+ * @return Points of the team, 0 for an invalid team.
+ */
+uint32_t scoring_get_points(const ScoringEngine_t * engine, int8_t team);
+
+/**
+ * @brief Get the team with the highest score.
+ *
+ * @param engine Engine to query.
+ * @return Leading team, SCORING_TEAM_NONE on a tie.
+ */
+int8_t scoring_get_leader(const ScoringEngine_t * engine);
@@ -0,0 +1,188 @@
+#include "string.h"
+
+#include "scoring.h"
+
+static void scoring_accrue(ScoringEngine_t * engine, uint32_t now_ms);
+static void scoring_update_rate(ScoringEngine_t * engine, int8_t team);
+
+static bool scoring_valid_team(const ScoringEngine_t * engine, int8_t team)
+{
+    return team >= 0 && team < engine->team_count;
+}
+
+void scoring_init(ScoringEngine_t * engine, const ScoringRules_t * rules, uint8_t team_count, uint32_t now_ms)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->rules = *rules;
+    engine->team_count = team_count < SCORING_MAX_TEAMS ? team_count : SCORING_MAX_TEAMS;
+
+    for(int team = 0; team < engine->team_count; team++)
+    {
+        engine->teams[team].points_held = 1;
+        scoring_update_rate(engine, team);
+    }
+
+    scoring_reset(engine, now_ms);
+}
+
+void scoring_reset(ScoringEngine_t * engine, uint32_t now_ms)
+{
+    engine->phase = SCORING_PHASE_NEUTRAL;
+    engine->owner = SCORING_TEAM_NONE;
+    engine->challenger = SCORING_TEAM_NONE;
+    engine->last_update_ms = now_ms;
+
+    for(int team = 0; team < engine->team_count; team++)
+    {
+        engine->teams[team].score = 0;
+    }
+}
+
+void scoring_set_rules(ScoringEngine_t * engine, const ScoringRules_t * rules, uint32_t now_ms)
+{
+    scoring_tick(engine, now_ms);
+    engine->rules = *rules;
+
+    for(int team = 0; team < engine->team_count; team++)
+    {
+        scoring_update_rate(engine, team);
+    }
+}
+
+void scoring_capture(ScoringEngine_t * engine, int8_t team, uint32_t now_ms)
+{
+
+    if(!scoring_valid_team(engine, team))
+        return;
+
+    scoring_tick(engine, now_ms);
+
+    if(engine->phase == SCORING_PHASE_HELD && engine->owner == team)
+        return;
+
+    if(engine->phase == SCORING_PHASE_CONTESTED && engine->owner == team)
+    {
+        // The defenders secure the point back before the delay expires
+        engine->phase = SCORING_PHASE_HELD;
+        engine->challenger = SCORING_TEAM_NONE;
+        return;
+    }
+
+    if(engine->rules.capture_delay_ms == 0)
+    {
+        engine->phase = SCORING_PHASE_HELD;
+        engine->owner = team;
+        engine->held_since_ms = now_ms;
+        return;
+    }
+
+    // A new capture restarts the contest, even by another challenger
+    engine->phase = SCORING_PHASE_CONTESTED;
+    engine->challenger = team;
+    engine->contest_start_ms = now_ms;
+
+}
+
+void scoring_neutralize(ScoringEngine_t * engine, uint32_t now_ms)
+{
+    scoring_tick(engine, now_ms);
+    engine->phase = SCORING_PHASE_NEUTRAL;
+    engine->owner = SCORING_TEAM_NONE;
+    engine->challenger = SCORING_TEAM_NONE;
+}
+
+void scoring_set_points_held(ScoringEngine_t * engine, int8_t team, uint8_t count, uint32_t now_ms)
+{
+    if(!scoring_valid_team(engine, team) || engine->teams[team].points_held == count)
+        return;
+
+    scoring_tick(engine, now_ms);
+    engine->teams[team].points_held = count;
+    scoring_update_rate(engine, team);
+}
+
+void scoring_set_points(ScoringEngine_t * engine, int8_t team, uint32_t points, uint32_t now_ms)
+{
+    if(!scoring_valid_team(engine, team))
+        return;
+
+    scoring_tick(engine, now_ms);
+    engine->teams[team].score = (uint64_t)points * (1000ULL << SCORING_FRAC_BITS);
+}
+
+void scoring_tick(ScoringEngine_t * engine, uint32_t now_ms)
+{
+
+    if(engine->phase == SCORING_PHASE_CONTESTED && (now_ms - engine->contest_start_ms) >= engine->rules.capture_delay_ms)
+    {
+        // The challenger owns the point from the end of the delay, not from the tick
+        uint32_t settled_ms = engine->contest_start_ms + engine->rules.capture_delay_ms;
+
+        scoring_accrue(engine, settled_ms);
+        engine->phase = SCORING_PHASE_HELD;
+        engine->owner = engine->challenger;
+        engine->challenger = SCORING_TEAM_NONE;
+        engine->held_since_ms = settled_ms;
+    }
+
+    scoring_accrue(engine, now_ms);
+
+}
+
+uint32_t scoring_get_points(const ScoringEngine_t * engine, int8_t team)
+{
+    if(!scoring_valid_team(engine, team))
+        return 0;
+
+    return (uint32_t)(engine->teams[team].score / (1000ULL << SCORING_FRAC_BITS));
+}
+
+int8_t scoring_get_leader(const ScoringEngine_t * engine)
+{
+
+    int8_t leader = SCORING_TEAM_NONE;
+    uint64_t best = 0;
+    bool tie = false;
+
+    for(int team = 0; team < engine->team_count; team++)
+    {
+        if(leader == SCORING_TEAM_NONE || engine->teams[team].score > best)
+        {
+            leader = team;
+            best = engine->teams[team].score;
+            tie = false;
+        }
+        else if(engine->teams[team].score == best)
+        {
+            tie = true;
+        }
+    }
+
+    return tie ? SCORING_TEAM_NONE : leader;
+
+}
+
+static void scoring_accrue(ScoringEngine_t * engine, uint32_t now_ms)
+{
+
+    // Unsigned difference: correct across the 49 days wrap of now_ms
+    uint32_t elapsed_ms = now_ms - engine->last_update_ms;
+    engine->last_update_ms = now_ms;
+
+    if(engine->phase == SCORING_PHASE_HELD && scoring_valid_team(engine, engine->owner))
+    {
+        ScoringTeam_t * owner = &engine->teams[engine->owner];
+        owner->score += (uint64_t)elapsed_ms * owner->rate;
+    }
+
+}
+
+static void scoring_update_rate(ScoringEngine_t * engine, int8_t team)
+{
+    // The owner holds at least the point the engine tracks
+    ScoringTeam_t * state = &engine->teams[team];
+    uint32_t extra_points = state->points_held > 1 ? state->points_held - 1 : 0;
+    uint64_t percent = 100 + (uint64_t)engine->rules.hold_bonus_pct * extra_points;
+
+    state->rate = (((uint64_t)engine->rules.points_per_second << SCORING_FRAC_BITS) * percent) / 100;
+}
@@ -1,9 +1,19 @@
 #pragma once
 
+#include "stdint.h"
+#include "stddef.h"
 #include "esp_err.h"
 
 #define NVS_NAMESPACE       "config"
 #define KEY_CONTROL_POINT   "controlpoint"
+#define KEY_GAME_CONFIG     "gameconfig"
+#define KEY_AUTH_KEY        "authkey"
+#define KEY_BOOT_EPOCH      "bootepoch"
+#define KEY_FAULT_LOG       "faultlog"
+#define KEY_WIFI_CACHE      "wificache"
+#define KEY_PEER_FLOORS     "peerfloors"
+
+#define AUTH_KEY_LEN        32
 
 typedef enum
 {
@@ -16,6 +26,33 @@ typedef enum
     CONTROL_POINT_MAX
 } ControlPoint_t;
 
+/**
+ * @brief Node configuration pushed by the master.
+ *
+ * Stored as a single NVS blob so that an update is applied atomically:
+ * after a reset the node sees either the old or the new configuration,
+ * never a mix of both. Zero thresholds and rate mean "use the firmware default".
+ * New fields are only ever appended, so that a blob written by an older
+ * firmware still loads, with the defaults for the missing fields.
+ */
+typedef struct
+{
+    uint32_t version;               /**< Monotonic configuration version, 0 if never provisioned. */
+    int8_t control_point;           /**< Assigned ControlPoint_t. */
+    uint32_t match_duration_s;      /**< Match duration in seconds, 0 for no time limit. */
+    uint16_t press_short_max_ms;    /**< Upper bound of a short press (ms). */
+    uint16_t press_medium_max_ms;   /**< Upper bound of a medium press (ms). */
+    uint16_t points_per_second;     /**< Points per second for holding the control point. */
+    uint16_t capture_delay_ms;      /**< Time a capture stays contested (ms). */
+    uint16_t hold_bonus_pct;        /**< Scoring bonus per extra control point held (%). */
+    uint8_t game_mode;              /**< GameModeId_t, used by runtime mode selection builds. */
+} GameConfig_t;
+
+/**
+ * @brief Macro to initialize a GameConfig_t instance with default values.
+ */
+#define GAME_CONFIG_DEFAULT() (GameConfig_t){ .version = 0, .control_point = CONTROL_POINT_NONE, .match_duration_s = 0, .press_short_max_ms = 0, .press_medium_max_ms = 0, .points_per_second = 0, .capture_delay_ms = 0, .hold_bonus_pct = 0, .game_mode = 0 }
+
 
 /**
  * @brief Initialize the storage system (NVS).
@@ -41,6 +78,35 @@ esp_err_t storage_set_control_point(ControlPoint_t control_point);
  */
 esp_err_t storage_get_control_point(ControlPoint_t * control_point);
 
+/**
+ * @brief Atomically replace the stored game configuration.
+ *
+ * @param config Configuration to save.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t storage_set_game_config(const GameConfig_t * config);
+
+/**
+ * @brief Load the stored game configuration.
+ *
+ * If no configuration was ever pushed, config is filled with defaults
+ * (and the legacy control point, if any) and ESP_ERR_NVS_NOT_FOUND is returned.
+ *
+ * @param config Pointer to configuration output variable.
+ * @return ESP_OK if found, ESP_ERR_NVS_NOT_FOUND if not set,
+ *         or other esp_err_t on internal error.
+ */
+esp_err_t storage_get_game_config(GameConfig_t * config);
+
+/**
+ * @brief Load the shared authentication key provisioned in NVS.
+ *
+ * @param key Output buffer of AUTH_KEY_LEN bytes.
+ * @return ESP_OK if found, ESP_ERR_NVS_NOT_FOUND if not provisioned,
+ *         or other esp_err_t on internal error.
+ */
+esp_err_t storage_get_auth_key(uint8_t key[AUTH_KEY_LEN]);
+
 /**
  * @brief Converts a ControlPoint_t enum value to its corresponding string representation.
  *
@@ -48,4 +114,73 @@ esp_err_t storage_get_control_point(ControlPoint_t * control_point);
  * @return A pointer to a string representing the name of the control point.
  *         Returns "Unknown" if the value is not a valid control point.
  */
-const char *control_point_to_string(ControlPoint_t control_point);
\ No newline at end of file
+const char *control_point_to_string(ControlPoint_t control_point);
+
+/**
+ * @brief Increment and return the persisted boot epoch.
+ *
+ * @param epoch Pointer to epoch output variable.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t storage_next_boot_epoch(uint32_t * epoch);
+
+/**
+ * @brief Read the fault log blob.
+ *
+ * The layout belongs to error_signaling, storage only keeps the bytes. A
+ * shorter blob from an older firmware leaves the rest of the buffer as is.
+ *
+ * @param log Buffer for the log.
+ * @param len Size of the buffer.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if no fault was ever logged, error code otherwise.
+ */
+esp_err_t storage_get_fault_log(void * log, size_t len);
+
+/**
+ * @brief Write the fault log blob.
+ *
+ * @param log Log to store.
+ * @param len Size of the log.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t storage_set_fault_log(const void * log, size_t len);
+
+/**
+ * @brief Read the replay floors of the senders.
+ *
+ * The layout belongs to auth, storage only keeps the bytes.
+ *
+ * @param floors Buffer for the floors.
+ * @param len Size of the buffer.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if no frame was ever received, error code otherwise.
+ */
+esp_err_t storage_get_peer_floors(void * floors, size_t len);
+
+/**
+ * @brief Write the replay floors of the senders.
+ *
+ * @param floors Floors to store.
+ * @param len Size of the floors.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t storage_set_peer_floors(const void * floors, size_t len);
+
+/**
+ * @brief Read the Wi-Fi connection cache blob.
+ *
+ * The layout belongs to the network component, storage only keeps the bytes.
+ *
+ * @param cache Buffer for the cache.
+ * @param len Size of the buffer.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if the node never connected, error code otherwise.
+ */
+esp_err_t storage_get_wifi_cache(void * cache, size_t len);
+
+/**
+ * @brief Write the Wi-Fi connection cache blob.
+ *
+ * @param cache Cache to store.
+ * @param len Size of the cache.
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t storage_set_wifi_cache(const void * cache, size_t len);
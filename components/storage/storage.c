@@ -23,7 +23,22 @@ esp_err_t storage_set_control_point(ControlPoint_t control_point)
     esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK) return err;
 
-    err = nvs_set_u8(handle, KEY_CONTROL_POINT, (uint8_t)control_point);
+    // Once the master pushed a configuration the control point lives inside
+    // the config blob, otherwise the legacy key is used. A shorter blob from
+    // an older firmware is written back with the defaults in the tail.
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    size_t len = sizeof(config);
+    err = nvs_get_blob(handle, KEY_GAME_CONFIG, &config, &len);
+    if (err == ESP_OK)
+    {
+        config.control_point = (int8_t)control_point;
+        err = nvs_set_blob(handle, KEY_GAME_CONFIG, &config, sizeof(config));
+    }
+    else if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        err = nvs_set_u8(handle, KEY_CONTROL_POINT, (uint8_t)control_point);
+    }
+
     if (err == ESP_OK)
         err = nvs_commit(handle);
 
@@ -35,26 +50,199 @@ esp_err_t storage_get_control_point(ControlPoint_t * control_point)
 {
     if (!control_point) return ESP_ERR_INVALID_ARG;
 
+    GameConfig_t config;
+    esp_err_t err = storage_get_game_config(&config);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+
+    if (config.control_point == CONTROL_POINT_NONE) return ESP_ERR_NVS_NOT_FOUND;
+
+    if (config.control_point > CONTROL_POINT_NONE && config.control_point < CONTROL_POINT_MAX)
+    {
+        *control_point = (ControlPoint_t)config.control_point;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_INVALID_RESPONSE;
+}
+
+esp_err_t storage_set_game_config(const GameConfig_t * config)
+{
+    if (!config) return ESP_ERR_INVALID_ARG;
+    if (config->control_point <= CONTROL_POINT_NONE || config->control_point >= CONTROL_POINT_MAX)
+        return ESP_ERR_INVALID_ARG;
+
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK) return err;
 
-    uint8_t val;
-    err = nvs_get_u8(handle, KEY_CONTROL_POINT, &val);
+    // A single blob write is atomic in NVS: a reset during the update
+    // leaves the previous configuration in place.
+    err = nvs_set_blob(handle, KEY_GAME_CONFIG, config, sizeof(GameConfig_t));
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
     nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_get_game_config(GameConfig_t * config)
+{
+    if (!config) return ESP_ERR_INVALID_ARG;
+
+    *config = GAME_CONFIG_DEFAULT();
 
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    // A shorter blob from an older firmware leaves the defaults in the tail
+    GameConfig_t stored = GAME_CONFIG_DEFAULT();
+    size_t len = sizeof(stored);
+    err = nvs_get_blob(handle, KEY_GAME_CONFIG, &stored, &len);
     if (err == ESP_OK)
     {
-        if (val < CONTROL_POINT_MAX)
-        {
-            *control_point = (ControlPoint_t)val;
-        }
-        else
-        {
-            err = ESP_ERR_INVALID_RESPONSE;
-        }
+        *config = stored;
     }
+    else if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        uint8_t val;
+        if (nvs_get_u8(handle, KEY_CONTROL_POINT, &val) == ESP_OK && val < CONTROL_POINT_MAX)
+            config->control_point = (int8_t)val;
+    }
+
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_get_auth_key(uint8_t key[AUTH_KEY_LEN])
+{
+    if (!key) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    size_t len = AUTH_KEY_LEN;
+    err = nvs_get_blob(handle, KEY_AUTH_KEY, key, &len);
+    nvs_close(handle);
+
+    if (err == ESP_OK && len != AUTH_KEY_LEN)
+        err = ESP_ERR_INVALID_SIZE;
+
+    return err;
+}
+
+esp_err_t storage_next_boot_epoch(uint32_t * epoch)
+{
+    if (!epoch) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    uint32_t val = 0;
+    err = nvs_get_u32(handle, KEY_BOOT_EPOCH, &val);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        val++;
+        err = nvs_set_u32(handle, KEY_BOOT_EPOCH, val);
+    }
+
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
+    nvs_close(handle);
+
+    if (err == ESP_OK)
+        *epoch = val;
+
+    return err;
+}
 
+esp_err_t storage_get_fault_log(void * log, size_t len)
+{
+    if (!log) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_get_blob(handle, KEY_FAULT_LOG, log, &len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_set_fault_log(const void * log, size_t len)
+{
+    if (!log) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(handle, KEY_FAULT_LOG, log, len);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_get_peer_floors(void * floors, size_t len)
+{
+    if (!floors) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_get_blob(handle, KEY_PEER_FLOORS, floors, &len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_set_peer_floors(const void * floors, size_t len)
+{
+    if (!floors) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(handle, KEY_PEER_FLOORS, floors, len);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_get_wifi_cache(void * cache, size_t len)
+{
+    if (!cache) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_get_blob(handle, KEY_WIFI_CACHE, cache, &len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_set_wifi_cache(const void * cache, size_t len)
+{
+    if (!cache) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(handle, KEY_WIFI_CACHE, cache, len);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
+    nvs_close(handle);
     return err;
 }
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+#include "esp_err.h"
+
+/**
+ * @file supervisor.h
+ * @brief Liveness supervisor of the critical tasks, backed by the task watchdog.
+ *
+ * Each supervised task registers a deadline and checks in at least that
+ * often. Every SUPERVISOR_PERIOD_MS the supervisor task feeds the task
+ * watchdog, but only while every registered task is within its deadline.
+ * The first task to miss it is logged as a WATCHDOG_ERROR fault with the
+ * task id as detail, then the watchdog is left to expire and reset the
+ * node, which boots degraded and resumes the match from the app snapshot.
+ *
+ * Detection takes at most the deadline plus SUPERVISOR_PERIOD_MS, the reset
+ * follows within SUPERVISOR_WDT_TIMEOUT_MS.
+ */
+
+#define SUPERVISOR_MAX_TASKS    4
+#define SUPERVISOR_ID_NONE      -1
+
+typedef struct
+{
+    const char * name;
+    uint32_t deadline_ms;
+    uint32_t since_checkin_ms;  // Time since the last check-in when read
+    uint32_t max_gap_ms;        // Longest time between two check-ins
+} SupervisorTask_t;
+
+/**
+ * @brief Start the supervisor task and subscribe it to the task watchdog.
+ *
+ * The watchdog is reconfigured to reset the node when it expires. Tasks may
+ * register before or after this call.
+ *
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t supervisor_init(void);
+
+/**
+ * @brief Put the calling task under supervision. Counts as a first check-in.
+ *
+ * @param name Task name, for the logs and the console.
+ * @param deadline_ms Longest time allowed between two check-ins.
+ *
+ * @return Id for supervisor_checkin(), SUPERVISOR_ID_NONE if the table is full.
+ */
+int supervisor_register(const char * name, uint32_t deadline_ms);
+
+/**
+ * @brief Tell the supervisor the task is alive. Cheap, call it every loop.
+ *
+ * @param id Id returned by supervisor_register(), SUPERVISOR_ID_NONE is ignored.
+ */
+void supervisor_checkin(int id);
+
+/**
+ * @brief Make a supervised task hang at its next check-in, to measure
+ * detection and recovery on the real node.
+ *
+ * @param name Name the task registered with.
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no task has that name.
+ */
+esp_err_t supervisor_inject_hang(const char * name);
+
+/**
+ * @brief Get the check-in figures of the supervised tasks.
+ *
+ * @param tasks Filled with up to max entries.
+ * @param max Size of tasks.
+ *
+ * @return Number of entries filled.
+ */
+size_t supervisor_get_tasks(SupervisorTask_t * tasks, size_t max);
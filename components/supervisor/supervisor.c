@@ -0,0 +1,258 @@
+#include "stdlib.h"
+#include "string.h"
+#include "inttypes.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#if CONFIG_ESP_TASK_WDT_EN
+#include "esp_task_wdt.h"
+#endif
+
+#include "supervisor.h"
+#include "error_signaling.h"
+#include "config.h"
+
+typedef struct
+{
+    const char * name;
+    TickType_t deadline;
+    volatile TickType_t last_checkin;
+    volatile TickType_t max_gap;
+} SupervisedTask_t;
+
+static SupervisedTask_t supervised[SUPERVISOR_MAX_TASKS];
+static volatile int supervised_count = 0;
+static portMUX_TYPE supervisor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile int hang_id = SUPERVISOR_ID_NONE;
+static TickType_t hang_tick = 0;
+
+#if CONFIG_ESP_TASK_WDT_EN
+static esp_task_wdt_user_handle_t wdt_user = NULL;
+#endif
+
+static void supervisor_task(void * arg);
+static int supervisor_find_missed(TickType_t now);
+static void supervisor_report(int id, TickType_t now, TickType_t last_feed);
+
+esp_err_t supervisor_init(void)
+{
+
+#if CONFIG_ESP_TASK_WDT_EN
+    // The sdkconfig watchdog only prints: a hung node has to reset
+    esp_task_wdt_config_t wdt_config =
+    {
+        .timeout_ms = SUPERVISOR_WDT_TIMEOUT_MS,
+        .idle_core_mask = 0
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+                          | (1 << 0)
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+                          | (1 << 1)
+#endif
+                          ,
+        .trigger_panic = true,
+    };
+
+    esp_err_t ret = esp_task_wdt_reconfigure(&wdt_config);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_task_wdt_reconfigure: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = esp_task_wdt_add_user("supervisor", &wdt_user);
+    if(ESP_OK != ret)
+    {
+        ESP_LOGE(__func__, "Error calling esp_task_wdt_add_user: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#endif
+
+    BaseType_t task_error = xTaskCreate(supervisor_task, "supervisor", SUPERVISOR_TASK_STACK_DEPTH, NULL, SUPERVISOR_TASK_PRIORITY, NULL);
+    if(pdPASS != task_error)
+    {
+        ESP_LOGE(__func__, "Error creating the supervisor task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+
+}
+
+int supervisor_register(const char * name, uint32_t deadline_ms)
+{
+
+    int id = SUPERVISOR_ID_NONE;
+
+    portENTER_CRITICAL(&supervisor_lock);
+    if(supervised_count < SUPERVISOR_MAX_TASKS)
+    {
+        id = supervised_count;
+        supervised[id] = (SupervisedTask_t)
+        {
+            .name = name,
+            .deadline = pdMS_TO_TICKS(deadline_ms),
+            .last_checkin = xTaskGetTickCount(),
+        };
+        // Published last: the supervisor never sees a half-written entry
+        supervised_count = id + 1;
+    }
+    portEXIT_CRITICAL(&supervisor_lock);
+
+    if(id == SUPERVISOR_ID_NONE)
+    {
+        ESP_LOGE(__func__, "No room to supervise %s", name);
+    }
+
+    return id;
+
+}
+
+void supervisor_checkin(int id)
+{
+
+    if(id < 0 || id >= supervised_count)
+        return;
+
+    if(id == hang_id)
+    {
+        ESP_LOGW(__func__, "Task %s hanging on request", supervised[id].name);
+        while(true)
+        {
+            vTaskSuspend(NULL);
+        }
+    }
+
+    SupervisedTask_t * task = &supervised[id];
+    TickType_t now = xTaskGetTickCount();
+    TickType_t gap = now - task->last_checkin;
+    if(gap > task->max_gap)
+    {
+        task->max_gap = gap;
+    }
+    task->last_checkin = now;
+
+}
+
+esp_err_t supervisor_inject_hang(const char * name)
+{
+
+    for(int id = 0; id < supervised_count; id++)
+    {
+        if(strcmp(supervised[id].name, name) == 0)
+        {
+            hang_tick = xTaskGetTickCount();
+            hang_id = id;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+
+}
+
+size_t supervisor_get_tasks(SupervisorTask_t * tasks, size_t max)
+{
+
+    TickType_t now = xTaskGetTickCount();
+    size_t count = 0;
+
+    for(int id = 0; id < supervised_count && count < max; id++, count++)
+    {
+        tasks[count] = (SupervisorTask_t)
+        {
+            .name = supervised[id].name,
+            .deadline_ms = pdTICKS_TO_MS(supervised[id].deadline),
+            .since_checkin_ms = pdTICKS_TO_MS(now - supervised[id].last_checkin),
+            .max_gap_ms = pdTICKS_TO_MS(supervised[id].max_gap),
+        };
+    }
+
+    return count;
+
+}
+
+static void supervisor_task(void * arg)
+{
+
+    TickType_t last_feed = xTaskGetTickCount();
+    bool expired = false;
+
+    for(;;)
+    {
+
+        vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_PERIOD_MS));
+
+        TickType_t now = xTaskGetTickCount();
+
+        if(!expired)
+        {
+            int missed = supervisor_find_missed(now);
+            if(missed == SUPERVISOR_ID_NONE)
+            {
+#if CONFIG_ESP_TASK_WDT_EN
+                esp_task_wdt_reset_user(wdt_user);
+#endif
+                last_feed = now;
+                continue;
+            }
+
+            // Once a task is lost the watchdog is not fed again, whatever happens next
+            expired = true;
+            supervisor_report(missed, now, last_feed);
+        }
+
+#if !CONFIG_ESP_TASK_WDT_EN
+        // No watchdog to expire: panic when it would have, a reset the
+        // match resumes from as it does from the watchdog's
+        if(now - last_feed >= pdMS_TO_TICKS(SUPERVISOR_WDT_TIMEOUT_MS))
+        {
+            abort();
+        }
+#endif
+
+    }
+
+}
+
+static int supervisor_find_missed(TickType_t now)
+{
+
+    for(int id = 0; id < supervised_count; id++)
+    {
+        if(now - supervised[id].last_checkin > supervised[id].deadline)
+            return id;
+    }
+
+    return SUPERVISOR_ID_NONE;
+
+}
+
+static void supervisor_report(int id, TickType_t now, TickType_t last_feed)
+{
+
+    const SupervisedTask_t * task = &supervised[id];
+    uint32_t silent_ms = pdTICKS_TO_MS(now - task->last_checkin);
+
+    ESP_LOGE(__func__, "Task %s silent for %" PRIu32 " ms, deadline %" PRIu32 " ms",
+             task->name, silent_ms, (uint32_t)pdTICKS_TO_MS(task->deadline));
+
+    if(hang_id == id)
+    {
+        ESP_LOGE(__func__, "Injected hang detected in %" PRIu32 " ms", (uint32_t)pdTICKS_TO_MS(now - hang_tick));
+    }
+
+    fault_record(WATCHDOG_ERROR, (uint8_t)id);
+
+    // The NVS write above takes a while: the reset is that much closer
+    TickType_t fed_ago = xTaskGetTickCount() - last_feed;
+    uint32_t reset_in_ms = (uint32_t)pdTICKS_TO_MS(fed_ago) < SUPERVISOR_WDT_TIMEOUT_MS ?
+                           SUPERVISOR_WDT_TIMEOUT_MS - (uint32_t)pdTICKS_TO_MS(fed_ago) : 0;
+    fault_expect_reset(WATCHDOG_ERROR, reset_in_ms);
+
+    ESP_LOGE(__func__, "Watchdog starved, reset in %" PRIu32 " ms", reset_in_ms);
+
+}
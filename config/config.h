@@ -1,22 +1,126 @@
+#include "sdkconfig.h"
+
+// TEAMS
+#define TEAM_COUNT      CONFIG_DOMINION_TEAM_COUNT
 
 // GPIO PINS
 #define GPIO_LED_RED     19
 #define GPIO_LED_BLUE    18
+#define GPIO_LED_GREEN   21
+#define GPIO_LED_YELLOW  22
 #define GPIO_BTN_RED     5
 #define GPIO_BTN_BLUE    4
+#define GPIO_BTN_GREEN   16
+#define GPIO_BTN_YELLOW  17
+#define GPIO_I2C_SDA     25
+#define GPIO_I2C_SCL     26
+#define GPIO_BUZZER      27
 
 // GENERIC
 #define DEBOUNCE_DELAY_MS       200
 #define SETTINGS_HOLD_TIME_MS   3000
 
 // EVENT BITS
-#define BTN_RED_EVENT   (1 << 0)
-#define BTN_BLUE_EVENT  (1 << 1)
+#define BTN_TEAM_EVENT(team)    (1 << (team))
+#define BTN_ALL_EVENTS          ((1 << TEAM_COUNT) - 1)
+
+// NETWORK
+#define NODE_UDP_PORT       4210
+#define MASTER_UDP_PORT     4211
+#define NETWORK_RX_QUEUE_LEN    4
+#define NETWORK_FAST_CONNECT_RETRIES    2       // Failed attempts on the cached access point before scanning
+#define NETWORK_BEACON_INTERVAL_TU      100     // Until a beacon of the access point is heard, 1 TU = 1024 us
+#define NETWORK_BEACON_INTERVAL_MAX_TU  1000    // Above, the periodic frames are not held for a beacon
+#define NETWORK_TX_WINDOW_OFFSET_US     1000    // After the beacon, once the station has it
+
+// FAILOVER
+#define MASTER_HEARTBEAT_TIMEOUT_MS 3000
+#define NODE_STATUS_PERIOD_MS       1000
+#define NODE_STATUS_TIMEOUT_MS      3000
+#define FAILOVER_POLL_MS            100
+#define FAILOVER_HANDBACK_REPEAT    3
+
+// MATCH SYNC
+#define MATCHSYNC_WINDOW            8       // Heartbeats the minimum delay is taken over
+#define MATCHSYNC_RESYNC_MS         1000    // A jump this large is a new master clock, not a delay
+#define MATCHSYNC_LATE_MAX_MS       1000    // An instant missed by less still applies, at once
+#define MATCHSYNC_COUNTDOWN_MAX_S   10
+#define MATCHSYNC_RETRY_MS          1       // A start or end the app queue had no room for goes again after
+
+// LINK
+#define NODE_STATUS_PERIOD_MAX_MS   4000    // On a poor link
+#define NODE_STATUS_PERIOD_STEP_MS  250     // Back towards NODE_STATUS_PERIOD_MS per status on a good link
+#define NODE_STATUS_TIMEOUT_PERIODS 3       // Periods of silence before a node is lost, at least NODE_STATUS_TIMEOUT_MS
+#define LINK_ACK_TIMEOUT_MS         1000
+#define LINK_LOSS_POOR_PCT          20
+#define LINK_LOSS_GOOD_PCT          5
+#define LINK_RTT_POOR_MS            600
+#define LINK_RTT_GOOD_MS            250     // In modem sleep the ack waits for a beacon at the access point
+#define LINK_RSSI_POOR_DBM          -80
+#define LINK_RSSI_GOOD_DBM          -70
+
+// OTA
+#define OTA_CHUNK_SIZE              4096
+#define OTA_CHUNK_MAX_RETRIES       5
+#define OTA_RETRY_DELAY_MS          2000
+#define OTA_HTTP_TIMEOUT_MS         5000
+
+// FAULTS
+#define FAULT_REBOOT_DELAY_MS       2000    // Pattern shown before a fatal fault reboots
+#define FAULT_MAX_REBOOTS           3       // Fault reboots in a row before giving up
+#define FAULT_BUTTON_SHOW_MS        5000    // Pattern shown when a stuck button is masked
+#define BUTTON_UNMASK_MS            1000    // A masked button released this long is used again
+#define BUTTON_MASK_POLL_MS         100
+
+// HEALTH: sampling period and the margins that raise a warning
+#define HEALTH_PERIOD_MS            5000
+#define HEALTH_STACK_WARN_BYTES     256
+#define HEALTH_HEAP_WARN_BYTES      16384
+#define HEALTH_QUEUE_WARN_PCT       80
+#define HEALTH_LOOP_WARN_US         20000
+
+// BATTERY: 1S Li-ion through a divider on GPIO 34 (ADC1 channel 6)
+#define BATTERY_ADC_CHANNEL             6
+#define BATTERY_DIVIDER_RATIO           2       // Pack voltage over pin voltage
+#define BATTERY_NOMINAL_FULL_SCALE_MV   3100    // Pin voltage at the top code without calibration
+#define BATTERY_OVERSAMPLE              16
+#define BATTERY_ABSENT_MV               2500    // Pack voltage under which no battery is fitted
+#define BATTERY_LOW_PCT                 15
+#define BATTERY_LOW_CLEAR_PCT           20
+#define BATTERY_CUE_PERIOD_MS           60000   // Low battery cue repeat
+#define BATTERY_SHOW_MS                 3000
+#define BATTERY_BLINK_HALF_PERIOD_MS    500     // Red LED between matches while low
+
+// DISPLAY
+#define DISPLAY_I2C_ADDR            0x3C
+#define DISPLAY_I2C_FREQ_HZ         400000
+#define DISPLAY_I2C_TIMEOUT_MS      50
+#define DISPLAY_REFRESH_MS          250
+
+// SUPERVISOR: longest silence of each task before the watchdog is starved
+#define SUPERVISOR_PERIOD_MS            250
+#define SUPERVISOR_WDT_TIMEOUT_MS       2000
+#define SUPERVISOR_BUTTON_DEADLINE_MS   2000
+#define SUPERVISOR_APP_DEADLINE_MS      3000    // The app waits up to SCORING_TICK_MS for an event
+#define BUTTON_CHECKIN_MS               500     // Longest button task wait between check-ins
 
 // TASKS STACK DEPTH
 #define BUTTON_TASK_STACK_DEPTH     2048
 #define APP_TASK_STACK_DEPTH        2048
+#define NETWORK_TASK_STACK_DEPTH    4096
+#define UDP_RX_TASK_STACK_DEPTH     3072
+#define FAILOVER_TASK_STACK_DEPTH   3072
+#define OTA_TASK_STACK_DEPTH        6144
+#define CLI_TASK_STACK_DEPTH        4096
+#define SUPERVISOR_TASK_STACK_DEPTH 3072
+#define DISPLAY_TASK_STACK_DEPTH    3072
 
 // TASK PRIORITY
 #define BUTTON_TASK_PRIORITY        5
-#define APP_TASK_PRIORITY           3
\ No newline at end of file
+#define APP_TASK_PRIORITY           3
+#define NETWORK_TASK_PRIORITY       2
+#define FAILOVER_TASK_PRIORITY      2
+#define OTA_TASK_PRIORITY           1
+#define CLI_TASK_PRIORITY           1
+#define DISPLAY_TASK_PRIORITY       1
+#define SUPERVISOR_TASK_PRIORITY    6       // Above every supervised task, or a spinning one starves it
\ No newline at end of file
@@ -27,6 +27,22 @@
 #include "buttons.h"
 #include "app.h"
 #include "storage.h"
+#include "auth.h"
+#include "history.h"
+#include "cli.h"
+#include "health.h"
+#include "supervisor.h"
+#include "display.h"
+#include "buzzer.h"
+#include "battery.h"
+#include "network.h"
+#include "provisioning.h"
+#include "ota.h"
+#include "failover.h"
+#include "matchsync.h"
+
+// Cleared when the network fails to start in a degraded boot
+static bool network_up = true;
 
 esp_err_t app_init()
 {
@@ -71,6 +87,127 @@ esp_err_t app_init()
         ESP_LOGI(__func__, "STORAGE INIT OK");
     }
 
+    // FAULT LOG (needs NVS)
+    partial_err = fault_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: faults are still signaled, just not persisted
+        ESP_LOGW(__func__, "Error calling fault_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "FAULT INIT OK");
+    }
+
+    // After a fault reboot the node plays standalone rather than rebooting again
+    bool network_required = !fault_is_degraded();
+
+    // AUTHENTICATION (needs NVS)
+    partial_err = auth_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: the node still plays standalone, but drops every frame it receives
+        ESP_LOGW(__func__, "Error calling auth_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "AUTH INIT OK");
+    }
+
+#if CONFIG_DOMINION_BUZZER
+    partial_err = buzzer_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: the LEDs still show the match
+        ESP_LOGW(__func__, "Error calling buzzer_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "BUZZER INIT OK");
+    }
+#endif
+
+#if CONFIG_DOMINION_BATTERY
+    partial_err = battery_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: the node plays, it just cannot warn before dying
+        ESP_LOGW(__func__, "Error calling battery_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "BATTERY INIT OK");
+    }
+#endif
+
+    // NETWORK INITIALIZATION (needs NVS)
+    partial_err = network_init();
+    if(ESP_OK != partial_err)
+    {
+        ESP_LOGE(__func__, "Error calling network_init: %s", esp_err_to_name(partial_err));
+        error |= network_required;
+        network_up = false;
+    }
+    else
+    {
+        ESP_LOGI(__func__, "NETWORK INIT OK");
+    }
+
+    partial_err = history_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: matches are played, just not recorded
+        ESP_LOGW(__func__, "Error calling history_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "HISTORY INIT OK");
+    }
+
+    partial_err = provisioning_init();
+    if(ESP_OK != partial_err)
+    {
+        ESP_LOGE(__func__, "Error calling provisioning_init: %s", esp_err_to_name(partial_err));
+        error |= network_required;
+    }
+    else
+    {
+        ESP_LOGI(__func__, "PROVISIONING INIT OK");
+    }
+
+    partial_err = failover_init();
+    if(ESP_OK != partial_err)
+    {
+        ESP_LOGE(__func__, "Error calling failover_init: %s", esp_err_to_name(partial_err));
+        error |= network_required;
+    }
+    else
+    {
+        ESP_LOGI(__func__, "FAILOVER INIT OK");
+    }
+
+    partial_err = matchsync_init();
+    if(ESP_OK != partial_err)
+    {
+        // Not fatal: matches still start on the first press
+        ESP_LOGW(__func__, "Error calling matchsync_init: %s", esp_err_to_name(partial_err));
+    }
+    else
+    {
+        ESP_LOGI(__func__, "MATCHSYNC INIT OK");
+    }
+
+    partial_err = ota_init();
+    if(ESP_OK != partial_err)
+    {
+        ESP_LOGE(__func__, "Error calling ota_init: %s", esp_err_to_name(partial_err));
+        error |= network_required;
+    }
+    else
+    {
+        ESP_LOGI(__func__, "OTA INIT OK");
+    }
+
     if(error)
     {
         ESP_LOGE(__func__, "Error initializing the app");
@@ -88,6 +225,10 @@ void app_main(void)
 {
     
     esp_err_t init_error = app_init();
+
+    // A freshly updated image that cannot initialize rolls back to the previous one
+    ota_confirm_boot(init_error);
+
     if(ESP_OK != init_error)
     {
         signal_fatal_error(INIT_ERROR);
@@ -105,4 +246,58 @@ void app_main(void)
         signal_fatal_error(INIT_ERROR);
     }
 
+    if(network_up)
+    {
+        BaseType_t network_task_error = xTaskCreate(network_task, "network", NETWORK_TASK_STACK_DEPTH, NULL, NETWORK_TASK_PRIORITY, NULL);
+        if(pdPASS != network_task_error)
+        {
+            signal_fatal_error(INIT_ERROR);
+        }
+
+        BaseType_t failover_task_error = xTaskCreate(failover_task, "failover", FAILOVER_TASK_STACK_DEPTH, NULL, FAILOVER_TASK_PRIORITY, NULL);
+        if(pdPASS != failover_task_error)
+        {
+            signal_fatal_error(INIT_ERROR);
+        }
+    }
+    else
+    {
+        ESP_LOGW(__func__, "Degraded mode: playing standalone");
+    }
+
+    // Not fatal: without it a hang is only caught by the idle task watchdog
+    esp_err_t supervisor_error = supervisor_init();
+    if(ESP_OK != supervisor_error)
+    {
+        ESP_LOGW(__func__, "Error calling supervisor_init: %s", esp_err_to_name(supervisor_error));
+    }
+
+    // Playing again: closes the time to recovery of a fault reboot
+    fault_mark_running();
+
+    // Not fatal: the sampler only reports
+    esp_err_t health_error = health_init();
+    if(ESP_OK != health_error)
+    {
+        ESP_LOGW(__func__, "Error calling health_init: %s", esp_err_to_name(health_error));
+    }
+
+#if CONFIG_DOMINION_DISPLAY
+    // Not fatal: the LEDs and the network still report the match
+    esp_err_t display_error = display_init();
+    if(ESP_OK != display_error)
+    {
+        ESP_LOGW(__func__, "Error calling display_init: %s", esp_err_to_name(display_error));
+    }
+#endif
+
+#if CONFIG_DOMINION_CLI
+    // Not fatal: the console is for diagnostics only
+    esp_err_t cli_error = cli_init();
+    if(ESP_OK != cli_error)
+    {
+        ESP_LOGW(__func__, "Error calling cli_init: %s", esp_err_to_name(cli_error));
+    }
+#endif
+
 }
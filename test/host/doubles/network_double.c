@@ -0,0 +1,168 @@
+#include <string.h>
+#include "network_double.h"
+#include "network.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static network_handler_t handlers[MSG_TYPE_MAX];
+static NetworkDoubleFrame_t sent[NETWORK_DOUBLE_LOG_LEN];
+static size_t sent_count = 0;
+static uint16_t node_id = 0x0101;
+static int8_t rssi = -55;
+static bool fail_sends = false;
+static uint32_t next_seq = 1;
+static int64_t rx_time_us = 0;
+
+void network_double_set_node_id(uint16_t id)
+{
+    node_id = id;
+}
+
+void network_double_set_rssi(int8_t value)
+{
+    rssi = value;
+}
+
+void network_double_fail_sends(bool fail)
+{
+    fail_sends = fail;
+}
+
+size_t network_double_sent_count(void)
+{
+    portENTER_CRITICAL(&lock);
+    size_t count = sent_count;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+const NetworkDoubleFrame_t * network_double_sent(size_t index)
+{
+    return index < NETWORK_DOUBLE_LOG_LEN && index < sent_count ? &sent[index] : NULL;
+}
+
+void network_double_clear(void)
+{
+    portENTER_CRITICAL(&lock);
+    sent_count = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+esp_err_t network_double_deliver(MessageType_t type, uint16_t src_node, uint16_t dst_node, const void * payload, uint16_t payload_len)
+{
+    if(type <= MSG_NONE || type >= MSG_TYPE_MAX || handlers[type] == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    FrameHeader_t header =
+    {
+        .magic = PROTOCOL_MAGIC,
+        .version = PROTOCOL_VERSION,
+        .type = type,
+        .flags = FRAME_FLAG_AUTH,
+        .src_node = src_node,
+        .dst_node = dst_node,
+        .payload_len = payload_len,
+    };
+    rx_time_us = esp_timer_get_time();
+    handlers[type](&header, payload);
+    return ESP_OK;
+}
+
+esp_err_t network_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t network_register_handler(MessageType_t type, network_handler_t handler)
+{
+    if(type <= MSG_NONE || type >= MSG_TYPE_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handlers[type] = handler;
+    return ESP_OK;
+}
+
+esp_err_t network_send_seq(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len, uint32_t * seq)
+{
+    if(payload_len > PROTOCOL_MAX_FRAME_LEN || (payload_len > 0 && payload == NULL))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(fail_sends)
+    {
+        return ESP_FAIL;
+    }
+    portENTER_CRITICAL(&lock);
+    uint32_t frame_seq = next_seq++;
+    if(sent_count < NETWORK_DOUBLE_LOG_LEN)
+    {
+        NetworkDoubleFrame_t * frame = &sent[sent_count];
+        frame->header = (FrameHeader_t)
+        {
+            .magic = PROTOCOL_MAGIC,
+            .version = PROTOCOL_VERSION,
+            .type = type,
+            .flags = FRAME_FLAG_AUTH,
+            .src_node = node_id,
+            .dst_node = dst_node,
+            .seq = frame_seq,
+            .payload_len = payload_len,
+        };
+        memcpy(frame->payload, payload, payload_len);
+    }
+    sent_count++;
+    portEXIT_CRITICAL(&lock);
+    if(seq != NULL)
+    {
+        *seq = frame_seq;
+    }
+    return ESP_OK;
+}
+
+esp_err_t network_send(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    return network_send_seq(dst_node, type, payload, payload_len, NULL);
+}
+
+esp_err_t network_send_to_master(MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    return network_send(NODE_ID_MASTER, type, payload, payload_len);
+}
+
+void network_task(void * arg)
+{
+    (void)arg;
+    vTaskDelete(NULL);
+}
+
+int64_t network_get_rx_time_us(void)
+{
+    return rx_time_us;
+}
+
+uint16_t network_get_node_id(void)
+{
+    return node_id;
+}
+
+void network_wait_tx_window(void)
+{
+}
+
+void network_get_wifi_stats(NetworkWifiStats_t * stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+int8_t network_get_rssi(void)
+{
+    return rssi;
+}
+
+esp_err_t network_wifi_reconnect(void)
+{
+    return ESP_OK;
+}
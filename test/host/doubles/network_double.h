@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "protocol.h"
+
+/**
+ * @file network_double.h
+ * @brief Stand-in for the network component: records what the node sends
+ * and delivers frames to the registered handlers, with no transport.
+ */
+
+#define NETWORK_DOUBLE_LOG_LEN  2048
+
+typedef struct
+{
+    FrameHeader_t header;
+    uint8_t payload[PROTOCOL_MAX_FRAME_LEN];
+} NetworkDoubleFrame_t;
+
+void network_double_set_node_id(uint16_t node_id);
+void network_double_set_rssi(int8_t rssi);
+
+/**
+ * @brief Make the sends fail with ESP_FAIL, as with no transport up.
+ */
+void network_double_fail_sends(bool fail);
+
+/**
+ * @brief Frames sent since the last clear, the first NETWORK_DOUBLE_LOG_LEN kept.
+ */
+size_t network_double_sent_count(void);
+const NetworkDoubleFrame_t * network_double_sent(size_t index);
+void network_double_clear(void);
+
+/**
+ * @brief Hand a received frame to the handler registered for its type.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a handler.
+ */
+esp_err_t network_double_deliver(MessageType_t type, uint16_t src_node, uint16_t dst_node, const void * payload, uint16_t payload_len);
@@ -0,0 +1,14 @@
+#pragma once
+#define ARG_END_ERRORS_MAX 8
+struct arg_hdr { char kind; const char *shortopts; const char *longopts; const char *datatype; const char *glossary; int mincount; int maxcount; };
+struct arg_int { struct arg_hdr hdr; int count; int *ival; };
+struct arg_str { struct arg_hdr hdr; int count; const char **sval; };
+struct arg_end { struct arg_hdr hdr; int count; char error[ARG_END_ERRORS_MAX][96]; };
+struct arg_int *arg_int0(const char *s, const char *l, const char *d, const char *g);
+struct arg_int *arg_int1(const char *s, const char *l, const char *d, const char *g);
+struct arg_str *arg_str1(const char *s, const char *l, const char *d, const char *g);
+struct arg_end *arg_end(int maxcount);
+int arg_parse(int argc, char **argv, void **argtable);
+void arg_print_errors(void *fp, struct arg_end *end, const char *progname);
+struct arg_lit { struct arg_hdr hdr; int count; };
+struct arg_lit *arg_lit0(const char *s, const char *l, const char *g);
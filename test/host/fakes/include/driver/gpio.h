@@ -0,0 +1,17 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_attr.h"
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef enum { GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE, GPIO_PULLDOWN_ENABLE } gpio_pulldown_t;
+typedef enum { GPIO_INTR_DISABLE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE } gpio_int_type_t;
+typedef struct { uint64_t pin_bit_mask; gpio_mode_t mode; gpio_pullup_t pull_up_en; gpio_pulldown_t pull_down_en; gpio_int_type_t intr_type; } gpio_config_t;
+typedef void (*gpio_isr_t)(void*);
+esp_err_t gpio_config(const gpio_config_t*);
+int gpio_get_level(gpio_num_t);
+esp_err_t gpio_set_level(gpio_num_t, uint32_t);
+esp_err_t gpio_install_isr_service(int);
+esp_err_t gpio_isr_handler_add(gpio_num_t, gpio_isr_t, void*);
+esp_err_t gpio_isr_handler_remove(gpio_num_t);
+esp_err_t gpio_intr_disable(gpio_num_t);
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+typedef struct i2c_master_bus_t * i2c_master_bus_handle_t;
+typedef struct i2c_master_dev_t * i2c_master_dev_handle_t;
+typedef enum { I2C_CLK_SRC_DEFAULT } i2c_clock_source_t;
+typedef enum { I2C_ADDR_BIT_LEN_7 } i2c_addr_bit_len_t;
+typedef struct { int i2c_port; int sda_io_num; int scl_io_num; i2c_clock_source_t clk_source; uint8_t glitch_ignore_cnt; int intr_priority; size_t trans_queue_depth; struct { uint32_t enable_internal_pullup:1; } flags; } i2c_master_bus_config_t;
+typedef struct { i2c_addr_bit_len_t dev_addr_length; uint16_t device_address; uint32_t scl_speed_hz; } i2c_device_config_t;
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *, i2c_master_bus_handle_t *);
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t, const i2c_device_config_t *, i2c_master_dev_handle_t *);
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t, const uint8_t *, size_t, int);
@@ -0,0 +1,7 @@
+#pragma once
+// RTC memory is static memory on the host, gathered in one section that
+// host_rtc_save() copies out for the next boot, see host_fakes.h
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+#define RTC_DATA_ATTR
+#define IRAM_ATTR
+#define DRAM_ATTR
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_ERR_HTTP_BASE               0x7000
+#define ESP_ERR_HTTP_CONNECT            (ESP_ERR_HTTP_BASE + 3)
+#define ESP_ERR_HTTP_WRITE_DATA         (ESP_ERR_HTTP_BASE + 4)
+
+typedef struct esp_http_client* esp_http_client_handle_t;
+typedef struct { const char* url; int timeout_ms; bool keep_alive_enable; int buffer_size; } esp_http_client_config_t;
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t*);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t, const char*, const char*);
+esp_err_t esp_http_client_open(esp_http_client_handle_t, int);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t);
+int esp_http_client_get_status_code(esp_http_client_handle_t);
+int esp_http_client_read(esp_http_client_handle_t, char*, int);
+esp_err_t esp_http_client_close(esp_http_client_handle_t);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t);
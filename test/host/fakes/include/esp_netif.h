@@ -0,0 +1,18 @@
+#pragma once
+#include "esp_event.h"
+#include "esp_err.h"
+typedef struct esp_netif_obj esp_netif_t;
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+typedef struct { esp_ip4_addr_t ip, netmask, gw; } esp_netif_ip_info_t;
+typedef struct { esp_netif_t* esp_netif; esp_netif_ip_info_t ip_info; bool ip_changed; } ip_event_got_ip_t;
+typedef enum { ESP_NETIF_DNS_MAIN } esp_netif_dns_type_t;
+extern esp_event_base_t IP_EVENT;
+enum { IP_EVENT_STA_GOT_IP, IP_EVENT_STA_LOST_IP };
+esp_err_t esp_netif_init(void);
+esp_netif_t* esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t*);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t*);
+esp_err_t esp_netif_set_ip_info(esp_netif_t*, const esp_netif_ip_info_t*);
+esp_err_t esp_netif_get_ip_info(esp_netif_t*, esp_netif_ip_info_t*);
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) (int)(ipaddr)->addr,0,0,0
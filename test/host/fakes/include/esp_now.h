@@ -0,0 +1,18 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_wifi.h"
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_MAX_DATA_LEN 250
+#define ESP_ERR_ESPNOW_BASE 0x3000
+#define ESP_ERR_ESPNOW_NOT_INIT (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG (ESP_ERR_ESPNOW_BASE + 2)
+typedef enum { ESP_NOW_SEND_SUCCESS, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+typedef struct { uint8_t peer_addr[6]; uint8_t lmk[16]; uint8_t channel; wifi_interface_t ifidx; bool encrypt; void* priv; } esp_now_peer_info_t;
+typedef struct { uint8_t* src_addr; uint8_t* des_addr; wifi_pkt_rx_ctrl_t* rx_ctrl; } esp_now_recv_info_t;
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t*, const uint8_t*, int);
+typedef void (*esp_now_send_cb_t)(const uint8_t*, esp_now_send_status_t);
+esp_err_t esp_now_init(void);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t*);
+esp_err_t esp_now_send(const uint8_t*, const uint8_t*, size_t);
@@ -0,0 +1,43 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+typedef enum { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+typedef enum { WIFI_IF_STA, WIFI_IF_AP } wifi_interface_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum { WIFI_AUTH_OPEN, WIFI_AUTH_WPA2_PSK } wifi_auth_mode_t;
+typedef enum { WIFI_FAST_SCAN, WIFI_ALL_CHANNEL_SCAN } wifi_scan_method_t;
+typedef enum { WIFI_STORAGE_FLASH, WIFI_STORAGE_RAM } wifi_storage_t;
+typedef struct { int x; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() (wifi_init_config_t){0}
+typedef struct { wifi_auth_mode_t authmode; } wifi_scan_threshold_t;
+typedef struct { uint8_t ssid[32]; uint8_t password[64]; wifi_scan_method_t scan_method; bool bssid_set; uint8_t bssid[6]; uint8_t channel; uint16_t listen_interval; wifi_scan_threshold_t threshold; } wifi_sta_config_t;
+typedef union { wifi_sta_config_t sta; } wifi_config_t;
+typedef struct { uint8_t bssid[6]; uint8_t ssid[33]; uint8_t primary; int8_t rssi; } wifi_ap_record_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; wifi_auth_mode_t authmode; uint16_t aid; } wifi_event_sta_connected_t;
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t reason; int8_t rssi; } wifi_event_sta_disconnected_t;
+typedef enum { WIFI_SECOND_CHAN_NONE } wifi_second_chan_t;
+extern esp_event_base_t WIFI_EVENT;
+enum { WIFI_EVENT_STA_START, WIFI_EVENT_STA_CONNECTED, WIFI_EVENT_STA_DISCONNECTED };
+esp_err_t esp_wifi_init(const wifi_init_config_t*);
+esp_err_t esp_wifi_set_mode(wifi_mode_t);
+esp_err_t esp_wifi_set_config(wifi_interface_t, wifi_config_t*);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t);
+esp_err_t esp_wifi_set_storage(wifi_storage_t);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t*);
+esp_err_t esp_wifi_set_channel(uint8_t, wifi_second_chan_t);
+esp_err_t esp_wifi_get_channel(uint8_t*, wifi_second_chan_t*);
+esp_err_t esp_wifi_disconnect(void);
+int64_t esp_wifi_get_tsf_time(wifi_interface_t);
+typedef struct { int8_t rssi; unsigned sig_len; } wifi_pkt_rx_ctrl_t;
+typedef enum { WIFI_PKT_MGMT, WIFI_PKT_CTRL, WIFI_PKT_DATA, WIFI_PKT_MISC } wifi_promiscuous_pkt_type_t;
+typedef struct { wifi_pkt_rx_ctrl_t rx_ctrl; uint8_t payload[]; } wifi_promiscuous_pkt_t;
+typedef struct { uint32_t filter_mask; } wifi_promiscuous_filter_t;
+#define WIFI_PROMIS_FILTER_MASK_MGMT (1 << 0)
+typedef void (*wifi_promiscuous_cb_t)(void*, wifi_promiscuous_pkt_type_t);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t*);
+esp_err_t esp_wifi_set_promiscuous(bool);
+enum { WIFI_REASON_ASSOC_LEAVE = 8, WIFI_REASON_BEACON_TIMEOUT = 200, WIFI_REASON_NO_AP_FOUND = 201 };
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * FreeRTOS on host threads. A tick is 10 ms as with CONFIG_FREERTOS_HZ=100,
+ * counted from the host clock, which a test may switch to virtual time, see
+ * host_clock.h. Critical sections take one process-wide recursive lock, so
+ * they exclude each other across tasks and timer callbacks as on the chip.
+ */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef uint32_t StackType_t;
+typedef struct host_queue * QueueHandle_t;
+typedef struct host_queue * SemaphoreHandle_t;
+typedef struct host_timer * TimerHandle_t;
+typedef struct host_task * TaskHandle_t;
+typedef struct host_event_group * EventGroupHandle_t;
+typedef struct { int owner; } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdPASS                  1
+#define pdFAIL                  0
+#define errQUEUE_FULL           0
+#define portMAX_DELAY           0xffffffffu
+#define configTICK_RATE_HZ      100
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(ticks)    ((TickType_t)(((TickType_t)(ticks) * (TickType_t)1000U) / (TickType_t)configTICK_RATE_HZ))
+#define configMAX_PRIORITIES    25
+#define tskIDLE_PRIORITY        0
+#define tskNO_AFFINITY          0x7fffffff
+
+void host_critical_enter(portMUX_TYPE * mux);
+void host_critical_exit(portMUX_TYPE * mux);
+
+#define portYIELD_FROM_ISR(...)         do { } while(0)
+#define portENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define portEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define portENTER_CRITICAL_ISR(mux)     host_critical_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux)      host_critical_exit(mux)
+#define portENTER_CRITICAL_SAFE(mux)    host_critical_enter(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     host_critical_exit(mux)
+#define taskENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define taskEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define xPortInIsrContext()             0
+#define xPortGetCoreID()                0
+
+#include "task.h"
+#include "timers.h"
@@ -0,0 +1,12 @@
+#pragma once
+#include "FreeRTOS.h"
+#include "queue.h"
+
+// Semaphores are queues of empty items, as in FreeRTOS
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t * woken);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+/**
+ * @file host_fakes.h
+ * @brief Controls and probes of the host fakes of ESP-IDF, for the tests.
+ *
+ * The firmware components build unchanged against the headers of
+ * fakes/include; the test drives the simulated hardware through these.
+ */
+
+// ---- Clock -----------------------------------------------------------------
+
+/**
+ * @brief Run on virtual time: the clock only moves with host_clock_advance()
+ * and with the blocking calls, which jump to the next timer expiry instead of
+ * sleeping. Timers fire in order in the calling thread and xTaskCreate()
+ * records the task without running it, so the test stays single-threaded.
+ *
+ * Call before anything reads the clock. The default is real monotonic time,
+ * with timers fired by a service thread.
+ */
+void host_clock_set_virtual(void);
+bool host_clock_is_virtual(void);
+
+/**
+ * @brief Move the virtual clock forward, firing the timers due on the way.
+ */
+void host_clock_advance(int64_t us);
+
+/**
+ * @brief Move the virtual clock to an instant, no-op if already past it.
+ */
+void host_clock_advance_to(int64_t at_us);
+
+/**
+ * @brief Number of esp_timer callbacks run, to tell a timer that keeps waking
+ * from one that is idle.
+ */
+uint32_t host_esp_timer_fired_count(void);
+
+/**
+ * @brief Called once, after the next esp_timer_stop() of any timer, e.g. to
+ * re-arm it as its callback running on another task meanwhile would.
+ */
+void host_esp_timer_after_stop(void (*hook)(esp_timer_handle_t timer));
+
+// ---- Log -------------------------------------------------------------------
+
+/**
+ * @brief Errors and warnings go to stderr unless quiet; all levels with
+ * HOST_LOG set in the environment.
+ */
+void host_log_set_quiet(bool quiet);
+uint32_t host_log_count(esp_log_level_t level);
+
+// ---- Tasks -----------------------------------------------------------------
+
+/**
+ * @brief Number of xTaskCreate() calls, the tasks not started in virtual time included.
+ */
+uint32_t host_task_created_count(void);
+
+// ---- System ----------------------------------------------------------------
+
+void host_set_reset_reason(esp_reset_reason_t reason);
+
+/**
+ * @brief Called by esp_restart() instead of exiting, e.g. to simulate the
+ * reboot in the same process. The calling task is then parked forever.
+ */
+void host_set_restart_hook(void (*hook)(void));
+uint32_t host_restart_count(void);
+
+/**
+ * @brief Copy the RTC_NOINIT_ATTR variables out, as a reset leaves them.
+ *
+ * A reboot in a new process, e.g. after a watchdog reset, copies them back
+ * with host_rtc_restore() before its first task starts.
+ *
+ * @return Bytes copied, 0 if more than max.
+ */
+size_t host_rtc_save(void * out, size_t max);
+void host_rtc_restore(const void * saved, size_t len);
+
+void host_set_mac(const uint8_t mac[6]);
+
+/**
+ * @brief Feeds of the task watchdog users since boot.
+ */
+uint32_t host_task_wdt_feeds(void);
+
+/**
+ * @brief Whether a watchdog user went unfed longer than the configured timeout.
+ *
+ * @param user_name Filled with the starved user, may be NULL.
+ * @return Time since the last feed of the starved user in ms, 0 if none starves.
+ */
+uint32_t host_task_wdt_starved_ms(const char ** user_name);
+
+// ---- NVS -------------------------------------------------------------------
+
+/**
+ * @brief Select the NVS partition of one simulated node, 0 at start.
+ *
+ * Each node keeps its own keys, so one process can host many nodes.
+ */
+void host_nvs_select(uint32_t instance);
+void host_nvs_erase_all(void);
+uint32_t host_nvs_write_count(void);
+
+/**
+ * @brief Make every set fail with ESP_ERR_NVS_NOT_ENOUGH_SPACE, as a full partition.
+ */
+void host_nvs_fail_writes(bool fail);
+
+// ---- Flash partitions ------------------------------------------------------
+
+/**
+ * @brief Add an erased partition in RAM, found by esp_partition_find_first().
+ */
+void host_partition_add(const char * label, int type, int subtype, uint32_t size);
+uint8_t * host_partition_data(const char * label);
+
+/**
+ * @brief Make the next erase or write of a partition fail, after a number of
+ * successful ones.
+ */
+void host_partition_fail_erase(const char * label, uint32_t after);
+void host_partition_fail_write(const char * label, uint32_t after);
+uint32_t host_partition_write_count(const char * label);
+
+/**
+ * @brief Flash traffic of a partition since it was added: sectors erased,
+ * read calls and bytes read.
+ */
+uint32_t host_partition_erase_count(const char * label);
+uint32_t host_partition_read_count(const char * label);
+uint64_t host_partition_read_bytes(const char * label);
+
+/**
+ * @brief Length of the app image in an app partition, hashed by
+ * esp_partition_get_sha256(); the whole partition by default.
+ */
+void host_partition_set_image_len(const char * label, uint32_t len);
+
+// ---- OTA -------------------------------------------------------------------
+
+/**
+ * @brief Boot from an app partition added with host_partition_add(), in a
+ * given esp_ota_img_states_t.
+ */
+void host_ota_set_running(const char * label, int state);
+int host_ota_running_state(void);
+
+/**
+ * @brief Label of the partition set by esp_ota_set_boot_partition(), NULL if none.
+ */
+const char * host_ota_boot_label(void);
+
+// ---- Delta OTA -------------------------------------------------------------
+
+/**
+ * @brief Build a patch from base to target in the format of the fake
+ * esp_delta_ota: copies from the base and literal inserts. A stand-in for
+ * detools, whose patches are smaller.
+ *
+ * @return Patch length, 0 if it does not fit in patch_max.
+ */
+size_t host_delta_build(const uint8_t * base, size_t base_len, const uint8_t * target, size_t target_len, uint8_t * patch, size_t patch_max);
+
+// ---- Air -------------------------------------------------------------------
+
+#define HOST_AIR_STATIONS   32
+
+typedef struct
+{
+    uint32_t espnow_frames;     /**< esp_now_send() calls. */
+    uint32_t ip_datagrams;      /**< sendto() calls that went out. */
+} HostAirStats_t;
+
+/**
+ * @brief Share a radio between forked processes, one station each: an access
+ * point with an IP network, and ESP-NOW between the stations in range of
+ * each other, none at first. Every station starts in range of the access
+ * point, 10.0.0.<station + 1> on its network.
+ *
+ * Call once in the parent before forking.
+ */
+void host_air_init(int stations);
+
+/**
+ * @brief Be one station, with the MAC giving node id host_air_node_id(), in
+ * the process that runs it. esp_wifi, esp_now and the lwIP sockets then work
+ * over the shared air.
+ */
+void host_air_join(int station);
+
+/**
+ * @brief Be a station on the network behind the access point, without Wi-Fi,
+ * as a master on the wire: its sockets work at once.
+ */
+void host_air_join_wired(int station);
+uint16_t host_air_node_id(int station);
+
+/**
+ * @brief Range changes, from any station: one that leaves the access point
+ * range loses its association, and reconnects once back.
+ */
+void host_air_set_ap_range(int station, bool in_range);
+void host_air_set_espnow_range(int a, int b, bool in_range);
+void host_air_set_rssi(int station, int8_t rssi);
+
+/**
+ * @brief Drop a share of the ESP-NOW frames and datagrams, per receiver.
+ */
+void host_air_set_loss(uint32_t pct);
+void host_air_stats(int station, HostAirStats_t * stats);
+
+/**
+ * @brief The beacon interval the access point announces, 100 TU at first.
+ */
+void host_air_set_beacon_interval(uint16_t interval_tu);
+
+/**
+ * @brief Whether this station is in promiscuous mode, hearing the beacons.
+ */
+bool host_air_sniffing(void);
+
+// ---- GPIO ------------------------------------------------------------------
+
+int host_gpio_level(int gpio);
+
+/**
+ * @brief Number of gpio_set_level() calls on every pin since the start.
+ */
+uint32_t host_gpio_set_count(void);
+
+/**
+ * @brief Drive an input pin, calling its ISR handler on a matching edge.
+ */
+void host_gpio_input(int gpio, int level);
+
+// ---- LEDC ------------------------------------------------------------------
+
+typedef struct
+{
+    int64_t time_us;
+    uint32_t freq_hz;
+    uint32_t duty;
+} HostLedcEntry_t;
+
+/**
+ * @brief Output changes of channel 0: one entry per ledc_update_duty() or
+ * frequency change, the oldest first.
+ *
+ * @return Number of entries copied.
+ */
+size_t host_ledc_log(HostLedcEntry_t * entries, size_t max);
+void host_ledc_log_clear(void);
+
+// ---- I2C -------------------------------------------------------------------
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t bytes;
+} HostI2cStats_t;
+
+void host_i2c_stats(HostI2cStats_t * stats);
+void host_i2c_stats_clear(void);
+
+/**
+ * @brief Make the next transmit calls fail with ESP_ERR_TIMEOUT.
+ */
+void host_i2c_fail(uint32_t count);
+
+#define HOST_PANEL_PAGES    8
+#define HOST_PANEL_COLUMNS  132
+
+/**
+ * @brief RAM of the OLED controller on the bus, SSD1306 or SH1106 in page
+ * addressing: the page and column commands move the pointer, data bytes
+ * are written there and move it one column on. Noise at power-up.
+ */
+void host_i2c_panel(uint8_t ram[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS]);
+
+// ---- ADC -------------------------------------------------------------------
+
+/**
+ * @brief Set the voltage at the ADC pin, read with a 1 mV resolution and a
+ * given noise amplitude around it.
+ */
+void host_adc_set_mv(int millivolts, int noise_mv);
+uint32_t host_adc_read_count(void);
+
+// ---- SHA-256 ---------------------------------------------------------------
+
+/**
+ * @brief SHA-256 of a buffer, the digest of the fake partitions and mbedtls.
+ */
+void host_sha256(const uint8_t * data, size_t len, uint8_t digest[32]);
+
+/**
+ * @brief 64-byte blocks compressed since the start, what a hash costs the
+ * accelerator on the chip.
+ */
+uint64_t host_sha256_block_count(void);
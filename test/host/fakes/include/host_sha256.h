@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Portable SHA-256 of the fakes, behind mbedtls/sha256.h and the partitions
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t total;             // Bytes hashed
+    uint8_t buffer[64];
+} HostSha256_t;
+
+void host_sha256_starts(HostSha256_t * ctx);
+void host_sha256_update(HostSha256_t * ctx, const uint8_t * data, size_t len);
+void host_sha256_finish(HostSha256_t * ctx, uint8_t digest[32]);
@@ -0,0 +1,26 @@
+#pragma once
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+
+/*
+ * The lwIP socket calls on the simulated air of host_air_init(): the
+ * station's datagrams reach the others through its access point, as the
+ * POSIX names of LWIP_COMPAT_SOCKETS map to lwip_*() on the chip.
+ */
+int lwip_socket(int domain, int type, int protocol);
+int lwip_bind(int s, const struct sockaddr * name, socklen_t namelen);
+int lwip_setsockopt(int s, int level, int optname, const void * optval, socklen_t optlen);
+ssize_t lwip_sendto(int s, const void * data, size_t size, int flags, const struct sockaddr * to, socklen_t tolen);
+ssize_t lwip_recvfrom(int s, void * mem, size_t len, int flags, struct sockaddr * from, socklen_t * fromlen);
+int lwip_close(int s);
+
+#define socket(domain, type, protocol)                  lwip_socket(domain, type, protocol)
+#define bind(s, name, namelen)                          lwip_bind(s, name, namelen)
+#define setsockopt(s, level, optname, optval, optlen)   lwip_setsockopt(s, level, optname, optval, optlen)
+#define sendto(s, data, size, flags, to, tolen)         lwip_sendto(s, data, size, flags, to, tolen)
+#define recvfrom(s, mem, len, flags, from, fromlen)     lwip_recvfrom(s, mem, len, flags, from, fromlen)
+#define close(s)                                        lwip_close(s)
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include "host_sha256.h"
+
+// The mbedtls SHA-256 API on the portable implementation of the fakes
+typedef HostSha256_t mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context * ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context * ctx);
+void mbedtls_sha256_clone(mbedtls_sha256_context * dst, const mbedtls_sha256_context * src);
+int mbedtls_sha256_starts(mbedtls_sha256_context * ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context * ctx, const unsigned char * input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context * ctx, unsigned char output[32]);
+int mbedtls_sha256(const unsigned char * input, size_t ilen, unsigned char output[32], int is224);
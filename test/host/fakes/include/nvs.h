@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+#define ESP_ERR_NVS_BASE                0x1100
+#define ESP_ERR_NVS_NOT_INITIALIZED     (ESP_ERR_NVS_BASE + 0x01)
+#define ESP_ERR_NVS_NOT_FOUND           (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_TYPE_MISMATCH       (ESP_ERR_NVS_BASE + 0x03)
+#define ESP_ERR_NVS_READ_ONLY           (ESP_ERR_NVS_BASE + 0x04)
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE    (ESP_ERR_NVS_BASE + 0x05)
+#define ESP_ERR_NVS_INVALID_HANDLE      (ESP_ERR_NVS_BASE + 0x07)
+#define ESP_ERR_NVS_INVALID_LENGTH      (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NO_FREE_PAGES       (ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   (ESP_ERR_NVS_BASE + 0x10)
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t mode, nvs_handle_t * handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char * key, uint8_t value);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * value);
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char * key, uint16_t value);
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char * key, uint16_t * value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char * key, uint32_t value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char * key, uint32_t * value);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * value, size_t * length);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key);
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Host build configuration: the defaults of main/Kconfig.projbuild for a
+ * node of the linux target. A test overrides any of them on the command
+ * line, e.g. -DCONFIG_DOMINION_TEAM_COUNT=4, or turns one off with =0.
+ */
+
+#ifndef CONFIG_IDF_TARGET_LINUX
+#define CONFIG_IDF_TARGET_LINUX 1
+#endif
+#ifndef CONFIG_DOMINION_WIFI_SSID
+#define CONFIG_DOMINION_WIFI_SSID "dominion"
+#endif
+#ifndef CONFIG_DOMINION_WIFI_PASSWORD
+#define CONFIG_DOMINION_WIFI_PASSWORD ""
+#endif
+#ifndef CONFIG_DOMINION_WIFI_CHANNEL
+#define CONFIG_DOMINION_WIFI_CHANNEL 1
+#endif
+#ifndef CONFIG_DOMINION_TRANSPORT_UDP
+#define CONFIG_DOMINION_TRANSPORT_UDP 1
+#endif
+#ifndef CONFIG_DOMINION_TRANSPORT_ESPNOW
+#define CONFIG_DOMINION_TRANSPORT_ESPNOW 1
+#endif
+#ifndef CONFIG_DOMINION_RELAY_HOPS
+#define CONFIG_DOMINION_RELAY_HOPS 2
+#endif
+#ifndef CONFIG_DOMINION_WIFI_MODEM_SLEEP
+#define CONFIG_DOMINION_WIFI_MODEM_SLEEP 1
+#endif
+#ifndef CONFIG_DOMINION_TEAM_COUNT
+#define CONFIG_DOMINION_TEAM_COUNT 2
+#endif
+#ifndef CONFIG_DOMINION_CLI
+#define CONFIG_DOMINION_CLI 1
+#endif
+#ifndef CONFIG_DOMINION_DISPLAY
+#define CONFIG_DOMINION_DISPLAY 1
+#endif
+#ifndef CONFIG_DOMINION_BUZZER
+#define CONFIG_DOMINION_BUZZER 1
+#endif
+#ifndef CONFIG_DOMINION_BATTERY
+#define CONFIG_DOMINION_BATTERY 1
+#endif
+#ifndef CONFIG_DOMINION_GAME_MODE_RUNTIME
+#define CONFIG_DOMINION_GAME_MODE_RUNTIME 1
+#endif
+#ifndef CONFIG_ESP_TASK_WDT_EN
+#define CONFIG_ESP_TASK_WDT_EN 1
+#endif
@@ -0,0 +1,862 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include "host_internal.h"
+#include "host_fakes.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+
+/*
+ * The radio of a fleet of stations, each a forked process: an access point
+ * with its IP network, and the ESP-NOW range between stations. Every
+ * station owns two loopback datagram sockets, opened before the fork: the
+ * air between stations is a sendto() to the sockets of those in range.
+ *
+ * Within a station, the Wi-Fi driver and the default event loop run on one
+ * thread, the "Wi-Fi task"; received ESP-NOW frames and datagrams each come
+ * from a thread of their own. In promiscuous mode an associated station
+ * hears a beacon of the access point every AIR_MONITOR_MS.
+ */
+
+#define AIR_FRAME_MAX       1500
+#define AIR_EVENT_QUEUE_LEN 16
+#define AIR_EVENT_DATA_MAX  64
+#define AIR_HANDLERS_MAX    8
+#define AIR_SOCKETS_MAX     4
+#define AIR_SOCKET_QUEUE    32
+#define AIR_SOCKET_FD_BASE  1000
+#define AIR_MONITOR_MS      50
+#define AIR_IP_PREFIX       0x0A000000      // 10.0.0.<station + 1>
+#define AIR_BEACON_LEN      40              // Up to the capabilities, and the FCS
+
+// Association of the station, from the probe to the DHCP lease
+#define AIR_CONNECT_MS      40
+#define AIR_SCAN_MS         600             // Every channel, the station configured without a BSSID
+#define AIR_PROBE_MS        120             // One channel, one BSSID, no answer
+
+typedef struct
+{
+    int stations;
+    uint16_t espnow_port[HOST_AIR_STATIONS];
+    uint16_t ip_port[HOST_AIR_STATIONS];
+    bool ap_range[HOST_AIR_STATIONS];
+    bool espnow_range[HOST_AIR_STATIONS][HOST_AIR_STATIONS];
+    bool ip_up[HOST_AIR_STATIONS];
+    int8_t rssi[HOST_AIR_STATIONS];
+    uint32_t loss_pct;
+    uint8_t ap_bssid[6];
+    uint8_t ap_channel;
+    uint16_t ap_beacon_interval_tu;
+    uint32_t espnow_tx[HOST_AIR_STATIONS];
+    uint32_t ip_tx[HOST_AIR_STATIONS];
+} HostAir_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t src;
+    uint16_t src_port;
+    uint16_t dst_port;
+} AirHeader_t;
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[AIR_EVENT_DATA_MAX];
+} AirEvent_t;
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void * arg;
+} AirHandler_t;
+
+typedef struct
+{
+    uint16_t len;
+    AirHeader_t header;
+    uint8_t data[AIR_FRAME_MAX];
+} AirDatagram_t;
+
+typedef struct
+{
+    bool used;
+    uint16_t port;
+    int64_t rcvtimeo_us;
+    AirDatagram_t queue[AIR_SOCKET_QUEUE];
+    uint32_t head;
+    uint32_t count;
+} AirSocket_t;
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+static HostAir_t * air = NULL;
+static int espnow_fds[HOST_AIR_STATIONS];
+static int ip_fds[HOST_AIR_STATIONS];
+static int self = -1;
+static __thread unsigned loss_seed = 0;     // Per thread: every sender draws its own losses
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static pthread_once_t cond_once = PTHREAD_ONCE_INIT;
+
+// Wi-Fi task
+static AirEvent_t events[AIR_EVENT_QUEUE_LEN];
+static uint32_t events_head = 0;
+static uint32_t events_count = 0;
+static AirHandler_t handlers[AIR_HANDLERS_MAX];
+static int handler_count = 0;
+static bool loop_started = false;
+static bool wifi_started = false;
+static bool connect_pending = false;
+static bool associated = false;
+static wifi_config_t sta_config;
+static bool promiscuous = false;
+static wifi_promiscuous_cb_t promiscuous_cb = NULL;
+static uint32_t promiscuous_filter = 0;
+
+static AirSocket_t sockets[AIR_SOCKETS_MAX];
+static bool ip_rx_started = false;
+
+static esp_now_recv_cb_t espnow_recv_cb = NULL;
+static bool espnow_started = false;
+
+static void cond_init(void)
+{
+    host_wait_init(NULL, &cond);
+}
+
+static void air_lock(void)
+{
+    pthread_once(&cond_once, cond_init);
+    pthread_mutex_lock(&lock);
+}
+
+static int open_socket(uint16_t * port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int size = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        abort();
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+void host_air_init(int stations)
+{
+    if(stations <= 0 || stations > HOST_AIR_STATIONS)
+    {
+        abort();
+    }
+    air = mmap(NULL, sizeof(*air), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(air == MAP_FAILED)
+    {
+        abort();
+    }
+    memset(air, 0, sizeof(*air));
+    air->stations = stations;
+    air->ap_bssid[0] = 0x02;
+    air->ap_bssid[3] = 0xAA;
+    air->ap_bssid[4] = 0xBB;
+    air->ap_bssid[5] = 0xCC;
+    air->ap_channel = 6;
+    air->ap_beacon_interval_tu = 100;
+    for(int i = 0; i < stations; i++)
+    {
+        espnow_fds[i] = open_socket(&air->espnow_port[i]);
+        ip_fds[i] = open_socket(&air->ip_port[i]);
+        air->ap_range[i] = true;
+        air->rssi[i] = -55;
+    }
+}
+
+uint16_t host_air_node_id(int station)
+{
+    return 0x0100 + station;
+}
+
+void host_air_join(int station)
+{
+    self = station;
+    const uint8_t mac[6] = { 0x24, 0x6f, 0x28, 0x00, 0x01, (uint8_t)station };
+    host_set_mac(mac);
+    // The other stations' sockets belong to their processes
+    for(int i = 0; i < air->stations; i++)
+    {
+        if(i != station)
+        {
+            close(espnow_fds[i]);
+            close(ip_fds[i]);
+        }
+    }
+}
+
+void host_air_join_wired(int station)
+{
+    host_air_join(station);
+    __atomic_store_n(&air->ip_up[station], true, __ATOMIC_SEQ_CST);
+}
+
+void host_air_set_ap_range(int station, bool in_range)
+{
+    __atomic_store_n(&air->ap_range[station], in_range, __ATOMIC_SEQ_CST);
+}
+
+void host_air_set_espnow_range(int a, int b, bool in_range)
+{
+    __atomic_store_n(&air->espnow_range[a][b], in_range, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&air->espnow_range[b][a], in_range, __ATOMIC_SEQ_CST);
+}
+
+void host_air_set_loss(uint32_t pct)
+{
+    __atomic_store_n(&air->loss_pct, pct, __ATOMIC_SEQ_CST);
+}
+
+void host_air_set_rssi(int station, int8_t rssi)
+{
+    __atomic_store_n(&air->rssi[station], rssi, __ATOMIC_SEQ_CST);
+}
+
+void host_air_set_beacon_interval(uint16_t interval_tu)
+{
+    __atomic_store_n(&air->ap_beacon_interval_tu, interval_tu, __ATOMIC_SEQ_CST);
+}
+
+bool host_air_sniffing(void)
+{
+    air_lock();
+    bool on = promiscuous;
+    pthread_mutex_unlock(&lock);
+    return on;
+}
+
+void host_air_stats(int station, HostAirStats_t * stats)
+{
+    stats->espnow_frames = __atomic_load_n(&air->espnow_tx[station], __ATOMIC_SEQ_CST);
+    stats->ip_datagrams = __atomic_load_n(&air->ip_tx[station], __ATOMIC_SEQ_CST);
+}
+
+static bool lost(void)
+{
+    uint32_t pct = __atomic_load_n(&air->loss_pct, __ATOMIC_SEQ_CST);
+    if(loss_seed == 0)
+    {
+        loss_seed = 0x9E3779B9u * (self + 1) ^ (unsigned)(uintptr_t)&loss_seed;
+    }
+    return pct > 0 && (uint32_t)(rand_r(&loss_seed) % 100) < pct;
+}
+
+static void air_send(int fd, uint16_t port, const AirHeader_t * header, const void * data, size_t len)
+{
+    uint8_t buf[sizeof(AirHeader_t) + AIR_FRAME_MAX];
+    memcpy(buf, header, sizeof(*header));
+    memcpy(buf + sizeof(*header), data, len);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    sendto(fd, buf, sizeof(*header) + len, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+// ---- Event loop and Wi-Fi task ---------------------------------------------
+
+static void post_locked(esp_event_base_t base, int32_t id, const void * data, size_t len)
+{
+    if(events_count == AIR_EVENT_QUEUE_LEN || len > AIR_EVENT_DATA_MAX)
+    {
+        abort();
+    }
+    AirEvent_t * event = &events[(events_head + events_count++) % AIR_EVENT_QUEUE_LEN];
+    event->base = base;
+    event->id = id;
+    if(len > 0)
+    {
+        memcpy(event->data, data, len);
+    }
+    pthread_cond_broadcast(&cond);
+}
+
+static void dispatch(const AirEvent_t * event)
+{
+    for(int i = 0; i < handler_count; i++)
+    {
+        if(handlers[i].base == event->base && (handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event->id))
+        {
+            handlers[i].handler(handlers[i].arg, event->base, event->id, (void *)event->data);
+        }
+    }
+}
+
+static void disconnected_locked(uint8_t reason)
+{
+    associated = false;
+    __atomic_store_n(&air->ip_up[self], false, __ATOMIC_SEQ_CST);
+    wifi_event_sta_disconnected_t event = { .reason = reason };
+    memcpy(event.bssid, sta_config.sta.bssid, sizeof(event.bssid));
+    post_locked(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event));
+}
+
+// A probe on the configured channel for the configured BSSID, or a scan
+static void connect_locked(void)
+{
+    bool in_range = __atomic_load_n(&air->ap_range[self], __ATOMIC_SEQ_CST);
+    bool locked = sta_config.sta.bssid_set;
+    bool found = in_range && (!locked || (memcmp(sta_config.sta.bssid, air->ap_bssid, 6) == 0 && sta_config.sta.channel == air->ap_channel));
+
+    pthread_mutex_unlock(&lock);
+    host_sleep_us((int64_t)1000 * (found ? (locked ? 0 : AIR_SCAN_MS) + AIR_CONNECT_MS : (locked ? AIR_PROBE_MS : AIR_SCAN_MS)));
+    pthread_mutex_lock(&lock);
+
+    if(!found)
+    {
+        disconnected_locked(WIFI_REASON_NO_AP_FOUND);
+        return;
+    }
+
+    associated = true;
+    wifi_event_sta_connected_t connected = { .channel = air->ap_channel, .authmode = sta_config.sta.threshold.authmode };
+    memcpy(connected.bssid, air->ap_bssid, sizeof(connected.bssid));
+    post_locked(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected, sizeof(connected));
+
+    ip_event_got_ip_t got_ip = { .ip_info.ip.addr = AIR_IP_PREFIX | (self + 1) };
+    __atomic_store_n(&air->ip_up[self], true, __ATOMIC_SEQ_CST);
+    post_locked(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip));
+}
+
+// A beacon of the access point to the promiscuous callback, the lock released
+static void beacon_locked(void)
+{
+    wifi_promiscuous_cb_t cb = promiscuous_cb;
+    if(!promiscuous || !associated || cb == NULL || !(promiscuous_filter & WIFI_PROMIS_FILTER_MASK_MGMT))
+    {
+        return;
+    }
+
+    static uint8_t buf[sizeof(wifi_promiscuous_pkt_t) + AIR_BEACON_LEN];
+    wifi_promiscuous_pkt_t * pkt = (wifi_promiscuous_pkt_t *)buf;
+    memset(buf, 0, sizeof(buf));
+    pkt->rx_ctrl.rssi = __atomic_load_n(&air->rssi[self], __ATOMIC_SEQ_CST);
+    pkt->rx_ctrl.sig_len = AIR_BEACON_LEN;
+    uint8_t * frame = pkt->payload;
+    frame[0] = 0x80;
+    memset(&frame[4], 0xFF, 6);
+    memcpy(&frame[10], air->ap_bssid, 6);
+    memcpy(&frame[16], air->ap_bssid, 6);
+    uint16_t interval_tu = __atomic_load_n(&air->ap_beacon_interval_tu, __ATOMIC_SEQ_CST);
+    frame[32] = interval_tu & 0xFF;
+    frame[33] = interval_tu >> 8;
+
+    pthread_mutex_unlock(&lock);
+    cb(pkt, WIFI_PKT_MGMT);
+    pthread_mutex_lock(&lock);
+}
+
+static bool loop_ready(void * ctx)
+{
+    (void)ctx;
+    return events_count > 0 || connect_pending;
+}
+
+static void * wifi_task(void * arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while(true)
+    {
+        host_wait(&lock, &cond, loop_ready, NULL, pdMS_TO_TICKS(AIR_MONITOR_MS));
+
+        if(events_count > 0)
+        {
+            AirEvent_t event = events[events_head];
+            events_head = (events_head + 1) % AIR_EVENT_QUEUE_LEN;
+            events_count--;
+            pthread_mutex_unlock(&lock);
+            dispatch(&event);
+            pthread_mutex_lock(&lock);
+            continue;
+        }
+
+        if(connect_pending)
+        {
+            connect_pending = false;
+            connect_locked();
+            continue;
+        }
+
+        // Beacons lost: the station leaves the access point
+        if(associated && !__atomic_load_n(&air->ap_range[self], __ATOMIC_SEQ_CST))
+        {
+            disconnected_locked(WIFI_REASON_BEACON_TIMEOUT);
+        }
+        beacon_locked();
+    }
+    return NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    air_lock();
+    if(loop_started)
+    {
+        pthread_mutex_unlock(&lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    loop_started = true;
+    pthread_mutex_unlock(&lock);
+    pthread_t thread;
+    pthread_create(&thread, NULL, wifi_task, NULL);
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg)
+{
+    air_lock();
+    if(handler_count == AIR_HANDLERS_MAX)
+    {
+        pthread_mutex_unlock(&lock);
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[handler_count++] = (AirHandler_t){ .base = base, .id = id, .handler = handler, .arg = arg };
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void * arg, esp_event_handler_instance_t * instance)
+{
+    if(instance != NULL)
+    {
+        *instance = NULL;
+    }
+    return esp_event_handler_register(base, id, handler, arg);
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return air != NULL && self >= 0 ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_netif_t * esp_netif_create_default_wifi_sta(void)
+{
+    static int netif;
+    return (esp_netif_t *)&netif;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t * config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return mode == WIFI_MODE_STA ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t * config)
+{
+    if(config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    air_lock();
+    sta_config = *config;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    air_lock();
+    wifi_started = true;
+    post_locked(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0);
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    air_lock();
+    esp_err_t ret = wifi_started ? ESP_OK : ESP_ERR_INVALID_STATE;
+    connect_pending = wifi_started;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    air_lock();
+    if(associated)
+    {
+        disconnected_locked(WIFI_REASON_ASSOC_LEAVE);
+    }
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb)
+{
+    air_lock();
+    promiscuous_cb = cb;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t * filter)
+{
+    if(filter == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    air_lock();
+    promiscuous_filter = filter->filter_mask;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool enable)
+{
+    air_lock();
+    esp_err_t ret = wifi_started ? ESP_OK : ESP_ERR_INVALID_STATE;
+    promiscuous = enable && wifi_started;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t * ap)
+{
+    air_lock();
+    bool up = associated;
+    pthread_mutex_unlock(&lock);
+    if(!up)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(ap, 0, sizeof(*ap));
+    memcpy(ap->bssid, air->ap_bssid, sizeof(ap->bssid));
+    ap->primary = air->ap_channel;
+    ap->rssi = __atomic_load_n(&air->rssi[self], __ATOMIC_SEQ_CST);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    (void)primary;
+    (void)second;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t * primary, wifi_second_chan_t * second)
+{
+    *primary = air->ap_channel;
+    if(second != NULL)
+    {
+        *second = WIFI_SECOND_CHAN_NONE;
+    }
+    return ESP_OK;
+}
+
+// The access point's TSF: the host clock, shared by every station
+int64_t esp_wifi_get_tsf_time(wifi_interface_t interface)
+{
+    (void)interface;
+    air_lock();
+    bool up = associated;
+    pthread_mutex_unlock(&lock);
+    return up ? esp_timer_get_time() : 0;
+}
+
+// ---- ESP-NOW ----------------------------------------------------------------
+
+static void * espnow_rx_task(void * arg)
+{
+    (void)arg;
+    uint8_t buf[sizeof(AirHeader_t) + AIR_FRAME_MAX];
+    while(true)
+    {
+        ssize_t len = recv(espnow_fds[self], buf, sizeof(buf), 0);
+        if(len < (ssize_t)sizeof(AirHeader_t))
+        {
+            continue;
+        }
+        const AirHeader_t * header = (const AirHeader_t *)buf;
+        uint8_t src_mac[6] = { 0x24, 0x6f, 0x28, 0x00, 0x01, header->src };
+        uint8_t dst_mac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+        wifi_pkt_rx_ctrl_t rx_ctrl = { .rssi = __atomic_load_n(&air->rssi[self], __ATOMIC_SEQ_CST) };
+        esp_now_recv_info_t info = { .src_addr = src_mac, .des_addr = dst_mac, .rx_ctrl = &rx_ctrl };
+        if(espnow_recv_cb != NULL)
+        {
+            espnow_recv_cb(&info, buf + sizeof(AirHeader_t), (int)(len - sizeof(AirHeader_t)));
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_now_init(void)
+{
+    if(air == NULL || self < 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(!espnow_started)
+    {
+        espnow_started = true;
+        pthread_t thread;
+        pthread_create(&thread, NULL, espnow_rx_task, NULL);
+        pthread_detach(thread);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    espnow_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    (void)cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t * peer)
+{
+    return peer != NULL ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+// Broadcast to every station in range, or unicast to one
+esp_err_t esp_now_send(const uint8_t * peer_addr, const uint8_t * data, size_t len)
+{
+    if(!espnow_started)
+    {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if(data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    __atomic_add_fetch(&air->espnow_tx[self], 1, __ATOMIC_SEQ_CST);
+    bool broadcast = peer_addr == NULL || peer_addr[0] == 0xFF;
+    AirHeader_t header = { .src = (uint8_t)self };
+    for(int i = 0; i < air->stations; i++)
+    {
+        if(i == self || !__atomic_load_n(&air->espnow_range[self][i], __ATOMIC_SEQ_CST) || (!broadcast && peer_addr[5] != i) || lost())
+        {
+            continue;
+        }
+        air_send(espnow_fds[self], air->espnow_port[i], &header, data, len);
+    }
+    return ESP_OK;
+}
+
+// ---- lwIP sockets ----------------------------------------------------------
+
+static AirSocket_t * socket_get(int s)
+{
+    int index = s - AIR_SOCKET_FD_BASE;
+    return index >= 0 && index < AIR_SOCKETS_MAX && sockets[index].used ? &sockets[index] : NULL;
+}
+
+static void * ip_rx_task(void * arg)
+{
+    (void)arg;
+    AirDatagram_t datagram;
+    while(true)
+    {
+        ssize_t len = recv(ip_fds[self], &datagram.header, sizeof(datagram.header) + AIR_FRAME_MAX, 0);
+        if(len < (ssize_t)sizeof(AirHeader_t))
+        {
+            continue;
+        }
+        datagram.len = len - sizeof(AirHeader_t);
+        pthread_mutex_lock(&lock);
+        for(int i = 0; i < AIR_SOCKETS_MAX; i++)
+        {
+            AirSocket_t * sock = &sockets[i];
+            if(sock->used && sock->port == datagram.header.dst_port && sock->count < AIR_SOCKET_QUEUE)
+            {
+                sock->queue[(sock->head + sock->count++) % AIR_SOCKET_QUEUE] = datagram;
+                pthread_cond_broadcast(&cond);
+            }
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+int lwip_socket(int domain, int type, int protocol)
+{
+    if(air == NULL || self < 0 || domain != AF_INET || type != SOCK_DGRAM)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    air_lock();
+    int s = -1;
+    for(int i = 0; i < AIR_SOCKETS_MAX && s < 0; i++)
+    {
+        if(!sockets[i].used)
+        {
+            memset(&sockets[i], 0, sizeof(sockets[i]));
+            sockets[i].used = true;
+            s = AIR_SOCKET_FD_BASE + i;
+        }
+    }
+    if(!ip_rx_started && s >= 0)
+    {
+        ip_rx_started = true;
+        pthread_t thread;
+        pthread_create(&thread, NULL, ip_rx_task, NULL);
+        pthread_detach(thread);
+    }
+    pthread_mutex_unlock(&lock);
+    if(s < 0)
+    {
+        errno = ENFILE;
+    }
+    return s;
+}
+
+int lwip_bind(int s, const struct sockaddr * name, socklen_t namelen)
+{
+    air_lock();
+    AirSocket_t * sock = socket_get(s);
+    if(sock != NULL)
+    {
+        sock->port = ntohs(((const struct sockaddr_in *)name)->sin_port);
+    }
+    pthread_mutex_unlock(&lock);
+    errno = sock == NULL ? EBADF : 0;
+    return sock == NULL ? -1 : 0;
+}
+
+int lwip_setsockopt(int s, int level, int optname, const void * optval, socklen_t optlen)
+{
+    air_lock();
+    AirSocket_t * sock = socket_get(s);
+    if(sock != NULL && level == SOL_SOCKET && optname == SO_RCVTIMEO)
+    {
+        const struct timeval * tv = optval;
+        sock->rcvtimeo_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    }
+    pthread_mutex_unlock(&lock);
+    return sock == NULL ? -1 : 0;
+}
+
+// Through the access point: to one station, or to all of them
+ssize_t lwip_sendto(int s, const void * data, size_t size, int flags, const struct sockaddr * to, socklen_t tolen)
+{
+    air_lock();
+    AirSocket_t * sock = socket_get(s);
+    uint16_t src_port = sock != NULL ? sock->port : 0;
+    pthread_mutex_unlock(&lock);
+    if(sock == NULL || size > AIR_FRAME_MAX)
+    {
+        errno = sock == NULL ? EBADF : EMSGSIZE;
+        return -1;
+    }
+    if(!__atomic_load_n(&air->ip_up[self], __ATOMIC_SEQ_CST))
+    {
+        errno = ENETUNREACH;
+        return -1;
+    }
+
+    const struct sockaddr_in * dest = (const struct sockaddr_in *)to;
+    uint32_t addr = ntohl(dest->sin_addr.s_addr);
+    bool broadcast = addr == INADDR_BROADCAST || addr == (AIR_IP_PREFIX | 0xFF);
+    AirHeader_t header = { .src = (uint8_t)self, .src_port = src_port, .dst_port = ntohs(dest->sin_port) };
+    __atomic_add_fetch(&air->ip_tx[self], 1, __ATOMIC_SEQ_CST);
+    for(int i = 0; i < air->stations; i++)
+    {
+        bool addressed = broadcast ? i != self : addr == (AIR_IP_PREFIX | (uint32_t)(i + 1));
+        if(addressed && __atomic_load_n(&air->ip_up[i], __ATOMIC_SEQ_CST) && !lost())
+        {
+            air_send(ip_fds[self], air->ip_port[i], &header, data, size);
+        }
+    }
+    return (ssize_t)size;
+}
+
+static bool socket_ready(void * ctx)
+{
+    return ((AirSocket_t *)ctx)->count > 0;
+}
+
+ssize_t lwip_recvfrom(int s, void * mem, size_t len, int flags, struct sockaddr * from, socklen_t * fromlen)
+{
+    air_lock();
+    AirSocket_t * sock = socket_get(s);
+    if(sock == NULL)
+    {
+        pthread_mutex_unlock(&lock);
+        errno = EBADF;
+        return -1;
+    }
+    TickType_t wait = sock->rcvtimeo_us > 0 ? pdMS_TO_TICKS((sock->rcvtimeo_us + 999) / 1000) : portMAX_DELAY;
+    if(!host_wait(&lock, &cond, socket_ready, sock, wait))
+    {
+        pthread_mutex_unlock(&lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    AirDatagram_t * datagram = &sock->queue[sock->head];
+    sock->head = (sock->head + 1) % AIR_SOCKET_QUEUE;
+    sock->count--;
+    size_t copied = datagram->len < len ? datagram->len : len;
+    memcpy(mem, datagram->data, copied);
+    if(from != NULL && fromlen != NULL && *fromlen >= sizeof(struct sockaddr_in))
+    {
+        struct sockaddr_in * src = (struct sockaddr_in *)from;
+        *src = (struct sockaddr_in)
+        {
+            .sin_family = AF_INET,
+            .sin_port = htons(datagram->header.src_port),
+            .sin_addr.s_addr = htonl(AIR_IP_PREFIX | (uint32_t)(datagram->header.src + 1)),
+        };
+        *fromlen = sizeof(*src);
+    }
+    pthread_mutex_unlock(&lock);
+    return (ssize_t)copied;
+}
+
+int lwip_close(int s)
+{
+    air_lock();
+    AirSocket_t * sock = socket_get(s);
+    if(sock != NULL)
+    {
+        sock->used = false;
+    }
+    pthread_mutex_unlock(&lock);
+    return sock == NULL ? -1 : 0;
+}
@@ -0,0 +1,281 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "host_internal.h"
+#include "host_fakes.h"
+#include "esp_timer.h"
+
+static pthread_mutex_t alarm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t alarm_cond;
+static pthread_once_t alarm_once = PTHREAD_ONCE_INIT;
+static host_alarm_t * alarms = NULL;
+static bool service_running = false;
+
+static bool virtual_time = false;
+static int64_t virtual_us = 0;
+static int64_t start_us = -1;
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t host_clock_now_us(void)
+{
+    if(virtual_time)
+    {
+        return __atomic_load_n(&virtual_us, __ATOMIC_SEQ_CST);
+    }
+    int64_t now = monotonic_us();
+    int64_t expected = -1;
+    __atomic_compare_exchange_n(&start_us, &expected, now, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return now - __atomic_load_n(&start_us, __ATOMIC_SEQ_CST);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_clock_now_us();
+}
+
+void host_clock_set_virtual(void)
+{
+    virtual_time = true;
+}
+
+bool host_clock_is_virtual(void)
+{
+    return virtual_time;
+}
+
+void host_wait_init(pthread_mutex_t * mutex, pthread_cond_t * cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if(mutex != NULL)
+    {
+        pthread_mutex_init(mutex, NULL);
+    }
+}
+
+static void alarm_init(void)
+{
+    host_wait_init(NULL, &alarm_cond);
+}
+
+// Pops the earliest alarm due by the given time, rearming it if periodic
+static host_alarm_t * alarm_take_due(int64_t by_us, int64_t * due_us)
+{
+    host_alarm_t * first = NULL;
+    for(host_alarm_t * alarm = alarms; alarm != NULL; alarm = alarm->next)
+    {
+        if(alarm->armed && alarm->due_us <= by_us && (first == NULL || alarm->due_us < first->due_us))
+        {
+            first = alarm;
+        }
+    }
+    if(first != NULL)
+    {
+        *due_us = first->due_us;
+        if(first->period_us > 0)
+        {
+            first->due_us += first->period_us;
+        }
+        else
+        {
+            first->armed = false;
+        }
+    }
+    return first;
+}
+
+static bool alarm_next_due(int64_t * due_us)
+{
+    bool found = false;
+    pthread_mutex_lock(&alarm_lock);
+    for(host_alarm_t * alarm = alarms; alarm != NULL; alarm = alarm->next)
+    {
+        if(alarm->armed && (!found || alarm->due_us < *due_us))
+        {
+            *due_us = alarm->due_us;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&alarm_lock);
+    return found;
+}
+
+// Real time: fires the alarms from their own thread, as the timer tasks do
+static void * alarm_service(void * arg)
+{
+    pthread_mutex_lock(&alarm_lock);
+    while(true)
+    {
+        int64_t due_us;
+        host_alarm_t * alarm = alarm_take_due(host_clock_now_us(), &due_us);
+        if(alarm != NULL)
+        {
+            pthread_mutex_unlock(&alarm_lock);
+            alarm->fire(alarm);
+            pthread_mutex_lock(&alarm_lock);
+            continue;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_nsec += 1000000;
+        if(ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&alarm_cond, &alarm_lock, &ts);
+    }
+    return NULL;
+}
+
+void host_alarm_arm(host_alarm_t * alarm, int64_t due_us, int64_t period_us)
+{
+    pthread_once(&alarm_once, alarm_init);
+    pthread_mutex_lock(&alarm_lock);
+    if(!alarm->registered)
+    {
+        alarm->registered = true;
+        alarm->next = alarms;
+        alarms = alarm;
+    }
+    alarm->due_us = due_us;
+    alarm->period_us = period_us;
+    alarm->armed = true;
+    if(!virtual_time && !service_running)
+    {
+        pthread_t thread;
+        service_running = true;
+        pthread_create(&thread, NULL, alarm_service, NULL);
+        pthread_detach(thread);
+    }
+    pthread_cond_signal(&alarm_cond);
+    pthread_mutex_unlock(&alarm_lock);
+}
+
+void host_alarm_disarm(host_alarm_t * alarm)
+{
+    pthread_mutex_lock(&alarm_lock);
+    alarm->armed = false;
+    pthread_mutex_unlock(&alarm_lock);
+}
+
+bool host_alarm_is_armed(host_alarm_t * alarm)
+{
+    pthread_mutex_lock(&alarm_lock);
+    bool armed = alarm->armed;
+    pthread_mutex_unlock(&alarm_lock);
+    return armed;
+}
+
+void host_clock_advance_to(int64_t at_us)
+{
+    if(!virtual_time)
+    {
+        fprintf(stderr, "host_clock_advance_to() needs host_clock_set_virtual()\n");
+        abort();
+    }
+    pthread_mutex_lock(&alarm_lock);
+    while(true)
+    {
+        int64_t due_us;
+        host_alarm_t * alarm = alarm_take_due(at_us, &due_us);
+        if(alarm == NULL)
+        {
+            break;
+        }
+        if(due_us > virtual_us)
+        {
+            __atomic_store_n(&virtual_us, due_us, __ATOMIC_SEQ_CST);
+        }
+        pthread_mutex_unlock(&alarm_lock);
+        alarm->fire(alarm);
+        pthread_mutex_lock(&alarm_lock);
+    }
+    if(at_us > virtual_us)
+    {
+        __atomic_store_n(&virtual_us, at_us, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&alarm_lock);
+}
+
+void host_clock_advance(int64_t us)
+{
+    host_clock_advance_to(host_clock_now_us() + us);
+}
+
+bool host_wait(pthread_mutex_t * mutex, pthread_cond_t * cond, bool (*ready)(void * ctx), void * ctx, TickType_t wait)
+{
+    if(ready(ctx) || wait == 0)
+    {
+        return ready(ctx);
+    }
+    const bool forever = wait == portMAX_DELAY;
+    const int64_t deadline_us = host_clock_now_us() + (int64_t)wait * portTICK_PERIOD_MS * 1000;
+
+    if(virtual_time)
+    {
+        // Nothing else runs: jump from one timer expiry to the next until
+        // one of them makes the wait succeed
+        while(!ready(ctx))
+        {
+            int64_t due_us;
+            bool pending = alarm_next_due(&due_us);
+            if(!pending || (!forever && due_us > deadline_us))
+            {
+                if(forever)
+                {
+                    fprintf(stderr, "Blocking forever in virtual time with no timer armed\n");
+                    abort();
+                }
+                pthread_mutex_unlock(mutex);
+                host_clock_advance_to(deadline_us);
+                pthread_mutex_lock(mutex);
+                break;
+            }
+            pthread_mutex_unlock(mutex);
+            host_clock_advance_to(due_us);
+            pthread_mutex_lock(mutex);
+        }
+        return ready(ctx);
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t abs_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (deadline_us - host_clock_now_us()) * 1000;
+    ts.tv_sec = abs_ns / 1000000000;
+    ts.tv_nsec = abs_ns % 1000000000;
+    while(!ready(ctx))
+    {
+        if(forever)
+        {
+            pthread_cond_wait(cond, mutex);
+        }
+        else if(pthread_cond_timedwait(cond, mutex, &ts) != 0)
+        {
+            break;
+        }
+    }
+    return ready(ctx);
+}
+
+void host_sleep_us(int64_t us)
+{
+    if(virtual_time)
+    {
+        host_clock_advance(us);
+    }
+    else if(us > 0)
+    {
+        usleep((useconds_t)us);
+    }
+}
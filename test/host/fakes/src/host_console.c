@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+
+/*
+ * The console as the linux target of ESP-IDF runs it: commands registered in
+ * a table, a line split on blanks and run in the calling task. The argtable3
+ * subset the commands use: integer, string and literal options, short or
+ * long, and positionals, with the errors collected in the arg_end.
+ */
+
+#define HOST_CONSOLE_MAX_COMMANDS   32
+
+// ---- Console ----------------------------------------------------------------
+
+static esp_console_cmd_t commands[HOST_CONSOLE_MAX_COMMANDS];
+static size_t command_count;
+static size_t max_cmdline_length = 256;
+static size_t max_cmdline_args = 32;
+
+esp_err_t esp_console_init(const esp_console_config_t * config)
+{
+    if(config->max_cmdline_length == 0 || config->max_cmdline_args == 0)
+        return ESP_ERR_INVALID_ARG;
+    max_cmdline_length = config->max_cmdline_length;
+    max_cmdline_args = config->max_cmdline_args;
+    command_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t * cmd)
+{
+    if(cmd->command == NULL || strchr(cmd->command, ' ') != NULL || cmd->func == NULL)
+        return ESP_ERR_INVALID_ARG;
+    for(size_t i = 0; i < command_count; i++)
+    {
+        if(strcmp(commands[i].command, cmd->command) == 0)
+        {
+            commands[i] = *cmd;
+            return ESP_OK;
+        }
+    }
+    if(command_count == HOST_CONSOLE_MAX_COMMANDS)
+        return ESP_ERR_NO_MEM;
+    commands[command_count++] = *cmd;
+    return ESP_OK;
+}
+
+static int help_command(int argc, char ** argv)
+{
+    for(size_t i = 0; i < command_count; i++)
+    {
+        printf("%s\n  %s\n\n", commands[i].command, commands[i].help ? commands[i].help : "");
+    }
+    return 0;
+}
+
+esp_err_t esp_console_register_help_command(void)
+{
+    esp_console_cmd_t help = { .command = "help", .help = "Print the list of registered commands", .func = help_command };
+    return esp_console_cmd_register(&help);
+}
+
+esp_err_t esp_console_run(const char * cmdline, int * cmd_ret)
+{
+    char line[max_cmdline_length];
+    char * argv[max_cmdline_args + 1];
+    int argc = 0;
+
+    if(strlen(cmdline) >= max_cmdline_length)
+        return ESP_ERR_INVALID_ARG;
+    strcpy(line, cmdline);
+    for(char * token = strtok(line, " \t"); token != NULL && (size_t)argc < max_cmdline_args; token = strtok(NULL, " \t"))
+    {
+        argv[argc++] = token;
+    }
+    argv[argc] = NULL;
+    if(argc == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    for(size_t i = 0; i < command_count; i++)
+    {
+        if(strcmp(commands[i].command, argv[0]) == 0)
+        {
+            *cmd_ret = commands[i].func(argc, argv);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+// The UART REPL is not run on the host, the linux target reads stdin itself
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t * dev_config, const esp_console_repl_config_t * repl_config,
+                                    esp_console_repl_t ** ret_repl)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t * repl)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ---- argtable3 --------------------------------------------------------------
+
+static void * arg_new(size_t size, char kind, const char * s, const char * l, const char * d, const char * g, int mincount)
+{
+    struct arg_hdr * hdr = calloc(1, size);
+    *hdr = (struct arg_hdr){ kind, s, l, d, g, mincount, 1 };
+    return hdr;
+}
+
+struct arg_int * arg_int0(const char * s, const char * l, const char * d, const char * g)
+{
+    struct arg_int * arg = arg_new(sizeof(*arg), 'i', s, l, d, g, 0);
+    arg->ival = calloc(1, sizeof(*arg->ival));
+    return arg;
+}
+
+struct arg_int * arg_int1(const char * s, const char * l, const char * d, const char * g)
+{
+    struct arg_int * arg = arg_int0(s, l, d, g);
+    arg->hdr.mincount = 1;
+    return arg;
+}
+
+struct arg_str * arg_str1(const char * s, const char * l, const char * d, const char * g)
+{
+    struct arg_str * arg = arg_new(sizeof(*arg), 's', s, l, d, g, 1);
+    arg->sval = calloc(1, sizeof(*arg->sval));
+    arg->sval[0] = "";
+    return arg;
+}
+
+struct arg_lit * arg_lit0(const char * s, const char * l, const char * g)
+{
+    return arg_new(sizeof(struct arg_lit), 'l', s, l, NULL, g, 0);
+}
+
+struct arg_end * arg_end(int maxcount)
+{
+    struct arg_end * end = arg_new(sizeof(*end), 'e', NULL, NULL, NULL, NULL, 0);
+    end->hdr.maxcount = maxcount < ARG_END_ERRORS_MAX ? maxcount : ARG_END_ERRORS_MAX;
+    return end;
+}
+
+// The count sits right after the header in every arg_ struct
+static int * arg_count(struct arg_hdr * hdr)
+{
+    return &((struct arg_int *)hdr)->count;
+}
+
+static void arg_error(struct arg_end * end, const char * format, const char * what)
+{
+    if(end->count < end->hdr.maxcount)
+    {
+        snprintf(end->error[end->count], sizeof(end->error[0]), format, what ? what : "");
+    }
+    end->count++;
+}
+
+static void arg_store(struct arg_hdr * hdr, const char * value, struct arg_end * end)
+{
+    int * count = arg_count(hdr);
+    if(*count >= hdr->maxcount)
+    {
+        arg_error(end, "excess argument %s", value);
+        return;
+    }
+    if(hdr->kind == 'i')
+    {
+        char * rest = NULL;
+        long number = strtol(value, &rest, 0);
+        if(*value == '\0' || *rest != '\0')
+        {
+            arg_error(end, "invalid argument \"%s\"", value);
+            return;
+        }
+        ((struct arg_int *)hdr)->ival[*count] = (int)number;
+    }
+    else
+    {
+        ((struct arg_str *)hdr)->sval[*count] = value;
+    }
+    (*count)++;
+}
+
+int arg_parse(int argc, char ** argv, void ** argtable)
+{
+    size_t entries = 0;
+    while(((struct arg_hdr *)argtable[entries])->kind != 'e')
+    {
+        *arg_count(argtable[entries++]) = 0;
+    }
+    struct arg_end * end = argtable[entries];
+    end->count = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char * token = argv[i];
+        bool option = token[0] == '-' && token[1] != '\0' && (token[1] < '0' || token[1] > '9');
+        struct arg_hdr * hdr = NULL;
+        const char * value = NULL;
+
+        for(size_t e = 0; e < entries && option; e++)
+        {
+            struct arg_hdr * candidate = argtable[e];
+            if(token[1] == '-' && candidate->longopts != NULL)
+            {
+                size_t len = strlen(candidate->longopts);
+                if(strncmp(&token[2], candidate->longopts, len) == 0 && (token[2 + len] == '\0' || token[2 + len] == '='))
+                {
+                    hdr = candidate;
+                    value = token[2 + len] == '=' ? &token[3 + len] : NULL;
+                    break;
+                }
+            }
+            else if(token[1] != '-' && candidate->shortopts != NULL && strchr(candidate->shortopts, token[1]) != NULL)
+            {
+                hdr = candidate;
+                value = token[2] != '\0' ? &token[2] : NULL;
+                break;
+            }
+        }
+        if(option && hdr == NULL)
+        {
+            arg_error(end, "invalid option \"%s\"", token);
+            continue;
+        }
+        if(hdr == NULL)
+        {
+            // The next positional with room left
+            for(size_t e = 0; e < entries && hdr == NULL; e++)
+            {
+                struct arg_hdr * candidate = argtable[e];
+                if(candidate->shortopts == NULL && candidate->longopts == NULL && *arg_count(candidate) < candidate->maxcount)
+                    hdr = candidate;
+            }
+            if(hdr == NULL)
+            {
+                arg_error(end, "unexpected argument \"%s\"", token);
+                continue;
+            }
+            value = token;
+        }
+
+        if(hdr->kind == 'l')
+        {
+            if(*arg_count(hdr) < hdr->maxcount)
+                (*arg_count(hdr))++;
+            else
+                arg_error(end, "excess option %s", token);
+            continue;
+        }
+        if(value == NULL)
+        {
+            if(i + 1 == argc)
+            {
+                arg_error(end, "option \"%s\" requires an argument", token);
+                continue;
+            }
+            value = argv[++i];
+        }
+        arg_store(hdr, value, end);
+    }
+
+    for(size_t e = 0; e < entries; e++)
+    {
+        struct arg_hdr * hdr = argtable[e];
+        if(*arg_count(hdr) < hdr->mincount)
+            arg_error(end, "missing %s", hdr->datatype);
+    }
+    return end->count;
+}
+
+void arg_print_errors(void * fp, struct arg_end * end, const char * progname)
+{
+    int kept = end->count < end->hdr.maxcount ? end->count : end->hdr.maxcount;
+    for(int i = 0; i < kept; i++)
+    {
+        fprintf(fp, "%s: %s\n", progname, end->error[i]);
+    }
+    if(end->count > kept)
+        fprintf(fp, "%s: too many errors\n", progname);
+}
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include "host_fakes.h"
+#include "esp_delta_ota.h"
+
+/*
+ * Stand-in for the detools patches of esp_delta_ota, with the same streaming
+ * interface: "DLT1", the target length, then operations
+ *   'C' <u32 base offset> <u32 length>   copy from the running image
+ *   'I' <u32 length> <bytes>             insert literal bytes
+ * all little-endian. Fed in arbitrary pieces, like the HTTP chunks.
+ */
+
+#define DELTA_MAGIC         "DLT1"
+#define DELTA_COPY          'C'
+#define DELTA_INSERT        'I'
+#define DELTA_MIN_MATCH     16
+#define DELTA_HASH_BITS     18
+
+typedef enum { STATE_HEADER, STATE_OP, STATE_ARGS, STATE_LITERAL, STATE_ERROR } DeltaState_t;
+
+typedef struct
+{
+    esp_delta_ota_cfg_t cfg;
+    DeltaState_t state;
+    uint8_t op;
+    uint8_t field[8];
+    size_t field_len;
+    size_t field_need;
+    uint32_t literal_left;
+    uint32_t target_len;
+    uint32_t written;
+} DeltaSession_t;
+
+static uint32_t le32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+esp_delta_ota_handle_t esp_delta_ota_init(esp_delta_ota_cfg_t * cfg)
+{
+    if(cfg == NULL || cfg->read_cb == NULL || cfg->write_cb == NULL)
+    {
+        return NULL;
+    }
+    DeltaSession_t * session = calloc(1, sizeof(*session));
+    session->cfg = *cfg;
+    session->state = STATE_HEADER;
+    session->field_need = 8;
+    return session;
+}
+
+static esp_err_t delta_copy(DeltaSession_t * session, uint32_t offset, uint32_t len)
+{
+    uint8_t buf[256];
+    while(len > 0)
+    {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        esp_err_t err = session->cfg.read_cb(buf, n, (int)offset);
+        if(ESP_OK == err)
+        {
+            err = session->cfg.write_cb(buf, n, session->cfg.user_data);
+        }
+        if(ESP_OK != err)
+        {
+            return err;
+        }
+        offset += n;
+        len -= n;
+        session->written += n;
+    }
+    return ESP_OK;
+}
+
+// A complete header or operation argument field
+static esp_err_t delta_field(DeltaSession_t * session)
+{
+    switch(session->state)
+    {
+        case STATE_HEADER:
+            if(memcmp(session->field, DELTA_MAGIC, 4) != 0)
+            {
+                return ESP_FAIL;
+            }
+            session->target_len = le32(session->field + 4);
+            session->state = STATE_OP;
+            return ESP_OK;
+        case STATE_ARGS:
+            if(session->op == DELTA_COPY)
+            {
+                session->state = STATE_OP;
+                return delta_copy(session, le32(session->field), le32(session->field + 4));
+            }
+            session->literal_left = le32(session->field);
+            session->state = session->literal_left > 0 ? STATE_LITERAL : STATE_OP;
+            return ESP_OK;
+        default:
+            return ESP_FAIL;
+    }
+}
+
+esp_err_t esp_delta_ota_feed_patch(esp_delta_ota_handle_t handle, const uint8_t * buf, int size)
+{
+    DeltaSession_t * session = handle;
+    if(session == NULL || buf == NULL || size < 0 || session->state == STATE_ERROR)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t pos = 0;
+    esp_err_t err = ESP_OK;
+    while(pos < (size_t)size && ESP_OK == err)
+    {
+        switch(session->state)
+        {
+            case STATE_OP:
+                session->op = buf[pos++];
+                if(session->op != DELTA_COPY && session->op != DELTA_INSERT)
+                {
+                    err = ESP_FAIL;
+                    break;
+                }
+                session->state = STATE_ARGS;
+                session->field_len = 0;
+                session->field_need = session->op == DELTA_COPY ? 8 : 4;
+                break;
+            case STATE_HEADER:
+            case STATE_ARGS:
+            {
+                size_t n = session->field_need - session->field_len;
+                if(n > size - pos)
+                {
+                    n = size - pos;
+                }
+                memcpy(session->field + session->field_len, buf + pos, n);
+                session->field_len += n;
+                pos += n;
+                if(session->field_len == session->field_need)
+                {
+                    err = delta_field(session);
+                }
+                break;
+            }
+            case STATE_LITERAL:
+            {
+                size_t n = session->literal_left;
+                if(n > size - pos)
+                {
+                    n = size - pos;
+                }
+                err = session->cfg.write_cb(buf + pos, n, session->cfg.user_data);
+                pos += n;
+                session->written += n;
+                session->literal_left -= n;
+                if(session->literal_left == 0)
+                {
+                    session->state = STATE_OP;
+                }
+                break;
+            }
+            default:
+                err = ESP_FAIL;
+                break;
+        }
+    }
+
+    if(ESP_OK != err || session->written > session->target_len)
+    {
+        session->state = STATE_ERROR;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_delta_ota_finalize(esp_delta_ota_handle_t handle)
+{
+    DeltaSession_t * session = handle;
+    if(session == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return session->state == STATE_OP && session->written == session->target_len ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_delta_ota_deinit(esp_delta_ota_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+// ---- Patch builder, the master side ----------------------------------------
+
+typedef struct
+{
+    uint8_t * out;
+    size_t len;
+    size_t max;
+} DeltaWriter_t;
+
+static void put(DeltaWriter_t * writer, const void * data, size_t len)
+{
+    if(writer->len + len <= writer->max)
+    {
+        memcpy(writer->out + writer->len, data, len);
+    }
+    writer->len += len;
+}
+
+static void put32(DeltaWriter_t * writer, uint32_t value)
+{
+    uint8_t bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    put(writer, bytes, 4);
+}
+
+static void put_insert(DeltaWriter_t * writer, const uint8_t * data, size_t len)
+{
+    if(len > 0)
+    {
+        uint8_t op = DELTA_INSERT;
+        put(writer, &op, 1);
+        put32(writer, len);
+        put(writer, data, len);
+    }
+}
+
+static uint32_t window_hash(const uint8_t * p)
+{
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < DELTA_MIN_MATCH; i++)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash >> (32 - DELTA_HASH_BITS);
+}
+
+size_t host_delta_build(const uint8_t * base, size_t base_len, const uint8_t * target, size_t target_len, uint8_t * patch, size_t patch_max)
+{
+    // Base windows at every DELTA_MIN_MATCH bytes: any match twice as long
+    // contains one of them
+    uint32_t * index = malloc(sizeof(uint32_t) << DELTA_HASH_BITS);
+    memset(index, 0xFF, sizeof(uint32_t) << DELTA_HASH_BITS);
+    for(size_t pos = 0; pos + DELTA_MIN_MATCH <= base_len; pos += DELTA_MIN_MATCH)
+    {
+        index[window_hash(base + pos)] = pos;
+    }
+
+    DeltaWriter_t writer = { .out = patch, .max = patch_max };
+    put(&writer, DELTA_MAGIC, 4);
+    put32(&writer, target_len);
+
+    size_t literal_start = 0;
+    size_t pos = 0;
+    while(pos + DELTA_MIN_MATCH <= target_len)
+    {
+        uint32_t candidate = index[window_hash(target + pos)];
+        if(candidate == UINT32_MAX || memcmp(base + candidate, target + pos, DELTA_MIN_MATCH) != 0)
+        {
+            pos++;
+            continue;
+        }
+
+        // Grow the match both ways, backwards into the pending literal
+        size_t src = candidate;
+        size_t dst = pos;
+        while(src > 0 && dst > literal_start && base[src - 1] == target[dst - 1])
+        {
+            src--;
+            dst--;
+        }
+        size_t len = pos - dst + DELTA_MIN_MATCH;
+        while(src + len < base_len && dst + len < target_len && base[src + len] == target[dst + len])
+        {
+            len++;
+        }
+
+        put_insert(&writer, target + literal_start, dst - literal_start);
+        uint8_t op = DELTA_COPY;
+        put(&writer, &op, 1);
+        put32(&writer, src);
+        put32(&writer, len);
+        pos = dst + len;
+        literal_start = pos;
+    }
+    put_insert(&writer, target + literal_start, target_len - literal_start);
+
+    free(index);
+    return writer.len <= patch_max ? writer.len : 0;
+}
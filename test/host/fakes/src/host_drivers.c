@@ -0,0 +1,477 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "host_internal.h"
+#include "host_fakes.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "driver/i2c_master.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+
+// ---- GPIO ------------------------------------------------------------------
+
+#define HOST_GPIO_COUNT 40
+
+typedef struct
+{
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    int level;
+    gpio_isr_t isr;
+    void * isr_arg;
+} HostGpio_t;
+
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static HostGpio_t gpios[HOST_GPIO_COUNT];
+static bool gpio_levels_set = false;
+static uint32_t gpio_sets = 0;
+
+// Inputs idle high, as with the button pull-ups
+static void gpio_defaults(void)
+{
+    if(!gpio_levels_set)
+    {
+        gpio_levels_set = true;
+        for(int i = 0; i < HOST_GPIO_COUNT; i++)
+        {
+            gpios[i].level = 1;
+        }
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t * config)
+{
+    if(config == NULL || config->pin_bit_mask >> HOST_GPIO_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&gpio_lock);
+    gpio_defaults();
+    for(int i = 0; i < HOST_GPIO_COUNT; i++)
+    {
+        if(config->pin_bit_mask & (1ULL << i))
+        {
+            gpios[i].mode = config->mode;
+            gpios[i].intr_type = config->intr_type;
+        }
+    }
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    if(gpio < 0 || gpio >= HOST_GPIO_COUNT)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&gpio_lock);
+    gpio_defaults();
+    int level = gpios[gpio].level;
+    pthread_mutex_unlock(&gpio_lock);
+    return level;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if(gpio < 0 || gpio >= HOST_GPIO_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&gpio_lock);
+    gpio_defaults();
+    gpios[gpio].level = level != 0;
+    gpio_sets++;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void * arg)
+{
+    if(gpio < 0 || gpio >= HOST_GPIO_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&gpio_lock);
+    gpios[gpio].isr = isr;
+    gpios[gpio].isr_arg = arg;
+    pthread_mutex_unlock(&gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio)
+{
+    return gpio_isr_handler_add(gpio, NULL, NULL);
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio)
+{
+    return gpio_isr_handler_remove(gpio);
+}
+
+int host_gpio_level(int gpio)
+{
+    return gpio_get_level(gpio);
+}
+
+uint32_t host_gpio_set_count(void)
+{
+    pthread_mutex_lock(&gpio_lock);
+    uint32_t count = gpio_sets;
+    pthread_mutex_unlock(&gpio_lock);
+    return count;
+}
+
+void host_gpio_input(int gpio, int level)
+{
+    pthread_mutex_lock(&gpio_lock);
+    gpio_defaults();
+    HostGpio_t * pin = &gpios[gpio];
+    bool edge = pin->level != (level != 0);
+    bool fires = edge && (pin->intr_type == GPIO_INTR_ANYEDGE || (pin->intr_type == GPIO_INTR_NEGEDGE && level == 0));
+    pin->level = level != 0;
+    gpio_isr_t isr = pin->isr;
+    void * arg = pin->isr_arg;
+    pthread_mutex_unlock(&gpio_lock);
+    if(fires && isr != NULL)
+    {
+        isr(arg);
+    }
+}
+
+// ---- LEDC ------------------------------------------------------------------
+
+#define HOST_LEDC_LOG_LEN 4096
+
+static pthread_mutex_t ledc_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t ledc_freq = 0;
+static uint32_t ledc_duty = 0;
+static uint32_t ledc_pending_duty = 0;
+static HostLedcEntry_t ledc_log[HOST_LEDC_LOG_LEN];
+static size_t ledc_log_len = 0;
+
+static void ledc_record(void)
+{
+    if(ledc_log_len < HOST_LEDC_LOG_LEN)
+    {
+        ledc_log[ledc_log_len++] = (HostLedcEntry_t){ host_clock_now_us(), ledc_freq, ledc_duty };
+    }
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t * config)
+{
+    if(config == NULL || config->freq_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&ledc_lock);
+    ledc_freq = config->freq_hz;
+    pthread_mutex_unlock(&ledc_lock);
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t * config)
+{
+    if(config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&ledc_lock);
+    ledc_duty = ledc_pending_duty = config->duty;
+    pthread_mutex_unlock(&ledc_lock);
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t timer, uint32_t freq_hz)
+{
+    (void)mode;
+    (void)timer;
+    if(freq_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&ledc_lock);
+    ledc_freq = freq_hz;
+    ledc_record();
+    pthread_mutex_unlock(&ledc_lock);
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+    (void)mode;
+    (void)channel;
+    pthread_mutex_lock(&ledc_lock);
+    ledc_pending_duty = duty;
+    pthread_mutex_unlock(&ledc_lock);
+    return ESP_OK;
+}
+
+// The new duty reaches the pin only here
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    (void)mode;
+    (void)channel;
+    pthread_mutex_lock(&ledc_lock);
+    ledc_duty = ledc_pending_duty;
+    ledc_record();
+    pthread_mutex_unlock(&ledc_lock);
+    return ESP_OK;
+}
+
+size_t host_ledc_log(HostLedcEntry_t * entries, size_t max)
+{
+    pthread_mutex_lock(&ledc_lock);
+    size_t count = ledc_log_len < max ? ledc_log_len : max;
+    memcpy(entries, ledc_log, count * sizeof(*entries));
+    pthread_mutex_unlock(&ledc_lock);
+    return count;
+}
+
+void host_ledc_log_clear(void)
+{
+    pthread_mutex_lock(&ledc_lock);
+    ledc_log_len = 0;
+    pthread_mutex_unlock(&ledc_lock);
+}
+
+// ---- I2C -------------------------------------------------------------------
+
+struct i2c_master_bus_t
+{
+    int port;
+};
+
+struct i2c_master_dev_t
+{
+    uint16_t address;
+};
+
+static pthread_mutex_t i2c_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct i2c_master_bus_t i2c_bus;
+static struct i2c_master_dev_t i2c_device;
+static HostI2cStats_t i2c_stats;
+static uint32_t i2c_failures = 0;
+static uint8_t panel_ram[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS];
+static uint8_t panel_page = 0;
+static uint8_t panel_column = 0;
+
+// A command stream after a 0x00 control byte, data after 0x40
+static void panel_receive(const uint8_t * data, size_t len)
+{
+    if(data[0] == 0x40)
+    {
+        for(size_t i = 1; i < len; i++, panel_column++)
+        {
+            if(panel_column < HOST_PANEL_COLUMNS)
+            {
+                panel_ram[panel_page][panel_column] = data[i];
+            }
+        }
+        return;
+    }
+    for(size_t i = 1; i < len; i++)
+    {
+        uint8_t command = data[i];
+        if(command >= 0xB0 && command <= 0xB7)
+        {
+            panel_page = command & 0x07;
+        }
+        else if(command <= 0x0F)
+        {
+            panel_column = (panel_column & 0xF0) | command;
+        }
+        else if(command <= 0x1F)
+        {
+            panel_column = (panel_column & 0x0F) | (command & 0x0F) << 4;
+        }
+        else if(command == 0x20 || command == 0x81 || command == 0x8D || command == 0xA8 || command == 0xAD ||
+                command == 0xD3 || command == 0xD5 || command == 0xD9 || command == 0xDA || command == 0xDB)
+        {
+            i++;        // One argument byte
+        }
+    }
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t * config, i2c_master_bus_handle_t * bus)
+{
+    if(config == NULL || bus == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    i2c_bus.port = config->i2c_port;
+    *bus = &i2c_bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t * config, i2c_master_dev_handle_t * device)
+{
+    if(bus == NULL || config == NULL || device == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    i2c_device.address = config->device_address;
+    *device = &i2c_device;
+    pthread_mutex_lock(&i2c_lock);
+    for(int page = 0; page < HOST_PANEL_PAGES; page++)
+    {
+        for(int column = 0; column < HOST_PANEL_COLUMNS; column++)
+        {
+            panel_ram[page][column] = (uint8_t)(page * 37 + column * 11) | 0x81;
+        }
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t device, const uint8_t * data, size_t len, int timeout_ms)
+{
+    (void)timeout_ms;
+    if(device == NULL || data == NULL || len == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    esp_err_t ret = ESP_OK;
+    if(i2c_failures > 0)
+    {
+        i2c_failures--;
+        ret = ESP_ERR_TIMEOUT;
+    }
+    else
+    {
+        i2c_stats.transactions++;
+        i2c_stats.bytes += len;
+        panel_receive(data, len);
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+void host_i2c_stats(HostI2cStats_t * stats)
+{
+    pthread_mutex_lock(&i2c_lock);
+    *stats = i2c_stats;
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+void host_i2c_stats_clear(void)
+{
+    pthread_mutex_lock(&i2c_lock);
+    memset(&i2c_stats, 0, sizeof(i2c_stats));
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+void host_i2c_panel(uint8_t ram[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS])
+{
+    pthread_mutex_lock(&i2c_lock);
+    memcpy(ram, panel_ram, sizeof(panel_ram));
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+void host_i2c_fail(uint32_t count)
+{
+    pthread_mutex_lock(&i2c_lock);
+    i2c_failures = count;
+    pthread_mutex_unlock(&i2c_lock);
+}
+
+// ---- ADC -------------------------------------------------------------------
+
+/*
+ * A 12-bit reading at 12 dB attenuation is taken as 0.8 mV per count; the
+ * line-fitting calibration turns it back into millivolts.
+ */
+#define HOST_ADC_UV_PER_COUNT   800
+
+struct adc_oneshot_unit_ctx_t
+{
+    adc_unit_t unit;
+};
+
+struct adc_cali_scheme_t
+{
+    int unused;
+};
+
+static struct adc_oneshot_unit_ctx_t adc_unit;
+static struct adc_cali_scheme_t adc_cali;
+static int adc_mv = 3900;
+static int adc_noise_mv = 0;
+static uint32_t adc_reads = 0;
+static uint32_t adc_seed = 1;
+
+void host_adc_set_mv(int millivolts, int noise_mv)
+{
+    adc_mv = millivolts;
+    adc_noise_mv = noise_mv;
+}
+
+uint32_t host_adc_read_count(void)
+{
+    return adc_reads;
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t * config, adc_oneshot_unit_handle_t * unit)
+{
+    if(config == NULL || unit == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adc_unit.unit = config->unit_id;
+    *unit = &adc_unit;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t unit, adc_channel_t channel, const adc_oneshot_chan_cfg_t * config)
+{
+    (void)channel;
+    return unit != NULL && config != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t unit, adc_channel_t channel, int * raw)
+{
+    (void)channel;
+    if(unit == NULL || raw == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int mv = adc_mv;
+    if(adc_noise_mv > 0)
+    {
+        adc_seed = adc_seed * 1103515245u + 12345u;
+        mv += (int)((adc_seed >> 16) % (2 * adc_noise_mv + 1)) - adc_noise_mv;
+    }
+    int counts = mv * 1000 / HOST_ADC_UV_PER_COUNT;
+    *raw = counts < 0 ? 0 : counts > 4095 ? 4095 : counts;
+    adc_reads++;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t * config, adc_cali_handle_t * handle)
+{
+    if(config == NULL || handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *handle = &adc_cali;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int * millivolts)
+{
+    if(handle == NULL || millivolts == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *millivolts = raw * HOST_ADC_UV_PER_COUNT / 1000;
+    return ESP_OK;
+}
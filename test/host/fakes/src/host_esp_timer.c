@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include "host_internal.h"
+#include "esp_timer.h"
+
+struct esp_timer
+{
+    host_alarm_t alarm;         // First member: the alarm is the timer
+    esp_timer_cb_t callback;
+    void * arg;
+};
+
+static uint32_t fired = 0;
+static void (*after_stop)(esp_timer_handle_t timer) = NULL;
+
+static void esp_timer_fire(host_alarm_t * alarm)
+{
+    struct esp_timer * timer = (struct esp_timer *)alarm;
+    __atomic_fetch_add(&fired, 1, __ATOMIC_SEQ_CST);
+    timer->callback(timer->arg);
+}
+
+uint32_t host_esp_timer_fired_count(void)
+{
+    return __atomic_load_n(&fired, __ATOMIC_SEQ_CST);
+}
+
+void host_esp_timer_after_stop(void (*hook)(esp_timer_handle_t timer))
+{
+    __atomic_store_n(&after_stop, hook, __ATOMIC_SEQ_CST);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * args, esp_timer_handle_t * handle)
+{
+    if(args == NULL || args->callback == NULL || handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer * timer = calloc(1, sizeof(*timer));
+    if(timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->alarm.fire = esp_timer_fire;
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    *handle = timer;
+    return ESP_OK;
+}
+
+// As in ESP-IDF, starting an active timer is an error
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if(timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(host_alarm_is_armed(&timer->alarm))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_arm(&timer->alarm, host_clock_now_us() + (int64_t)timeout_us, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if(timer == NULL || period_us == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(host_alarm_is_armed(&timer->alarm))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_arm(&timer->alarm, host_clock_now_us() + (int64_t)period_us, (int64_t)period_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if(timer == NULL || !host_alarm_is_armed(&timer->alarm))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_arm(&timer->alarm, host_clock_now_us() + (int64_t)timeout_us, timer->alarm.period_us > 0 ? (int64_t)timeout_us : 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if(timer == NULL || !host_alarm_is_armed(&timer->alarm))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_disarm(&timer->alarm);
+    void (*hook)(esp_timer_handle_t timer) = __atomic_exchange_n(&after_stop, NULL, __ATOMIC_SEQ_CST);
+    if(hook != NULL)
+    {
+        hook(timer);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if(timer == NULL || host_alarm_is_armed(&timer->alarm))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Kept allocated: the alarm stays in the list of the clock
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer != NULL && host_alarm_is_armed(&timer->alarm);
+}
@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_internal.h"
+#include "host_fakes.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
+
+#define HOST_TASK_MAX   64
+
+// ---- Critical sections -----------------------------------------------------
+
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void host_critical_enter(portMUX_TYPE * mux)
+{
+    (void)mux;
+    pthread_once(&critical_once, critical_init);
+    pthread_mutex_lock(&critical_lock);
+}
+
+void host_critical_exit(portMUX_TYPE * mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&critical_lock);
+}
+
+// ---- Tasks -----------------------------------------------------------------
+
+struct host_task
+{
+    char name[16];
+    TaskFunction_t code;
+    void * arg;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+static pthread_mutex_t task_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task * task_list[HOST_TASK_MAX];
+static uint32_t task_count = 0;
+static uint32_t task_created = 0;
+static __thread struct host_task * current_task = NULL;
+
+static struct host_task * task_new(const char * name)
+{
+    struct host_task * task = calloc(1, sizeof(*task));
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    host_wait_init(&task->lock, &task->cond);
+    pthread_mutex_lock(&task_lock);
+    if(task_count < HOST_TASK_MAX)
+    {
+        task_list[task_count++] = task;
+    }
+    pthread_mutex_unlock(&task_lock);
+    return task;
+}
+
+static void task_remove(struct host_task * task)
+{
+    pthread_mutex_lock(&task_lock);
+    for(uint32_t i = 0; i < task_count; i++)
+    {
+        if(task_list[i] == task)
+        {
+            task_list[i] = task_list[--task_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&task_lock);
+}
+
+static struct host_task * task_current(void)
+{
+    if(current_task == NULL)
+    {
+        current_task = task_new("main");
+        current_task->started = true;
+    }
+    return current_task;
+}
+
+static void * task_entry(void * arg)
+{
+    current_task = arg;
+    current_task->code(current_task->arg);
+    fprintf(stderr, "Task %s returned without deleting itself\n", current_task->name);
+    abort();
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle)
+{
+    (void)stack_depth;
+    (void)priority;
+    struct host_task * task = task_new(name);
+    task->code = code;
+    task->arg = arg;
+    __atomic_add_fetch(&task_created, 1, __ATOMIC_SEQ_CST);
+    if(handle != NULL)
+    {
+        *handle = task;
+    }
+    // In virtual time the test is the only thread, tasks are never started
+    if(!host_clock_is_virtual())
+    {
+        pthread_t thread;
+        task->started = true;
+        if(pthread_create(&thread, NULL, task_entry, task) != 0)
+        {
+            return pdFAIL;
+        }
+        pthread_detach(thread);
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core)
+{
+    (void)core;
+    return xTaskCreate(code, name, stack_depth, arg, priority, handle);
+}
+
+uint32_t host_task_created_count(void)
+{
+    return __atomic_load_n(&task_created, __ATOMIC_SEQ_CST);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_clock_now_us() / (portTICK_PERIOD_MS * 1000));
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    // Round up to the next tick boundary as the scheduler does
+    int64_t now = host_clock_now_us();
+    int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t wake = (now / tick_us + ticks) * tick_us;
+    host_sleep_us(wake - now);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t * previous_wake, TickType_t increment)
+{
+    TickType_t wake = *previous_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    *previous_wake = wake;
+    if((int32_t)(wake - now) <= 0)
+    {
+        return pdFALSE;
+    }
+    host_sleep_us((int64_t)wake * portTICK_PERIOD_MS * 1000 - host_clock_now_us());
+    return pdTRUE;
+}
+
+void vTaskDelayUntil(TickType_t * previous_wake, TickType_t increment)
+{
+    xTaskDelayUntil(previous_wake, increment);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if(task == NULL || task == current_task)
+    {
+        task_remove(task_current());
+        pthread_exit(NULL);
+    }
+    // Another task: only forgotten, a host thread cannot be stopped safely
+    task_remove(task);
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    if(task == NULL || task == current_task)
+    {
+        while(true)
+        {
+            pause();
+        }
+    }
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    (void)task;
+    return 1024;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return task_current();
+}
+
+TaskHandle_t xTaskGetHandle(const char * name)
+{
+    TaskHandle_t found = NULL;
+    pthread_mutex_lock(&task_lock);
+    for(uint32_t i = 0; i < task_count && found == NULL; i++)
+    {
+        if(strcmp(task_list[i]->name, name) == 0)
+        {
+            found = task_list[i];
+        }
+    }
+    pthread_mutex_unlock(&task_lock);
+    return found;
+}
+
+const char * pcTaskGetName(TaskHandle_t task)
+{
+    return (task != NULL ? task : task_current())->name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    pthread_mutex_lock(&task_lock);
+    UBaseType_t count = task_count;
+    pthread_mutex_unlock(&task_lock);
+    return count;
+}
+
+static bool notify_ready(void * ctx)
+{
+    return ((struct host_task *)ctx)->notify > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait)
+{
+    struct host_task * task = task_current();
+    pthread_mutex_lock(&task->lock);
+    host_wait(&task->lock, &task->cond, notify_ready, task, wait);
+    uint32_t value = task->notify;
+    if(value > 0)
+    {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * woken)
+{
+    xTaskNotifyGive(task);
+    if(woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+}
+
+// ---- Queues and semaphores -------------------------------------------------
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t * items;
+    UBaseType_t length;
+    UBaseType_t item_size;      // 0 for a semaphore
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static bool queue_has_item(void * ctx)
+{
+    return ((struct host_queue *)ctx)->count > 0;
+}
+
+static bool queue_has_room(void * ctx)
+{
+    struct host_queue * queue = ctx;
+    return queue->count < queue->length;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue * queue = calloc(1, sizeof(*queue));
+    if(queue == NULL)
+    {
+        return NULL;
+    }
+    host_wait_init(&queue->lock, &queue->cond);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = calloc(length, item_size > 0 ? item_size : 1);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void * item, TickType_t wait, bool front, bool overwrite)
+{
+    pthread_mutex_lock(&queue->lock);
+    if(!overwrite && !host_wait(&queue->lock, &queue->cond, queue_has_room, queue, wait))
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return errQUEUE_FULL;
+    }
+    if(overwrite && queue->count == queue->length)
+    {
+        queue->count--;
+    }
+    UBaseType_t slot;
+    if(front)
+    {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+    }
+    else
+    {
+        slot = (queue->head + queue->count) % queue->length;
+    }
+    if(queue->item_size > 0)
+    {
+        memcpy(queue->items + slot * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void * item, TickType_t wait, bool peek)
+{
+    pthread_mutex_lock(&queue->lock);
+    if(!host_wait(&queue->lock, &queue->cond, queue_has_item, queue, wait))
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    if(queue->item_size > 0 && item != NULL)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    if(!peek)
+    {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+    return queue_send(queue, item, wait, false, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+    return queue_send(queue, item, wait, false, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+    return queue_send(queue, item, wait, true, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void * item, BaseType_t * woken)
+{
+    if(woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+    return queue_send(queue, item, 0, false, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item)
+{
+    return queue_send(queue, item, 0, false, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t wait)
+{
+    return queue_receive(queue, item, wait, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t wait)
+{
+    return queue_receive(queue, item, wait, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    struct host_queue * semaphore = xQueueCreate(max_count, 0);
+    if(semaphore != NULL)
+    {
+        semaphore->count = initial_count;
+    }
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+    return queue_receive(semaphore, NULL, wait, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return queue_send(semaphore, NULL, 0, false, false);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t * woken)
+{
+    if(woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    vQueueDelete(semaphore);
+}
+
+// ---- Event groups ----------------------------------------------------------
+
+struct host_event_group
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+    EventBits_t wanted;         // Of the current waiter
+    bool all;
+};
+
+static bool event_group_ready(void * ctx)
+{
+    struct host_event_group * group = ctx;
+    EventBits_t set = group->bits & group->wanted;
+    return group->all ? set == group->wanted : set != 0;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group * group = calloc(1, sizeof(*group));
+    if(group != NULL)
+    {
+        host_wait_init(&group->lock, &group->cond);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t wait)
+{
+    pthread_mutex_lock(&group->lock);
+    group->wanted = bits;
+    group->all = wait_for_all;
+    bool ready = host_wait(&group->lock, &group->cond, event_group_ready, group, wait);
+    EventBits_t value = group->bits;
+    if(ready && clear_on_exit)
+    {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t * woken)
+{
+    if(woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+    xEventGroupSetBits(group, bits);
+    return pdPASS;
+}
+
+// ---- Software timers -------------------------------------------------------
+
+struct host_timer
+{
+    host_alarm_t alarm;         // First member: the alarm is the timer
+    TickType_t period;
+    bool auto_reload;
+    void * id;
+    TimerCallbackFunction_t callback;
+};
+
+static void timer_fire(host_alarm_t * alarm)
+{
+    struct host_timer * timer = (struct host_timer *)alarm;
+    timer->callback(timer);
+}
+
+static int64_t ticks_to_us(TickType_t ticks)
+{
+    return (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+TimerHandle_t xTimerCreate(const char * name, TickType_t period, BaseType_t auto_reload, void * id, TimerCallbackFunction_t callback)
+{
+    (void)name;
+    if(period == 0)
+    {
+        return NULL;
+    }
+    struct host_timer * timer = calloc(1, sizeof(*timer));
+    if(timer != NULL)
+    {
+        timer->alarm.fire = timer_fire;
+        timer->period = period;
+        timer->auto_reload = auto_reload;
+        timer->id = id;
+        timer->callback = callback;
+    }
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    // Counted from the current tick, as the timer service does
+    int64_t now_tick_us = ticks_to_us(xTaskGetTickCount());
+    host_alarm_arm(&timer->alarm, now_tick_us + ticks_to_us(timer->period),
+                   timer->auto_reload ? ticks_to_us(timer->period) : 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    host_alarm_disarm(&timer->alarm);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    if(period == 0)
+    {
+        return pdFAIL;
+    }
+    timer->period = period;
+    // Starts a dormant timer too
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return host_alarm_is_armed(&timer->alarm);
+}
+
+void * pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+TickType_t xTimerGetExpiryTime(TimerHandle_t timer)
+{
+    return (TickType_t)(timer->alarm.due_us / (portTICK_PERIOD_MS * 1000));
+}
+
+TickType_t xTimerGetPeriod(TimerHandle_t timer)
+{
+    return timer->period;
+}
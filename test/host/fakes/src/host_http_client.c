@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_http_client.h"
+
+/*
+ * HTTP/1.1 GET over a real TCP socket, enough for the OTA downloads against
+ * a local server: one request per open, Content-Length bodies only.
+ */
+
+#define HTTP_HEADER_MAX     16
+#define HTTP_LINE_MAX       256
+
+struct esp_http_client
+{
+    char host[64];
+    uint16_t port;
+    char path[128];
+    int timeout_ms;
+    int sock;
+    char header_names[HTTP_HEADER_MAX][32];
+    char header_values[HTTP_HEADER_MAX][64];
+    int header_count;
+    int status;
+    int64_t content_left;
+};
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t * config)
+{
+    if(config == NULL || config->url == NULL)
+    {
+        return NULL;
+    }
+    struct esp_http_client * client = calloc(1, sizeof(*client));
+    unsigned port = 80;
+    if(sscanf(config->url, "http://%63[^:/]:%u%127s", client->host, &port, client->path) < 2
+       && sscanf(config->url, "http://%63[^:/]%127s", client->host, client->path) < 1)
+    {
+        free(client);
+        return NULL;
+    }
+    if(client->path[0] == '\0')
+    {
+        strcpy(client->path, "/");
+    }
+    client->port = port;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : 5000;
+    client->sock = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char * name, const char * value)
+{
+    for(int i = 0; i < client->header_count; i++)
+    {
+        if(strcasecmp(client->header_names[i], name) == 0)
+        {
+            snprintf(client->header_values[i], sizeof(client->header_values[i]), "%s", value);
+            return ESP_OK;
+        }
+    }
+    if(client->header_count == HTTP_HEADER_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(client->header_names[client->header_count], sizeof(client->header_names[0]), "%s", name);
+    snprintf(client->header_values[client->header_count], sizeof(client->header_values[0]), "%s", value);
+    client->header_count++;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    esp_http_client_close(client);
+
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct timeval tv = { .tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000 };
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(client->port) };
+    if(inet_pton(AF_INET, strcmp(client->host, "localhost") == 0 ? "127.0.0.1" : client->host, &addr.sin_addr) != 1
+       || connect(client->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    char request[1024];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n", client->path, client->host);
+    for(int i = 0; i < client->header_count; i++)
+    {
+        len += snprintf(request + len, sizeof(request) - len, "%s: %s\r\n", client->header_names[i], client->header_values[i]);
+    }
+    len += snprintf(request + len, sizeof(request) - len, "\r\n");
+    if(send(client->sock, request, len, MSG_NOSIGNAL) != len)
+    {
+        esp_http_client_close(client);
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    client->status = 0;
+    client->content_left = 0;
+    return ESP_OK;
+}
+
+// One header line without its CRLF, false on a closed or silent connection
+static bool read_line(int sock, char * line, size_t max)
+{
+    size_t len = 0;
+    while(true)
+    {
+        char c;
+        if(recv(sock, &c, 1, 0) != 1)
+        {
+            return false;
+        }
+        if(c == '\n')
+        {
+            if(len > 0 && line[len - 1] == '\r')
+            {
+                len--;
+            }
+            line[len] = '\0';
+            return true;
+        }
+        if(len + 1 < max)
+        {
+            line[len++] = c;
+        }
+    }
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char line[HTTP_LINE_MAX];
+    if(client->sock < 0 || !read_line(client->sock, line, sizeof(line)) || sscanf(line, "HTTP/1.%*d %d", &client->status) != 1)
+    {
+        return ESP_FAIL;
+    }
+    while(read_line(client->sock, line, sizeof(line)))
+    {
+        if(line[0] == '\0')
+        {
+            return client->content_left;
+        }
+        long long length;
+        if(sscanf(line, "Content-Length: %lld", &length) == 1)
+        {
+            client->content_left = length;
+        }
+    }
+    return ESP_FAIL;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char * buffer, int len)
+{
+    if(client->sock < 0)
+    {
+        return -1;
+    }
+    int total = 0;
+    while(total < len && client->content_left > 0)
+    {
+        ssize_t n = recv(client->sock, buffer + total, len - total < client->content_left ? len - total : client->content_left, 0);
+        if(n <= 0)
+        {
+            break;
+        }
+        total += n;
+        client->content_left -= n;
+    }
+    return total;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if(client->sock >= 0)
+    {
+        close(client->sock);
+        client->sock = -1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if(client != NULL)
+    {
+        esp_http_client_close(client);
+        free(client);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Shared by the fakes: the alarms behind esp_timer and FreeRTOS timers, and
+ * the blocking wait of queues, semaphores, event groups and notifications.
+ */
+
+typedef struct host_alarm
+{
+    int64_t due_us;
+    int64_t period_us;          // 0 for a one-shot alarm
+    bool armed;
+    bool registered;
+    void (*fire)(struct host_alarm * alarm);
+    struct host_alarm * next;
+} host_alarm_t;
+
+void host_alarm_arm(host_alarm_t * alarm, int64_t due_us, int64_t period_us);
+void host_alarm_disarm(host_alarm_t * alarm);
+bool host_alarm_is_armed(host_alarm_t * alarm);
+
+int64_t host_clock_now_us(void);
+
+/**
+ * @brief Wait until ready(ctx) holds, the mutex held on entry and on return.
+ *
+ * @return ready(ctx) at the end of the wait.
+ */
+bool host_wait(pthread_mutex_t * mutex, pthread_cond_t * cond, bool (*ready)(void * ctx), void * ctx, TickType_t wait);
+
+/**
+ * @brief Mutex and condition variable on the monotonic clock, as host_wait() expects.
+ */
+void host_wait_init(pthread_mutex_t * mutex, pthread_cond_t * cond);
+
+/**
+ * @brief Sleep on the host clock, moving it in virtual time.
+ */
+void host_sleep_us(int64_t us);
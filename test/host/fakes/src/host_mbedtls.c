@@ -0,0 +1,63 @@
+#include <string.h>
+#include "mbedtls/sha256.h"
+#include "mbedtls/constant_time.h"
+#include "host_fakes.h"
+
+void mbedtls_sha256_init(mbedtls_sha256_context * ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context * ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_clone(mbedtls_sha256_context * dst, const mbedtls_sha256_context * src)
+{
+    *dst = *src;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context * ctx, int is224)
+{
+    if(is224)
+    {
+        return -1;
+    }
+    host_sha256_starts(ctx);
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context * ctx, const unsigned char * input, size_t ilen)
+{
+    host_sha256_update(ctx, input, ilen);
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context * ctx, unsigned char output[32])
+{
+    host_sha256_finish(ctx, output);
+    return 0;
+}
+
+int mbedtls_sha256(const unsigned char * input, size_t ilen, unsigned char output[32], int is224)
+{
+    if(is224)
+    {
+        return -1;
+    }
+    host_sha256(input, ilen, output);
+    return 0;
+}
+
+int mbedtls_ct_memcmp(const void * a, const void * b, size_t n)
+{
+    const unsigned char * x = a;
+    const unsigned char * y = b;
+    unsigned char diff = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        diff |= x[i] ^ y[i];
+    }
+    return diff;
+}
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "host_fakes.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define HOST_NVS_KEY_LEN        16
+#define HOST_NVS_NAMESPACES     16
+
+/*
+ * Keys of every simulated node, in RAM. A handle is the node instance in the
+ * high half and the namespace index in the low half, plus one so that no
+ * handle is 0.
+ */
+typedef enum { ENTRY_U8, ENTRY_U16, ENTRY_U32, ENTRY_BLOB } EntryType_t;
+
+typedef struct Entry
+{
+    uint32_t instance;
+    uint32_t ns;
+    char key[HOST_NVS_KEY_LEN];
+    EntryType_t type;
+    size_t length;
+    uint8_t * data;
+    struct Entry * next;
+} Entry_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static char namespaces[HOST_NVS_NAMESPACES][HOST_NVS_KEY_LEN];
+static uint32_t namespace_count = 0;
+static Entry_t * entries = NULL;
+static uint32_t instance = 0;
+static uint32_t write_count = 0;
+static bool fail_writes = false;
+
+void host_nvs_select(uint32_t selected)
+{
+    pthread_mutex_lock(&nvs_lock);
+    instance = selected;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void host_nvs_fail_writes(bool fail)
+{
+    pthread_mutex_lock(&nvs_lock);
+    fail_writes = fail;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+uint32_t host_nvs_write_count(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    uint32_t count = write_count;
+    pthread_mutex_unlock(&nvs_lock);
+    return count;
+}
+
+static void erase_instance(uint32_t erased)
+{
+    Entry_t ** link = &entries;
+    while(*link != NULL)
+    {
+        Entry_t * entry = *link;
+        if(entry->instance == erased)
+        {
+            *link = entry->next;
+            free(entry->data);
+            free(entry);
+        }
+        else
+        {
+            link = &entry->next;
+        }
+    }
+}
+
+void host_nvs_erase_all(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    erase_instance(instance);
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    host_nvs_erase_all();
+    return ESP_OK;
+}
+
+static Entry_t * find(nvs_handle_t handle, const char * key)
+{
+    for(Entry_t * entry = entries; entry != NULL; entry = entry->next)
+    {
+        if(entry->instance == (handle >> 16) && entry->ns == (handle & 0x7FFF) - 1 &&
+           strncmp(entry->key, key, HOST_NVS_KEY_LEN) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t mode, nvs_handle_t * handle)
+{
+    if(name == NULL || handle == NULL || strlen(name) >= HOST_NVS_KEY_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    uint32_t ns = 0;
+    while(ns < namespace_count && strcmp(namespaces[ns], name) != 0)
+    {
+        ns++;
+    }
+    if(ns == namespace_count)
+    {
+        if(mode == NVS_READONLY || namespace_count == HOST_NVS_NAMESPACES)
+        {
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        strcpy(namespaces[namespace_count++], name);
+    }
+    // Bit 15 marks a read-only handle
+    *handle = instance << 16 | (mode == NVS_READONLY ? 0x8000 : 0) | (ns + 1);
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return handle == 0 ? ESP_ERR_NVS_INVALID_HANDLE : ESP_OK;
+}
+
+static esp_err_t set(nvs_handle_t handle, const char * key, EntryType_t type, const void * value, size_t length)
+{
+    if(handle == 0 || key == NULL || strlen(key) >= HOST_NVS_KEY_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(handle & 0x8000)
+    {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    if(fail_writes)
+    {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    Entry_t * entry = find(handle, key);
+    if(entry == NULL)
+    {
+        entry = calloc(1, sizeof(*entry));
+        entry->instance = handle >> 16;
+        entry->ns = (handle & 0x7FFF) - 1;
+        strcpy(entry->key, key);
+        entry->next = entries;
+        entries = entry;
+    }
+    free(entry->data);
+    entry->data = malloc(length > 0 ? length : 1);
+    memcpy(entry->data, value, length);
+    entry->length = length;
+    entry->type = type;
+    write_count++;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+static esp_err_t get(nvs_handle_t handle, const char * key, EntryType_t type, void * value, size_t * length)
+{
+    if(handle == 0 || key == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    Entry_t * entry = find(handle, key);
+    esp_err_t ret = ESP_OK;
+    if(entry == NULL || entry->type != type)
+    {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if(type == ENTRY_BLOB && value == NULL)
+    {
+        *length = entry->length;
+    }
+    else if(*length < entry->length)
+    {
+        *length = entry->length;
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(value, entry->data, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char * key, uint8_t value)
+{
+    return set(handle, key, ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * value)
+{
+    size_t length = sizeof(*value);
+    return get(handle, key, ENTRY_U8, value, &length);
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char * key, uint16_t value)
+{
+    return set(handle, key, ENTRY_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char * key, uint16_t * value)
+{
+    size_t length = sizeof(*value);
+    return get(handle, key, ENTRY_U16, value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char * key, uint32_t value)
+{
+    return set(handle, key, ENTRY_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char * key, uint32_t * value)
+{
+    size_t length = sizeof(*value);
+    return get(handle, key, ENTRY_U32, value, &length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length)
+{
+    return set(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * value, size_t * length)
+{
+    if(length == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return get(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key)
+{
+    if(handle & 0x8000)
+    {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    Entry_t * found = find(handle, key);
+    esp_err_t ret = ESP_ERR_NVS_NOT_FOUND;
+    for(Entry_t ** link = &entries; found != NULL && *link != NULL; link = &(*link)->next)
+    {
+        if(*link == found)
+        {
+            *link = found->next;
+            free(found->data);
+            free(found);
+            write_count++;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ret;
+}
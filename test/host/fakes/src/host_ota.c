@@ -0,0 +1,162 @@
+#include <string.h>
+#include <pthread.h>
+#include "host_fakes.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+
+/*
+ * OTA slots on the fake partitions: the update goes to the slot not running,
+ * the image checks of esp_ota_end() are left to the test.
+ */
+
+static pthread_mutex_t ota_lock = PTHREAD_MUTEX_INITIALIZER;
+static const esp_partition_t * running = NULL;
+static const esp_partition_t * boot = NULL;
+static esp_ota_img_states_t running_state = ESP_OTA_IMG_VALID;
+static const esp_partition_t * target = NULL;
+static size_t written = 0;
+
+void host_ota_set_running(const char * label, int state)
+{
+    pthread_mutex_lock(&ota_lock);
+    running = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, label);
+    running_state = (esp_ota_img_states_t)state;
+    boot = NULL;
+    pthread_mutex_unlock(&ota_lock);
+}
+
+int host_ota_running_state(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    int state = running_state;
+    pthread_mutex_unlock(&ota_lock);
+    return state;
+}
+
+const char * host_ota_boot_label(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    const char * label = boot != NULL ? boot->label : NULL;
+    pthread_mutex_unlock(&ota_lock);
+    return label;
+}
+
+const esp_partition_t * esp_ota_get_running_partition(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    const esp_partition_t * partition = running;
+    pthread_mutex_unlock(&ota_lock);
+    return partition;
+}
+
+const esp_partition_t * esp_ota_get_next_update_partition(const esp_partition_t * start)
+{
+    const esp_partition_t * from = start != NULL ? start : esp_ota_get_running_partition();
+    if(from == NULL)
+    {
+        return NULL;
+    }
+    esp_partition_subtype_t next = from->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0 ? ESP_PARTITION_SUBTYPE_APP_OTA_1 : ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, next, NULL);
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t * partition, size_t image_size, esp_ota_handle_t * handle)
+{
+    if(partition == NULL || handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(partition == esp_ota_get_running_partition())
+    {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    esp_err_t err = esp_partition_erase_range(partition, 0, partition->size);
+    if(ESP_OK != err)
+    {
+        return err;
+    }
+    pthread_mutex_lock(&ota_lock);
+    target = partition;
+    written = 0;
+    pthread_mutex_unlock(&ota_lock);
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void * data, size_t size)
+{
+    if(handle != 1 || target == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = esp_partition_write(target, written, data, size);
+    if(ESP_OK == err)
+    {
+        written += size;
+    }
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if(handle != 1 || target == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = written > 0 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+    if(ESP_OK == err)
+    {
+        host_partition_set_image_len(target->label, written);
+    }
+    target = NULL;
+    return err;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    target = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t * partition)
+{
+    if(partition == NULL || partition->type != ESP_PARTITION_TYPE_APP)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&ota_lock);
+    boot = partition;
+    pthread_mutex_unlock(&ota_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t * partition, esp_ota_img_states_t * state)
+{
+    if(partition == NULL || state == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(partition != esp_ota_get_running_partition())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *state = (esp_ota_img_states_t)host_ota_running_state();
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    running_state = ESP_OTA_IMG_VALID;
+    pthread_mutex_unlock(&ota_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    running_state = ESP_OTA_IMG_INVALID;
+    boot = esp_ota_get_next_update_partition(running);
+    pthread_mutex_unlock(&ota_lock);
+    esp_restart();
+}
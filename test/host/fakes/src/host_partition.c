@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "host_fakes.h"
+#include "esp_partition.h"
+
+#define HOST_PARTITION_MAX      8
+#define HOST_SECTOR_SIZE        4096
+#define HOST_NO_FAILURE         UINT32_MAX
+
+/*
+ * Flash partitions in RAM with NOR semantics: erasing sets whole sectors to
+ * 0xFF, writing can only clear bits.
+ */
+typedef struct
+{
+    esp_partition_t partition;  // First member: the partition is the entry
+    uint8_t * data;
+    uint32_t image_len;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t fail_erase_after;
+    uint32_t fail_write_after;
+} HostPartition_t;
+
+static pthread_mutex_t partition_lock = PTHREAD_MUTEX_INITIALIZER;
+static HostPartition_t partitions[HOST_PARTITION_MAX];
+static uint32_t partition_count = 0;
+
+static HostPartition_t * by_label(const char * label)
+{
+    for(uint32_t i = 0; i < partition_count; i++)
+    {
+        if(strcmp(partitions[i].partition.label, label) == 0)
+        {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+void host_partition_add(const char * label, int type, int subtype, uint32_t size)
+{
+    pthread_mutex_lock(&partition_lock);
+    HostPartition_t * entry = by_label(label);
+    if(entry == NULL && partition_count < HOST_PARTITION_MAX)
+    {
+        entry = &partitions[partition_count++];
+        strncpy(entry->partition.label, label, sizeof(entry->partition.label) - 1);
+        entry->partition.address = 0x10000 * partition_count;
+    }
+    if(entry != NULL)
+    {
+        free(entry->data);
+        entry->partition.type = (esp_partition_type_t)type;
+        entry->partition.subtype = (esp_partition_subtype_t)subtype;
+        entry->partition.size = size;
+        entry->partition.erase_size = HOST_SECTOR_SIZE;
+        entry->data = malloc(size);
+        memset(entry->data, 0xFF, size);
+        entry->image_len = size;
+        entry->writes = 0;
+        entry->erases = 0;
+        entry->reads = 0;
+        entry->read_bytes = 0;
+        entry->fail_erase_after = HOST_NO_FAILURE;
+        entry->fail_write_after = HOST_NO_FAILURE;
+    }
+    pthread_mutex_unlock(&partition_lock);
+}
+
+uint8_t * host_partition_data(const char * label)
+{
+    HostPartition_t * entry = by_label(label);
+    return entry != NULL ? entry->data : NULL;
+}
+
+void host_partition_set_image_len(const char * label, uint32_t len)
+{
+    HostPartition_t * entry = by_label(label);
+    if(entry != NULL)
+    {
+        entry->image_len = len;
+    }
+}
+
+void host_partition_fail_erase(const char * label, uint32_t after)
+{
+    HostPartition_t * entry = by_label(label);
+    if(entry != NULL)
+    {
+        entry->fail_erase_after = after;
+    }
+}
+
+void host_partition_fail_write(const char * label, uint32_t after)
+{
+    HostPartition_t * entry = by_label(label);
+    if(entry != NULL)
+    {
+        entry->fail_write_after = after;
+    }
+}
+
+uint32_t host_partition_write_count(const char * label)
+{
+    HostPartition_t * entry = by_label(label);
+    return entry != NULL ? entry->writes : 0;
+}
+
+uint32_t host_partition_erase_count(const char * label)
+{
+    HostPartition_t * entry = by_label(label);
+    return entry != NULL ? entry->erases : 0;
+}
+
+uint32_t host_partition_read_count(const char * label)
+{
+    HostPartition_t * entry = by_label(label);
+    return entry != NULL ? entry->reads : 0;
+}
+
+uint64_t host_partition_read_bytes(const char * label)
+{
+    HostPartition_t * entry = by_label(label);
+    return entry != NULL ? entry->read_bytes : 0;
+}
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char * label)
+{
+    const esp_partition_t * found = NULL;
+    pthread_mutex_lock(&partition_lock);
+    for(uint32_t i = 0; i < partition_count && found == NULL; i++)
+    {
+        const esp_partition_t * partition = &partitions[i].partition;
+        if((type == ESP_PARTITION_TYPE_ANY || partition->type == type) &&
+           (subtype == ESP_PARTITION_SUBTYPE_ANY || partition->subtype == subtype) &&
+           (label == NULL || strcmp(partition->label, label) == 0))
+        {
+            found = partition;
+        }
+    }
+    pthread_mutex_unlock(&partition_lock);
+    return found;
+}
+
+static bool in_bounds(const esp_partition_t * partition, size_t offset, size_t size)
+{
+    return partition != NULL && offset <= partition->size && size <= partition->size - offset;
+}
+
+// Counts down the failure injection: true when this access must fail
+static bool inject(uint32_t * after)
+{
+    if(*after == HOST_NO_FAILURE)
+    {
+        return false;
+    }
+    if(*after == 0)
+    {
+        *after = HOST_NO_FAILURE;
+        return true;
+    }
+    (*after)--;
+    return false;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t * partition, size_t src_offset, void * dst, size_t size)
+{
+    if(dst == NULL || !in_bounds(partition, src_offset, size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostPartition_t * entry = (HostPartition_t *)partition;
+    pthread_mutex_lock(&partition_lock);
+    memcpy(dst, entry->data + src_offset, size);
+    entry->reads++;
+    entry->read_bytes += size;
+    pthread_mutex_unlock(&partition_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t * partition, size_t dst_offset, const void * src, size_t size)
+{
+    if(src == NULL || !in_bounds(partition, dst_offset, size))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostPartition_t * entry = (HostPartition_t *)partition;
+    pthread_mutex_lock(&partition_lock);
+    if(inject(&entry->fail_write_after))
+    {
+        pthread_mutex_unlock(&partition_lock);
+        return ESP_FAIL;
+    }
+    const uint8_t * bytes = src;
+    for(size_t i = 0; i < size; i++)
+    {
+        entry->data[dst_offset + i] &= bytes[i];
+    }
+    entry->writes++;
+    pthread_mutex_unlock(&partition_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t * partition, size_t offset, size_t size)
+{
+    if(!in_bounds(partition, offset, size) || offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostPartition_t * entry = (HostPartition_t *)partition;
+    pthread_mutex_lock(&partition_lock);
+    if(inject(&entry->fail_erase_after))
+    {
+        pthread_mutex_unlock(&partition_lock);
+        return ESP_FAIL;
+    }
+    memset(entry->data + offset, 0xFF, size);
+    entry->erases += size / HOST_SECTOR_SIZE;
+    pthread_mutex_unlock(&partition_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t * partition, uint8_t * sha_256)
+{
+    if(partition == NULL || sha_256 == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const HostPartition_t * entry = (const HostPartition_t *)partition;
+    pthread_mutex_lock(&partition_lock);
+    host_sha256(entry->data, entry->image_len, sha_256);
+    pthread_mutex_unlock(&partition_lock);
+    return ESP_OK;
+}
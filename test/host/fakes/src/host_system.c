@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_internal.h"
+#include "host_fakes.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_mac.h"
+#include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/task.h"
+
+// ---- Errors and log ---------------------------------------------------------
+
+const char * esp_err_to_name(esp_err_t code)
+{
+    switch(code)
+    {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_INVALID_MAC:       return "ESP_ERR_INVALID_MAC";
+        case ESP_ERR_NOT_FINISHED:      return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED:       return "ESP_ERR_NOT_ALLOWED";
+        default:                        return "ESP_ERR_UNKNOWN";
+    }
+}
+
+static bool log_quiet = false;
+static uint32_t log_counts[ESP_LOG_VERBOSE + 1];
+
+void host_log_set_quiet(bool quiet)
+{
+    log_quiet = quiet;
+}
+
+uint32_t host_log_count(esp_log_level_t level)
+{
+    return __atomic_load_n(&log_counts[level], __ATOMIC_SEQ_CST);
+}
+
+void esp_log_level_set(const char * tag, esp_log_level_t level)
+{
+    (void)tag;
+    (void)level;
+}
+
+void host_log(esp_log_level_t level, const char * tag, const char * format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    __atomic_add_fetch(&log_counts[level], 1, __ATOMIC_SEQ_CST);
+    bool verbose = getenv("HOST_LOG") != NULL;
+    if(!verbose && (log_quiet || level > ESP_LOG_WARN))
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    flockfile(stderr);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(host_clock_now_us() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    funlockfile(stderr);
+    va_end(args);
+}
+
+// ---- Reset and restart -----------------------------------------------------
+
+static esp_reset_reason_t reset_reason = ESP_RST_POWERON;
+static void (*restart_hook)(void) = NULL;
+static uint32_t restarts = 0;
+
+void host_set_reset_reason(esp_reset_reason_t reason)
+{
+    reset_reason = reason;
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return reset_reason;
+}
+
+void host_set_restart_hook(void (*hook)(void))
+{
+    restart_hook = hook;
+}
+
+uint32_t host_restart_count(void)
+{
+    return __atomic_load_n(&restarts, __ATOMIC_SEQ_CST);
+}
+
+// The linker bounds of the section of RTC_NOINIT_ATTR, if anything is in it
+extern uint8_t __start_rtc_noinit[] __attribute__((weak));
+extern uint8_t __stop_rtc_noinit[] __attribute__((weak));
+
+size_t host_rtc_save(void * out, size_t max)
+{
+    size_t len = (size_t)(__stop_rtc_noinit - __start_rtc_noinit);
+    if(len > max)
+    {
+        return 0;
+    }
+    memcpy(out, __start_rtc_noinit, len);
+    return len;
+}
+
+void host_rtc_restore(const void * saved, size_t len)
+{
+    if(len == (size_t)(__stop_rtc_noinit - __start_rtc_noinit))
+    {
+        memcpy(__start_rtc_noinit, saved, len);
+    }
+}
+
+void esp_restart(void)
+{
+    __atomic_add_fetch(&restarts, 1, __ATOMIC_SEQ_CST);
+    if(restart_hook == NULL)
+    {
+        fprintf(stderr, "esp_restart() called\n");
+        exit(3);
+    }
+    restart_hook();
+    // Never returns on the chip
+    while(true)
+    {
+        vTaskSuspend(NULL);
+    }
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 200000;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 180000;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return 110000;
+}
+
+// ---- MAC -------------------------------------------------------------------
+
+static uint8_t base_mac[6] = { 0x24, 0x6f, 0x28, 0x00, 0x00, 0x01 };
+
+void host_set_mac(const uint8_t mac[6])
+{
+    memcpy(base_mac, mac, sizeof(base_mac));
+}
+
+esp_err_t esp_read_mac(uint8_t * mac, esp_mac_type_t type)
+{
+    if(mac == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(mac, base_mac, sizeof(base_mac));
+    if(type == ESP_MAC_WIFI_SOFTAP)
+    {
+        mac[5] += 1;
+    }
+    return ESP_OK;
+}
+
+// ---- Task watchdog ---------------------------------------------------------
+
+#define HOST_WDT_USERS 4
+
+struct esp_task_wdt_user_handle_s
+{
+    char name[16];
+    int64_t last_feed_us;
+};
+
+static pthread_mutex_t wdt_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_task_wdt_user_handle_s wdt_users[HOST_WDT_USERS];
+static uint32_t wdt_user_count = 0;
+static uint32_t wdt_timeout_ms = 5000;
+static uint32_t wdt_feeds = 0;
+
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t * config)
+{
+    if(config == NULL || config->timeout_ms == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    wdt_timeout_ms = config->timeout_ms;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add_user(const char * name, esp_task_wdt_user_handle_t * handle)
+{
+    pthread_mutex_lock(&wdt_lock);
+    if(wdt_user_count == HOST_WDT_USERS)
+    {
+        pthread_mutex_unlock(&wdt_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    struct esp_task_wdt_user_handle_s * user = &wdt_users[wdt_user_count++];
+    strncpy(user->name, name, sizeof(user->name) - 1);
+    user->last_feed_us = host_clock_now_us();
+    *handle = user;
+    pthread_mutex_unlock(&wdt_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t handle)
+{
+    if(handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&wdt_lock);
+    handle->last_feed_us = host_clock_now_us();
+    wdt_feeds++;
+    pthread_mutex_unlock(&wdt_lock);
+    return ESP_OK;
+}
+
+uint32_t host_task_wdt_feeds(void)
+{
+    pthread_mutex_lock(&wdt_lock);
+    uint32_t feeds = wdt_feeds;
+    pthread_mutex_unlock(&wdt_lock);
+    return feeds;
+}
+
+uint32_t host_task_wdt_starved_ms(const char ** user_name)
+{
+    uint32_t starved_ms = 0;
+    int64_t now = host_clock_now_us();
+    pthread_mutex_lock(&wdt_lock);
+    for(uint32_t i = 0; i < wdt_user_count; i++)
+    {
+        uint32_t unfed_ms = (uint32_t)((now - wdt_users[i].last_feed_us) / 1000);
+        if(unfed_ms > wdt_timeout_ms && unfed_ms > starved_ms)
+        {
+            starved_ms = unfed_ms;
+            if(user_name != NULL)
+            {
+                *user_name = wdt_users[i].name;
+            }
+        }
+    }
+    pthread_mutex_unlock(&wdt_lock);
+    return starved_ms;
+}
+
+// ---- ROM -------------------------------------------------------------------
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const * buf, uint32_t len)
+{
+    crc = ~crc;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for(int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+/**
+ * @file host_test.h
+ * @brief Checks of the host tests: a failed check prints where and exits
+ * with a non-zero status, which ctest reports.
+ */
+
+#define CHECK(cond) do                                                              \
+    {                                                                               \
+        if(!(cond))                                                                 \
+        {                                                                           \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);\
+            exit(1);                                                                \
+        }                                                                           \
+    } while(0)
+
+#define CHECK_EQ(actual, expected) do                                               \
+    {                                                                               \
+        long long actual_ = (long long)(actual);                                    \
+        long long expected_ = (long long)(expected);                                \
+        if(actual_ != expected_)                                                    \
+        {                                                                           \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %s = %lld\n",              \
+                    __FILE__, __LINE__, #actual, actual_, #expected, expected_);    \
+            exit(1);                                                                \
+        }                                                                           \
+    } while(0)
+
+#define CHECK_OK(call) CHECK_EQ((call), ESP_OK)
+
+/**
+ * @brief One result line: "<name>: <value> <unit>", parsed by nothing, read by people.
+ */
+#define REPORT(name, format, ...) printf("%-40s " format "\n", name ":", ##__VA_ARGS__)
@@ -0,0 +1,210 @@
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "nvs.h"
+
+#include "auth.h"
+#include "storage.h"
+#include "protocol.h"
+
+/*
+ * Frame authentication: the tag against a published HMAC-SHA256 vector, the
+ * replay window, the replay floors across a reboot of the receiver and the
+ * loss of a window, the sequence across exhausted epochs, then the sign and
+ * verify throughput over the frame sizes of the protocol.
+ */
+
+#define BENCH_ITERATIONS    20000
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void provision_key(const uint8_t key[AUTH_KEY_LEN])
+{
+    nvs_handle_t handle;
+    CHECK_OK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle));
+    CHECK_OK(nvs_set_blob(handle, KEY_AUTH_KEY, key, AUTH_KEY_LEN));
+    CHECK_OK(nvs_commit(handle));
+    nvs_close(handle);
+}
+
+// RFC 4231 test case 2: a key shorter than a block is zero padded, as the
+// 32-byte key slot is
+static void test_tag(void)
+{
+    CHECK_EQ(auth_init(), ESP_ERR_NVS_NOT_FOUND);
+    CHECK(!auth_is_ready());
+
+    uint8_t key[AUTH_KEY_LEN] = { 'J', 'e', 'f', 'e' };
+    provision_key(key);
+    CHECK_OK(auth_init());
+    CHECK(auth_is_ready());
+
+    const char * data = "what do ya want for nothing?";
+    const uint8_t expected[AUTH_TAG_LEN] = { 0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e };
+    uint8_t tag[AUTH_TAG_LEN];
+    CHECK_OK(auth_sign((const uint8_t *)data, strlen(data), tag));
+    CHECK(memcmp(tag, expected, AUTH_TAG_LEN) == 0);
+    CHECK_OK(auth_verify((const uint8_t *)data, strlen(data), expected));
+
+    // Same tag again: the primed contexts are not consumed by a message
+    CHECK_OK(auth_sign((const uint8_t *)data, strlen(data), tag));
+    CHECK(memcmp(tag, expected, AUTH_TAG_LEN) == 0);
+
+    tag[AUTH_TAG_LEN - 1] ^= 1;
+    CHECK_EQ(auth_verify((const uint8_t *)data, strlen(data), tag), ESP_ERR_INVALID_MAC);
+}
+
+static void test_replay(void)
+{
+    CHECK(auth_check_replay(0x0101, 100));
+    CHECK(!auth_check_replay(0x0101, 100));
+    CHECK(auth_check_replay(0x0101, 98));
+    CHECK(!auth_check_replay(0x0101, 98));
+    CHECK(auth_check_replay(0x0101, 100 + AUTH_REPLAY_WINDOW));
+    CHECK(!auth_check_replay(0x0101, 100));
+    CHECK(auth_check_replay(0x0102, 100));
+}
+
+#define SEQ(epoch, counter)     (((uint32_t)(epoch) << AUTH_SEQ_EPOCH_SHIFT) | (counter))
+
+// Frames captured before a reboot of the receiver, or before the window of
+// their sender went to other senders, stay refused
+static void test_floor(void)
+{
+    const uint16_t sender = 0x0201;
+    uint32_t writes = host_nvs_write_count();
+    CHECK(auth_check_replay(sender, SEQ(3, 10)));
+    CHECK(auth_check_replay(sender, SEQ(3, 11)));
+    CHECK_EQ(host_nvs_write_count() - writes, 1);
+
+    // The sender reboots: its new epoch is stored once
+    CHECK(auth_check_replay(sender, SEQ(4, 1)));
+    CHECK(auth_check_replay(sender, SEQ(4, 2)));
+    CHECK(auth_check_replay(sender, SEQ(4, 3)));
+    CHECK_EQ(host_nvs_write_count() - writes, 2);
+
+    // The receiver reboots: no window, the stored floor instead
+    CHECK_OK(auth_init());
+    writes = host_nvs_write_count();
+    CHECK(!auth_check_replay(sender, SEQ(3, 11)));
+    CHECK(!auth_check_replay(sender, SEQ(3, 10)));
+    CHECK(!auth_check_replay(sender, SEQ(4, 1)));
+    CHECK(auth_check_replay(sender, SEQ(4, 4)));
+    CHECK(auth_check_replay(sender, SEQ(4, 6)));
+
+    // Its window goes to other senders: the last frame seen is the floor,
+    // moved in RAM only
+    for(int peer = 1; peer <= AUTH_MAX_PEERS; peer++)
+    {
+        CHECK(auth_check_replay(sender + peer, SEQ(1, 1)));
+    }
+    CHECK(!auth_check_replay(sender, SEQ(4, 6)));
+    CHECK(!auth_check_replay(sender, SEQ(4, 4)));
+    CHECK(auth_check_replay(sender, SEQ(4, 7)));
+    CHECK_EQ(host_nvs_write_count() - writes, AUTH_MAX_PEERS);
+}
+
+// The last counter of an epoch, then a new epoch, never a wrap
+static void test_seq(void)
+{
+    uint32_t first;
+    CHECK_OK(auth_next_seq(&first));
+    uint32_t epoch = first >> AUTH_SEQ_EPOCH_SHIFT;
+
+    uint32_t seq = first;
+    for(uint32_t counter = (first & AUTH_SEQ_COUNTER_MASK) + 1; counter <= AUTH_SEQ_COUNTER_MASK; counter++)
+    {
+        uint32_t next;
+        CHECK_OK(auth_next_seq(&next));
+        CHECK_EQ(next, seq + 1);
+        seq = next;
+    }
+    CHECK_EQ(seq & AUTH_SEQ_COUNTER_MASK, AUTH_SEQ_COUNTER_MASK);
+
+    // No epoch can be stored: nothing goes out, however often it is asked
+    host_nvs_fail_writes(true);
+    uint32_t refused = 0;
+    CHECK_EQ(auth_next_seq(&refused), ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    CHECK_EQ(auth_next_seq(&refused), ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    CHECK_EQ(refused, 0);
+    host_nvs_fail_writes(false);
+
+    uint32_t next;
+    CHECK_OK(auth_next_seq(&next));
+    CHECK(next > seq);
+    CHECK_EQ(next >> AUTH_SEQ_EPOCH_SHIFT, epoch + 1);
+    CHECK_EQ(next & AUTH_SEQ_COUNTER_MASK, 1);
+}
+
+static void bench(const char * name, size_t len)
+{
+    static uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    for(size_t i = 0; i < len; i++)
+    {
+        frame[i] = (uint8_t)i;
+    }
+    uint8_t tag[AUTH_TAG_LEN];
+
+    uint64_t blocks = host_sha256_block_count();
+    int64_t start_us = host_us();
+    for(int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        frame[0] = (uint8_t)i;
+        CHECK_OK(auth_sign(frame, len, tag));
+    }
+    int64_t sign_us = host_us() - start_us;
+    uint64_t sign_blocks = (host_sha256_block_count() - blocks) / BENCH_ITERATIONS;
+
+    start_us = host_us();
+    for(int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        CHECK_OK(auth_verify(frame, len, tag));
+    }
+    int64_t verify_us = host_us() - start_us;
+
+    // Inner: the message, its padding and length; outer: the digest. The
+    // key pad blocks are hashed at init only
+    uint64_t inner_blocks = (len + 9 + 63) / 64;
+    CHECK_EQ(sign_blocks, inner_blocks + 1);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s, %zu bytes", name, len);
+    printf("%-36s %6.2f us sign %6.2f us verify %8.0f signs/s %2llu blocks (%llu with the pads)\n", label,
+           (double)sign_us / BENCH_ITERATIONS, (double)verify_us / BENCH_ITERATIONS,
+           BENCH_ITERATIONS * 1e6 / (sign_us > 0 ? sign_us : 1),
+           (unsigned long long)sign_blocks, (unsigned long long)sign_blocks + 2);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+
+    test_tag();
+    test_replay();
+    test_floor();
+    test_seq();
+
+    bench("config ack", sizeof(FrameHeader_t) + sizeof(ConfigAckPayload_t));
+    bench("node status (capture)", sizeof(FrameHeader_t) + sizeof(NodeStatusPayload_t));
+    bench("largest frame", PROTOCOL_MAX_FRAME_LEN - AUTH_TAG_LEN);
+
+    // A capture is signed once by the node and verified once by the master
+    uint8_t frame[sizeof(FrameHeader_t) + sizeof(NodeStatusPayload_t)] = { 0 };
+    uint8_t tag[AUTH_TAG_LEN];
+    int64_t start_us = host_us();
+    for(int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        frame[0] = (uint8_t)i;
+        CHECK_OK(auth_sign(frame, sizeof(frame), tag));
+        CHECK_OK(auth_verify(frame, sizeof(frame), tag));
+    }
+    REPORT("added per-capture latency (host)", "%.2f us", (double)(host_us() - start_us) / BENCH_ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "battery.h"
+#include "buzzer.h"
+#include "config.h"
+
+/*
+ * The battery monitor on a fake ADC and the virtual clock, sampled at the
+ * health period: a node on USB reads no battery and never warns, a pack
+ * plugged in is read at once without the filter climbing from zero, a pack
+ * under BATTERY_LOW_PCT plays the low battery cue once a BATTERY_CUE_PERIOD_MS,
+ * a pack run down under the bottom of the curve is still there at 0% and
+ * keeps warning, and a pack taken out clears the warning.
+ */
+
+#define TOLERANCE_MV        20
+
+// Low battery cues started since the last call: the first note of the cue
+static uint32_t cues_heard(void)
+{
+    static HostLedcEntry_t log[256];
+    size_t count = host_ledc_log(log, sizeof(log) / sizeof(log[0]));
+    CHECK(count < sizeof(log) / sizeof(log[0]));
+    host_ledc_log_clear();
+
+    uint32_t cues = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        cues += log[i].freq_hz == 800 && log[i].duty != 0 && (i == 0 || log[i - 1].duty == 0 || log[i - 1].freq_hz != 800);
+    }
+    return cues;
+}
+
+// Samples at the health period with the pack at a voltage, 0 for none
+static BatteryStatus_t run(int pack_mv, uint32_t duration_ms)
+{
+    host_adc_set_mv(pack_mv / BATTERY_DIVIDER_RATIO, 2);
+    for(uint32_t ms = 0; ms < duration_ms; ms += HEALTH_PERIOD_MS)
+    {
+        CHECK_OK(battery_sample());
+        host_clock_advance((int64_t)HEALTH_PERIOD_MS * 1000);
+    }
+    BatteryStatus_t status;
+    battery_get(&status);
+    return status;
+}
+
+static void check_absent(const BatteryStatus_t * status)
+{
+    CHECK(!status->present);
+    CHECK(!status->low);
+    CHECK_EQ(status->millivolts, 0);
+    CHECK_EQ(status->soc_pct, BATTERY_PCT_UNKNOWN);
+}
+
+// On USB the divider reads nothing: no battery, no charge, nothing plays
+static void test_usb(void)
+{
+    host_adc_set_mv(0, 2);
+    CHECK_OK(battery_init());
+    BatteryStatus_t status = run(0, 3 * BATTERY_CUE_PERIOD_MS);
+    check_absent(&status);
+    CHECK(status.samples > 3 * BATTERY_CUE_PERIOD_MS / HEALTH_PERIOD_MS);
+    CHECK_EQ(cues_heard(), 0);
+}
+
+// Plugged in: the pack voltage from the first sample, no warning
+static void test_plugged(void)
+{
+    BatteryStatus_t status = run(4000, HEALTH_PERIOD_MS);
+    CHECK(status.present);
+    CHECK(status.millivolts >= 4000 - TOLERANCE_MV && status.millivolts <= 4000 + TOLERANCE_MV);
+    CHECK(status.soc_pct >= 75 && status.soc_pct <= 80);
+    CHECK(!status.low);
+    CHECK_EQ(cues_heard(), 0);
+}
+
+// Run down: the cue on the way under BATTERY_LOW_PCT, then once a period
+static void test_low(void)
+{
+    BatteryStatus_t status = run(3600, 3 * BATTERY_CUE_PERIOD_MS);
+    CHECK(status.present);
+    CHECK(status.low);
+    CHECK(status.soc_pct < BATTERY_LOW_PCT);
+    uint32_t cues = cues_heard();
+    CHECK(cues >= 3 && cues <= 4);
+}
+
+// Run down under the bottom of the curve: empty, not gone, the cue goes on
+static void test_empty(void)
+{
+    BatteryStatus_t status = run(3200, 2 * BATTERY_CUE_PERIOD_MS);
+    CHECK(status.present);
+    CHECK(status.millivolts >= 3200 - TOLERANCE_MV && status.millivolts <= 3200 + TOLERANCE_MV);
+    CHECK_EQ(status.soc_pct, 0);
+    CHECK(status.low);
+    uint32_t cues = cues_heard();
+    CHECK(cues >= 2 && cues <= 3);
+}
+
+// Taken out: back to no battery, the warning gone, silent
+static void test_unplugged(void)
+{
+    BatteryStatus_t status = run(0, HEALTH_PERIOD_MS);
+    check_absent(&status);
+    cues_heard();
+    status = run(0, 2 * BATTERY_CUE_PERIOD_MS);
+    check_absent(&status);
+    CHECK_EQ(cues_heard(), 0);
+}
+
+int main(void)
+{
+    host_clock_set_virtual();
+    host_log_set_quiet(true);
+    CHECK_OK(buzzer_init());
+
+    test_usb();
+    test_plugged();
+    test_low();
+    test_empty();
+    test_unplugged();
+    return 0;
+}
@@ -0,0 +1,267 @@
+#include <string.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "esp_timer.h"
+
+#include "buzzer.h"
+
+/*
+ * The cue sequencer on a mocked LEDC and the virtual clock: buzzer_play()
+ * returns without touching the LEDC or waiting, each cue is heard with its
+ * notes on time to the microsecond, a higher or equal cue cuts the one
+ * playing, even with the timer callback re-arming for the cut cue meanwhile,
+ * a lower one waits for its end and only the highest waiting one is kept.
+ * Once a cue is over no timer runs until the next. Timer callbacks per cue
+ * are reported.
+ */
+
+#define HEARD_MAX           64
+#define IDLE_US             (10 * 1000 * 1000)
+
+typedef struct
+{
+    int64_t time_us;
+    uint32_t freq_hz;           // 0 silent
+} Heard_t;
+
+typedef struct
+{
+    uint16_t freq_hz;
+    uint16_t duration_ms;
+} Note_t;
+
+typedef struct
+{
+    const char * name;
+    uint8_t note_count;
+    Note_t notes[6];
+} Cue_t;
+
+// What the players hear of each cue
+static const Cue_t cues[BUZZER_CUE_MAX] =
+{
+    [BUZZER_CUE_LOW_BATTERY] = { "low battery", 3, { { 800, 150 }, { 0, 150 }, { 600, 300 } } },
+    [BUZZER_CUE_CONTESTED]   = { "contested", 5, { { 2000, 60 }, { 0, 60 }, { 2000, 60 }, { 0, 60 }, { 2000, 60 } } },
+    [BUZZER_CUE_CAPTURE]     = { "capture", 5, { { 1200, 80 }, { 0, 40 }, { 1600, 80 }, { 0, 40 }, { 2000, 150 } } },
+    [BUZZER_CUE_MATCH_START] = { "match start", 5, { { 1000, 200 }, { 0, 100 }, { 1000, 200 }, { 0, 100 }, { 2000, 500 } } },
+    [BUZZER_CUE_MATCH_END]   = { "match end", 5, { { 2000, 300 }, { 0, 100 }, { 1500, 300 }, { 0, 100 }, { 1000, 800 } } },
+};
+
+static int64_t cue_us(BuzzerCue_t cue)
+{
+    int64_t total = 0;
+    for(int i = 0; i < cues[cue].note_count; i++)
+    {
+        total += cues[cue].notes[i].duration_ms * 1000;
+    }
+    return total;
+}
+
+// The LEDC log as the pin sounds: a change of tone or silence per entry
+static size_t heard(Heard_t * out)
+{
+    static HostLedcEntry_t log[HEARD_MAX * 2];
+    size_t entries = host_ledc_log(log, sizeof(log) / sizeof(log[0]));
+    CHECK(entries < sizeof(log) / sizeof(log[0]));
+    size_t count = 0;
+    uint32_t last = 0;
+    for(size_t i = 0; i < entries; i++)
+    {
+        uint32_t freq_hz = log[i].duty != 0 ? log[i].freq_hz : 0;
+        if(freq_hz != last)
+        {
+            CHECK(count < HEARD_MAX);
+            out[count++] = (Heard_t){ log[i].time_us, freq_hz };
+            last = freq_hz;
+        }
+    }
+    return count;
+}
+
+static size_t ledc_entries(void)
+{
+    static HostLedcEntry_t log[HEARD_MAX * 2];
+    size_t entries = host_ledc_log(log, sizeof(log) / sizeof(log[0]));
+    CHECK(entries < sizeof(log) / sizeof(log[0]));
+    return entries;
+}
+
+// The notes of a cue from an instant, index first on: where the next check goes on
+static size_t check_notes(const Heard_t * tones, size_t index, BuzzerCue_t cue, int64_t start_us, int note_count)
+{
+    int64_t at_us = start_us;
+    for(int i = 0; i < note_count; i++)
+    {
+        CHECK_EQ(tones[index].time_us, at_us);
+        CHECK_EQ(tones[index].freq_hz, cues[cue].notes[i].freq_hz);
+        at_us += cues[cue].notes[i].duration_ms * 1000;
+        index++;
+    }
+    return index;
+}
+
+// The cue returns at once and nothing runs until the clock moves
+static int64_t play(BuzzerCue_t cue)
+{
+    int64_t now = esp_timer_get_time();
+    size_t entries = ledc_entries();
+    uint32_t fired = host_esp_timer_fired_count();
+    buzzer_play(cue);
+    CHECK_EQ(esp_timer_get_time(), now);
+    CHECK_EQ(ledc_entries(), entries);
+    CHECK_EQ(host_esp_timer_fired_count(), fired);
+    return now;
+}
+
+// Silent after the cue, no timer left running
+static void check_idle(void)
+{
+    uint32_t fired = host_esp_timer_fired_count();
+    host_ledc_log_clear();
+    host_clock_advance(IDLE_US);
+    CHECK_EQ(host_esp_timer_fired_count(), fired);
+    CHECK_EQ(ledc_entries(), 0);
+}
+
+// Before buzzer_init() a cue is dropped
+static void test_not_initialised(void)
+{
+    host_ledc_log_clear();
+    buzzer_play(BUZZER_CUE_MATCH_START);
+    host_clock_advance(IDLE_US);
+    CHECK_EQ(ledc_entries(), 0);
+    CHECK_EQ(host_esp_timer_fired_count(), 0);
+}
+
+// Each cue alone, note by note
+static void test_each_cue(void)
+{
+    Heard_t tones[HEARD_MAX];
+    for(BuzzerCue_t cue = 0; cue < BUZZER_CUE_MAX; cue++)
+    {
+        host_ledc_log_clear();
+        uint32_t fired = host_esp_timer_fired_count();
+        int64_t start_us = play(cue);
+        host_clock_advance(cue_us(cue) + 1000);
+
+        size_t count = heard(tones);
+        CHECK_EQ(count, cues[cue].note_count + 1u);
+        size_t index = check_notes(tones, 0, cue, start_us, cues[cue].note_count);
+        CHECK_EQ(tones[index].time_us, start_us + cue_us(cue));
+        CHECK_EQ(tones[index].freq_hz, 0);
+
+        // The start and one per note end
+        uint32_t callbacks = host_esp_timer_fired_count() - fired;
+        CHECK_EQ(callbacks, cues[cue].note_count + 1u);
+        check_idle();
+        REPORT("cue", "%-12s %u timer callbacks in %u ms, none after",
+               cues[cue].name, callbacks, (unsigned)(cue_us(cue) / 1000));
+    }
+}
+
+// A capture cuts a contested cue in its first rest: the contested is not resumed
+static void test_preemption(void)
+{
+    Heard_t tones[HEARD_MAX];
+    host_ledc_log_clear();
+    int64_t start_us = play(BUZZER_CUE_CONTESTED);
+    host_clock_advance(70 * 1000);
+    int64_t cut_us = play(BUZZER_CUE_CAPTURE);
+    host_clock_advance(cue_us(BUZZER_CUE_CAPTURE) + cue_us(BUZZER_CUE_CONTESTED));
+
+    size_t count = heard(tones);
+    size_t index = check_notes(tones, 0, BUZZER_CUE_CONTESTED, start_us, 2);
+    index = check_notes(tones, index, BUZZER_CUE_CAPTURE, cut_us, cues[BUZZER_CUE_CAPTURE].note_count);
+    CHECK_EQ(tones[index].time_us, cut_us + cue_us(BUZZER_CUE_CAPTURE));
+    CHECK_EQ(tones[index].freq_hz, 0);
+    CHECK_EQ(count, index + 1);
+    check_idle();
+
+    // Equal priority cuts too: the end of the match over its start, mid-note
+    host_ledc_log_clear();
+    start_us = play(BUZZER_CUE_MATCH_START);
+    host_clock_advance(250 * 1000);
+    cut_us = play(BUZZER_CUE_MATCH_END);
+    host_clock_advance(cue_us(BUZZER_CUE_MATCH_END) + 1000);
+    count = heard(tones);
+    index = check_notes(tones, 0, BUZZER_CUE_MATCH_START, start_us, 2);
+    index = check_notes(tones, index, BUZZER_CUE_MATCH_END, cut_us, cues[BUZZER_CUE_MATCH_END].note_count);
+    CHECK_EQ(count, index + 1);
+    check_idle();
+}
+
+// Lower cues wait for the end of the one playing, the highest of them only.
+// The end of the match plays first: its last note is none of their first
+static void test_waiting(void)
+{
+    Heard_t tones[HEARD_MAX];
+    host_ledc_log_clear();
+    int64_t start_us = play(BUZZER_CUE_MATCH_END);
+    host_clock_advance(10 * 1000);
+    play(BUZZER_CUE_LOW_BATTERY);
+    host_clock_advance(10 * 1000);
+    play(BUZZER_CUE_CAPTURE);
+    host_clock_advance(cue_us(BUZZER_CUE_MATCH_END) + cue_us(BUZZER_CUE_CAPTURE) + cue_us(BUZZER_CUE_LOW_BATTERY));
+
+    size_t count = heard(tones);
+    size_t index = check_notes(tones, 0, BUZZER_CUE_MATCH_END, start_us, cues[BUZZER_CUE_MATCH_END].note_count);
+    int64_t next_us = start_us + cue_us(BUZZER_CUE_MATCH_END);
+    index = check_notes(tones, index, BUZZER_CUE_CAPTURE, next_us, cues[BUZZER_CUE_CAPTURE].note_count);
+    CHECK_EQ(tones[index].time_us, next_us + cue_us(BUZZER_CUE_CAPTURE));
+    CHECK_EQ(tones[index].freq_hz, 0);
+    CHECK_EQ(count, index + 1);
+    check_idle();
+
+    // A lower cue does not take the place of a higher one waiting
+    host_ledc_log_clear();
+    start_us = play(BUZZER_CUE_MATCH_END);
+    play(BUZZER_CUE_CAPTURE);
+    play(BUZZER_CUE_CONTESTED);
+    host_clock_advance(cue_us(BUZZER_CUE_MATCH_END) + cue_us(BUZZER_CUE_CAPTURE) + cue_us(BUZZER_CUE_CONTESTED));
+    count = heard(tones);
+    index = check_notes(tones, 0, BUZZER_CUE_MATCH_END, start_us, cues[BUZZER_CUE_MATCH_END].note_count);
+    next_us = start_us + cue_us(BUZZER_CUE_MATCH_END);
+    index = check_notes(tones, index, BUZZER_CUE_CAPTURE, next_us, cues[BUZZER_CUE_CAPTURE].note_count);
+    CHECK_EQ(count, index + 1);
+    check_idle();
+}
+
+// The callback of the cut cue running meanwhile, about to wait for its note
+static void rearm_for_note(esp_timer_handle_t timer)
+{
+    CHECK_OK(esp_timer_start_once(timer, 700 * 1000));
+}
+
+// The end of the match cut by another in its last note while the callback
+// re-arms the timer for that note, between the stop and the start: the new
+// cue still starts at once, all of it
+static void test_cut_race(void)
+{
+    Heard_t tones[HEARD_MAX];
+    host_ledc_log_clear();
+    int64_t start_us = play(BUZZER_CUE_MATCH_END);
+    host_clock_advance(900 * 1000);
+    host_esp_timer_after_stop(rearm_for_note);
+    int64_t cut_us = play(BUZZER_CUE_MATCH_END);
+    host_clock_advance(cue_us(BUZZER_CUE_MATCH_END) + 1000);
+
+    size_t count = heard(tones);
+    size_t index = check_notes(tones, 0, BUZZER_CUE_MATCH_END, start_us, cues[BUZZER_CUE_MATCH_END].note_count);
+    index = check_notes(tones, index, BUZZER_CUE_MATCH_END, cut_us, cues[BUZZER_CUE_MATCH_END].note_count);
+    CHECK_EQ(count, index + 1);
+    check_idle();
+}
+
+int main(void)
+{
+    host_clock_set_virtual();
+    host_log_set_quiet(true);
+
+    test_not_initialised();
+    CHECK_OK(buzzer_init());
+    test_each_cue();
+    test_preemption();
+    test_waiting();
+    test_cut_race();
+    return 0;
+}
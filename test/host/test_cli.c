@@ -0,0 +1,208 @@
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "cli.h"
+#include "storage.h"
+
+/*
+ * The serial console of the linux target: a node with its app task up, the
+ * commands written line by line to the stdin the console task reads, the
+ * output taken from its stdout. The commands are dispatched with their
+ * arguments, bad arguments and unknown commands are reported, and injected
+ * events are paced at the rate asked for, which the tick rate bounds.
+ */
+
+#define CLI_EXPECT_TIMEOUT_MS   2000
+#define CLI_OUTPUT_MAX          16384
+
+static int stdin_writer = -1;
+static int output_reader = -1;
+static int saved_stdout = -1;
+static int saved_stderr = -1;
+static char output[CLI_OUTPUT_MAX];
+static size_t output_len;
+static size_t output_seen;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The console reads stdin and prints to stdout and stderr: all three redirected
+static void console_attach(void)
+{
+    int input[2];
+    CHECK(pipe(input) == 0);
+    CHECK(dup2(input[0], STDIN_FILENO) == STDIN_FILENO);
+    close(input[0]);
+    stdin_writer = input[1];
+
+    char path[] = "/tmp/test_cli_XXXXXX";
+    int out = mkstemp(path);
+    CHECK(out >= 0);
+    unlink(path);
+    output_reader = dup(out);
+    CHECK(output_reader >= 0);
+
+    fflush(stdout);
+    fflush(stderr);
+    saved_stdout = dup(STDOUT_FILENO);
+    saved_stderr = dup(STDERR_FILENO);
+    CHECK(dup2(out, STDOUT_FILENO) == STDOUT_FILENO);
+    CHECK(dup2(out, STDERR_FILENO) == STDERR_FILENO);
+    close(out);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+static void console_detach(void)
+{
+    close(stdin_writer);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+}
+
+static void command(const char * line)
+{
+    CHECK(write(stdin_writer, line, strlen(line)) == (ssize_t)strlen(line));
+    CHECK(write(stdin_writer, "\n", 1) == 1);
+}
+
+// Wait for the text in the output not matched yet, then go past it
+static void expect(const char * text)
+{
+    int64_t until_us = host_us() + CLI_EXPECT_TIMEOUT_MS * 1000;
+    while(true)
+    {
+        ssize_t got = pread(output_reader, &output[output_len], sizeof(output) - 1 - output_len, output_len);
+        CHECK(got >= 0);
+        output_len += got;
+        output[output_len] = '\0';
+
+        const char * found = strstr(&output[output_seen], text);
+        if(found != NULL)
+        {
+            output_seen = found - output + strlen(text);
+            return;
+        }
+        if(host_us() > until_us)
+        {
+            console_detach();
+            fprintf(stderr, "no \"%s\" in the console output:\n%s\n", text, &output[output_seen]);
+            exit(1);
+        }
+        usleep(1000);
+    }
+}
+
+static void start_app(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    CHECK_OK(storage_set_game_config(&config));
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    AppEventMessage_t setup_expired = { .type = APP_EVENT_TMR_INIT_SETUP, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&setup_expired, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+    AppStatus_t status;
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    } while(status.state != APP_STATE_IDLE);
+}
+
+// The commands with their arguments, and what is refused
+static void test_commands(void)
+{
+    char line[64];
+
+    command("help");
+    expect("inject");
+    expect("history");
+    command("status");
+    expect("state IDLE, control point 0");
+
+    command("selfdestruct");
+    expect("unknown command: selfdestruct");
+    command("inject");
+    expect("inject: missing <event>");
+    expect("command returned 1");
+    command("inject 3 --bogus");
+    expect("invalid option \"--bogus\"");
+    expect("command returned 1");
+
+    snprintf(line, sizeof(line), "inject %d", APP_EVENT_MAX);
+    command(line);
+    expect("rate 1-");
+    expect("command returned 1");
+
+    // Faster than the tick rate cannot be paced: refused, not run slower
+    snprintf(line, sizeof(line), "inject %d -n 5 -r %d", APP_EVENT_TMR_MATCH_END, configTICK_RATE_HZ + 1);
+    command(line);
+    snprintf(line, sizeof(line), "rate 1-%d", configTICK_RATE_HZ);
+    expect(line);
+    expect("command returned 1");
+
+    // The loops do not yield: a count out of bounds would starve the idle task
+    command("bench -n -1");
+    expect("iterations 1-");
+    expect("command returned 1");
+    command("bench -n 100001");
+    expect("iterations 1-");
+    expect("command returned 1");
+
+    // A control point past the last is no filter
+    snprintf(line, sizeof(line), "history -c %d", CONTROL_POINT_MAX);
+    command(line);
+    expect("control point 0-");
+    expect("command returned 1");
+}
+
+// Events at the rate asked for: count - 1 periods from the first to the last
+static int64_t test_inject_rate(int rate, int count)
+{
+    char line[64];
+    snprintf(line, sizeof(line), "inject %d --count=%d -r %d", APP_EVENT_TMR_MATCH_END, count, rate);
+
+    int64_t start_us = host_us();
+    command(line);
+    snprintf(line, sizeof(line), "injected %d x event %d, 0 dropped", count, APP_EVENT_TMR_MATCH_END);
+    expect(line);
+    int64_t elapsed_ms = (host_us() - start_us) / 1000;
+
+    int64_t expected_ms = (int64_t)(count - 1) * 1000 / rate;
+    CHECK(elapsed_ms >= expected_ms - portTICK_PERIOD_MS);
+    CHECK(elapsed_ms < expected_ms + 500);
+    return elapsed_ms;
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    start_app();
+
+    console_attach();
+    CHECK_OK(cli_init());
+    test_commands();
+    int64_t slow_ms = test_inject_rate(10, 6);
+    int64_t fast_ms = test_inject_rate(configTICK_RATE_HZ, 51);
+    console_detach();
+
+    REPORT("inject at 10 Hz", "6 events in %lld ms", (long long)slow_ms);
+    REPORT("inject at the tick rate", "51 events in %lld ms, %d Hz", (long long)fast_ms, configTICK_RATE_HZ);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "display.h"
+#include "storage.h"
+
+/*
+ * The status display on a mocked I2C bus that keeps the RAM of the panel:
+ * the first flush overwrites the whole panel, nothing is sent while the
+ * status stays the same, a second of play sends only the columns that
+ * changed. Once the match is over, the first page of the flush lost on
+ * the bus, the panel catches up with the next refresh and shows the same
+ * countdown and header pixels as before the match, after all the partial
+ * updates. Bytes per second of play are reported against a full frame.
+ */
+
+#define FULL_FRAME_BYTES    (DISPLAY_PAGES * (4 + 1 + DISPLAY_WIDTH))
+#define PLAY_MS             4000
+#define HEADER_NAME_COLUMNS (15 * 6)        // The control point name, left of the state
+
+static uint8_t idle_panel[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS];
+static uint8_t play_panel[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS];
+static uint8_t end_panel[HOST_PANEL_PAGES][HOST_PANEL_COLUMNS];
+
+static void send(AppEvent_t type)
+{
+    AppEventMessage_t message = { .type = type, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&message, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+}
+
+static void wait_state(AppState_t state)
+{
+    AppStatus_t status;
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    } while(status.state != state);
+}
+
+// Refreshes that have drawn the status as it is now
+static DisplayStats_t settle(void)
+{
+    DisplayStats_t stats;
+    display_get_stats(&stats);
+    uint32_t refreshes = stats.refreshes;
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(DISPLAY_REFRESH_MS / 2));
+        display_get_stats(&stats);
+    } while(stats.refreshes < refreshes + 2);
+    return stats;
+}
+
+static void start_app(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_CHARLIE;
+    config.match_duration_s = 600;
+    config.points_per_second = 1;
+    config.capture_delay_ms = 0;
+    config.game_mode = 0;       // GAME_MODE_DOMINATION
+    CHECK_OK(storage_set_game_config(&config));
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+    send(APP_EVENT_TMR_INIT_SETUP);
+    wait_state(APP_STATE_IDLE);
+}
+
+// The first flush writes every page whole over the noise of the panel RAM
+static void test_first_frame(void)
+{
+    CHECK_OK(display_init());
+    DisplayStats_t stats = settle();
+    CHECK(stats.flushes >= 1);
+    CHECK_EQ(stats.pages, DISPLAY_PAGES);
+    CHECK_EQ(stats.bytes, FULL_FRAME_BYTES);
+
+    // The noise has the top and bottom rows of a page lit, the idle screen never
+    host_i2c_panel(idle_panel);
+    for(int page = 0; page < DISPLAY_PAGES; page++)
+    {
+        for(int column = 0; column < DISPLAY_WIDTH; column++)
+        {
+            CHECK((idle_panel[page][column] & 0x81) != 0x81);
+        }
+    }
+}
+
+// The same status redrawn: nothing goes over the bus
+static void test_idle(void)
+{
+    HostI2cStats_t bus_before;
+    HostI2cStats_t bus_after;
+    DisplayStats_t before = settle();
+    host_i2c_stats(&bus_before);
+    DisplayStats_t after = settle();
+    settle();
+    host_i2c_stats(&bus_after);
+    display_get_stats(&after);
+
+    CHECK(after.refreshes > before.refreshes);
+    CHECK_EQ(after.flushes, before.flushes);
+    CHECK_EQ(bus_after.bytes, bus_before.bytes);
+}
+
+// A second of play: the countdown and the holder's line
+static void test_play(void)
+{
+    send(APP_EVENT_BTN_RED_SHORT);
+    wait_state(APP_STATE_RUNNING);
+    DisplayStats_t start = settle();
+    DisplayStats_t before = settle();
+    HostI2cStats_t bus_before;
+    host_i2c_stats(&bus_before);
+
+    vTaskDelay(pdMS_TO_TICKS(PLAY_MS));
+
+    DisplayStats_t after;
+    HostI2cStats_t bus_after;
+    display_get_stats(&after);
+    host_i2c_stats(&bus_after);
+
+    uint32_t bytes = after.bytes - before.bytes;
+    uint32_t flushes = after.flushes - before.flushes;
+    uint32_t pages = after.pages - before.pages;
+    // What the driver counts is what went over the bus
+    CHECK_EQ(bus_after.bytes - bus_before.bytes, bytes);
+    CHECK_EQ(bus_after.transactions - bus_before.transactions, 2 * pages);
+    CHECK(flushes >= PLAY_MS / 1000 - 1);
+    CHECK(flushes <= PLAY_MS / DISPLAY_REFRESH_MS + 1);
+
+    host_i2c_panel(play_panel);
+
+    uint32_t per_second = bytes * 1000 / PLAY_MS;
+    CHECK(per_second < FULL_FRAME_BYTES / 8);
+    REPORT("match start", "%" PRIu32 " bytes, a full frame is %d", start.bytes - FULL_FRAME_BYTES, FULL_FRAME_BYTES);
+    REPORT("second of play", "%" PRIu32 " bytes in %.1f flushes, %.1f pages each",
+           per_second, flushes * 1000.0 / PLAY_MS, (double)pages / flushes);
+}
+
+// The end of the match, the header lost on the bus: it stays dirty and goes
+// on the next refresh. Then what is back as it was before the match is
+// pixel for pixel the same
+static void test_end(void)
+{
+    // Right after a refresh, the next one draws the end
+    DisplayStats_t before = settle();
+    send(APP_EVENT_TMR_MATCH_END);
+    wait_state(APP_STATE_FINISHED);
+    host_i2c_fail(1);
+    settle();
+    DisplayStats_t after = settle();
+    CHECK_EQ(after.bus_errors, before.bus_errors + 1);
+    host_i2c_panel(end_panel);
+
+    CHECK(memcmp(&end_panel[0][HEADER_NAME_COLUMNS], &play_panel[0][HEADER_NAME_COLUMNS], DISPLAY_WIDTH - HEADER_NAME_COLUMNS) != 0);
+    CHECK(memcmp(end_panel[0], idle_panel[0], HEADER_NAME_COLUMNS) == 0);
+    CHECK(memcmp(end_panel[0], idle_panel[0], DISPLAY_WIDTH) != 0);
+    CHECK(memcmp(end_panel[2], idle_panel[2], DISPLAY_WIDTH) == 0);
+    CHECK(memcmp(end_panel[3], idle_panel[3], DISPLAY_WIDTH) == 0);
+    CHECK(memcmp(end_panel[DISPLAY_PAGES - TEAM_COUNT + TEAM_RED], idle_panel[DISPLAY_PAGES - TEAM_COUNT + TEAM_RED], DISPLAY_WIDTH) != 0);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    start_app();
+
+    test_first_frame();
+    test_idle();
+    test_play();
+    test_end();
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "pool.h"
+#include "storage.h"
+
+/*
+ * The app event channel under a flood: control events at 1 kHz, as the
+ * console injects them at most, against config pushes from several network
+ * senders as fast as they go, received by a stand-in of the app task. No
+ * control event is dropped, the pushes coalesce to one place in the network
+ * queue, the newest config is the one received, no payload block leaks, and
+ * the worst-case latency of the control events is reported. Then with the
+ * receiver stalled: control events first, a full queue counted as drops.
+ */
+
+#define FLOOD_MS            3000
+#define FLOOD_CONTROL_HZ    1000
+#define FLOOD_CONTROL_COUNT (FLOOD_MS * FLOOD_CONTROL_HZ / 1000)
+#define FLOOD_PUSHERS       3
+#define FLOOD_WORK_US       50          // The app task handling a control event
+#define FLOOD_CONFIG_WORK_US 2000       // And a config push, written to NVS
+#define FLOOD_LATENCY_MAX_US (APP_EVENT_ENQUEUE_TIMEOUT_MS * 1000)
+
+static int64_t sent_us[FLOOD_CONTROL_COUNT];
+static int64_t latency_us[FLOOD_CONTROL_COUNT];
+static volatile bool flooding;
+static volatile bool receiving;
+static uint32_t pushed_version;         // The last config version pushed
+static pthread_mutex_t push_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t received_version;
+static uint32_t control_received;
+static uint32_t network_received;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void busy_wait_us(int64_t us)
+{
+    int64_t until_us = host_us() + us;
+    while(host_us() < until_us)
+    {
+    }
+}
+
+static int compare_us(const void * a, const void * b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+    return (left > right) - (left < right);
+}
+
+// The app task: handles one event at a time, releases the payloads
+static void * receiver(void * arg)
+{
+    AppEventMessage_t message;
+    while(receiving)
+    {
+        if(!app_event_receive(&message, pdMS_TO_TICKS(10)))
+            continue;
+
+        int64_t now_us = host_us();
+        if(message.type == APP_EVENT_CFG_UPDATED)
+        {
+            const GameConfig_t * config = pool_data(&app_payload_pool, message.payload);
+            CHECK(config != NULL);
+            // Newer configs only, whatever was superseded on the way
+            CHECK(config->version > received_version);
+            received_version = config->version;
+            network_received++;
+            busy_wait_us(FLOOD_CONFIG_WORK_US - FLOOD_WORK_US);
+        }
+        else
+        {
+            // The control events carry their index in payload_len
+            latency_us[control_received++] = now_us - sent_us[message.payload_len];
+        }
+        pool_release(&app_payload_pool, message.payload);
+        busy_wait_us(FLOOD_WORK_US);
+    }
+    return NULL;
+}
+
+// A config push handler: a block per push, given up on a failed send. The
+// senders take turns, so that the versions are sent in order
+static void * pusher(void * arg)
+{
+    while(flooding)
+    {
+        PoolHandle_t block = pool_alloc(&app_payload_pool);
+        if(block == POOL_HANDLE_NONE)
+        {
+            sched_yield();
+            continue;
+        }
+        GameConfig_t * config = pool_data(&app_payload_pool, block);
+        *config = (GameConfig_t)GAME_CONFIG_DEFAULT();
+
+        AppEventMessage_t message = { .type = APP_EVENT_CFG_UPDATED, .payload = block, .payload_len = sizeof(GameConfig_t) };
+        pthread_mutex_lock(&push_lock);
+        config->version = ++pushed_version;
+        esp_err_t ret = app_event_send(&message, 0);
+        pthread_mutex_unlock(&push_lock);
+        if(ESP_OK != ret)
+        {
+            pool_release(&app_payload_pool, block);
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void test_flood(void)
+{
+    AppEventStats_t before;
+    AppEventStats_t after;
+    app_event_get_stats(&before);
+
+    pthread_t receive_thread;
+    pthread_t push_threads[FLOOD_PUSHERS];
+    receiving = true;
+    flooding = true;
+    CHECK(pthread_create(&receive_thread, NULL, receiver, NULL) == 0);
+    for(int i = 0; i < FLOOD_PUSHERS; i++)
+    {
+        CHECK(pthread_create(&push_threads[i], NULL, pusher, NULL) == 0);
+    }
+
+    // Buttons and timers, a control event every millisecond
+    int64_t next_us = host_us();
+    for(uint16_t i = 0; i < FLOOD_CONTROL_COUNT; i++)
+    {
+        next_us += 1000000 / FLOOD_CONTROL_HZ;
+        while(host_us() < next_us)
+        {
+            sched_yield();
+        }
+        AppEventMessage_t message = { .type = i % 10 ? APP_EVENT_BTN(i % TEAM_COUNT, PRESS_SHORT) : APP_EVENT_TMR_MATCH_END,
+                                      .payload_len = i };
+        sent_us[i] = host_us();
+        CHECK_OK(app_event_send(&message, pdMS_TO_TICKS(APP_EVENT_ENQUEUE_TIMEOUT_MS)));
+    }
+
+    flooding = false;
+    for(int i = 0; i < FLOOD_PUSHERS; i++)
+    {
+        pthread_join(push_threads[i], NULL);
+    }
+    // Let the receiver take what is left
+    int64_t drain_until_us = host_us() + 200000;
+    while(host_us() < drain_until_us && (control_received < FLOOD_CONTROL_COUNT || received_version != pushed_version))
+    {
+        sched_yield();
+    }
+    receiving = false;
+    pthread_join(receive_thread, NULL);
+    app_event_get_stats(&after);
+
+    uint32_t pushed = pushed_version;
+    CHECK_EQ(control_received, FLOOD_CONTROL_COUNT);
+    CHECK_EQ(received_version, pushed);
+    CHECK_EQ(after.dropped[APP_EVENT_PRIO_CONTROL], before.dropped[APP_EVENT_PRIO_CONTROL]);
+    CHECK_EQ(after.dropped[APP_EVENT_PRIO_NETWORK], before.dropped[APP_EVENT_PRIO_NETWORK]);
+    // One coalescing event type: one place in the network queue at most
+    CHECK(after.high_water[APP_EVENT_PRIO_NETWORK] <= 1);
+    CHECK_EQ(after.coalesced - before.coalesced, pushed - network_received);
+
+    PoolStats_t pool;
+    pool_get_stats(&app_payload_pool, &pool);
+    CHECK_EQ(pool.used, 0);
+
+    qsort(latency_us, FLOOD_CONTROL_COUNT, sizeof(latency_us[0]), compare_us);
+    int64_t worst_us = latency_us[FLOOD_CONTROL_COUNT - 1];
+    REPORT("flood", "%d control events, %u config pushes, %u received, %u coalesced",
+           FLOOD_CONTROL_COUNT, pushed, network_received, after.coalesced - before.coalesced);
+    REPORT("control latency", "median %lld us, p99 %lld us, worst %lld us",
+           (long long)latency_us[FLOOD_CONTROL_COUNT / 2], (long long)latency_us[FLOOD_CONTROL_COUNT * 99 / 100], (long long)worst_us);
+    REPORT("deepest queues", "control %lu, network %lu",
+           (unsigned long)after.high_water[APP_EVENT_PRIO_CONTROL], (unsigned long)after.high_water[APP_EVENT_PRIO_NETWORK]);
+    CHECK(worst_us < FLOOD_LATENCY_MAX_US);
+}
+
+// Nobody receiving: the pushes take one place, the control events sent after
+// them are received first, and a full control queue drops without blocking
+static void test_stalled(void)
+{
+    AppEventStats_t before;
+    AppEventStats_t after;
+    app_event_get_stats(&before);
+
+    for(uint32_t version = 1; version <= 3; version++)
+    {
+        PoolHandle_t block = pool_alloc(&app_payload_pool);
+        CHECK(block != POOL_HANDLE_NONE);
+        GameConfig_t * config = pool_data(&app_payload_pool, block);
+        *config = (GameConfig_t)GAME_CONFIG_DEFAULT();
+        config->version = 1000 + version;
+        AppEventMessage_t message = { .type = APP_EVENT_CFG_UPDATED, .payload = block, .payload_len = sizeof(GameConfig_t) };
+        CHECK_OK(app_event_send(&message, 0));
+    }
+    int dropped = 0;
+    for(int i = 0; i < APP_EVENT_QUEUE_LEN_CONTROL + 5; i++)
+    {
+        AppEventMessage_t message = { .type = APP_EVENT_BTN_BLUE_SHORT };
+        dropped += app_event_send(&message, 0) != ESP_OK;
+    }
+    app_event_get_stats(&after);
+    CHECK_EQ(dropped, 5);
+    CHECK_EQ(after.dropped[APP_EVENT_PRIO_CONTROL] - before.dropped[APP_EVENT_PRIO_CONTROL], 5);
+    CHECK_EQ(after.high_water[APP_EVENT_PRIO_CONTROL], APP_EVENT_QUEUE_LEN_CONTROL);
+    CHECK_EQ(after.coalesced - before.coalesced, 2);
+
+    AppEventMessage_t message;
+    for(int i = 0; i < APP_EVENT_QUEUE_LEN_CONTROL; i++)
+    {
+        CHECK(app_event_receive(&message, 0));
+        CHECK_EQ(message.type, APP_EVENT_BTN_BLUE_SHORT);
+    }
+    CHECK(app_event_receive(&message, 0));
+    CHECK_EQ(message.type, APP_EVENT_CFG_UPDATED);
+    const GameConfig_t * config = pool_data(&app_payload_pool, message.payload);
+    CHECK_EQ(config->version, 1003);
+    pool_release(&app_payload_pool, message.payload);
+    CHECK(!app_event_receive(&message, 0));
+
+    PoolStats_t pool;
+    pool_get_stats(&app_payload_pool, &pool);
+    CHECK_EQ(pool.used, 0);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    pool_init(&app_payload_pool);
+    CHECK_OK(app_event_init());
+    test_flood();
+    test_stalled();
+    return 0;
+}
@@ -0,0 +1,482 @@
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "nvs.h"
+
+#include "failover.h"
+#include "network.h"
+#include "transport.h"
+#include "auth.h"
+#include "storage.h"
+#include "app.h"
+#include "config.h"
+
+/*
+ * Master failover on the simulated air, one process per node, all of them in
+ * range of the access point and of each other, each running the app, the
+ * network and the failover task.
+ *
+ * The master, the test process, acks the statuses and sends heartbeats, then
+ * goes silent in the middle of the match: the node holding ALPHA must stand
+ * in. It is then killed, and BRAVO must take over. The master comes back and
+ * must get the replica handed back. The nodes capture their points all
+ * along: every capture must be in the replica handed back. A scoreboard of
+ * the five points is too long for one ESP-NOW frame: it comes in several
+ * that each fit.
+ */
+
+#define STATIONS            6           // The master and a node per control point
+#define MASTER              0
+#define HEARTBEAT_PERIOD_MS 1000
+#define CAPTURE_PERIOD_MS   400
+#define LOSS_PCT            2
+// A lost status is repeated within the period, which grows unacked: the
+// nodes agree on the last captures after that long
+#define STATUS_SETTLE_MS    (NODE_STATUS_PERIOD_MAX_MS + NODE_STATUS_PERIOD_MS)
+
+typedef struct
+{
+    volatile uint32_t capture_requests;
+    volatile uint16_t captures;         // As the app of the node counts them
+    volatile int8_t owner;
+    volatile bool ready;
+} NodeShared_t;
+
+typedef struct
+{
+    volatile bool done;
+    NodeShared_t nodes[STATIONS];
+} Shared_t;
+
+typedef struct
+{
+    int64_t at_us;
+    uint16_t aggregator;
+    uint8_t entry_count;
+    ScoreboardEntry_t entries[CONTROL_POINT_MAX];
+} Board_t;
+
+// The node of each station: ALPHA is not the first station, the election
+// does not follow the node ids
+static const ControlPoint_t station_points[STATIONS] = { CONTROL_POINT_NONE, CONTROL_POINT_BRAVO, CONTROL_POINT_ALPHA, CONTROL_POINT_DELTA, CONTROL_POINT_CHARLIE,
+                                                       CONTROL_POINT_ECHO };
+
+static Shared_t * shared;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---- Nodes -----------------------------------------------------------------
+
+static void node_send_event(AppEvent_t type)
+{
+    AppEventMessage_t event = { .type = type, .payload = POOL_HANDLE_NONE };
+    CHECK_OK(app_event_send(&event, portMAX_DELAY));
+}
+
+static void node_run(int station)
+{
+    NodeShared_t * node = &shared->nodes[station];
+    host_air_join(station);
+    CHECK_OK(storage_set_control_point(station_points[station]));
+    CHECK_OK(network_init());
+    CHECK(xTaskCreate(network_task, "network", NETWORK_TASK_STACK_DEPTH, NULL, NETWORK_TASK_PRIORITY, NULL) == pdPASS);
+    CHECK_OK(failover_init());
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    // Past the setup window, as if its timer expired, once the app is up
+    AppEventMessage_t setup_expired = { .type = APP_EVENT_TMR_INIT_SETUP, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&setup_expired, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+    AppStatus_t status;
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    } while(status.state != APP_STATE_IDLE);
+    CHECK(xTaskCreate(failover_task, "failover", FAILOVER_TASK_STACK_DEPTH, NULL, FAILOVER_TASK_PRIORITY, NULL) == pdPASS);
+    network_wait_connected();
+    node->ready = true;
+
+    // Each request is a press of the team not holding the point
+    uint32_t done = 0;
+    while(!shared->done)
+    {
+        if(done == node->capture_requests)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        uint16_t before = status.captures;
+        node_send_event(status.owner == TEAM_RED ? APP_EVENT_BTN_BLUE_SHORT : APP_EVENT_BTN_RED_SHORT);
+        done++;
+        do
+        {
+            vTaskDelay(1);
+            app_get_status(&status);
+        } while(status.captures == before);
+        node->owner = status.owner;
+        node->captures = status.captures;
+    }
+    _exit(0);
+}
+
+// ---- Master ----------------------------------------------------------------
+
+static int master_sock = -1;
+static uint32_t master_seq = 0;
+static pthread_mutex_t master_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool master_alive = true;
+static volatile bool master_stop = false;
+
+static Board_t first_boards[STATIONS];     // First scoreboard of each aggregator
+static Board_t last_board;
+static Board_t handback;
+static uint32_t boards_while_alive = 0;
+static uint32_t handback_standin_ms = 0;
+static uint32_t scoreboard_frames = 0;         // Of the first handback
+static int64_t last_heartbeat_us = 0;
+
+static int station_of(uint16_t node_id)
+{
+    int station = node_id - host_air_node_id(0);
+    CHECK(station > MASTER && station < STATIONS);
+    return station;
+}
+
+static void master_send(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    FrameHeader_t * header = (FrameHeader_t *)frame;
+    pthread_mutex_lock(&master_lock);
+    *header = (FrameHeader_t)
+    {
+        .magic = PROTOCOL_MAGIC,
+        .version = PROTOCOL_VERSION,
+        .type = type,
+        .flags = FRAME_FLAG_AUTH,
+        .src_node = NODE_ID_MASTER,
+        .dst_node = dst_node,
+        .seq = ++master_seq,
+        .payload_len = payload_len,
+    };
+    memcpy(frame + sizeof(FrameHeader_t), payload, payload_len);
+    size_t len = sizeof(FrameHeader_t) + payload_len;
+    CHECK_OK(auth_sign(frame, len, frame + len));
+    header->ttl = CONFIG_DOMINION_RELAY_HOPS;
+    struct sockaddr_in dest = { .sin_family = AF_INET, .sin_port = htons(NODE_UDP_PORT), .sin_addr.s_addr = htonl(INADDR_BROADCAST) };
+    CHECK(sendto(master_sock, frame, len + AUTH_TAG_LEN, 0, (struct sockaddr *)&dest, sizeof(dest)) > 0);
+    pthread_mutex_unlock(&master_lock);
+}
+
+// Each frame of a scoreboard fits in ESP-NOW: their entries are merged by control point
+static void board_merge(Board_t * board, const uint8_t * payload, uint16_t len)
+{
+    const ScoreboardPayload_t * header = (const ScoreboardPayload_t *)payload;
+    CHECK(len >= sizeof(ScoreboardPayload_t));
+    CHECK(sizeof(FrameHeader_t) + len + AUTH_TAG_LEN <= ESP_NOW_MAX_DATA_LEN);
+    CHECK_EQ(len, sizeof(ScoreboardPayload_t) + header->entry_count * sizeof(ScoreboardEntry_t));
+    board->at_us = host_us();
+    board->aggregator = header->aggregator_node;
+    for(int i = 0; i < header->entry_count; i++)
+    {
+        ScoreboardEntry_t entry;
+        memcpy(&entry, payload + sizeof(ScoreboardPayload_t) + i * sizeof(entry), sizeof(entry));
+        CHECK(entry.status.control_point > CONTROL_POINT_NONE && entry.status.control_point < CONTROL_POINT_MAX);
+        int slot = 0;
+        while(slot < board->entry_count && board->entries[slot].status.control_point != entry.status.control_point)
+        {
+            slot++;
+        }
+        board->entries[slot] = entry;
+        board->entry_count += slot == board->entry_count;
+    }
+}
+
+static void * master_rx_task(void * arg)
+{
+    uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    while(!master_stop)
+    {
+        ssize_t len = recvfrom(master_sock, frame, sizeof(frame), 0, NULL, NULL);
+        FrameHeader_t * header = (FrameHeader_t *)frame;
+        if(len < (ssize_t)sizeof(FrameHeader_t) || len != (ssize_t)(sizeof(FrameHeader_t) + header->payload_len + AUTH_TAG_LEN))
+        {
+            continue;
+        }
+        header->ttl = 0;
+        size_t signed_len = sizeof(FrameHeader_t) + header->payload_len;
+        CHECK_OK(auth_verify(frame, signed_len, frame + signed_len));
+        if(!auth_check_replay(header->src_node, header->seq))
+        {
+            continue;
+        }
+
+        const uint8_t * payload = frame + sizeof(FrameHeader_t);
+        if(header->type == MSG_NODE_STATUS && master_alive)
+        {
+            StatusAckPayload_t ack = { .seq = header->seq };
+            master_send(header->src_node, MSG_STATUS_ACK, &ack, sizeof(ack));
+        }
+        else if(header->type == MSG_SCOREBOARD)
+        {
+            Board_t board = { 0 };
+            board_merge(&board, payload, header->payload_len);
+            pthread_mutex_lock(&master_lock);
+            boards_while_alive += master_alive;
+            Board_t * first = &first_boards[station_of(board.aggregator)];
+            if(first->at_us == 0)
+            {
+                *first = board;
+            }
+            last_board = board;
+            pthread_mutex_unlock(&master_lock);
+        }
+        else if(header->type == MSG_REPLICA_HANDBACK && header->dst_node == NODE_ID_MASTER)
+        {
+            const ScoreboardPayload_t * board = (const ScoreboardPayload_t *)payload;
+            pthread_mutex_lock(&master_lock);
+            if(handback.at_us == 0)
+            {
+                handback_standin_ms = board->standin_ms;
+            }
+            scoreboard_frames += board->standin_ms == handback_standin_ms;
+            board_merge(&handback, payload, header->payload_len);
+            pthread_mutex_unlock(&master_lock);
+        }
+    }
+    return NULL;
+}
+
+static void * master_heartbeat_task(void * arg)
+{
+    while(!master_stop)
+    {
+        if(master_alive)
+        {
+            MasterHeartbeatPayload_t heartbeat = { .time_us = esp_timer_get_time() };
+            master_send(NODE_ID_BROADCAST, MSG_MASTER_HEARTBEAT, &heartbeat, sizeof(heartbeat));
+            last_heartbeat_us = host_us();
+        }
+        usleep(HEARTBEAT_PERIOD_MS * 1000);
+    }
+    return NULL;
+}
+
+// Waits for the first scoreboard of a node, returns its time
+static int64_t wait_board(int station, int64_t timeout_us)
+{
+    int64_t deadline_us = host_us() + timeout_us;
+    while(host_us() < deadline_us)
+    {
+        pthread_mutex_lock(&master_lock);
+        int64_t at_us = first_boards[station].at_us;
+        pthread_mutex_unlock(&master_lock);
+        if(at_us != 0)
+        {
+            return at_us;
+        }
+        usleep(10000);
+    }
+    return 0;
+}
+
+// Captures round-robin on the live nodes, for a while
+static uint32_t capture_for(int64_t duration_us, int skip)
+{
+    uint32_t captures = 0;
+    int64_t end_us = host_us() + duration_us;
+    for(int station = 1; host_us() < end_us; station = station % (STATIONS - 1) + 1)
+    {
+        if(station == skip)
+        {
+            continue;
+        }
+        shared->nodes[station].capture_requests++;
+        captures++;
+        usleep(CAPTURE_PERIOD_MS * 1000);
+    }
+    return captures;
+}
+
+static void wait_captures_applied(void)
+{
+    for(int station = 1; station < STATIONS; station++)
+    {
+        for(int i = 0; i < 200 && shared->nodes[station].captures < shared->nodes[station].capture_requests; i++)
+        {
+            usleep(10000);
+        }
+    }
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(shared != MAP_FAILED);
+
+    // One fleet key, stored before the nodes fork with it
+    CHECK_OK(storage_init());
+    nvs_handle_t handle;
+    uint8_t key[AUTH_KEY_LEN] = "failover test key";
+    CHECK_OK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle));
+    CHECK_OK(nvs_set_blob(handle, KEY_AUTH_KEY, key, AUTH_KEY_LEN));
+    CHECK_OK(nvs_commit(handle));
+    nvs_close(handle);
+    CHECK_OK(auth_init());
+    esp_timer_get_time();
+
+    host_air_init(STATIONS);
+    host_air_set_loss(LOSS_PCT);
+    for(int a = 1; a < STATIONS; a++)
+    {
+        for(int b = a + 1; b < STATIONS; b++)
+        {
+            host_air_set_espnow_range(a, b, true);
+        }
+    }
+
+    pid_t pids[STATIONS];
+    for(int station = 1; station < STATIONS; station++)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        pids[station] = fork();
+        CHECK(pids[station] >= 0);
+        if(pids[station] == 0)
+        {
+            // A failed check in the master must not leave the nodes running
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            node_run(station);
+        }
+    }
+
+    host_air_join_wired(MASTER);
+    master_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(MASTER_UDP_PORT), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    CHECK(bind(master_sock, (struct sockaddr *)&local, sizeof(local)) == 0);
+    struct timeval timeout = { .tv_usec = 50000 };
+    setsockopt(master_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    pthread_t rx;
+    pthread_t heartbeat;
+    pthread_create(&rx, NULL, master_rx_task, NULL);
+    pthread_create(&heartbeat, NULL, master_heartbeat_task, NULL);
+
+    for(int station = 1; station < STATIONS; station++)
+    {
+        for(int i = 0; i < 500 && !shared->nodes[station].ready; i++)
+        {
+            usleep(10000);
+        }
+        CHECK(shared->nodes[station].ready);
+    }
+
+    // The match starts with the master up: nobody stands in
+    uint32_t captures = capture_for(2000000, 0);
+    CHECK_EQ(boards_while_alive, 0);
+
+    // The master goes silent: ALPHA stands in
+    master_alive = false;
+    usleep(HEARTBEAT_PERIOD_MS * 1000);
+    int64_t silent_us = last_heartbeat_us;
+    uint32_t outage_captures = capture_for(3000000, 0);
+    int64_t standin_us = wait_board(2, 3000000);
+    CHECK(standin_us != 0);
+    CHECK_EQ(first_boards[2].aggregator, host_air_node_id(2));
+    int64_t failover_ms = (standin_us - silent_us) / 1000;
+    CHECK(failover_ms <= MASTER_HEARTBEAT_TIMEOUT_MS + NODE_STATUS_PERIOD_MS + 2 * FAILOVER_POLL_MS + HEARTBEAT_PERIOD_MS);
+
+    // Its last captures settle, then it dies: BRAVO takes over
+    outage_captures += capture_for(1500000, 0);
+    wait_captures_applied();
+    usleep(STATUS_SETTLE_MS * 1000);
+    NodeShared_t alpha_at_death = shared->nodes[2];
+    kill(pids[2], SIGKILL);
+    waitpid(pids[2], NULL, 0);
+    int64_t killed_us = host_us();
+    outage_captures += capture_for(2000000, 2);
+    int64_t takeover_us = wait_board(1, (int64_t)NODE_STATUS_PERIOD_MAX_MS * (NODE_STATUS_TIMEOUT_PERIODS + 1) * 1000 + 3000000);
+    CHECK(takeover_us != 0);
+    int64_t takeover_ms = (takeover_us - killed_us) / 1000;
+    outage_captures += capture_for(2000000, 2);
+    wait_captures_applied();
+    usleep(STATUS_SETTLE_MS * 1000);
+
+    // Only the elected node ever stood in
+    CHECK_EQ(first_boards[3].at_us, 0);
+    CHECK_EQ(first_boards[4].at_us, 0);
+    CHECK_EQ(first_boards[5].at_us, 0);
+
+    // The master is back: the replica comes home, every capture in it
+    master_alive = true;
+    int64_t back_us = host_us();
+    int64_t handback_us = 0;
+    for(int i = 0; i < 500 && handback_us == 0; i++)
+    {
+        usleep(10000);
+        pthread_mutex_lock(&master_lock);
+        handback_us = handback.at_us;
+        pthread_mutex_unlock(&master_lock);
+    }
+    CHECK(handback_us != 0);
+    usleep(NODE_STATUS_PERIOD_MS * 1000 * 2);
+
+    pthread_mutex_lock(&master_lock);
+    CHECK_EQ(handback.aggregator, host_air_node_id(1));
+    CHECK_EQ(handback.entry_count, STATIONS - 1);
+    for(int i = 0; i < handback.entry_count; i++)
+    {
+        ScoreboardEntry_t entry;
+        memcpy(&entry, &handback.entries[i], sizeof(entry));
+        int station = station_of(entry.node_id);
+        const NodeShared_t * truth = station == 2 ? &alpha_at_death : &shared->nodes[station];
+        CHECK_EQ(entry.status.control_point, station_points[station]);
+        CHECK_EQ(entry.status.captures, truth->captures);
+        CHECK_EQ(entry.status.owner, truth->owner);
+    }
+    // Scoreboards stopped with the first heartbeat
+    CHECK(last_board.at_us < back_us + (int64_t)HEARTBEAT_PERIOD_MS * 1000 + 500000);
+    pthread_mutex_unlock(&master_lock);
+
+    shared->done = true;
+    master_stop = true;
+    pthread_join(rx, NULL);
+    pthread_join(heartbeat, NULL);
+    for(int station = 1; station < STATIONS; station++)
+    {
+        if(station != 2)
+        {
+            int status;
+            waitpid(pids[station], &status, 0);
+            CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+
+    REPORT("nodes", "%d, %d %% loss on the air", STATIONS - 1, LOSS_PCT);
+    REPORT("captures", "%" PRIu32 ", %" PRIu32 " without a master, none lost", captures + outage_captures, outage_captures);
+    REPORT("master silent to stand-in", "%" PRId64 " ms (heartbeat timeout %d ms)", failover_ms, MASTER_HEARTBEAT_TIMEOUT_MS);
+    REPORT("stand-in killed to takeover", "%" PRId64 " ms", takeover_ms);
+    REPORT("master back to handback", "%" PRId64 " ms", (handback_us - back_us) / 1000);
+    REPORT("scoreboard frames", "%" PRIu32 " for %d points, at most %d bytes each", scoreboard_frames, STATIONS - 1,
+           ESP_NOW_MAX_DATA_LEN);
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#include "app.h"
+#include "buttons.h"
+#include "storage.h"
+#include "error_signaling.h"
+
+/*
+ * Faults and their recovery, one process per boot with the RTC memory and
+ * the fault log in NVS handed on. A button stuck at boot is masked while the
+ * other team still plays, its fault is raised before NVS is up and written
+ * by fault_init(), and once released for BUTTON_UNMASK_MS the team plays
+ * again. A fatal fault before the fault log is loaded reboots with its
+ * record in RTC memory, drained into the log by the next boot, which is degraded and
+ * stores its time to recovery. After FAULT_MAX_REBOOTS fault reboots in a
+ * row the node stops rebooting and only shows the pattern; a power cycle
+ * starts over. Times to recovery are reported.
+ */
+
+#define RTC_MAX             4096
+#define WAIT_MS             10000
+#define PRESS_MS            100
+
+typedef struct
+{
+    uint8_t rtc[RTC_MAX];
+    size_t rtc_len;
+    FaultLog_t log;                 // The fault log blob in NVS
+} BootMemory_t;
+
+typedef struct
+{
+    BootMemory_t memory;            // At the end of the last boot
+    uint32_t unmask_ms;             // From the release of the stuck button to its unmasking
+    uint32_t button_recovery_ms;    // Stored for the stuck button
+    uint32_t reboot_recovery_ms;    // Stored for the fault reboot
+} Shared_t;
+
+typedef void (*BootScenario_t)(void);
+
+static Shared_t * shared;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t since_ms(int64_t start_us)
+{
+    return (uint32_t)((host_us() - start_us) / 1000);
+}
+
+static void save_memory(void)
+{
+    shared->memory.rtc_len = host_rtc_save(shared->memory.rtc, sizeof(shared->memory.rtc));
+    CHECK(shared->memory.rtc_len > 0);
+    memset(&shared->memory.log, 0, sizeof(shared->memory.log));
+    esp_err_t err = storage_get_fault_log(&shared->memory.log, sizeof(shared->memory.log));
+    CHECK(err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND);
+}
+
+// The reset: the next boot gets what this one left
+static void restart_hook(void)
+{
+    save_memory();
+    fflush(stdout);
+    _exit(0);
+}
+
+static void boot(esp_reset_reason_t reason, BootScenario_t scenario)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid > 0)
+    {
+        int status = 0;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return;
+    }
+
+    host_log_set_quiet(true);
+    host_set_reset_reason(reason);
+    host_set_restart_hook(restart_hook);
+    if(shared->memory.rtc_len > 0)
+    {
+        host_rtc_restore(shared->memory.rtc, shared->memory.rtc_len);
+    }
+    CHECK_OK(storage_init());
+    if(shared->memory.log.count > 0)
+    {
+        CHECK_OK(storage_set_fault_log(&shared->memory.log, sizeof(shared->memory.log)));
+    }
+
+    scenario();
+    save_memory();
+    fflush(stdout);
+    _exit(0);
+}
+
+static FaultLog_t stored_log(void)
+{
+    FaultLog_t log = { 0 };
+    CHECK_OK(storage_get_fault_log(&log, sizeof(log)));
+    return log;
+}
+
+static const FaultRecord_t * newest(const FaultLog_t * log)
+{
+    CHECK(log->count > 0);
+    return &log->records[(log->count - 1) % FAULT_LOG_LEN];
+}
+
+// A press of a team button, then the event the button task sent for it
+static bool press(Team_t team)
+{
+    host_gpio_input(teams[team].button_gpio, 0);
+    vTaskDelay(pdMS_TO_TICKS(PRESS_MS));
+    host_gpio_input(teams[team].button_gpio, 1);
+
+    AppEventMessage_t message;
+    if(!app_event_receive(&message, pdMS_TO_TICKS(PRESS_MS + 500)))
+        return false;
+    CHECK_EQ(message.type, APP_EVENT_BTN(team, PRESS_SHORT));
+    return true;
+}
+
+// Boot 1: RED stuck from power on
+static void stuck_button(void)
+{
+    host_gpio_input(teams[TEAM_RED].button_gpio, 0);
+    CHECK_OK(app_event_init());
+    CHECK_OK(button_init());
+    CHECK_EQ(button_get_masked(), BTN_TEAM_EVENT(TEAM_RED));
+
+    // Raised before NVS is up: written by fault_init()
+    CHECK_EQ(host_nvs_write_count(), 0);
+    CHECK_OK(fault_init());
+    FaultLog_t log = stored_log();
+    CHECK_EQ(log.count, 1);
+    CHECK_EQ(newest(&log)->code, BUTTON_ERROR);
+    CHECK_EQ(newest(&log)->detail, TEAM_RED);
+    CHECK_EQ(newest(&log)->recovery_ms, 0);
+    CHECK(!fault_is_degraded());
+
+    // The other team plays, the stuck button sends nothing even as it chatters
+    CHECK(xTaskCreate(button_task, "button", BUTTON_TASK_STACK_DEPTH, NULL, BUTTON_TASK_PRIORITY, NULL) == pdPASS);
+    CHECK(press(TEAM_BLUE));
+    for(int chatter = 0; chatter < 5; chatter++)
+    {
+        host_gpio_input(teams[TEAM_RED].button_gpio, 1);
+        vTaskDelay(1);
+        host_gpio_input(teams[TEAM_RED].button_gpio, 0);
+        vTaskDelay(pdMS_TO_TICKS(PRESS_MS));
+    }
+    AppEventMessage_t message;
+    CHECK(!app_event_receive(&message, pdMS_TO_TICKS(500)));
+    CHECK_EQ(button_get_masked(), BTN_TEAM_EVENT(TEAM_RED));
+
+    // Freed: used again BUTTON_UNMASK_MS after the release
+    int64_t release_us = host_us();
+    host_gpio_input(teams[TEAM_RED].button_gpio, 1);
+    while(button_get_masked() != 0)
+    {
+        CHECK(since_ms(release_us) < WAIT_MS);
+        vTaskDelay(1);
+    }
+    shared->unmask_ms = since_ms(release_us);
+    CHECK(shared->unmask_ms >= BUTTON_UNMASK_MS);
+    CHECK(shared->unmask_ms < BUTTON_UNMASK_MS + 3 * BUTTON_MASK_POLL_MS);
+    CHECK(press(TEAM_RED));
+    CHECK(press(TEAM_BLUE));
+
+    log = stored_log();
+    CHECK_EQ(log.count, 1);
+    shared->button_recovery_ms = newest(&log)->recovery_ms;
+    CHECK(shared->button_recovery_ms >= shared->unmask_ms);
+}
+
+static void fatal_task(void * arg)
+{
+    (void)arg;
+    signal_fatal_error(INIT_ERROR);
+}
+
+// A fatal fault: the restart hook ends the boot
+static void fatal_error(void)
+{
+    CHECK(xTaskCreate(fatal_task, "fatal", 4096, NULL, 5, NULL) == pdPASS);
+    vTaskDelay(pdMS_TO_TICKS(FAULT_REBOOT_DELAY_MS + WAIT_MS));
+    CHECK(false);
+}
+
+// Boot 2: a fatal fault before fault_init(), kept in RTC memory
+static void fatal_before_nvs(void)
+{
+    CHECK_EQ(stored_log().count, 1);
+    fatal_error();
+}
+
+// Boot 3: degraded, the record drained from RTC memory, playing again
+static void recover(void)
+{
+    CHECK_OK(fault_init());
+    CHECK(fault_is_degraded());
+    FaultLog_t log = stored_log();
+    CHECK_EQ(log.count, 2);
+    CHECK_EQ(log.records[0].code, BUTTON_ERROR);
+    CHECK_EQ(newest(&log)->code, INIT_ERROR);
+    CHECK_EQ(newest(&log)->recovery_ms, 0);
+
+    fault_mark_running();
+    log = stored_log();
+    shared->reboot_recovery_ms = newest(&log)->recovery_ms;
+    CHECK(shared->reboot_recovery_ms >= FAULT_REBOOT_DELAY_MS);
+    CHECK(shared->reboot_recovery_ms < FAULT_REBOOT_DELAY_MS + 1000);
+}
+
+// Boots 4 on: fatal again without playing in between
+static void fatal_after_nvs(void)
+{
+    CHECK_OK(fault_init());
+    fatal_error();
+}
+
+static void recover_then_fatal(void)
+{
+    recover();
+    fatal_error();
+}
+
+static void unexpected_restart(void)
+{
+    CHECK(false);
+}
+
+// The last boot: the pattern on, no more reboots
+static void give_up(void)
+{
+    host_set_restart_hook(unexpected_restart);
+    CHECK_OK(fault_init());
+    CHECK(fault_is_degraded());
+    uint32_t count = stored_log().count;
+    uint32_t leds_before = host_gpio_set_count();
+
+    CHECK(xTaskCreate(fatal_task, "fatal", 4096, NULL, 5, NULL) == pdPASS);
+    vTaskDelay(pdMS_TO_TICKS(FAULT_REBOOT_DELAY_MS + 1000));
+    CHECK_EQ(host_restart_count(), 0);
+    CHECK_EQ(stored_log().count, count + 1);
+    CHECK(host_gpio_set_count() > leds_before + 2);
+}
+
+// A power cycle: RTC memory is lost, the fault log is not
+static void power_cycle(void)
+{
+    CHECK_OK(fault_init());
+    CHECK(!fault_is_degraded());
+    CHECK_EQ(stored_log().count, 2 + FAULT_MAX_REBOOTS + 1);
+}
+
+int main(void)
+{
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(shared != MAP_FAILED);
+
+    boot(ESP_RST_POWERON, stuck_button);
+    boot(ESP_RST_SW, fatal_before_nvs);
+    boot(ESP_RST_SW, recover_then_fatal);
+    for(int reboot = 1; reboot < FAULT_MAX_REBOOTS; reboot++)
+    {
+        boot(ESP_RST_SW, fatal_after_nvs);
+    }
+    boot(ESP_RST_SW, give_up);
+    boot(ESP_RST_POWERON, power_cycle);
+
+    REPORT("stuck button unmasked", "%u ms after the release, %u ms after the fault", shared->unmask_ms, shared->button_recovery_ms);
+    REPORT("fault reboot recovered", "%u ms after the fault, %d ms shown", shared->reboot_recovery_ms, FAULT_REBOOT_DELAY_MS);
+    return 0;
+}
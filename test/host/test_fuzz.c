@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "buttons.h"
+#include "game_mode.h"
+#include "storage.h"
+
+/*
+ * Fuzz driver of the input-to-state pipeline: an input is decoded into
+ * button presses of arbitrary timing, timer expiries and network events,
+ * sent through the app event channel as their producers would, received as
+ * the app task would and replayed through the state machine. Each input
+ * must leave no event dropped by the channel, pass the match invariants
+ * after every step and hold the point no longer than the match lasted.
+ *
+ *   test_fuzz [executions]         random inputs from a fixed seed, executions per second
+ *   test_fuzz <input>...           the given inputs, e.g. a crash found by a campaign
+ *
+ * With -DDOMINION_FUZZ=ON and clang, fuzz_app is the same driver as a
+ * libFuzzer target for coverage-guided campaigns; AFL runs test_fuzz on
+ * one input file at a time.
+ */
+
+#define FUZZ_MAX_INPUT          1024
+#define FUZZ_RECORD_LEN         4
+#define FUZZ_MAX_EVENTS         (FUZZ_MAX_INPUT / FUZZ_RECORD_LEN * 32 + 1)
+#define FUZZ_DEFAULT_RUNS       20000
+#define FUZZ_SEED               0x5eed1234u
+
+// The producers, at the fastest their tasks can go
+#define FUZZ_TIMER_MIN_GAP_MS   1000        // One-shot timers, rearmed at most once a second
+#define FUZZ_SYNC_MIN_GAP_MS    1000        // The master's countdown beat
+#define FUZZ_CFG_MAX_BURST      32          // Config pushes from the retries of several masters
+// The app task: one event per loop, at the loop time the health check warns about
+#define FUZZ_APP_EVENT_MS       (HEALTH_LOOP_WARN_US / 1000)
+
+typedef struct
+{
+    uint32_t time_ms;
+    AppEvent_t event;
+} FuzzEvent_t;
+
+static FuzzEvent_t produced[FUZZ_MAX_EVENTS];
+static AppTraceEntry_t received[FUZZ_MAX_EVENTS];
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int event_compare(const void * a, const void * b)
+{
+    const FuzzEvent_t * left = a;
+    const FuzzEvent_t * right = b;
+    if(left->time_ms != right->time_ms)
+        return left->time_ms < right->time_ms ? -1 : 1;
+    // Stable on the time: the producers' own order
+    return left < right ? -1 : left > right;
+}
+
+/*
+ * The input: a mode and a duration byte, then 4-byte records. The low two
+ * bits of the first byte of a record pick the producer:
+ *   0, 1  a press of the buttons in the high bits, held for bytes 1-2 ms,
+ *         after byte 3 tenths of a second idle;
+ *   2     a timer expiry, byte 1 picks which, bytes 2-3 the seconds after the last one;
+ *   3     from the network, byte 1 picks a config burst or a sync event,
+ *         byte 2 the burst size, byte 3 the seconds after the last one.
+ */
+static size_t fuzz_decode(const uint8_t * data, size_t size)
+{
+    size_t count = 0;
+    uint32_t button_ms = 0;
+    uint32_t timer_ms = 0;
+    uint32_t network_ms = 0;
+
+    for(size_t at = 2; at + FUZZ_RECORD_LEN <= size; at += FUZZ_RECORD_LEN)
+    {
+        const uint8_t * record = &data[at];
+        switch(record[0] & 3)
+        {
+            case 0:
+            case 1:
+            {
+                // What button_task measures: debounced, polled, capped
+                uint32_t held_ms = (record[1] | record[2] << 8) % (PRESS_LONG_MAX_MS + 1);
+                held_ms = (held_ms / PRESS_INTER_TIME_MS + 1) * PRESS_INTER_TIME_MS;
+                button_ms += record[3] * 100 + DEBOUNCE_DELAY_MS + held_ms;
+                AppEvent_t event = button_classify(record[0] >> 2, held_ms);
+                if(event != APP_EVENT_MAX)
+                {
+                    produced[count++] = (FuzzEvent_t){ button_ms, event };
+                }
+                break;
+            }
+            case 2:
+                timer_ms += FUZZ_TIMER_MIN_GAP_MS + (record[2] | record[3] << 8) * 1000;
+                produced[count++] = (FuzzEvent_t){ timer_ms, record[1] & 1 ? APP_EVENT_TMR_MATCH_END : APP_EVENT_TMR_INIT_SETUP };
+                break;
+            default:
+                network_ms += FUZZ_SYNC_MIN_GAP_MS + record[3] * 1000;
+                if(record[1] & 1)
+                {
+                    produced[count++] = (FuzzEvent_t){ network_ms, APP_EVENT_SYNC_COUNTDOWN + (record[1] >> 1) % 3 };
+                    break;
+                }
+                for(int burst = 0; burst <= record[2] % FUZZ_CFG_MAX_BURST; burst++)
+                {
+                    produced[count++] = (FuzzEvent_t){ network_ms, APP_EVENT_CFG_UPDATED };
+                }
+                break;
+        }
+    }
+
+    qsort(produced, count, sizeof(produced[0]), event_compare);
+    return count;
+}
+
+// The app task takes the next event once done with the previous one; the
+// times of an input count from its first tick, the virtual clock goes on
+static size_t fuzz_drain(uint32_t until_ms, uint32_t * app_free_ms, TickType_t first_tick, size_t count)
+{
+    AppEventMessage_t message;
+    while(*app_free_ms <= until_ms && app_event_receive(&message, 0))
+    {
+        uint32_t queued_ms = (message.queued_tick - first_tick) * portTICK_PERIOD_MS;
+        uint32_t start_ms = queued_ms > *app_free_ms ? queued_ms : *app_free_ms;
+        received[count++] = (AppTraceEntry_t){ start_ms, (uint8_t)message.type };
+        *app_free_ms = start_ms + FUZZ_APP_EVENT_MS;
+    }
+    return count;
+}
+
+static void fuzz_config(const uint8_t * data)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.points_per_second = 1;
+    config.capture_delay_ms = (data[1] & 3) * 1000;
+    config.game_mode = data[0] % GAME_MODE_MAX;
+    config.match_duration_s = 60 + (data[1] >> 2) * 30;
+    CHECK_OK(storage_set_game_config(&config));
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+    if(size < 2 || size > FUZZ_MAX_INPUT)
+        return 0;
+
+    fuzz_config(data);
+    size_t count = fuzz_decode(data, size);
+
+    // Through the channel at the producers' times, the senders not waiting
+    AppEventStats_t before;
+    AppEventStats_t after;
+    app_event_get_stats(&before);
+    uint32_t app_free_ms = 0;
+    size_t delivered = 0;
+    TickType_t first_tick = xTaskGetTickCount();
+    int64_t first_us = (int64_t)first_tick * portTICK_PERIOD_MS * 1000;
+    for(size_t i = 0; i < count; i++)
+    {
+        delivered = fuzz_drain(produced[i].time_ms, &app_free_ms, first_tick, delivered);
+        host_clock_advance_to(first_us + (int64_t)produced[i].time_ms * 1000);
+        AppEventMessage_t message = { .type = produced[i].event, .payload = POOL_HANDLE_NONE };
+        CHECK_OK(app_event_send(&message, 0));
+    }
+    delivered = fuzz_drain(UINT32_MAX, &app_free_ms, first_tick, delivered);
+    app_event_get_stats(&after);
+
+    for(int prio = 0; prio < APP_EVENT_PRIO_MAX; prio++)
+    {
+        CHECK_EQ(after.dropped[prio], before.dropped[prio]);
+    }
+    CHECK_EQ(delivered, count - (after.coalesced - before.coalesced));
+
+    AppStatus_t status;
+    CHECK_OK(app_replay(received, delivered, &status));
+    uint32_t held_s = 0;
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        held_s += status.seconds[team];
+    }
+    uint32_t wall_ms = delivered > 0 ? received[delivered - 1].time_ms - received[0].time_ms : 0;
+    CHECK(held_s <= wall_ms / 1000 + 1);
+    return 0;
+}
+
+int LLVMFuzzerInitialize(int * argc, char *** argv)
+{
+    (void)argc;
+    (void)argv;
+    host_log_set_quiet(true);
+    host_clock_set_virtual();
+    CHECK_OK(storage_init());
+    CHECK_OK(app_event_init());
+    return 0;
+}
+
+#ifndef DOMINION_LIBFUZZER
+
+static uint32_t xorshift(uint32_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// The given input files, e.g. from AFL or a crash of a campaign
+static void run_files(int count, char ** paths)
+{
+    static uint8_t data[FUZZ_MAX_INPUT];
+    for(int i = 0; i < count; i++)
+    {
+        FILE * file = fopen(paths[i], "rb");
+        CHECK(file != NULL);
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        LLVMFuzzerTestOneInput(data, size);
+        printf("%-40s %zu bytes, ok\n", paths[i], size);
+    }
+}
+
+static void campaign(uint32_t runs)
+{
+    static uint8_t data[FUZZ_MAX_INPUT];
+    uint32_t rng = FUZZ_SEED;
+    uint64_t bytes = 0;
+    AppEventStats_t stats;
+
+    int64_t start_us = host_us();
+    for(uint32_t run = 0; run < runs; run++)
+    {
+        size_t size = 2 + xorshift(&rng) % (FUZZ_MAX_INPUT - 1);
+        for(size_t i = 0; i < size; i++)
+        {
+            data[i] = (uint8_t)xorshift(&rng);
+        }
+        LLVMFuzzerTestOneInput(data, size);
+        bytes += size;
+    }
+    int64_t elapsed_us = host_us() - start_us;
+
+    app_event_get_stats(&stats);
+    REPORT("random inputs", "%u executions, %.0f bytes each", runs, bytes / (double)runs);
+    REPORT("throughput", "%.0f executions/s", runs * 1e6 / elapsed_us);
+    REPORT("deepest queues", "control %lu, network %lu of %d, %lu coalesced",
+           (unsigned long)stats.high_water[APP_EVENT_PRIO_CONTROL], (unsigned long)stats.high_water[APP_EVENT_PRIO_NETWORK],
+           APP_EVENT_QUEUE_LEN_CONTROL, (unsigned long)stats.coalesced);
+}
+
+int main(int argc, char ** argv)
+{
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    char * end = NULL;
+    unsigned long runs = argc > 1 ? strtoul(argv[1], &end, 10) : FUZZ_DEFAULT_RUNS;
+    if(argc > 1 && *end != '\0')
+    {
+        run_files(argc - 1, argv + 1);
+        return 0;
+    }
+    campaign((uint32_t)runs);
+    return 0;
+}
+
+#endif
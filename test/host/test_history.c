@@ -0,0 +1,287 @@
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "esp_partition.h"
+
+#include "history.h"
+#include "storage.h"
+
+/*
+ * The match history ring on a fake flash partition: an export in the middle
+ * of a match reads the page still in RAM and writes nothing, the records of
+ * a match come back whole across page boundaries, and a flash write or
+ * erase error stops the recording until the next boot, which resumes after
+ * the last record written. A control point past the last is refused. Then
+ * the flash cost of a match hour, and a synthetic year on a fresh ring: the
+ * flash traffic of the ingest and the bytes each query reads.
+ */
+
+#define PARTITION_SIZE      0x20000
+#define SECTOR_SIZE         4096
+#define PRESS_GAP_MS        15000       // 3-byte press records
+// A year of three matches a day: a reboot every 5 matches, another control
+// point every 100, 149k presses in all
+#define YEAR_MATCHES        1095
+#define YEAR_PRESSES        136
+#define YEAR_REBOOT_EVERY   5
+#define YEAR_CP_EVERY       100
+// Target estimate of a query: flash reads at 15 MB/s plus 10 us per read call
+#define FLASH_BYTES_PER_US  15
+#define FLASH_CALL_US       10
+
+typedef struct
+{
+    uint32_t starts;
+    uint32_t presses;
+    uint32_t ends;
+    uint32_t last_match;        // Number of the last match started
+    size_t bytes;
+} Records_t;
+
+static uint32_t now_ms = 0;
+
+static esp_err_t count_sink(const uint8_t * data, size_t len, void * ctx)
+{
+    Records_t * records = ctx;
+    switch(data[0] & 0xF0)
+    {
+        case 0x10:
+            records->starts++;
+            // The match number follows the type, a little-endian base-128 varint
+            records->last_match = 0;
+            for(size_t i = 1; i < len && i < 6; i++)
+            {
+                records->last_match |= (uint32_t)(data[i] & 0x7F) << (7 * (i - 1));
+                if(!(data[i] & 0x80))
+                    break;
+            }
+            break;
+        case 0x20: records->presses++; break;
+        case 0x40: records->ends++; break;
+        default: CHECK(false);
+    }
+    records->bytes += len;
+    return ESP_OK;
+}
+
+static Records_t export_last(uint8_t match_count)
+{
+    Records_t records = { 0 };
+    CHECK_OK(history_export(0, match_count, HISTORY_ANY_CONTROL_POINT, count_sink, &records));
+    return records;
+}
+
+static void presses(int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        now_ms += PRESS_GAP_MS;
+        history_press((int8_t)(i % 2), 0, now_ms);
+    }
+}
+
+static void match_end(void)
+{
+    uint32_t seconds[2] = { 100, 200 };
+    uint32_t points[2] = { 100, 200 };
+    history_match_end(1, seconds, points, 2, now_ms);
+}
+
+// Mid-match exports read the page in RAM, nothing is flushed early
+static void test_export_mid_match(void)
+{
+    history_match_start(1, 0, 2, now_ms);
+    presses(100);
+
+    uint32_t writes = host_partition_write_count(HISTORY_PARTITION_LABEL);
+    Records_t records = export_last(1);
+    CHECK_EQ(host_partition_write_count(HISTORY_PARTITION_LABEL), writes);
+    CHECK_EQ(records.starts, 1);
+    CHECK_EQ(records.presses, 100);
+    CHECK_EQ(records.ends, 0);
+
+    // Again, past a few more pages: still all there, then closed
+    for(int round = 0; round < 5; round++)
+    {
+        presses(50);
+        records = export_last(1);
+        CHECK_EQ(records.presses, 150 + 50 * round);
+    }
+    match_end();
+    records = export_last(1);
+    CHECK_EQ(records.starts, 1);
+    CHECK_EQ(records.presses, 350);
+    CHECK_EQ(records.ends, 1);
+
+    // The batches filled their pages: one write per page of records
+    size_t pages = (records.bytes + 255) / 256;
+    uint32_t match_writes = host_partition_write_count(HISTORY_PARTITION_LABEL) - writes;
+    CHECK(match_writes <= pages + 1);
+}
+
+// A failed flush stops the recording: nothing more is written, what was
+// written is still exported, and the next boot records again
+static void test_write_error(void)
+{
+    history_match_start(2, 0, 2, now_ms);
+    host_partition_fail_write(HISTORY_PARTITION_LABEL, 0);
+    presses(200);
+    uint32_t writes = host_partition_write_count(HISTORY_PARTITION_LABEL);
+    presses(200);
+    match_end();
+    history_match_start(2, 0, 2, now_ms);
+    presses(10);
+    CHECK_EQ(host_partition_write_count(HISTORY_PARTITION_LABEL), writes);
+
+    // The first match whole, the start of the second: its presses were lost
+    Records_t records = export_last(2);
+    CHECK_EQ(records.starts, 2);
+    CHECK_EQ(records.presses, 350);
+    CHECK_EQ(records.ends, 1);
+
+    // The next boot resumes after the last record written
+    CHECK_OK(history_init());
+    history_match_start(2, 0, 2, now_ms);
+    presses(10);
+    match_end();
+    CHECK(host_partition_write_count(HISTORY_PARTITION_LABEL) > writes);
+    records = export_last(1);
+    CHECK_EQ(records.starts, 1);
+    CHECK_EQ(records.presses, 10);
+    CHECK_EQ(records.ends, 1);
+}
+
+// The erase of the next sector fails: no record goes past the sector end
+static void test_erase_error(void)
+{
+    host_partition_fail_erase(HISTORY_PARTITION_LABEL, 0);
+    history_match_start(3, 0, 2, now_ms);
+    presses(2 * SECTOR_SIZE / 3);
+    uint32_t writes = host_partition_write_count(HISTORY_PARTITION_LABEL);
+    presses(100);
+    match_end();
+    CHECK_EQ(host_partition_write_count(HISTORY_PARTITION_LABEL), writes);
+
+    CHECK_OK(history_init());
+    history_match_start(3, 0, 2, now_ms);
+    match_end();
+    Records_t records = export_last(1);
+    CHECK_EQ(records.starts, 1);
+    CHECK_EQ(records.ends, 1);
+}
+
+// A one-hour match with a press every 15 s
+static void report_cost(void)
+{
+    uint32_t writes = host_partition_write_count(HISTORY_PARTITION_LABEL);
+    history_match_start(4, 0, 2, now_ms);
+    presses(3600 * 1000 / PRESS_GAP_MS);
+    match_end();
+    // A page write each: the start on its own page, then full pages
+    uint32_t pages = host_partition_write_count(HISTORY_PARTITION_LABEL) - writes;
+    Records_t records = export_last(1);
+    REPORT("match hour", "%u presses, %zu bytes in %u flash pages, %.1f bytes per press",
+           records.presses, records.bytes, pages, (double)records.bytes / records.presses);
+    REPORT("matches in the ring", "%u one-hour matches", (unsigned)(PARTITION_SIZE / (pages * 256)));
+}
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The flash a query reads and its estimated time on the target
+static Records_t report_query(const char * name, uint32_t from_match, uint8_t match_count, uint8_t control_point)
+{
+    uint32_t calls = host_partition_read_count(HISTORY_PARTITION_LABEL);
+    uint64_t bytes = host_partition_read_bytes(HISTORY_PARTITION_LABEL);
+    Records_t records = { 0 };
+    CHECK_OK(history_export(from_match, match_count, control_point, count_sink, &records));
+    calls = host_partition_read_count(HISTORY_PARTITION_LABEL) - calls;
+    bytes = host_partition_read_bytes(HISTORY_PARTITION_LABEL) - bytes;
+
+    double estimate_ms = ((double)bytes / FLASH_BYTES_PER_US + (double)calls * FLASH_CALL_US) / 1000;
+    REPORT("query", "%-28s %4u matches, %7llu bytes read in %4u calls, %6.2f ms", name, records.starts, (unsigned long long)bytes, calls,
+           estimate_ms);
+    return records;
+}
+
+// A year of matches on a fresh ring, then the queries of a master pulling it
+static void report_year(void)
+{
+    host_partition_add(HISTORY_PARTITION_LABEL, ESP_PARTITION_TYPE_DATA, HISTORY_PARTITION_SUBTYPE, PARTITION_SIZE);
+    CHECK_OK(history_init());
+
+    int64_t start_us = host_us();
+    uint32_t reboots = 0;
+    for(uint32_t match = 0; match < YEAR_MATCHES; match++)
+    {
+        if(match > 0 && match % YEAR_REBOOT_EVERY == 0)
+        {
+            CHECK_OK(history_init());
+            reboots++;
+        }
+        history_match_start((match / YEAR_CP_EVERY) % CONTROL_POINT_MAX, 0, 2, now_ms);
+        presses(YEAR_PRESSES);
+        match_end();
+    }
+    int64_t ingest_us = host_us() - start_us;
+
+    uint32_t records = YEAR_MATCHES * (YEAR_PRESSES + 2);
+    uint32_t writes = host_partition_write_count(HISTORY_PARTITION_LABEL);
+    REPORT("year ingest", "%u matches, %u presses, %u reboots, %u records in %lld ms on the host",
+           YEAR_MATCHES, YEAR_MATCHES * YEAR_PRESSES, reboots, records, (long long)ingest_us / 1000);
+    REPORT("year flash", "%u sector erases, %u page writes, %.1f records per write",
+           host_partition_erase_count(HISTORY_PARTITION_LABEL), writes, (double)records / writes);
+
+    // The newest matches only read the sectors they are in
+    Records_t last = report_query("last match", 0, 1, HISTORY_ANY_CONTROL_POINT);
+    CHECK_EQ(last.starts, 1);
+    CHECK_EQ(last.presses, YEAR_PRESSES);
+    // The numbers go on from the matches of the tests before
+    uint32_t first = last.last_match - YEAR_MATCHES + 1;
+    CHECK_EQ(report_query("last 10 matches", 0, 10, HISTORY_ANY_CONTROL_POINT).starts, 10);
+    CHECK_EQ(report_query("last 32 matches", 0, 32, HISTORY_ANY_CONTROL_POINT).starts, 32);
+    CHECK_EQ(report_query("20 matches from #950", first + 949, 20, HISTORY_ANY_CONTROL_POINT).starts, 20);
+
+    // Matches 900 to 999 were played as control point 4, the ring has lost
+    // the oldest of them: only the sectors holding the point are read
+    uint64_t before = host_partition_read_bytes(HISTORY_PARTITION_LABEL);
+    Records_t point = report_query("control point 4 from #800", first + 799, 255, 4);
+    CHECK(point.starts > 0 && point.starts <= YEAR_CP_EVERY);
+    CHECK(host_partition_read_bytes(HISTORY_PARTITION_LABEL) - before < PARTITION_SIZE / 2);
+
+    // A pull with nothing new reads no flash
+    uint64_t bytes = host_partition_read_bytes(HISTORY_PARTITION_LABEL);
+    Records_t none = report_query("nothing new since last pull", last.last_match + 1, 32, HISTORY_ANY_CONTROL_POINT);
+    CHECK_EQ(none.starts + none.presses + none.ends, 0);
+    CHECK(host_partition_read_bytes(HISTORY_PARTITION_LABEL) == bytes);
+}
+
+// A control point past the last is refused, not shifted into the filter
+static void test_control_point(void)
+{
+    Records_t records = { 0 };
+    CHECK_OK(history_export(0, 1, CONTROL_POINT_MAX - 1, count_sink, &records));
+    CHECK_EQ(history_export(0, 1, CONTROL_POINT_MAX, count_sink, &records), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(history_export(0, 1, 40, count_sink, &records), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(records.starts + records.presses + records.ends, 0);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    host_partition_add(HISTORY_PARTITION_LABEL, ESP_PARTITION_TYPE_DATA, HISTORY_PARTITION_SUBTYPE, PARTITION_SIZE);
+    CHECK_OK(history_init());
+
+    test_export_mid_match();
+    test_write_error();
+    test_erase_error();
+    test_control_point();
+    report_cost();
+    report_year();
+    return 0;
+}
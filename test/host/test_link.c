@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "network_double.h"
+#include "esp_timer.h"
+
+#include "link.h"
+#include "network.h"
+#include "config.h"
+
+/*
+ * The status pacing of link.c over a field of mixed links, one process per
+ * node on the virtual clock, polled as the failover task does: a status on
+ * every capture and once a period, each acknowledged by the master over a
+ * link with its own loss and round trip. Every node plays the same captures
+ * twice, at the fixed NODE_STATUS_PERIOD_MS and at the period link.c picks.
+ * Near nodes keep the fixed period, nodes at the edge and behind relays back
+ * off, captures go out at the next poll either way and, lost, are not held
+ * longer than at the fixed period. Reported per kind of
+ * link and for the field: frames and air time per node-hour, share of them
+ * delivered, capture latency to the master, median and p99.
+ */
+
+#define SIM_S               3600
+#define CAPTURE_MEAN_S      15          // Between two captures on one node
+#define CAPTURES_MAX        512
+#define IN_FLIGHT_MAX       16
+
+typedef enum
+{
+    PACING_FIXED,
+    PACING_LINK,
+    PACING_MAX
+} Pacing_t;
+
+typedef struct
+{
+    const char * name;
+    int nodes;
+    uint32_t loss_pct;          // Each way
+    uint32_t rtt_ms;
+    int8_t rssi;                // 0 relayed over ESP-NOW
+    uint32_t airtime_us;        // Of a status with its MAC retries, at the rate the link allows
+} LinkClass_t;
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t delivered;
+    uint64_t airtime_us;
+    uint32_t captures;
+    uint32_t latency_ms[CAPTURES_MAX];
+    uint16_t period_ms;
+} NodeResult_t;
+
+typedef struct
+{
+    int64_t at_us;
+    bool ack;                   // Else a status on its way to the master
+    uint32_t value;             // Sequence number of the ack, captures in the status
+} InFlight_t;
+
+static const LinkClass_t classes[] =
+{
+    { "near",    10,  1,  40, -55,  300 },
+    { "edge",     6, 25, 350, -83, 2500 },
+    { "relayed",  4, 10, 700,   0, 1500 },
+};
+
+#define CLASS_COUNT         (sizeof(classes) / sizeof(classes[0]))
+#define NODE_COUNT          20
+
+static NodeResult_t (*results)[NODE_COUNT];
+
+static bool drawn(unsigned * seed, uint32_t pct)
+{
+    return (uint32_t)(rand_r(seed) % 100) < pct;
+}
+
+// One node in its own process: link.c keeps one link
+static void node_run(const LinkClass_t * link_class, int node, Pacing_t pacing, NodeResult_t * result)
+{
+    host_clock_set_virtual();
+    host_log_set_quiet(true);
+    network_double_set_rssi(link_class->rssi);
+    CHECK_OK(link_init());
+
+    // The same captures in both runs, the losses drawn apart
+    unsigned capture_seed = 1000 + node;
+    unsigned loss_seed = 2000 + node + 100 * pacing;
+    int64_t capture_us[CAPTURES_MAX];
+    int64_t next_capture_us = (int64_t)(rand_r(&capture_seed) % (2 * CAPTURE_MEAN_S * 1000)) * 1000;
+
+    InFlight_t in_flight[IN_FLIGHT_MAX];
+    int in_flight_count = 0;
+    uint32_t captures = 0;
+    uint32_t sent_captures = 0;
+    uint32_t master_captures = 0;
+    uint32_t seq = 0;
+    int64_t last_status_us = 0;
+
+    for(int64_t now = 0; now < (int64_t)SIM_S * 1000000; now += FAILOVER_POLL_MS * 1000)
+    {
+        host_clock_advance_to(now);
+
+        // What the air brings back: statuses to the master, acks to the node
+        for(int i = 0; i < in_flight_count; i++)
+        {
+            if(in_flight[i].at_us > now)
+                continue;
+
+            if(in_flight[i].ack)
+            {
+                StatusAckPayload_t ack = { .seq = in_flight[i].value };
+                CHECK_OK(network_double_deliver(MSG_STATUS_ACK, NODE_ID_MASTER, network_get_node_id(), &ack, sizeof(ack)));
+            }
+            else
+            {
+                for(; master_captures < in_flight[i].value; master_captures++)
+                {
+                    result->latency_ms[master_captures] = (uint32_t)((in_flight[i].at_us - capture_us[master_captures]) / 1000);
+                }
+            }
+            in_flight[i--] = in_flight[--in_flight_count];
+        }
+
+        while(next_capture_us <= now && captures < CAPTURES_MAX)
+        {
+            capture_us[captures++] = next_capture_us;
+            next_capture_us += (int64_t)(rand_r(&capture_seed) % (2 * CAPTURE_MEAN_S * 1000)) * 1000;
+        }
+
+        // As failover_task: captures right away, the rest once a period
+        uint32_t period_ms = link_get_period_ms();
+        if(pacing == PACING_FIXED)
+            period_ms = NODE_STATUS_PERIOD_MS;
+
+        bool changed = captures != sent_captures;
+        if(!changed && now - last_status_us < (int64_t)period_ms * 1000)
+            continue;
+
+        last_status_us = now;
+        sent_captures = captures;
+        link_sent(++seq, changed);
+        result->frames++;
+        result->airtime_us += link_class->airtime_us;
+
+        if(drawn(&loss_seed, link_class->loss_pct))
+            continue;
+
+        result->delivered++;
+        CHECK(in_flight_count + 2 <= IN_FLIGHT_MAX);
+        in_flight[in_flight_count++] = (InFlight_t){ now + link_class->rtt_ms * 500, false, captures };
+        if(!drawn(&loss_seed, link_class->loss_pct))
+        {
+            in_flight[in_flight_count++] = (InFlight_t){ now + link_class->rtt_ms * 1000, true, seq };
+        }
+    }
+
+    // Every capture reached the master
+    CHECK(captures > SIM_S / CAPTURE_MEAN_S / 2);
+    CHECK(master_captures + 1 >= captures);
+    result->captures = master_captures;
+
+    LinkStats_t stats;
+    link_get_stats(&stats);
+    result->period_ms = stats.period_ms;
+}
+
+static int compare_u32(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t delivered;
+    uint64_t airtime_us;
+    uint32_t captures;
+    uint32_t latency_ms[NODE_COUNT * CAPTURES_MAX];
+} Totals_t;
+
+static void totals_add(Totals_t * totals, const NodeResult_t * result)
+{
+    totals->frames += result->frames;
+    totals->delivered += result->delivered;
+    totals->airtime_us += result->airtime_us;
+    memcpy(&totals->latency_ms[totals->captures], result->latency_ms, result->captures * sizeof(uint32_t));
+    totals->captures += result->captures;
+}
+
+// Sorts the latencies, returns the p99
+static uint32_t report(const char * name, Pacing_t pacing, Totals_t * totals, int nodes)
+{
+    qsort(totals->latency_ms, totals->captures, sizeof(uint32_t), compare_u32);
+    uint32_t p99_ms = totals->latency_ms[totals->captures * 99 / 100];
+    double hours = nodes * SIM_S / 3600.0;
+    REPORT("link", "%-8s %-5s %5.0f frames/node-h, %5.2f s air/node-h, %3u%% delivered, capture %4u ms median %5u ms p99",
+           name, pacing == PACING_FIXED ? "fixed" : "link", totals->frames / hours, totals->airtime_us / 1e6 / hours,
+           totals->delivered * 100 / totals->frames, totals->latency_ms[totals->captures / 2], p99_ms);
+    return p99_ms;
+}
+
+int main(void)
+{
+    results = mmap(NULL, sizeof(NodeResult_t) * NODE_COUNT * PACING_MAX, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(results != MAP_FAILED);
+
+    pid_t pids[PACING_MAX][NODE_COUNT];
+    int node = 0;
+    for(size_t c = 0; c < CLASS_COUNT; c++)
+    {
+        for(int i = 0; i < classes[c].nodes; i++, node++)
+        {
+            for(Pacing_t pacing = 0; pacing < PACING_MAX; pacing++)
+            {
+                fflush(stdout);
+                pids[pacing][node] = fork();
+                CHECK(pids[pacing][node] >= 0);
+                if(pids[pacing][node] == 0)
+                {
+                    node_run(&classes[c], node, pacing, &results[pacing][node]);
+                    _exit(0);
+                }
+            }
+        }
+    }
+    CHECK_EQ(node, NODE_COUNT);
+    for(Pacing_t pacing = 0; pacing < PACING_MAX; pacing++)
+    {
+        for(node = 0; node < NODE_COUNT; node++)
+        {
+            int status;
+            CHECK(waitpid(pids[pacing][node], &status, 0) == pids[pacing][node]);
+            CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+
+    static Totals_t field[PACING_MAX];
+    static Totals_t per_class[PACING_MAX];
+    node = 0;
+    for(size_t c = 0; c < CLASS_COUNT; c++)
+    {
+        memset(per_class, 0, sizeof(per_class));
+        for(int i = 0; i < classes[c].nodes; i++, node++)
+        {
+            const NodeResult_t * fixed = &results[PACING_FIXED][node];
+            const NodeResult_t * paced = &results[PACING_LINK][node];
+
+            // A good link keeps the period but for a burst of losses, a poor one backs off to the longest
+            if(classes[c].loss_pct <= LINK_LOSS_GOOD_PCT)
+            {
+                CHECK_EQ(paced->period_ms, NODE_STATUS_PERIOD_MS);
+                CHECK(paced->frames * 10 >= fixed->frames * 9);
+            }
+            else
+            {
+                CHECK_EQ(paced->period_ms, NODE_STATUS_PERIOD_MAX_MS);
+                CHECK(paced->frames * 2 < fixed->frames);
+            }
+
+            for(Pacing_t pacing = 0; pacing < PACING_MAX; pacing++)
+            {
+                totals_add(&per_class[pacing], &results[pacing][node]);
+                totals_add(&field[pacing], &results[pacing][node]);
+            }
+        }
+        // A capture lost on a poor link goes again as soon as at the fixed period
+        uint32_t fixed_p99_ms = report(classes[c].name, PACING_FIXED, &per_class[PACING_FIXED], classes[c].nodes);
+        uint32_t link_p99_ms = report(classes[c].name, PACING_LINK, &per_class[PACING_LINK], classes[c].nodes);
+        CHECK(link_p99_ms <= fixed_p99_ms + NODE_STATUS_PERIOD_MS / 2);
+    }
+
+    // The field: less than half the air for the same captures
+    CHECK(field[PACING_LINK].airtime_us * 2 < field[PACING_FIXED].airtime_us);
+    for(Pacing_t pacing = 0; pacing < PACING_MAX; pacing++)
+    {
+        report("field", pacing, &field[pacing], NODE_COUNT);
+    }
+    return 0;
+}
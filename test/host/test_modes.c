@@ -0,0 +1,161 @@
+#include <string.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "game_mode.h"
+#include "storage.h"
+
+/*
+ * Every game mode through a replayed event script: the state, owner,
+ * captures, hold times, points and winner at the end of each script are
+ * checked against the rules of the mode. A runtime mode build plays all the
+ * scripts, a build with one mode compiled in plays its own.
+ */
+
+#define T_S(s)  ((s) * 1000)
+
+typedef struct
+{
+    const char * name;
+    GameModeId_t mode;
+    const AppTraceEntry_t * trace;
+    size_t count;
+    AppStatus_t expected;       // seq and time left not checked
+} ModeScript_t;
+
+#define SCRIPT(mode_, trace_, ...) { .name = #trace_, .mode = mode_, .trace = trace_, .count = sizeof(trace_) / sizeof(trace_[0]), .expected = { __VA_ARGS__ } }
+
+// Any press captures, the longest hold wins when the time is up; presses of
+// the owner change nothing
+static const AppTraceEntry_t domination[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(1),   APP_EVENT_BTN_RED_SHORT },
+    { T_S(11),  APP_EVENT_BTN_BLUE_MEDIUM },
+    { T_S(21),  APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(41),  APP_EVENT_TMR_MATCH_END },
+};
+
+// The hill is neutralized before it changes hands, nobody scores meanwhile
+static const AppTraceEntry_t koth[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(1),   APP_EVENT_BTN_RED_SHORT },
+    { T_S(21),  APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(26),  APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(36),  APP_EVENT_BTN_RED_MEDIUM },
+    { T_S(50),  APP_EVENT_TMR_MATCH_END },
+};
+
+// Short presses do not arm, a long one does; the other team defuses
+static const AppTraceEntry_t bomb_defused[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(1),   APP_EVENT_BTN_RED_SHORT },
+    { T_S(2),   APP_EVENT_BTN_RED_LONG },
+    { T_S(10),  APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(12),  APP_EVENT_BTN_RED_LONG },
+    { T_S(20),  APP_EVENT_BTN_BLUE_LONG },
+};
+
+// Nobody defuses: the fuse, i.e. the match timer, goes off
+static const AppTraceEntry_t bomb_exploded[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(2),   APP_EVENT_BTN_BLUE_LONG },
+    { T_S(2) + BOMB_FUSE_TIME_MS, APP_EVENT_TMR_MATCH_END },
+};
+
+// Held uninterrupted for TIMED_CAPTURE_HOLD_MS: won on the scoring tick,
+// before the match timer; a press after the end changes nothing
+static const AppTraceEntry_t timed_capture[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(1),   APP_EVENT_BTN_RED_SHORT },
+    { T_S(31),  APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(31) + TIMED_CAPTURE_HOLD_MS + T_S(30), APP_EVENT_BTN_RED_SHORT },
+};
+
+// Timed capture with no long enough hold: the time is up, most points win
+static const AppTraceEntry_t timed_capture_timeout[] =
+{
+    { T_S(0),   APP_EVENT_TMR_INIT_SETUP },
+    { T_S(1),   APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(101), APP_EVENT_BTN_RED_SHORT },
+    { T_S(201), APP_EVENT_BTN_BLUE_SHORT },
+    { T_S(231), APP_EVENT_BTN_BOTH_LONG },
+};
+
+static const ModeScript_t scripts[] =
+{
+    SCRIPT(GAME_MODE_DOMINATION, domination,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_BLUE, .captures = 2,
+           .seconds[TEAM_BLUE] = 30, .seconds[TEAM_RED] = 10, .points[TEAM_BLUE] = 30, .points[TEAM_RED] = 10),
+    SCRIPT(GAME_MODE_KOTH, koth,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_RED, .captures = 2,
+           .seconds[TEAM_BLUE] = 10, .seconds[TEAM_RED] = 20, .points[TEAM_BLUE] = 10, .points[TEAM_RED] = 20),
+    SCRIPT(GAME_MODE_BOMB, bomb_defused,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_BLUE),
+    SCRIPT(GAME_MODE_BOMB, bomb_exploded,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_BLUE),
+    SCRIPT(GAME_MODE_TIMED_CAPTURE, timed_capture,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_BLUE, .captures = 2,
+           .seconds[TEAM_BLUE] = TIMED_CAPTURE_HOLD_MS / 1000, .seconds[TEAM_RED] = 30,
+           .points[TEAM_BLUE] = TIMED_CAPTURE_HOLD_MS / 1000, .points[TEAM_RED] = 30),
+    SCRIPT(GAME_MODE_TIMED_CAPTURE, timed_capture_timeout,
+           .state = APP_STATE_FINISHED, .owner = TEAM_NONE, .winner = TEAM_BLUE, .captures = 3,
+           .seconds[TEAM_BLUE] = 130, .seconds[TEAM_RED] = 100, .points[TEAM_BLUE] = 130, .points[TEAM_RED] = 100),
+};
+
+static void store_config(GameModeId_t mode)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.match_duration_s = 600;
+    config.points_per_second = 1;
+    config.game_mode = mode;
+    CHECK_OK(storage_set_game_config(&config));
+}
+
+static void play(const ModeScript_t * script)
+{
+    store_config(script->mode);
+    AppStatus_t result;
+    CHECK_OK(app_replay(script->trace, script->count, &result));
+    CHECK(app_check_invariants());
+
+    const AppStatus_t * expected = &script->expected;
+    printf("%-40s %s wins, %u captures\n", script->name,
+           result.winner == TEAM_NONE ? "nobody" : teams[result.winner].name, result.captures);
+    CHECK_EQ(result.state, expected->state);
+    CHECK_EQ(result.owner, expected->owner);
+    CHECK_EQ(result.winner, expected->winner);
+    CHECK_EQ(result.captures, expected->captures);
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        CHECK_EQ(result.seconds[team], expected->seconds[team]);
+        CHECK_EQ(result.points[team], expected->points[team]);
+    }
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+
+    int played = 0;
+    for(size_t i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++)
+    {
+#if !CONFIG_DOMINION_GAME_MODE_RUNTIME
+        // The compiled mode plays whatever the config says
+        if(scripts[i].mode != GAME_MODE_COMPILED.id)
+            continue;
+#endif
+        play(&scripts[i]);
+        played++;
+    }
+    CHECK(played > 0);
+    return 0;
+}
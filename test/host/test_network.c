@@ -0,0 +1,333 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#include "network.h"
+#include "transport.h"
+#include "auth.h"
+#include "storage.h"
+#include "config.h"
+
+/*
+ * The relay topology on the simulated air, one process per node:
+ *
+ *   master ==UDP== node 1 --ESP-NOW-- node 2 --ESP-NOW-- node 3 --ESP-NOW-- node 4
+ *
+ * Only node 1 is in range of the access point. Every node sends statuses to
+ * the master and a few broadcasts, the master sends to node 3, and node 3 to
+ * node 1. With DOMINION_RELAY_HOPS at 2, node 4 is one hop too far.
+ *
+ * The master is the test process, on the wire behind the access point: it
+ * verifies the frames itself, as the master firmware does. The latencies
+ * are those of the host, the hops and the delivery ratio those of the
+ * firmware over a lossy air.
+ */
+
+#define STATIONS            5           // The master and 4 nodes
+#define MASTER              0
+#define FRAMES_PER_NODE     100
+#define BROADCASTS_PER_NODE 10
+#define SEND_PERIOD_MS      10
+#define LOSS_PCT            5
+#define MIN_DELIVERY_PCT    75          // 3 hops at 5 % loss deliver 86 %
+
+typedef struct __attribute__((packed))
+{
+    uint8_t station;
+    uint16_t index;
+    int64_t sent_us;
+} TestPayload_t;
+
+typedef struct
+{
+    uint32_t received;
+    uint32_t hops;
+    int64_t latency_us;
+    int64_t latency_max_us;
+} Delivery_t;
+
+typedef struct
+{
+    volatile int ready;
+    volatile bool go;
+    volatile bool done;
+    Delivery_t to_master[STATIONS];
+    uint32_t broadcasts_at_master[STATIONS];
+    uint32_t duplicates_at_master;
+    uint32_t downlink_received[STATIONS];
+    uint32_t unicast_received[STATIONS];
+    uint32_t broadcasts_received[STATIONS];
+} Shared_t;
+
+static Shared_t * shared;
+static int self;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---- Nodes -----------------------------------------------------------------
+
+static void on_status(const FrameHeader_t * header, const uint8_t * payload)
+{
+    if(header->dst_node == NODE_ID_BROADCAST)
+    {
+        __atomic_add_fetch(&shared->broadcasts_received[self], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void on_ack(const FrameHeader_t * header, const uint8_t * payload)
+{
+    uint32_t * counter = header->src_node == NODE_ID_MASTER ? &shared->downlink_received[self] : &shared->unicast_received[self];
+    __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+}
+
+static void node_run(int station)
+{
+    self = station;
+    host_air_join(station);
+    CHECK_OK(network_init());
+    CHECK(xTaskCreate(network_task, "network", 4096, NULL, NETWORK_TASK_PRIORITY, NULL) == pdPASS);
+    CHECK_OK(network_register_handler(MSG_NODE_STATUS, on_status));
+    CHECK_OK(network_register_handler(MSG_STATUS_ACK, on_ack));
+    CHECK_EQ(network_get_node_id(), host_air_node_id(station));
+
+    if(station == 1)
+    {
+        network_wait_connected();
+    }
+    __atomic_add_fetch(&shared->ready, 1, __ATOMIC_SEQ_CST);
+    while(!shared->go)
+    {
+        vTaskDelay(1);
+    }
+
+    for(int i = 0; i < FRAMES_PER_NODE; i++)
+    {
+        TestPayload_t payload = { .station = station, .index = i, .sent_us = host_us() };
+        CHECK_OK(network_send_to_master(MSG_NODE_STATUS, &payload, sizeof(payload)));
+        if(i < BROADCASTS_PER_NODE)
+        {
+            CHECK_OK(network_send(NODE_ID_BROADCAST, MSG_NODE_STATUS, &payload, sizeof(payload)));
+        }
+        if(station == 3)
+        {
+            CHECK_OK(network_send(host_air_node_id(1), MSG_STATUS_ACK, &payload, sizeof(payload)));
+        }
+        vTaskDelay(pdMS_TO_TICKS(SEND_PERIOD_MS));
+    }
+
+    // Relaying for the others until the end
+    while(!shared->done)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    _exit(0);
+}
+
+// ---- Master ----------------------------------------------------------------
+
+static int master_sock = -1;
+static uint32_t master_seq = 0;
+
+static void * master_rx_task(void * arg)
+{
+    uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    while(!shared->done)
+    {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(master_sock, frame, sizeof(frame), 0, (struct sockaddr *)&from, &from_len);
+        int64_t now_us = host_us();
+        FrameHeader_t * header = (FrameHeader_t *)frame;
+        if(len < (ssize_t)sizeof(FrameHeader_t) || header->magic != PROTOCOL_MAGIC ||
+           len != (ssize_t)(sizeof(FrameHeader_t) + header->payload_len + AUTH_TAG_LEN))
+        {
+            continue;
+        }
+
+        uint8_t ttl = header->ttl;
+        header->ttl = 0;
+        size_t signed_len = sizeof(FrameHeader_t) + header->payload_len;
+        CHECK_OK(auth_verify(frame, signed_len, frame + signed_len));
+        if(!auth_check_replay(header->src_node, header->seq))
+        {
+            shared->duplicates_at_master++;
+            continue;
+        }
+
+        int station = header->src_node - host_air_node_id(0);
+        CHECK(station > MASTER && station < STATIONS);
+        if(header->type != MSG_NODE_STATUS)
+        {
+            continue;
+        }
+        if(header->dst_node == NODE_ID_BROADCAST)
+        {
+            shared->broadcasts_at_master[station]++;
+            continue;
+        }
+
+        const TestPayload_t * payload = (const TestPayload_t *)(frame + sizeof(FrameHeader_t));
+        Delivery_t * delivery = &shared->to_master[station];
+        int64_t latency_us = now_us - payload->sent_us;
+        delivery->received++;
+        delivery->hops = CONFIG_DOMINION_RELAY_HOPS - ttl;
+        delivery->latency_us += latency_us;
+        delivery->latency_max_us = latency_us > delivery->latency_max_us ? latency_us : delivery->latency_max_us;
+    }
+    return NULL;
+}
+
+static void master_send(uint16_t dst_node, MessageType_t type, const void * payload, uint16_t payload_len)
+{
+    uint8_t frame[PROTOCOL_MAX_FRAME_LEN];
+    FrameHeader_t * header = (FrameHeader_t *)frame;
+    *header = (FrameHeader_t)
+    {
+        .magic = PROTOCOL_MAGIC,
+        .version = PROTOCOL_VERSION,
+        .type = type,
+        .flags = FRAME_FLAG_AUTH,
+        .src_node = NODE_ID_MASTER,
+        .dst_node = dst_node,
+        .seq = ++master_seq,
+        .payload_len = payload_len,
+    };
+    memcpy(frame + sizeof(FrameHeader_t), payload, payload_len);
+    size_t len = sizeof(FrameHeader_t) + payload_len;
+    CHECK_OK(auth_sign(frame, len, frame + len));
+    header->ttl = CONFIG_DOMINION_RELAY_HOPS;
+
+    struct sockaddr_in dest = { .sin_family = AF_INET, .sin_port = htons(NODE_UDP_PORT), .sin_addr.s_addr = htonl(INADDR_BROADCAST) };
+    CHECK(sendto(master_sock, frame, len + AUTH_TAG_LEN, 0, (struct sockaddr *)&dest, sizeof(dest)) > 0);
+}
+
+static void report_delivery(int station)
+{
+    const Delivery_t * delivery = &shared->to_master[station];
+    char name[48];
+    snprintf(name, sizeof(name), "node %d to master:", station);
+    printf("%-40s %3" PRIu32 " %% delivered, %" PRIu32 " hop(s), %.0f us mean, %.0f us max\n", name,
+           delivery->received * 100 / FRAMES_PER_NODE, delivery->hops,
+           delivery->received > 0 ? (double)delivery->latency_us / delivery->received : 0.0, (double)delivery->latency_max_us);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(shared != MAP_FAILED);
+
+    // One fleet key, stored before the nodes fork with it
+    CHECK_OK(storage_init());
+    nvs_handle_t handle;
+    uint8_t key[AUTH_KEY_LEN] = "relay topology test key";
+    CHECK_OK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle));
+    CHECK_OK(nvs_set_blob(handle, KEY_AUTH_KEY, key, AUTH_KEY_LEN));
+    CHECK_OK(nvs_commit(handle));
+    nvs_close(handle);
+    CHECK_OK(auth_init());
+
+    host_air_init(STATIONS);
+    host_air_set_loss(LOSS_PCT);
+    for(int station = 2; station < STATIONS; station++)
+    {
+        host_air_set_ap_range(station, false);
+        host_air_set_espnow_range(station - 1, station, true);
+    }
+
+    pid_t pids[STATIONS];
+    for(int station = 1; station < STATIONS; station++)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        pids[station] = fork();
+        CHECK(pids[station] >= 0);
+        if(pids[station] == 0)
+        {
+            node_run(station);
+        }
+    }
+
+    host_air_join_wired(MASTER);
+    master_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK(master_sock >= 0);
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(MASTER_UDP_PORT), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    CHECK(bind(master_sock, (struct sockaddr *)&local, sizeof(local)) == 0);
+    struct timeval timeout = { .tv_usec = 100000 };
+    setsockopt(master_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    pthread_t rx;
+    pthread_create(&rx, NULL, master_rx_task, NULL);
+
+    int64_t deadline_us = host_us() + 5000000;
+    while(shared->ready < STATIONS - 1 && host_us() < deadline_us)
+    {
+        usleep(1000);
+    }
+    CHECK_EQ(shared->ready, STATIONS - 1);
+    shared->go = true;
+
+    for(int i = 0; i < FRAMES_PER_NODE; i++)
+    {
+        TestPayload_t payload = { .station = MASTER, .index = i, .sent_us = host_us() };
+        master_send(host_air_node_id(3), MSG_STATUS_ACK, &payload, sizeof(payload));
+        usleep(SEND_PERIOD_MS * 1000);
+    }
+    usleep(500000);
+
+    shared->done = true;
+    pthread_join(rx, NULL);
+    for(int station = 1; station < STATIONS; station++)
+    {
+        int status;
+        waitpid(pids[station], &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    for(int station = 1; station < STATIONS; station++)
+    {
+        report_delivery(station);
+    }
+    REPORT("master to node 3", "%" PRIu32 " %% delivered, 2 hops", shared->downlink_received[3] * 100 / FRAMES_PER_NODE);
+    REPORT("node 3 to node 1", "%" PRIu32 " %% delivered, 1 hop", shared->unicast_received[1] * 100 / FRAMES_PER_NODE);
+    REPORT("air loss", "%d %% per frame and receiver", LOSS_PCT);
+    for(int station = 1; station < STATIONS; station++)
+    {
+        HostAirStats_t stats;
+        host_air_stats(station, &stats);
+        char name[48];
+        snprintf(name, sizeof(name), "node %d on the air:", station);
+        printf("%-40s %" PRIu32 " ESP-NOW frames, %" PRIu32 " datagrams\n", name, stats.espnow_frames, stats.ip_datagrams);
+    }
+
+    // Through 0, 1 and 2 relays; the third is past the hop limit
+    for(int station = 1; station <= 3; station++)
+    {
+        CHECK(shared->to_master[station].received * 100 >= FRAMES_PER_NODE * MIN_DELIVERY_PCT);
+        CHECK_EQ(shared->to_master[station].hops, station - 1);
+    }
+    CHECK_EQ(shared->to_master[4].received, 0);
+    CHECK(shared->downlink_received[3] * 100 >= FRAMES_PER_NODE * MIN_DELIVERY_PCT);
+    CHECK(shared->unicast_received[1] * 100 >= FRAMES_PER_NODE * MIN_DELIVERY_PCT);
+    CHECK_EQ(shared->duplicates_at_master, 0);
+
+    // Broadcasts stay on ESP-NOW: the master gets those of node 1 straight,
+    // no relayed copy of the others
+    CHECK(shared->broadcasts_at_master[1] > 0);
+    CHECK_EQ(shared->broadcasts_at_master[2] + shared->broadcasts_at_master[3] + shared->broadcasts_at_master[4], 0);
+    CHECK(shared->broadcasts_received[1] > 0 && shared->broadcasts_received[4] > 0);
+    return 0;
+}
@@ -0,0 +1,519 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "network_double.h"
+#include "esp_ota_ops.h"
+
+#include "ota.h"
+#include "app.h"
+
+/*
+ * Delta OTA of a 20-node fleet against a local HTTP stand-in of the master.
+ *
+ * The parent serves the patch with Range support and drops one response in
+ * DROP_EVERY halfway through; each node is a child process with its two OTA
+ * slots in RAM, updating in parallel with the others. The patch format is the
+ * stand-in of the fakes (copies and inserts), not detools: the bytes per
+ * update are those of this format.
+ *
+ * The partition table of the firmware is checked first: both slots must hold
+ * the image, and the table must fit in the flash size of sdkconfig.
+ */
+
+#define NODE_COUNT          20
+#define IMAGE_LEN           (640 * 1024)
+#define DROP_EVERY          25
+#define NODE_TIMEOUT_S      60
+#define FIELD_GOODPUT_BPS   (2 * 1000 * 1000)       // A congested field AP, shared by the fleet
+
+typedef enum
+{
+    SCENARIO_UPDATE,
+    SCENARIO_WRONG_BASE,
+    SCENARIO_BUSY,
+    SCENARIO_BAD_PATCH,
+    SCENARIO_ROLLBACK,
+    SCENARIO_CONFIRM,
+} Scenario_t;
+
+typedef struct
+{
+    bool ok;
+    uint32_t bytes_transferred;
+    uint32_t statuses;
+    uint32_t elapsed_ms;
+} NodeResult_t;
+
+static uint8_t base_image[IMAGE_LEN];
+static uint8_t new_image[IMAGE_LEN + 16384];
+static size_t new_len = 0;
+static uint8_t patch[256 * 1024];
+static size_t patch_len = 0;
+static uint8_t bad_patch[256 * 1024];
+
+static NodeResult_t * results;
+static int listen_sock = -1;
+static uint16_t server_port = 0;
+static uint32_t requests = 0;
+static uint32_t drops = 0;
+
+static AppState_t app_state = APP_STATE_IDLE;
+static Scenario_t scenario;
+static int node_index;
+static int64_t node_start_us;
+
+// The app is not linked: the node is idle, or in a match
+AppState_t get_app_state(void)
+{
+    return app_state;
+}
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t rng_state = 2024;
+
+// Xorshift: the low bits of an LCG repeat within an image, which copies would
+// match far better than compiled code
+static uint32_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// A new build: code changed in places, functions grown, a new module at the end
+static void images_build(void)
+{
+    for(size_t i = 0; i < IMAGE_LEN; i++)
+    {
+        base_image[i] = (uint8_t)rng_next();
+    }
+
+    size_t src = 0;
+    for(int region = 0; region < 64; region++)
+    {
+        size_t next = (size_t)(region + 1) * (IMAGE_LEN / 64);
+        size_t keep = next - src - 1024;
+        memcpy(new_image + new_len, base_image + src, keep);
+        new_len += keep;
+        src += keep;
+
+        // 256 bytes rewritten, every fourth region also grows by 512
+        for(int i = 0; i < 256; i++)
+        {
+            new_image[new_len++] = (uint8_t)rng_next();
+        }
+        src += 256;
+        if(region % 4 == 0)
+        {
+            for(int i = 0; i < 512; i++)
+            {
+                new_image[new_len++] = (uint8_t)rng_next();
+            }
+        }
+        memcpy(new_image + new_len, base_image + src, next - src);
+        new_len += next - src;
+        src = next;
+    }
+    for(int i = 0; i < 8192; i++)
+    {
+        new_image[new_len++] = (uint8_t)rng_next();
+    }
+    CHECK(new_len <= sizeof(new_image));
+
+    patch_len = host_delta_build(base_image, IMAGE_LEN, new_image, new_len, patch, sizeof(patch));
+    CHECK(patch_len > 0);
+
+    // Copies of base bytes past the end of the running image: no image
+    memcpy(bad_patch, patch, patch_len);
+    for(size_t i = 8; i < patch_len; i++)
+    {
+        if(bad_patch[i] == 'C')
+        {
+            bad_patch[i + 4] = 0xFF;
+            break;
+        }
+    }
+}
+
+// ---- HTTP stand-in of the master ---------------------------------------------
+
+static void serve(int sock, const char * status, const char * headers, const uint8_t * body, size_t len)
+{
+    char head[256];
+    int head_len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\n%sContent-Length: %zu\r\n\r\n", status, headers, len);
+    send(sock, head, head_len, MSG_NOSIGNAL);
+    if(len > 0)
+    {
+        send(sock, body, len, MSG_NOSIGNAL);
+    }
+}
+
+static void * connection_task(void * arg)
+{
+    int sock = (int)(intptr_t)arg;
+    char request[1024];
+    size_t len = 0;
+
+    while(true)
+    {
+        ssize_t n = recv(sock, request + len, sizeof(request) - 1 - len, 0);
+        if(n <= 0)
+        {
+            break;
+        }
+        len += n;
+        request[len] = '\0';
+        char * end = strstr(request, "\r\n\r\n");
+        if(end == NULL)
+        {
+            continue;
+        }
+
+        char path[64] = "";
+        sscanf(request, "GET %63s", path);
+        const uint8_t * blob = strcmp(path, "/patch.bin") == 0 ? patch : strcmp(path, "/bad.bin") == 0 ? bad_patch : NULL;
+        unsigned long first = 0;
+        unsigned long last = patch_len - 1;
+        const char * range = strstr(request, "Range: bytes=");
+        bool ranged = range != NULL && sscanf(range, "Range: bytes=%lu-%lu", &first, &last) == 2;
+
+        uint32_t count = __atomic_add_fetch(&requests, 1, __ATOMIC_SEQ_CST);
+        if(blob == NULL)
+        {
+            serve(sock, "404 Not Found", "", NULL, 0);
+        }
+        else if(!ranged || first > last || last >= patch_len)
+        {
+            serve(sock, "416 Range Not Satisfiable", "", NULL, 0);
+        }
+        else if(count % DROP_EVERY == 0)
+        {
+            // The link goes down in the middle of the body
+            char head[128];
+            int head_len = snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nContent-Length: %lu\r\n\r\n", last - first + 1);
+            send(sock, head, head_len, MSG_NOSIGNAL);
+            send(sock, blob + first, (last - first + 1) / 2, MSG_NOSIGNAL);
+            __atomic_add_fetch(&drops, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        else
+        {
+            char headers[96];
+            snprintf(headers, sizeof(headers), "Content-Range: bytes %lu-%lu/%zu\r\n", first, last, patch_len);
+            serve(sock, "206 Partial Content", headers, blob + first, last - first + 1);
+        }
+
+        size_t consumed = end + 4 - request;
+        memmove(request, end + 4, len - consumed);
+        len -= consumed;
+    }
+
+    close(sock);
+    return NULL;
+}
+
+static void * server_task(void * arg)
+{
+    while(true)
+    {
+        int sock = accept(listen_sock, NULL, NULL);
+        if(sock < 0)
+        {
+            break;
+        }
+        pthread_t thread;
+        pthread_create(&thread, NULL, connection_task, (void *)(intptr_t)sock);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static void server_listen(void)
+{
+    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    CHECK(bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(listen(listen_sock, 64) == 0);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_sock, (struct sockaddr *)&addr, &addr_len);
+    server_port = ntohs(addr.sin_port);
+}
+
+// ---- One node ------------------------------------------------------------------
+
+static size_t statuses(OtaStatus_t status, OtaStatusPayload_t * last)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < network_double_sent_count(); i++)
+    {
+        const NetworkDoubleFrame_t * frame = network_double_sent(i);
+        const OtaStatusPayload_t * report = (const OtaStatusPayload_t *)frame->payload;
+        if(frame->header.type == MSG_OTA_STATUS && report->status == status)
+        {
+            count++;
+            if(last != NULL)
+            {
+                *last = *report;
+            }
+        }
+    }
+    return count;
+}
+
+static void node_finish(bool ok)
+{
+    NodeResult_t * result = &results[node_index];
+    OtaStatusPayload_t last = { 0 };
+    statuses(OTA_STATUS_DONE, &last);
+    result->ok = ok;
+    result->bytes_transferred = last.bytes_transferred;
+    result->statuses = network_double_sent_count();
+    result->elapsed_ms = (host_us() - node_start_us) / 1000;
+    _exit(ok ? 0 : 1);
+}
+
+// esp_restart(): the update is in the other slot, or the rollback happened
+static void node_restarted(void)
+{
+    switch(scenario)
+    {
+        case SCENARIO_UPDATE:
+        {
+            const char * boot = host_ota_boot_label();
+            bool ok = boot != NULL && strcmp(boot, "ota_1") == 0
+                      && memcmp(host_partition_data("ota_1"), new_image, new_len) == 0
+                      && statuses(OTA_STATUS_STARTED, NULL) == 1
+                      && statuses(OTA_STATUS_DONE, NULL) == 1
+                      && statuses(OTA_STATUS_PROGRESS, NULL) > 0;
+            node_finish(ok);
+            break;
+        }
+        case SCENARIO_ROLLBACK:
+        {
+            const char * boot = host_ota_boot_label();
+            node_finish(boot != NULL && strcmp(boot, "ota_0") == 0 && host_ota_running_state() == ESP_OTA_IMG_INVALID);
+            break;
+        }
+        default:
+            node_finish(false);
+            break;
+    }
+}
+
+static void announce(const char * path, const uint8_t base_sha[32])
+{
+    OtaAnnouncePayload_t payload = { .firmware_version = 2, .patch_size = patch_len };
+    memcpy(payload.base_sha256, base_sha, 32);
+    snprintf(payload.url, sizeof(payload.url), "http://127.0.0.1:%u%s", server_port, path);
+    CHECK_OK(network_double_deliver(MSG_OTA_ANNOUNCE, NODE_ID_MASTER, NODE_ID_BROADCAST, &payload, sizeof(payload)));
+}
+
+static void node_run(void)
+{
+    host_log_set_quiet(true);
+    node_start_us = host_us();
+    host_set_restart_hook(node_restarted);
+    network_double_set_node_id(0x0100 + node_index);
+
+    host_partition_add("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0xE0000);
+    host_partition_add("ota_1", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0xE0000);
+    memcpy(host_partition_data("ota_0"), base_image, IMAGE_LEN);
+    host_partition_set_image_len("ota_0", IMAGE_LEN);
+    host_ota_set_running("ota_0", ESP_OTA_IMG_VALID);
+    CHECK_OK(ota_init());
+
+    uint8_t base_sha[32];
+    host_sha256(base_image, IMAGE_LEN, base_sha);
+
+    switch(scenario)
+    {
+        case SCENARIO_UPDATE:
+            announce("/patch.bin", base_sha);
+            break;
+        case SCENARIO_WRONG_BASE:
+            base_sha[0] ^= 1;
+            announce("/patch.bin", base_sha);
+            node_finish(statuses(OTA_STATUS_REJECTED_BASE, NULL) == 1 && network_double_sent_count() == 1);
+            break;
+        case SCENARIO_BUSY:
+            app_state = APP_STATE_RUNNING;
+            announce("/patch.bin", base_sha);
+            node_finish(statuses(OTA_STATUS_REJECTED_BUSY, NULL) == 1 && network_double_sent_count() == 1);
+            break;
+        case SCENARIO_BAD_PATCH:
+            announce("/bad.bin", base_sha);
+            break;
+        case SCENARIO_ROLLBACK:
+            // Back from the update, app_init() fails
+            host_ota_set_running("ota_1", ESP_OTA_IMG_PENDING_VERIFY);
+            ota_confirm_boot(ESP_FAIL);
+            node_finish(false);
+            break;
+        case SCENARIO_CONFIRM:
+            host_ota_set_running("ota_1", ESP_OTA_IMG_PENDING_VERIFY);
+            ota_confirm_boot(ESP_OK);
+            node_finish(host_ota_running_state() == ESP_OTA_IMG_VALID && host_ota_boot_label() == NULL);
+            break;
+    }
+
+    // The OTA task runs on its own thread, until the restart or a failure
+    while(host_us() - node_start_us < NODE_TIMEOUT_S * 1000000LL)
+    {
+        if(statuses(OTA_STATUS_FAILED, NULL) > 0)
+        {
+            node_finish(scenario == SCENARIO_BAD_PATCH && host_ota_boot_label() == NULL);
+        }
+        usleep(10000);
+    }
+    node_finish(false);
+}
+
+static pid_t node_spawn(int index, Scenario_t node_scenario)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid == 0)
+    {
+        node_index = index;
+        scenario = node_scenario;
+        node_run();
+    }
+    return pid;
+}
+
+// ---- Partition table -------------------------------------------------------
+
+static void test_partition_table(void)
+{
+    FILE * sdkconfig = fopen(DOMINION_REPO_DIR "/sdkconfig", "r");
+    CHECK(sdkconfig != NULL);
+    char line[256];
+    unsigned flash_mb = 0;
+    while(fgets(line, sizeof(line), sdkconfig))
+    {
+        sscanf(line, "CONFIG_ESPTOOLPY_FLASHSIZE=\"%uMB\"", &flash_mb);
+    }
+    fclose(sdkconfig);
+    CHECK(flash_mb > 0);
+
+    FILE * table = fopen(DOMINION_REPO_DIR "/partitions.csv", "r");
+    CHECK(table != NULL);
+    uint32_t end = 0x9000;      // Bootloader and partition table
+    uint32_t slots[2] = { 0 };
+    while(fgets(line, sizeof(line), table))
+    {
+        char name[32];
+        char type[16];
+        char subtype[16];
+        unsigned offset;
+        unsigned size;
+        if(line[0] == '#' || sscanf(line, " %31[^,], %15[^,], %15[^,], %x, %x", name, type, subtype, &offset, &size) != 5)
+        {
+            continue;
+        }
+        CHECK(offset >= end);
+        if(strcmp(type, "app") == 0)
+        {
+            CHECK_EQ(offset % 0x10000, 0);
+            if(strcmp(subtype, "ota_0") == 0 || strcmp(subtype, "ota_1") == 0)
+            {
+                slots[subtype[4] - '0'] = size;
+            }
+        }
+        end = offset + size;
+    }
+    fclose(table);
+
+    CHECK(slots[0] > 0);
+    CHECK_EQ(slots[0], slots[1]);
+    CHECK(end <= flash_mb * 1024 * 1024);
+    CHECK(new_len <= slots[1]);
+
+    REPORT("OTA slots", "2 x %u KB", slots[0] / 1024);
+    REPORT("flash used by the partition table", "%u of %u KB", end / 1024, flash_mb * 1024);
+}
+
+int main(void)
+{
+    images_build();
+    test_partition_table();
+
+    results = mmap(NULL, sizeof(NodeResult_t) * (NODE_COUNT + 8), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(results != MAP_FAILED);
+    server_listen();
+
+    // The nodes fork before the server threads start
+    const Scenario_t checks[] = { SCENARIO_WRONG_BASE, SCENARIO_BUSY, SCENARIO_BAD_PATCH, SCENARIO_ROLLBACK, SCENARIO_CONFIRM };
+    const char * check_names[] = { "wrong base image", "during a match", "corrupt patch", "rollback on init failure", "confirm on init success" };
+    pid_t pids[NODE_COUNT + 8];
+    int64_t start_us = host_us();
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        pids[node] = node_spawn(node, SCENARIO_UPDATE);
+    }
+    for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        pids[NODE_COUNT + i] = node_spawn(NODE_COUNT + i, checks[i]);
+    }
+
+    pthread_t server;
+    pthread_create(&server, NULL, server_task, NULL);
+
+    int failures = 0;
+    for(size_t i = 0; i < NODE_COUNT + sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        int status;
+        waitpid(pids[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !results[i].ok)
+        {
+            fprintf(stderr, "node %zu %s failed\n", i, i < NODE_COUNT ? "update" : check_names[i - NODE_COUNT]);
+            failures++;
+        }
+    }
+    int64_t fleet_ms = (host_us() - start_us) / 1000;
+    CHECK_EQ(failures, 0);
+
+    uint64_t total = 0;
+    uint32_t slowest_ms = 0;
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        // A cut response resumes where it stopped: nothing is fetched twice
+        CHECK_EQ(results[node].bytes_transferred, patch_len);
+        total += results[node].bytes_transferred;
+        slowest_ms = results[node].elapsed_ms > slowest_ms ? results[node].elapsed_ms : slowest_ms;
+    }
+    CHECK(drops > 0);
+
+    REPORT("image", "%zu bytes, from %d", new_len, IMAGE_LEN);
+    REPORT("patch (stand-in format)", "%zu bytes, %.1f %% of the image", patch_len, 100.0 * patch_len / new_len);
+    REPORT("HTTP requests", "%" PRIu32 ", %" PRIu32 " cut halfway", requests, drops);
+    REPORT("bytes per update", "%.0f, cut responses resumed", (double)total / NODE_COUNT);
+    REPORT("fleet bytes", "%" PRIu64 " for %d nodes, %zu as full images", total, NODE_COUNT, new_len * NODE_COUNT);
+    REPORT("fleet update on the host", "%" PRId64 " ms, slowest node %" PRIu32 " ms", fleet_ms, slowest_ms);
+    REPORT("fleet transfer at 2 Mbit/s shared", "%.1f s, %.1f s as full images",
+           total * 8.0 / FIELD_GOODPUT_BPS, new_len * NODE_COUNT * 8.0 / FIELD_GOODPUT_BPS);
+    for(size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+    {
+        printf("%-40s ok\n", check_names[i]);
+    }
+    return 0;
+}
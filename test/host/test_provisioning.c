@@ -0,0 +1,301 @@
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "network_double.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "provisioning.h"
+#include "storage.h"
+#include "app.h"
+#include "game_mode.h"
+
+/*
+ * A fleet-wide config push to 100 nodes over a lossy link, then a push that
+ * lands in the middle of a match.
+ *
+ * The nodes share the process: each has its own NVS partition and node id,
+ * switched before its frame is delivered. The master re-broadcasts the same
+ * push every PUSH_RETRY_MS until every node acked, as the companion app does.
+ */
+
+#define NODE_COUNT          100
+#define LOSS_PCT            10      // Per direction, independently per node
+#define PUSH_RETRY_MS       500
+#define MAX_ROUNDS          20
+
+typedef struct __attribute__((packed))
+{
+    ConfigPushPayload_t push;
+    ConfigAssignment_t assignments[NODE_COUNT];
+} FleetPush_t;
+
+_Static_assert(sizeof(FleetPush_t) + sizeof(FrameHeader_t) <= PROTOCOL_MAX_FRAME_LEN, "The fleet push does not fit in a frame");
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 16;
+}
+
+static bool lost(void)
+{
+    return rng_next() % 100 < LOSS_PCT;
+}
+
+static uint16_t node_id(int node)
+{
+    return 0x0100 + node;
+}
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Switch the process to one node, as if its frame arrived there: its NVS,
+// its id and the config provisioning holds in RAM
+static void node_select(int node)
+{
+    host_nvs_select(node);
+    network_double_set_node_id(node_id(node));
+    CHECK_OK(storage_init());
+    CHECK_OK(provisioning_init());
+}
+
+static void fleet_push_build(FleetPush_t * frame, uint32_t version)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->push = (ConfigPushPayload_t)
+    {
+        .config_version = version,
+        .match_duration_s = 900,
+        .press_short_max_ms = 400,
+        .press_medium_max_ms = 1500,
+        .points_per_second = 2,
+        .capture_delay_ms = 3000,
+        .hold_bonus_pct = 25,
+        .game_mode = GAME_MODE_DOMINATION,
+        .assignment_count = NODE_COUNT,
+    };
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        frame->assignments[node].node_id = node_id(node);
+        frame->assignments[node].control_point = CONTROL_POINT_ALPHA + node % (CONTROL_POINT_MAX - CONTROL_POINT_ALPHA);
+    }
+}
+
+// Delivers the push to one node, returns the status of its ack, -1 if none.
+// The ack carries the version the node holds after the push
+static int push_to_node(int node, const FleetPush_t * frame, uint32_t acked_version)
+{
+    node_select(node);
+    network_double_clear();
+    CHECK_OK(network_double_deliver(MSG_CONFIG_PUSH, NODE_ID_MASTER, NODE_ID_BROADCAST, frame, sizeof(*frame)));
+    if(network_double_sent_count() == 0)
+    {
+        return -1;
+    }
+    CHECK_EQ(network_double_sent_count(), 1);
+    const NetworkDoubleFrame_t * ack = network_double_sent(0);
+    CHECK_EQ(ack->header.type, MSG_CONFIG_ACK);
+    CHECK_EQ(ack->header.src_node, node_id(node));
+    CHECK_EQ(ack->header.dst_node, NODE_ID_MASTER);
+    const ConfigAckPayload_t * payload = (const ConfigAckPayload_t *)ack->payload;
+    CHECK_EQ(payload->config_version, acked_version);
+    return payload->status;
+}
+
+static void test_fleet_push(void)
+{
+    static FleetPush_t frame;
+    fleet_push_build(&frame, 7);
+
+    bool acked[NODE_COUNT] = { false };
+    int acked_count = 0;
+    int rounds = 0;
+    uint32_t deliveries = 0;
+    uint32_t acks = 0;
+    int64_t handler_us = 0;
+    uint32_t writes_before = host_nvs_write_count();
+
+    while(acked_count < NODE_COUNT && rounds < MAX_ROUNDS)
+    {
+        rounds++;
+        for(int node = 0; node < NODE_COUNT; node++)
+        {
+            if(acked[node] || lost())
+            {
+                continue;
+            }
+            deliveries++;
+            int64_t start_us = host_us();
+            int status = push_to_node(node, &frame, frame.push.config_version);
+            handler_us += host_us() - start_us;
+            CHECK_EQ(status, CONFIG_ACK_OK);
+            acks++;
+            if(!lost())
+            {
+                acked[node] = true;
+                acked_count++;
+            }
+        }
+    }
+
+    CHECK_EQ(acked_count, NODE_COUNT);
+
+    // One NVS write per node whatever the retries
+    CHECK_EQ(host_nvs_write_count() - writes_before, NODE_COUNT);
+
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        node_select(node);
+        GameConfig_t config = GAME_CONFIG_DEFAULT();
+        CHECK_OK(storage_get_game_config(&config));
+        CHECK_EQ(config.version, 7);
+        CHECK_EQ(config.control_point, frame.assignments[node].control_point);
+        CHECK_EQ(config.match_duration_s, 900);
+        ControlPoint_t point = CONTROL_POINT_NONE;
+        CHECK_OK(storage_get_control_point(&point));
+        CHECK_EQ(point, frame.assignments[node].control_point);
+    }
+
+    REPORT("fleet push nodes", "%d", NODE_COUNT);
+    REPORT("fleet push frame", "%zu bytes", sizeof(FrameHeader_t) + sizeof(frame));
+    REPORT("fleet push loss", "%d %% each way", LOSS_PCT);
+    REPORT("fleet push broadcast rounds", "%d", rounds);
+    REPORT("fleet push deliveries", "%" PRIu32, deliveries);
+    REPORT("fleet push acks sent", "%" PRIu32, acks);
+    REPORT("fleet push node handling", "%.1f us mean", (double)handler_us / deliveries);
+    REPORT("fleet push time to all acked", "%d ms (%d ms retry)", rounds * PUSH_RETRY_MS, PUSH_RETRY_MS);
+
+    // Retried once more for every node: acked again, the flash left alone
+    writes_before = host_nvs_write_count();
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        CHECK_EQ(push_to_node(node, &frame, frame.push.config_version), CONFIG_ACK_OK);
+    }
+    CHECK_EQ(host_nvs_write_count(), writes_before);
+
+    // An older push is refused, a broken one too
+    FleetPush_t older;
+    fleet_push_build(&older, 6);
+    CHECK_EQ(push_to_node(0, &older, 7), CONFIG_ACK_STALE);
+
+    FleetPush_t broken;
+    fleet_push_build(&broken, 8);
+    broken.assignments[1].control_point = CONTROL_POINT_MAX;
+    CHECK_EQ(push_to_node(1, &broken, 7), CONFIG_ACK_INVALID);
+    CHECK_EQ(host_nvs_write_count(), writes_before);
+
+    // A node the push does not name stays silent
+    node_select(NODE_COUNT);
+    network_double_clear();
+    CHECK_OK(network_double_deliver(MSG_CONFIG_PUSH, NODE_ID_MASTER, NODE_ID_BROADCAST, &frame, sizeof(frame)));
+    CHECK_EQ(network_double_sent_count(), 0);
+}
+
+static bool wait_status(AppStatus_t * status, AppState_t state, int8_t control_point)
+{
+    for(int i = 0; i < 2000; i++)
+    {
+        app_get_status(status);
+        if(status->state == state && (control_point == CONTROL_POINT_NONE || status->control_point == control_point))
+        {
+            return true;
+        }
+        vTaskDelay(1);
+    }
+    return false;
+}
+
+static void send_event(AppEvent_t type)
+{
+    AppEventMessage_t event = { .type = type, .payload = POOL_HANDLE_NONE };
+    CHECK_OK(app_event_send(&event, portMAX_DELAY));
+}
+
+// The control point picked in the settings menu is stored and a retry of the
+// push assigns its own again, then a push during a match changes nothing
+// until the match ends: same rules, same control point, then all of the new
+// config at once
+static void test_app_config(void)
+{
+    const int node = NODE_COUNT + 1;
+    static FleetPush_t frame;
+    fleet_push_build(&frame, 1);
+    frame.assignments[0].node_id = node_id(node);
+    frame.assignments[0].control_point = CONTROL_POINT_BRAVO;
+    CHECK_EQ(push_to_node(node, &frame, frame.push.config_version), CONFIG_ACK_OK);
+
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    AppStatus_t status;
+    CHECK(wait_status(&status, APP_STATE_INIT, CONTROL_POINT_BRAVO));
+
+    // Settings, ALPHA, BRAVO, CHARLIE, select it and leave
+    send_event(APP_EVENT_BTN_BOTH_LONG);
+    send_event(APP_EVENT_BTN_RED_SHORT);
+    send_event(APP_EVENT_BTN_BLUE_SHORT);
+    send_event(APP_EVENT_BTN_BLUE_SHORT);
+    send_event(APP_EVENT_BTN_RED_SHORT);
+    CHECK(wait_status(&status, APP_STATE_SETTINGS_CONTROL_POINT, CONTROL_POINT_CHARLIE));
+    send_event(APP_EVENT_BTN_BOTH_MEDIUM);
+    CHECK(wait_status(&status, APP_STATE_IDLE, CONTROL_POINT_CHARLIE));
+    GameConfig_t stored;
+    CHECK_OK(storage_get_game_config(&stored));
+    CHECK_EQ(stored.control_point, CONTROL_POINT_CHARLIE);
+    CHECK_EQ(stored.version, 1);
+
+    // A retry of the push, provisioning not reloaded: it is no plain retry
+    // any more, the assigned control point is stored and acked again
+    network_double_clear();
+    CHECK_OK(network_double_deliver(MSG_CONFIG_PUSH, NODE_ID_MASTER, NODE_ID_BROADCAST, &frame, sizeof(frame)));
+    CHECK_EQ(network_double_sent_count(), 1);
+    CHECK_EQ(((const ConfigAckPayload_t *)network_double_sent(0)->payload)->status, CONFIG_ACK_OK);
+    CHECK(wait_status(&status, APP_STATE_IDLE, CONTROL_POINT_BRAVO));
+    CHECK_OK(storage_get_game_config(&stored));
+    CHECK_EQ(stored.control_point, CONTROL_POINT_BRAVO);
+
+    send_event(APP_EVENT_BTN_RED_SHORT);
+    CHECK(wait_status(&status, APP_STATE_RUNNING, CONTROL_POINT_NONE));
+    CHECK_EQ(status.control_point, CONTROL_POINT_BRAVO);
+    CHECK_EQ(status.owner, TEAM_RED);
+
+    frame.push.config_version = 2;
+    frame.push.match_duration_s = 60;
+    frame.assignments[0].control_point = CONTROL_POINT_DELTA;
+    CHECK_EQ(push_to_node(node, &frame, frame.push.config_version), CONFIG_ACK_OK);
+
+    // Stored at once, the match plays on as it started
+    CHECK_OK(storage_get_game_config(&stored));
+    CHECK_EQ(stored.version, 2);
+    send_event(APP_EVENT_BTN_BLUE_SHORT);
+    CHECK(wait_status(&status, APP_STATE_RUNNING, CONTROL_POINT_NONE));
+    for(int i = 0; i < 50 && status.owner != TEAM_BLUE; i++)
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    }
+    CHECK_EQ(status.owner, TEAM_BLUE);
+    CHECK_EQ(status.control_point, CONTROL_POINT_BRAVO);
+    CHECK(status.time_left_s > 60);
+
+    send_event(APP_EVENT_BTN_BOTH_LONG);
+    CHECK(wait_status(&status, APP_STATE_FINISHED, CONTROL_POINT_DELTA));
+
+    REPORT("push during match", "applied at the end, %s", control_point_to_string(status.control_point));
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    test_fleet_push();
+    test_app_config();
+    return 0;
+}
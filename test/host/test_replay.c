@@ -0,0 +1,312 @@
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <dirent.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "storage.h"
+
+/*
+ * Replay driver: loads app event traces, replays them with app_replay() and
+ * compares the status at the end with the golden file next to each trace.
+ *
+ *   test_replay <dir>              every <name>.trace of the directory against <name>.golden
+ *   test_replay --bless <dir>      writes the golden files instead, review the diff
+ *   test_replay <file>.trace       prints the status at the end of one trace
+ *
+ * A trace is the serial capture of a node built with
+ * CONFIG_DOMINION_APP_TRACE: the "TRACE,<time_ms>,<event>" lines are kept,
+ * wherever they start, everything else is ignored. An optional
+ * "CONFIG,<mode>,<duration_s>,<points_per_second>,<capture_delay_ms>,<hold_bonus_pct>,<control_point>"
+ * line gives the stored game configuration, the defaults otherwise. Events
+ * are AppEvent_t values of a 2-team build.
+ *
+ * With no argument, or after the directory, it also checks that a trace out
+ * of time order is refused, that a replay leaves the hardware and the NVS
+ * alone, and reports the events per second over a 6-hour match.
+ */
+
+#define TRACE_MAX_EVENTS    (1 << 20)
+#define GOLDEN_MAX_LEN      1024
+#define BENCH_MATCH_MS      (6 * 3600 * 1000)
+#define BENCH_PERIOD_MS     100             // A press every 100 ms, for 6 hours
+
+_Static_assert(TEAM_COUNT == 2 && APP_EVENT_BTN_BOTH_SHORT == 8, "The traces are recorded on a 2-team build");
+
+typedef struct
+{
+    GameConfig_t config;
+    size_t count;
+    AppTraceEntry_t * entries;
+} Trace_t;
+
+static AppTraceEntry_t trace_entries[TRACE_MAX_EVENTS];
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static GameConfig_t default_config(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.points_per_second = 1;
+    return config;
+}
+
+static bool trace_load(const char * path, Trace_t * trace)
+{
+    FILE * file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+
+    trace->config = default_config();
+    trace->count = 0;
+    trace->entries = trace_entries;
+
+    char line[256];
+    int line_number = 0;
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        const char * record = strstr(line, "TRACE,");
+        unsigned long time_ms;
+        unsigned event;
+        int mode, duration_s, points_per_second, capture_delay_ms, hold_bonus_pct, control_point;
+
+        if(record && sscanf(record, "TRACE,%lu,%u", &time_ms, &event) == 2)
+        {
+            if(event >= APP_EVENT_MAX || trace->count == TRACE_MAX_EVENTS)
+            {
+                fprintf(stderr, "%s:%d: bad event %u or trace too long\n", path, line_number, event);
+                ok = false;
+                break;
+            }
+            trace->entries[trace->count++] = (AppTraceEntry_t){ .time_ms = (uint32_t)time_ms, .event = (uint8_t)event };
+        }
+        else if(sscanf(line, "CONFIG,%d,%d,%d,%d,%d,%d", &mode, &duration_s, &points_per_second,
+                       &capture_delay_ms, &hold_bonus_pct, &control_point) == 6)
+        {
+            trace->config.game_mode = (uint8_t)mode;
+            trace->config.match_duration_s = (uint32_t)duration_s;
+            trace->config.points_per_second = (uint16_t)points_per_second;
+            trace->config.capture_delay_ms = (uint16_t)capture_delay_ms;
+            trace->config.hold_bonus_pct = (uint16_t)hold_bonus_pct;
+            trace->config.control_point = (int8_t)control_point;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static const char * team_name(Team_t team)
+{
+    return team == TEAM_NONE ? "NONE" : teams[team].name;
+}
+
+// The golden file: one line per field of the status, seq left out
+static void status_format(const AppStatus_t * status, char * out, size_t len)
+{
+    int used = snprintf(out, len, "state %d\ncontrol_point %d\nowner %s\nwinner %s\ncaptures %u\ntime_left_s %lu\n",
+                        status->state, status->control_point, team_name(status->owner), team_name(status->winner),
+                        status->captures, (unsigned long)status->time_left_s);
+    for(int team = 0; team < TEAM_COUNT && used < (int)len; team++)
+    {
+        used += snprintf(out + used, len - used, "%s seconds %lu points %lu\n", teams[team].name,
+                         (unsigned long)status->seconds[team], (unsigned long)status->points[team]);
+    }
+}
+
+static bool trace_replay(const char * path, char * out, size_t len, size_t * count)
+{
+    static Trace_t trace;
+    if(!trace_load(path, &trace))
+        return false;
+
+    CHECK_OK(storage_set_game_config(&trace.config));
+    AppStatus_t status;
+    esp_err_t ret = app_replay(trace.entries, trace.count, &status);
+    if(ret != ESP_OK)
+    {
+        fprintf(stderr, "%s: app_replay: %s\n", path, esp_err_to_name(ret));
+        return false;
+    }
+    status_format(&status, out, len);
+    *count = trace.count;
+    return true;
+}
+
+static bool ends_with(const char * name, const char * suffix)
+{
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+// Each trace of the directory against its golden file, or into it
+static int replay_dir(const char * dir_path, bool bless)
+{
+    DIR * dir = opendir(dir_path);
+    CHECK(dir != NULL);
+
+    int failed = 0;
+    int traces = 0;
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(!ends_with(entry->d_name, ".trace"))
+            continue;
+
+        char path[512];
+        char golden_path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        snprintf(golden_path, sizeof(golden_path), "%.*s.golden", (int)(strlen(path) - strlen(".trace")), path);
+
+        char actual[GOLDEN_MAX_LEN];
+        size_t count = 0;
+        traces++;
+        if(!trace_replay(path, actual, sizeof(actual), &count))
+        {
+            failed++;
+            continue;
+        }
+
+        FILE * golden = fopen(golden_path, bless ? "w" : "r");
+        CHECK(golden != NULL);
+        if(bless)
+        {
+            fputs(actual, golden);
+            fclose(golden);
+            printf("%-40s %zu events, blessed\n", entry->d_name, count);
+            continue;
+        }
+
+        char expected[GOLDEN_MAX_LEN];
+        size_t expected_len = fread(expected, 1, sizeof(expected) - 1, golden);
+        expected[expected_len] = '\0';
+        fclose(golden);
+
+        bool match = strcmp(actual, expected) == 0;
+        printf("%-40s %zu events, %s\n", entry->d_name, count, match ? "matches" : "DIFFERS");
+        if(!match)
+        {
+            fprintf(stderr, "--- %s\n%s+++ replayed\n%s", golden_path, expected, actual);
+            failed++;
+        }
+    }
+    closedir(dir);
+
+    CHECK(traces > 0);
+    return failed;
+}
+
+// A trace out of time order is refused before the app is touched
+static void test_unsorted(void)
+{
+    GameConfig_t config = default_config();
+    CHECK_OK(storage_set_game_config(&config));
+    const AppTraceEntry_t unsorted[] =
+    {
+        { 0,     APP_EVENT_TMR_INIT_SETUP },
+        { 5000,  APP_EVENT_BTN_RED_SHORT },
+        { 4999,  APP_EVENT_BTN_BLUE_SHORT },
+        { 10000, APP_EVENT_TMR_MATCH_END },
+    };
+    AppStatus_t status;
+    AppStatus_t before;
+    app_get_status(&before);
+    CHECK_EQ(app_replay(unsorted, 4, &status), ESP_ERR_INVALID_ARG);
+    app_get_status(&status);
+    CHECK_EQ(status.seq, before.seq);
+
+    // Two events at the same time are in order
+    const AppTraceEntry_t same_time[] =
+    {
+        { 0,     APP_EVENT_TMR_INIT_SETUP },
+        { 5000,  APP_EVENT_BTN_RED_SHORT },
+        { 5000,  APP_EVENT_BTN_BLUE_SHORT },
+        { 10000, APP_EVENT_TMR_MATCH_END },
+    };
+    CHECK_OK(app_replay(same_time, 4, &status));
+    CHECK_EQ(status.winner, TEAM_BLUE);
+}
+
+// A 6-hour match with a press every BENCH_PERIOD_MS, the settings menu on
+// the way in: no LED, buzzer or NVS write, and the events per second
+static void bench(void)
+{
+    GameConfig_t config = default_config();
+    config.capture_delay_ms = 2000;
+    CHECK_OK(storage_set_game_config(&config));
+
+    size_t count = 0;
+    const uint8_t menu[] = { APP_EVENT_BTN_BOTH_LONG, APP_EVENT_BTN_RED_SHORT, APP_EVENT_BTN_BLUE_SHORT,
+                             APP_EVENT_BTN_RED_SHORT, APP_EVENT_BTN_BOTH_MEDIUM };
+    for(size_t i = 0; i < sizeof(menu); i++)
+    {
+        trace_entries[count++] = (AppTraceEntry_t){ (uint32_t)(i * 1000), menu[i] };
+    }
+    uint32_t start_ms = 10000;
+    uint32_t rng = 1;
+    for(uint32_t at_ms = start_ms; at_ms < start_ms + BENCH_MATCH_MS; at_ms += BENCH_PERIOD_MS)
+    {
+        rng = rng * 1103515245 + 12345;
+        trace_entries[count++] = (AppTraceEntry_t){ at_ms, APP_EVENT_BTN((Team_t)((rng >> 16) & 1), (rng >> 8) & 1 ? PRESS_SHORT : PRESS_MEDIUM) };
+    }
+    trace_entries[count++] = (AppTraceEntry_t){ start_ms + BENCH_MATCH_MS, APP_EVENT_TMR_MATCH_END };
+    CHECK(count <= TRACE_MAX_EVENTS);
+
+    uint32_t gpio_before = host_gpio_set_count();
+    uint32_t nvs_before = host_nvs_write_count();
+    AppStatus_t status;
+    int64_t start_us = host_us();
+    CHECK_OK(app_replay(trace_entries, count, &status));
+    int64_t elapsed_us = host_us() - start_us;
+    CHECK_EQ(host_gpio_set_count(), gpio_before);
+    CHECK_EQ(host_nvs_write_count(), nvs_before);
+
+    CHECK_EQ(status.state, APP_STATE_FINISHED);
+    CHECK_EQ(status.control_point, CONTROL_POINT_BRAVO);
+    CHECK(status.seconds[TEAM_BLUE] + status.seconds[TEAM_RED] <= BENCH_MATCH_MS / 1000);
+
+    uint64_t steps = count + BENCH_MATCH_MS / SCORING_TICK_MS;
+    REPORT("6-hour match", "%zu events and %d ticks in %.0f ms", count, BENCH_MATCH_MS / SCORING_TICK_MS, elapsed_us / 1000.0);
+    REPORT("replay throughput", "%.2f M events and ticks/s", steps / (double)elapsed_us);
+}
+
+int main(int argc, char ** argv)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+
+    bool bless = argc > 1 && strcmp(argv[1], "--bless") == 0;
+    const char * target = argc > 1 + bless ? argv[1 + bless] : NULL;
+
+    if(target && ends_with(target, ".trace"))
+    {
+        char out[GOLDEN_MAX_LEN];
+        size_t count;
+        CHECK(trace_replay(target, out, sizeof(out), &count));
+        printf("%s", out);
+        return 0;
+    }
+
+    int failed = target ? replay_dir(target, bless) : 0;
+    if(bless)
+        return 0;
+
+    test_unsorted();
+    bench();
+    return failed ? 1 : 0;
+}
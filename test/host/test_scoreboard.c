@@ -0,0 +1,173 @@
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "failover.h"
+#include "network_double.h"
+#include "storage.h"
+#include "app.h"
+#include "config.h"
+
+/*
+ * The scoreboard of a stand-in, on the network double: the node holding
+ * ALPHA hears no master and stands in while three other nodes report RED on
+ * BRAVO and CHARLIE and BLUE on DELTA. The stand-in scores the field again
+ * from their statuses with the multi-point bonus of the config: RED holds two
+ * points and scores each 50% faster, three times the rate of BLUE, from the
+ * points the nodes reported. A new match on the nodes starts the totals over.
+ */
+
+#define STATUS_PERIOD_MS    250
+#define BASE_POINTS         100         // Scored by each node before the stand-in heard it
+#define MEASURE_MS          (MASTER_HEARTBEAT_TIMEOUT_MS + 2 * NODE_STATUS_PERIOD_MAX_MS)
+
+enum { NODE_BRAVO, NODE_CHARLIE, NODE_DELTA, NODE_COUNT };
+
+static const ControlPoint_t node_points[NODE_COUNT] = { CONTROL_POINT_BRAVO, CONTROL_POINT_CHARLIE, CONTROL_POINT_DELTA };
+static const Team_t node_owners[NODE_COUNT] = { TEAM_RED, TEAM_RED, TEAM_BLUE };
+
+typedef struct
+{
+    int64_t at_us;
+    uint32_t points[PROTOCOL_MAX_TEAMS];
+} Board_t;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void start_node(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.points_per_second = 1;
+    config.hold_bonus_pct = 50;
+    CHECK_OK(storage_set_game_config(&config));
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    AppEventMessage_t setup_expired = { .type = APP_EVENT_TMR_INIT_SETUP, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&setup_expired, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+    AppStatus_t status;
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    } while(status.state != APP_STATE_IDLE);
+
+    CHECK_OK(failover_init());
+    CHECK(xTaskCreate(failover_task, "failover", FAILOVER_TASK_STACK_DEPTH, NULL, FAILOVER_TASK_PRIORITY, NULL) == pdPASS);
+}
+
+// The status of each node: the base points of its owner grow at the plain rate
+static void send_statuses(bool running, uint32_t elapsed_s)
+{
+    for(int node = 0; node < NODE_COUNT; node++)
+    {
+        NodeStatusPayload_t status =
+        {
+            .control_point = node_points[node],
+            .state = running ? APP_STATE_RUNNING : APP_STATE_IDLE,
+            .owner = running ? node_owners[node] : TEAM_NONE,
+            .captures = running ? 1 : 0,
+            .team_count = TEAM_COUNT,
+            .battery_pct = 0xFF,
+            .loss_pct = 0xFF,
+            .period_ms = NODE_STATUS_PERIOD_MS,
+        };
+        if(running)
+        {
+            status.seconds[node_owners[node]] = elapsed_s;
+            status.points[node_owners[node]] = BASE_POINTS + elapsed_s;
+        }
+        CHECK_OK(network_double_deliver(MSG_NODE_STATUS, 0x0102 + node, NODE_ID_BROADCAST, &status, sizeof(status)));
+    }
+}
+
+// The last scoreboard frame sent since the frame index, false if none
+static bool last_board(size_t * index, Board_t * board)
+{
+    bool found = false;
+    for(size_t count = network_double_sent_count(); *index < count; (*index)++)
+    {
+        const NetworkDoubleFrame_t * frame = network_double_sent(*index);
+        CHECK(frame != NULL);
+        if(frame->header.type != MSG_SCOREBOARD)
+            continue;
+
+        ScoreboardPayload_t payload;
+        memcpy(&payload, frame->payload, sizeof(payload));
+        board->at_us = host_us();
+        memcpy(board->points, payload.points, sizeof(board->points));
+        found = true;
+    }
+    return found;
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    network_double_set_node_id(0x0101);
+    start_node();
+
+    // Silent master: the node holding ALPHA stands in and scores the field
+    Board_t first = { 0 };
+    Board_t last = { 0 };
+    bool have_first = false;
+    size_t index = 0;
+    int64_t start_us = host_us();
+    while(host_us() - start_us < (int64_t)MEASURE_MS * 1000)
+    {
+        send_statuses(true, (host_us() - start_us) / 1000000);
+        vTaskDelay(pdMS_TO_TICKS(STATUS_PERIOD_MS));
+
+        Board_t board;
+        if(last_board(&index, &board))
+        {
+            if(!have_first)
+                first = board;
+            have_first = true;
+            last = board;
+        }
+    }
+    CHECK(failover_is_standin());
+    CHECK(have_first);
+    CHECK(last.at_us - first.at_us >= 4000000);
+
+    // Picked up from the points the nodes reported
+    CHECK(first.points[TEAM_RED] >= 2 * BASE_POINTS);
+    CHECK(first.points[TEAM_BLUE] >= BASE_POINTS);
+
+    // Two points at 150% against one at 100%
+    uint32_t red = last.points[TEAM_RED] - first.points[TEAM_RED];
+    uint32_t blue = last.points[TEAM_BLUE] - first.points[TEAM_BLUE];
+    CHECK(blue >= 3);
+    CHECK(red * 10 >= blue * 25 && red * 10 <= blue * 35);
+    int64_t span_ms = (last.at_us - first.at_us) / 1000;
+    REPORT("RED holding 2 points", "%lu points in %lld ms", (unsigned long)red, (long long)span_ms);
+    REPORT("BLUE holding 1 point", "%lu points in %lld ms", (unsigned long)blue, (long long)span_ms);
+
+    // A new match on the nodes: the totals start over
+    bool restarted = false;
+    start_us = host_us();
+    while(!restarted && host_us() - start_us < 2 * NODE_STATUS_PERIOD_MAX_MS * 1000)
+    {
+        send_statuses(false, 0);
+        vTaskDelay(pdMS_TO_TICKS(STATUS_PERIOD_MS));
+
+        Board_t board;
+        restarted = last_board(&index, &board) && board.points[TEAM_RED] == 0 && board.points[TEAM_BLUE] == 0;
+    }
+    CHECK(restarted);
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "nvs.h"
+
+#include "scoring.h"
+#include "storage.h"
+
+/*
+ * The scoring engine: the rules against hand-computed scores, a score picked
+ * up from a node, no drift between one long accrual and many ticks, the rules
+ * of an older config blob kept at their defaults, then the updates per
+ * second of the engine against a recomputation over the capture history.
+ */
+
+#define BENCH_UPDATES       2000000
+#define HISTORY_CAPTURES    1024        // Captures of a long match, for the baseline
+
+enum { RED, BLUE, GREEN, YELLOW };
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void test_rules(void)
+{
+    ScoringEngine_t engine;
+    ScoringRules_t rules = { .points_per_second = 2, .capture_delay_ms = 3000, .hold_bonus_pct = 50 };
+    scoring_init(&engine, &rules, 2, 0);
+
+    // Contested for the delay, nobody scores
+    scoring_capture(&engine, RED, 1000);
+    scoring_tick(&engine, 3999);
+    CHECK_EQ(engine.phase, SCORING_PHASE_CONTESTED);
+    CHECK_EQ(scoring_get_points(&engine, RED), 0);
+
+    // Held from the end of the delay, not from the tick
+    scoring_tick(&engine, 9000);
+    CHECK_EQ(engine.owner, RED);
+    CHECK_EQ(scoring_get_points(&engine, RED), 10);
+
+    // A second point held: 50 % more
+    scoring_set_points_held(&engine, RED, 2, 9000);
+    scoring_tick(&engine, 19000);
+    CHECK_EQ(scoring_get_points(&engine, RED), 10 + 30);
+
+    // The defenders secure the point back before the delay expires
+    scoring_capture(&engine, BLUE, 19000);
+    scoring_capture(&engine, RED, 20000);
+    CHECK_EQ(engine.phase, SCORING_PHASE_HELD);
+    CHECK_EQ(engine.owner, RED);
+    scoring_tick(&engine, 21000);
+    CHECK_EQ(scoring_get_points(&engine, RED), 40 + 3);
+    CHECK_EQ(scoring_get_points(&engine, BLUE), 0);
+
+    // The challengers take it, the previous owner stops scoring at the capture
+    scoring_capture(&engine, BLUE, 21000);
+    scoring_tick(&engine, 30000);
+    CHECK_EQ(scoring_get_points(&engine, RED), 43);
+    CHECK_EQ(scoring_get_points(&engine, BLUE), 12);
+    CHECK_EQ(scoring_get_leader(&engine), RED);
+
+    scoring_neutralize(&engine, 30000);
+    scoring_tick(&engine, 60000);
+    CHECK_EQ(scoring_get_points(&engine, BLUE), 12);
+
+    // Picking up the points a node reported, then accruing on top of them
+    scoring_set_points(&engine, BLUE, 100, 60000);
+    scoring_capture(&engine, BLUE, 60000);
+    scoring_tick(&engine, 62000);
+    CHECK_EQ(engine.phase, SCORING_PHASE_CONTESTED);
+    scoring_tick(&engine, 70000);
+    CHECK_EQ(scoring_get_points(&engine, BLUE), 100 + 14);
+    CHECK_EQ(scoring_get_points(&engine, RED), 43);
+
+    scoring_reset(&engine, 70000);
+    CHECK_EQ(scoring_get_points(&engine, RED), 0);
+    CHECK_EQ(scoring_get_leader(&engine), SCORING_TEAM_NONE);
+}
+
+// Fixed-point point-milliseconds: an odd rate accrued tick by tick adds up to
+// the same score as in one go, across the wrap of the millisecond clock
+static void test_no_drift(void)
+{
+    ScoringRules_t rules = { .points_per_second = 7, .capture_delay_ms = 0, .hold_bonus_pct = 33 };
+    ScoringEngine_t ticked;
+    ScoringEngine_t once;
+    uint32_t start_ms = UINT32_MAX - 50000;
+    scoring_init(&ticked, &rules, 4, start_ms);
+    scoring_init(&once, &rules, 4, start_ms);
+    scoring_capture(&ticked, GREEN, start_ms);
+    scoring_capture(&once, GREEN, start_ms);
+    scoring_set_points_held(&ticked, GREEN, 3, start_ms);
+    scoring_set_points_held(&once, GREEN, 3, start_ms);
+
+    uint32_t now_ms = start_ms;
+    for(int i = 0; i < 3600 * 10; i++)
+    {
+        now_ms += 97;
+        scoring_tick(&ticked, now_ms);
+    }
+    scoring_tick(&once, now_ms);
+    CHECK(ticked.teams[GREEN].score == once.teams[GREEN].score);
+    // 7 points per second with 66 % bonus, for 3492 s
+    CHECK_EQ(scoring_get_points(&ticked, GREEN), 3492ULL * 7 * 166 / 100);
+}
+
+// Leaves garbage where the next call keeps its locals
+static void __attribute__((noinline)) dirty_stack(void)
+{
+    volatile uint8_t junk[1024];
+    memset((void *)junk, 0xA5, sizeof(junk));
+}
+
+// A config pushed by a firmware that had no scoring rules yet: setting the
+// control point from the menu must not fill the rules with garbage
+static void test_legacy_config(void)
+{
+    CHECK_OK(storage_init());
+
+    GameConfig_t legacy = GAME_CONFIG_DEFAULT();
+    legacy.version = 4;
+    legacy.control_point = CONTROL_POINT_BRAVO;
+    legacy.match_duration_s = 600;
+    nvs_handle_t handle;
+    CHECK_OK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle));
+    CHECK_OK(nvs_set_blob(handle, KEY_GAME_CONFIG, &legacy, offsetof(GameConfig_t, points_per_second)));
+    CHECK_OK(nvs_commit(handle));
+    nvs_close(handle);
+
+    dirty_stack();
+    CHECK_OK(storage_set_control_point(CONTROL_POINT_DELTA));
+
+    GameConfig_t config;
+    CHECK_OK(storage_get_game_config(&config));
+    CHECK_EQ(config.version, 4);
+    CHECK_EQ(config.control_point, CONTROL_POINT_DELTA);
+    CHECK_EQ(config.match_duration_s, 600);
+    CHECK_EQ(config.points_per_second, 0);
+    CHECK_EQ(config.capture_delay_ms, 0);
+    CHECK_EQ(config.hold_bonus_pct, 0);
+    CHECK_EQ(config.game_mode, 0);
+}
+
+typedef struct
+{
+    uint32_t at_ms;
+    int8_t team;
+} Capture_t;
+
+// What the engine saves: the scores recomputed from the capture history
+static uint64_t recompute(const Capture_t * history, int count, int8_t team, uint32_t now_ms)
+{
+    uint64_t held_ms = 0;
+    for(int i = 0; i < count; i++)
+    {
+        uint32_t end_ms = i + 1 < count ? history[i + 1].at_ms : now_ms;
+        if(history[i].team == team)
+        {
+            held_ms += end_ms - history[i].at_ms;
+        }
+    }
+    return held_ms;
+}
+
+static void report_rate(const char * name, int64_t elapsed_us, uint32_t updates)
+{
+    printf("%-40s %.1f M updates/s, %.0f ns each\n", name, updates / (double)elapsed_us,
+           elapsed_us * 1000.0 / updates);
+}
+
+static void bench(void)
+{
+    ScoringRules_t rules = { .points_per_second = 1, .capture_delay_ms = 2000, .hold_bonus_pct = 25 };
+    ScoringEngine_t engine;
+    scoring_init(&engine, &rules, 4, 0);
+    scoring_capture(&engine, RED, 0);
+
+    // The SCORING_TICK_MS tick of the app task, over a match
+    int64_t start_us = host_us();
+    uint32_t now_ms = 0;
+    for(uint32_t i = 0; i < BENCH_UPDATES; i++)
+    {
+        now_ms += 100;
+        scoring_tick(&engine, now_ms);
+    }
+    report_rate("tick", host_us() - start_us, BENCH_UPDATES);
+    CHECK(scoring_get_points(&engine, RED) > 0);
+
+    // Captures by all the teams, every one settling a contest
+    start_us = host_us();
+    for(uint32_t i = 0; i < BENCH_UPDATES; i++)
+    {
+        now_ms += 2500;
+        scoring_capture(&engine, (int8_t)(i % 4), now_ms);
+    }
+    report_rate("capture", host_us() - start_us, BENCH_UPDATES);
+
+    // The master moving the bonus of the teams
+    start_us = host_us();
+    for(uint32_t i = 0; i < BENCH_UPDATES; i++)
+    {
+        now_ms += 10;
+        scoring_set_points_held(&engine, (int8_t)(i % 4), (uint8_t)(1 + i % 5), now_ms);
+    }
+    report_rate("points held", host_us() - start_us, BENCH_UPDATES);
+
+    // The baseline: every tick over the history of a long match
+    static Capture_t history[HISTORY_CAPTURES];
+    for(int i = 0; i < HISTORY_CAPTURES; i++)
+    {
+        history[i] = (Capture_t){ .at_ms = i * 3000, .team = (int8_t)(i % 4) };
+    }
+    uint32_t baseline_updates = BENCH_UPDATES / 1000;
+    volatile uint64_t sink = 0;
+    start_us = host_us();
+    for(uint32_t i = 0; i < baseline_updates; i++)
+    {
+        for(int8_t team = 0; team < 4; team++)
+        {
+            sink += recompute(history, HISTORY_CAPTURES, team, HISTORY_CAPTURES * 3000 + i);
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "recompute over %d captures", HISTORY_CAPTURES);
+    report_rate(name, host_us() - start_us, baseline_updates);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    test_rules();
+    test_no_drift();
+    test_legacy_config();
+    bench();
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "storage.h"
+
+/*
+ * The published status under concurrent readers: the app task plays a
+ * domination match where the teams take the point in turn, as fast as the
+ * presses come, while reader threads call app_get_status() in a loop. Every
+ * snapshot read must be one the app task published: the owner matches the
+ * parity of the captures, two reads of the same publication are identical,
+ * and nothing goes backwards. Reads per second and publications per second
+ * are reported.
+ */
+
+#define STRESS_MS           3000
+#define STRESS_READERS      4
+
+typedef struct
+{
+    pthread_t thread;
+    uint64_t reads;
+    uint64_t same_seq;          // Reads of a publication already seen
+} Reader_t;
+
+static Reader_t readers[STRESS_READERS];
+static volatile bool reading;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void * reader(void * arg)
+{
+    Reader_t * self = arg;
+    AppStatus_t last;
+    app_get_status(&last);
+
+    while(reading)
+    {
+        AppStatus_t status;
+        app_get_status(&status);
+        self->reads++;
+
+        CHECK(status.seq >= last.seq);
+        if(status.seq == last.seq)
+        {
+            CHECK(memcmp(&status, &last, sizeof(status)) == 0);
+            self->same_seq++;
+            continue;
+        }
+
+        // Red takes the point first, then the teams alternate
+        CHECK(status.captures >= last.captures);
+        if(status.state == APP_STATE_RUNNING && status.captures > 0)
+        {
+            CHECK_EQ(status.owner, status.captures % 2 ? TEAM_RED : TEAM_BLUE);
+        }
+        for(int team = 0; team < TEAM_COUNT; team++)
+        {
+            CHECK(status.seconds[team] >= last.seconds[team]);
+            CHECK(status.points[team] >= last.points[team]);
+        }
+        last = status;
+    }
+    return NULL;
+}
+
+static void start_app(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.match_duration_s = 3600;
+    config.points_per_second = 1;
+    config.capture_delay_ms = 0;
+    config.game_mode = 0;       // GAME_MODE_DOMINATION
+    CHECK_OK(storage_set_game_config(&config));
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    // Past the setup window once the app is up
+    AppEventMessage_t setup_expired = { .type = APP_EVENT_TMR_INIT_SETUP, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&setup_expired, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+    AppStatus_t status;
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+    } while(status.state != APP_STATE_IDLE);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    start_app();
+
+    AppStatus_t first;
+    app_get_status(&first);
+    reading = true;
+    for(int i = 0; i < STRESS_READERS; i++)
+    {
+        CHECK(pthread_create(&readers[i].thread, NULL, reader, &readers[i]) == 0);
+    }
+
+    // Each press takes the point from the other team, a publication each
+    int64_t start_us = host_us();
+    uint32_t presses = 0;
+    while(host_us() - start_us < STRESS_MS * 1000)
+    {
+        AppEventMessage_t press = { .type = presses % 2 ? APP_EVENT_BTN_BLUE_SHORT : APP_EVENT_BTN_RED_SHORT };
+        CHECK_OK(app_event_send(&press, portMAX_DELAY));
+        presses++;
+    }
+
+    // The last press handled, then the readers stop
+    AppStatus_t status;
+    do
+    {
+        sched_yield();
+        app_get_status(&status);
+    } while(status.captures < presses);
+    reading = false;
+
+    uint64_t reads = 0;
+    uint64_t same_seq = 0;
+    for(int i = 0; i < STRESS_READERS; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+        reads += readers[i].reads;
+        same_seq += readers[i].same_seq;
+    }
+    int64_t elapsed_us = host_us() - start_us;
+
+    CHECK_EQ(status.state, APP_STATE_RUNNING);
+    CHECK_EQ(status.captures, presses);
+    CHECK(reads > 0);
+    REPORT("publications", "%lu in %lld ms, %.0f/s, %u captures", (unsigned long)(status.seq - first.seq),
+           (long long)(elapsed_us / 1000), (status.seq - first.seq) * 1e6 / elapsed_us, presses);
+    REPORT("reads", "%d readers, %llu reads, %.2f M/s, %llu of a new publication",
+           STRESS_READERS, (unsigned long long)reads, reads / (double)elapsed_us, (unsigned long long)(reads - same_seq));
+    return 0;
+}
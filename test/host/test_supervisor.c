@@ -0,0 +1,268 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "esp_partition.h"
+
+#include "app.h"
+#include "history.h"
+#include "storage.h"
+#include "supervisor.h"
+#include "error_signaling.h"
+
+/*
+ * A hang of the app task in the middle of a match, one process per boot:
+ * the supervisor detects it and starves the task watchdog, the node is
+ * reset when the watchdog would bite and the next boot gets the RTC memory
+ * and the flash of the previous one. The match resumes with its owner,
+ * captures, hold times and time left, and its history goes on after its
+ * start. A finished match or a software reset does not resume. Detection,
+ * reset and resume times are reported.
+ */
+
+#define PARTITION_SIZE      0x10000
+#define RTC_MAX             4096
+#define WAIT_MS             10000
+#define PLAY_MS             1500
+
+typedef struct
+{
+    uint8_t rtc[RTC_MAX];
+    size_t rtc_len;
+    uint8_t history[PARTITION_SIZE];
+} BootMemory_t;
+
+typedef struct
+{
+    BootMemory_t hung;              // At the watchdog reset in the middle of the match
+    BootMemory_t finished;          // At a watchdog reset once the match is over
+    AppStatus_t before;             // The last status published before the hang
+    uint32_t detect_ms;             // From the hang to the fault record
+    uint32_t reset_ms;              // From the hang to the watchdog reset
+    uint32_t resume_ms;             // From the boot to the match playing again
+} Shared_t;
+
+typedef struct
+{
+    uint32_t starts;
+    uint32_t presses;
+    uint32_t ends;
+} Records_t;
+
+typedef void (*BootScenario_t)(void);
+
+static Shared_t * shared;
+static int64_t boot_us;
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t since_ms(int64_t start_us)
+{
+    return (uint32_t)((host_us() - start_us) / 1000);
+}
+
+static GameConfig_t match_config(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_BRAVO;
+    config.match_duration_s = 600;
+    config.points_per_second = 1;
+    config.capture_delay_ms = 0;
+    config.game_mode = 0;       // GAME_MODE_DOMINATION
+    return config;
+}
+
+static void send(AppEvent_t type)
+{
+    AppEventMessage_t message = { .type = type, .payload = POOL_HANDLE_NONE };
+    while(app_event_send(&message, portMAX_DELAY) == ESP_ERR_INVALID_STATE)
+    {
+        vTaskDelay(1);
+    }
+}
+
+static AppStatus_t wait_state(AppState_t state)
+{
+    AppStatus_t status;
+    int64_t start_us = host_us();
+    do
+    {
+        vTaskDelay(1);
+        app_get_status(&status);
+        CHECK(since_ms(start_us) < WAIT_MS);
+    } while(status.state != state);
+    return status;
+}
+
+static void save_memory(BootMemory_t * memory)
+{
+    memory->rtc_len = host_rtc_save(memory->rtc, sizeof(memory->rtc));
+    CHECK(memory->rtc_len > 0);
+    memcpy(memory->history, host_partition_data(HISTORY_PARTITION_LABEL), PARTITION_SIZE);
+}
+
+// What the firmware starts that takes part: NVS with the config stored, the
+// fault log, the history, the supervisor and the app task
+static void boot(esp_reset_reason_t reason, const BootMemory_t * memory, BootScenario_t scenario)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid > 0)
+    {
+        int status = 0;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return;
+    }
+
+    boot_us = host_us();
+    host_log_set_quiet(true);
+    host_set_reset_reason(reason);
+    host_partition_add(HISTORY_PARTITION_LABEL, ESP_PARTITION_TYPE_DATA, HISTORY_PARTITION_SUBTYPE, PARTITION_SIZE);
+    if(memory != NULL)
+    {
+        host_rtc_restore(memory->rtc, memory->rtc_len);
+        memcpy(host_partition_data(HISTORY_PARTITION_LABEL), memory->history, PARTITION_SIZE);
+    }
+
+    CHECK_OK(storage_init());
+    GameConfig_t config = match_config();
+    CHECK_OK(storage_set_game_config(&config));
+    CHECK_OK(fault_init());
+    CHECK_OK(history_init());
+    CHECK_OK(supervisor_init());
+    CHECK(xTaskCreate(app_task, "app", 4096, NULL, 5, NULL) == pdPASS);
+
+    scenario();
+    fflush(stdout);
+    _exit(0);
+}
+
+static esp_err_t count_sink(const uint8_t * data, size_t len, void * ctx)
+{
+    Records_t * records = ctx;
+    switch(data[0] & 0xF0)
+    {
+        case 0x10: records->starts++; break;
+        case 0x20: records->presses++; break;
+        case 0x40: records->ends++; break;
+        default: CHECK(false);
+    }
+    return ESP_OK;
+}
+
+static bool watchdog_fault_logged(void)
+{
+    FaultLog_t log;
+    fault_get_log(&log);
+    return log.count > 0 && log.records[(log.count - 1) % FAULT_LOG_LEN].code == WATCHDOG_ERROR;
+}
+
+// A match played a while, then the app task hangs
+static void play_and_hang(void)
+{
+    send(APP_EVENT_TMR_INIT_SETUP);
+    wait_state(APP_STATE_IDLE);
+    send(APP_EVENT_BTN_RED_SHORT);
+    wait_state(APP_STATE_RUNNING);
+    vTaskDelay(pdMS_TO_TICKS(PLAY_MS));
+    send(APP_EVENT_BTN_BLUE_SHORT);
+    vTaskDelay(pdMS_TO_TICKS(PLAY_MS));
+
+    int64_t hang_us = host_us();
+    CHECK_OK(supervisor_inject_hang("app"));
+    while(!watchdog_fault_logged())
+    {
+        CHECK(since_ms(hang_us) < WAIT_MS);
+        usleep(1000);
+    }
+    shared->detect_ms = since_ms(hang_us);
+
+    // The hardware resets the node once the supervisor left it unfed
+    const char * starved = NULL;
+    while(host_task_wdt_starved_ms(&starved) == 0)
+    {
+        CHECK(since_ms(hang_us) < WAIT_MS);
+        usleep(1000);
+    }
+    shared->reset_ms = since_ms(hang_us);
+    CHECK(strcmp(starved, "supervisor") == 0);
+
+    app_get_status(&shared->before);
+    CHECK_EQ(shared->before.state, APP_STATE_RUNNING);
+    save_memory(&shared->hung);
+}
+
+// Back from the watchdog reset: the same match, played on to its end
+static void resume_and_finish(void)
+{
+    AppStatus_t status = wait_state(APP_STATE_RUNNING);
+    shared->resume_ms = since_ms(boot_us);
+
+    const AppStatus_t * before = &shared->before;
+    CHECK(fault_is_degraded());
+    CHECK_EQ(status.control_point, CONTROL_POINT_BRAVO);
+    CHECK_EQ(status.owner, TEAM_BLUE);
+    CHECK_EQ(status.captures, before->captures);
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        CHECK(status.seconds[team] >= before->seconds[team]);
+        CHECK(status.seconds[team] <= before->seconds[team] + 1);
+        CHECK(status.points[team] >= before->points[team]);
+    }
+    // The time spent resetting is not played
+    CHECK(status.time_left_s <= before->time_left_s);
+    CHECK(status.time_left_s + 1 >= before->time_left_s);
+
+    send(APP_EVENT_BTN_RED_SHORT);
+    send(APP_EVENT_TMR_MATCH_END);
+    status = wait_state(APP_STATE_FINISHED);
+    CHECK_EQ(status.captures, before->captures + 1);
+
+    // The start written before the hang, the press of this boot and the end after it
+    Records_t records = { 0 };
+    CHECK_OK(history_export(0, 1, HISTORY_ANY_CONTROL_POINT, count_sink, &records));
+    CHECK_EQ(records.starts, 1);
+    CHECK_EQ(records.presses, 1);
+    CHECK_EQ(records.ends, 1);
+    save_memory(&shared->finished);
+}
+
+// No match to resume: the node waits in its setup window
+static void start_over(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(500));
+    AppStatus_t status;
+    app_get_status(&status);
+    CHECK_EQ(status.state, APP_STATE_INIT);
+    CHECK_EQ(status.captures, 0);
+}
+
+int main(void)
+{
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(shared != MAP_FAILED);
+
+    boot(ESP_RST_POWERON, NULL, play_and_hang);
+    boot(ESP_RST_TASK_WDT, &shared->hung, resume_and_finish);
+    boot(ESP_RST_TASK_WDT, &shared->finished, start_over);
+    boot(ESP_RST_SW, &shared->hung, start_over);
+    boot(ESP_RST_POWERON, &shared->hung, start_over);
+
+    REPORT("hang detected", "%u ms, deadline %d ms", shared->detect_ms, SUPERVISOR_APP_DEADLINE_MS);
+    REPORT("watchdog reset", "%u ms after the hang", shared->reset_ms);
+    REPORT("match resumed", "%u ms after the boot, %u captures, %u s left",
+           shared->resume_ms, shared->before.captures, shared->before.time_left_s);
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "host_test.h"
+#include "host_fakes.h"
+#include "network_double.h"
+#include "esp_timer.h"
+
+#include "matchsync.h"
+#include "app.h"
+#include "config.h"
+
+/*
+ * A scheduled match start on 20 nodes, one process per node on the virtual
+ * clock: each clock off the master by up to 30 s and drifting by up to
+ * 20 ppm, a heartbeat with the master clock every second and the schedule
+ * repeated over the last seconds before the start, each frame late by a base
+ * delay, a random jitter and now and then a spike of a few hundred ms. The
+ * instant each node starts, in master time, gives the spread across the
+ * field and the error against the instant scheduled; the countdown before
+ * it is whole. The timers fire on time: what is left is the estimate of the
+ * master clock. Reported per link jitter. First, a start due while the app
+ * queue is full goes once the queue has room.
+ */
+
+#define NODES               20
+#define START_S             60          // Master clock of the scheduled start
+#define SCHEDULE_FROM_S     52          // Repeated every second from then on
+#define COUNTDOWN_S         3
+#define BASE_DELAY_US       1500
+#define SPIKE_US            100000      // Up to three times this
+#define OFFSET_MAX_US       30000000
+#define DRIFT_MAX_PPM       20
+
+typedef struct
+{
+    const char * name;
+    double jitter_mean_us;
+    uint32_t spike_pct;
+    int64_t spread_max_us;
+} Scenario_t;
+
+static const Scenario_t scenarios[] =
+{
+    { "quiet",        100,  0,   500 },
+    { "busy",        2000,  5,  2000 },
+    { "congested",  10000, 20, 20000 },
+};
+
+#define SCENARIO_COUNT      (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static int64_t (*start_us)[NODES];          // Master clock of each start
+
+// Node clock
+static uint32_t countdowns;
+static double offset_us;
+static double drift;
+static unsigned seed;
+
+static double uniform(void)
+{
+    return (rand_r(&seed) + 1.0) / (RAND_MAX + 2.0);
+}
+
+static double delay_us(const Scenario_t * scenario)
+{
+    double delay = BASE_DELAY_US - log(uniform()) * scenario->jitter_mean_us;
+    if(uniform() * 100 < scenario->spike_pct)
+    {
+        delay += SPIKE_US * (1 + 2 * uniform());
+    }
+    return delay;
+}
+
+static int64_t to_local(double master_us)
+{
+    return (int64_t)(master_us * (1 + drift) + offset_us);
+}
+
+static double to_master(int64_t local_us)
+{
+    return (local_us - offset_us) / (1 + drift);
+}
+
+// The app task: the start it is handed, at the instant the timer armed for it
+static bool started(int64_t armed_us, int64_t * at_us)
+{
+    AppEventMessage_t message;
+    while(app_event_receive(&message, 0))
+    {
+        countdowns += message.type == APP_EVENT_SYNC_COUNTDOWN;
+        if(message.type == APP_EVENT_SYNC_START)
+        {
+            MatchSyncStats_t stats;
+            matchsync_get_stats(&stats);
+            *at_us = armed_us + stats.last_late_us;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void node_run(const Scenario_t * scenario, int node, int64_t * result)
+{
+    host_clock_set_virtual();
+    host_log_set_quiet(true);
+    seed = 7919 * (node + 1) + (unsigned)(scenario - scenarios);
+    offset_us = uniform() * OFFSET_MAX_US;
+    drift = (2 * uniform() - 1) * DRIFT_MAX_PPM * 1e-6;
+    host_clock_advance_to(to_local(0));
+    CHECK_OK(app_event_init());
+    CHECK_OK(matchsync_init());
+
+    const MatchSchedulePayload_t schedule =
+    {
+        .action = MATCH_SCHEDULE_START,
+        .at_us = (uint64_t)START_S * 1000000,
+        .countdown_s = COUNTDOWN_S,
+    };
+    int64_t armed_us = 0;
+    int64_t local_start_us = -1;
+
+    for(int second = 0; second <= START_S + 1 && local_start_us < 0; second++)
+    {
+        double master_us = second * 1e6;
+        int64_t heartbeat_us = to_local(master_us + delay_us(scenario));
+        int64_t schedule_us = second >= SCHEDULE_FROM_S && second < START_S ? to_local(master_us + 5000 + delay_us(scenario)) : -1;
+
+        // In the order they arrive, the timer firing on the way
+        for(int frame = 0; frame < 2; frame++)
+        {
+            bool heartbeat_first = schedule_us < 0 || heartbeat_us <= schedule_us;
+            int64_t at_us = (frame == 0) == heartbeat_first ? heartbeat_us : schedule_us;
+            if(at_us < 0)
+                continue;
+
+            host_clock_advance_to(at_us);
+            if(started(armed_us, &local_start_us))
+                break;
+
+            if(at_us == heartbeat_us)
+            {
+                matchsync_master_time((uint64_t)master_us, esp_timer_get_time());
+            }
+            else
+            {
+                CHECK_OK(network_double_deliver(MSG_MATCH_SCHEDULE, NODE_ID_MASTER, NODE_ID_BROADCAST, &schedule, sizeof(schedule)));
+            }
+
+            MatchSyncStats_t stats;
+            matchsync_get_stats(&stats);
+            if(stats.pending == MATCH_SCHEDULE_START)
+            {
+                armed_us = esp_timer_get_time() + stats.pending_in_us;
+            }
+        }
+    }
+
+    CHECK(local_start_us >= 0);
+    CHECK_EQ(countdowns, COUNTDOWN_S);
+    *result = (int64_t)to_master(local_start_us);
+}
+
+// The start due with the control queue full: retried until there is room
+static void test_full_queue(void)
+{
+    host_clock_set_virtual();
+    host_log_set_quiet(true);
+    CHECK_OK(app_event_init());
+    CHECK_OK(matchsync_init());
+    matchsync_master_time(0, esp_timer_get_time());
+
+    const MatchSchedulePayload_t schedule = { .action = MATCH_SCHEDULE_START, .at_us = 1000000 };
+    CHECK_OK(network_double_deliver(MSG_MATCH_SCHEDULE, NODE_ID_MASTER, NODE_ID_BROADCAST, &schedule, sizeof(schedule)));
+    const int64_t start_at_us = esp_timer_get_time() + 1000000;
+
+    AppEventMessage_t filler = { .type = APP_EVENT_TMR_MATCH_END };
+    while(app_event_send(&filler, 0) == ESP_OK)
+        ;
+
+    host_clock_advance_to(start_at_us + 5000);
+    MatchSyncStats_t stats;
+    matchsync_get_stats(&stats);
+    CHECK(stats.send_failures >= 5);
+    CHECK_EQ(stats.pending, MATCH_SCHEDULE_START);
+
+    AppEventMessage_t message;
+    while(app_event_receive(&message, 0))
+    {
+        CHECK_EQ(message.type, APP_EVENT_TMR_MATCH_END);
+    }
+    host_clock_advance(MATCHSYNC_RETRY_MS * 1000);
+    CHECK(app_event_receive(&message, 0));
+    CHECK_EQ(message.type, APP_EVENT_SYNC_START);
+
+    matchsync_get_stats(&stats);
+    CHECK_EQ(stats.pending, -1);
+    CHECK(stats.last_late_us >= 5000 && stats.last_late_us <= 5000 + MATCHSYNC_RETRY_MS * 1000);
+    REPORT("full queue", "start retried %" PRIu32 " times, sent %" PRId64 " us late", stats.send_failures, stats.last_late_us);
+}
+
+int main(void)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if(pid == 0)
+    {
+        test_full_queue();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    start_us = mmap(NULL, sizeof(int64_t) * NODES * SCENARIO_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(start_us != MAP_FAILED);
+
+    for(size_t s = 0; s < SCENARIO_COUNT; s++)
+    {
+        pid_t pids[NODES];
+        for(int node = 0; node < NODES; node++)
+        {
+            fflush(stdout);
+            pids[node] = fork();
+            CHECK(pids[node] >= 0);
+            if(pids[node] == 0)
+            {
+                node_run(&scenarios[s], node, &start_us[s][node]);
+                _exit(0);
+            }
+        }
+        for(int node = 0; node < NODES; node++)
+        {
+            int status;
+            CHECK(waitpid(pids[node], &status, 0) == pids[node]);
+            CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        int64_t first_us = INT64_MAX;
+        int64_t last_us = INT64_MIN;
+        for(int node = 0; node < NODES; node++)
+        {
+            first_us = start_us[s][node] < first_us ? start_us[s][node] : first_us;
+            last_us = start_us[s][node] > last_us ? start_us[s][node] : last_us;
+        }
+
+        // Every node a base delay or so after the instant, all of them together
+        const int64_t scheduled_us = (int64_t)START_S * 1000000;
+        CHECK(last_us - first_us <= scenarios[s].spread_max_us);
+        CHECK(first_us - scheduled_us >= 0);
+        CHECK(last_us - scheduled_us <= BASE_DELAY_US + scenarios[s].spread_max_us);
+        REPORT("start", "%-10s jitter %5.0f us, %2u%% spikes: spread %5" PRId64 " us across %d nodes, %+5" PRId64 " to %+5" PRId64 " us after the instant",
+               scenarios[s].name, scenarios[s].jitter_mean_us, scenarios[s].spike_pct, last_us - first_us, NODES,
+               first_us - scheduled_us, last_us - scheduled_us);
+    }
+    return 0;
+}
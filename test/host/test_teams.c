@@ -0,0 +1,115 @@
+#include <string.h>
+#include <time.h>
+#include "host_test.h"
+#include "host_fakes.h"
+
+#include "app.h"
+#include "leds.h"
+#include "storage.h"
+
+/*
+ * Teams as data: built with 2 and with 4 teams, every team leaves the setup
+ * window, captures and scores the same way, the presses of any team are
+ * ignored once the match is over, and each team has its own LED. Then
+ * the events per second of a long domination match through the state
+ * machine, to compare the two builds.
+ */
+
+#define BENCH_EVENTS    200000
+#define BENCH_PERIOD_MS 700         // Between presses, a scoring tick every other press or so
+
+static AppTraceEntry_t trace[BENCH_EVENTS + 2];
+
+static int64_t host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void store_config(void)
+{
+    GameConfig_t config = GAME_CONFIG_DEFAULT();
+    config.version = 1;
+    config.control_point = CONTROL_POINT_ALPHA;
+    config.points_per_second = 1;
+    config.game_mode = 0;       // GAME_MODE_DOMINATION
+    CHECK_OK(storage_set_game_config(&config));
+}
+
+// The last team leaves the setup window, then each team in turn holds the
+// point 10 s longer than the previous one, the last team wins
+static void test_teams(void)
+{
+    size_t count = 0;
+    trace[count++] = (AppTraceEntry_t){ 0, APP_EVENT_BTN((Team_t)(TEAM_COUNT - 1), PRESS_MEDIUM) };
+    uint32_t now_ms = 1000;
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        trace[count++] = (AppTraceEntry_t){ now_ms, APP_EVENT_BTN((Team_t)team, team % 2 ? PRESS_MEDIUM : PRESS_SHORT) };
+        now_ms += 10000 * (team + 1);
+    }
+    trace[count++] = (AppTraceEntry_t){ now_ms, APP_EVENT_TMR_MATCH_END };
+    // Over: the presses of every team change nothing
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        trace[count++] = (AppTraceEntry_t){ now_ms + 1000 + team, APP_EVENT_BTN((Team_t)team, PRESS_SHORT) };
+    }
+
+    AppStatus_t result;
+    CHECK_OK(app_replay(trace, count, &result));
+    CHECK_EQ(result.state, APP_STATE_FINISHED);
+    CHECK_EQ(result.winner, TEAM_COUNT - 1);
+    CHECK_EQ(result.captures, TEAM_COUNT);
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        CHECK_EQ(result.seconds[team], 10 * (team + 1));
+        CHECK_EQ(result.points[team], 10 * (team + 1));
+    }
+
+    // One LED per team
+    for(int team = 0; team < TEAM_COUNT; team++)
+    {
+        for(int other = team + 1; other < TEAM_COUNT; other++)
+        {
+            CHECK(team_leds[team] != team_leds[other]);
+        }
+    }
+}
+
+static void bench(void)
+{
+    size_t count = 0;
+    trace[count++] = (AppTraceEntry_t){ 0, APP_EVENT_TMR_INIT_SETUP };
+    uint32_t rng = 12345;
+    for(uint32_t i = 0; i < BENCH_EVENTS; i++)
+    {
+        rng = rng * 1103515245 + 12345;
+        Team_t team = (Team_t)((rng >> 16) % TEAM_COUNT);
+        PressKind_t press = (rng >> 8) & 1 ? PRESS_SHORT : PRESS_MEDIUM;
+        trace[count++] = (AppTraceEntry_t){ 1000 + i * BENCH_PERIOD_MS, APP_EVENT_BTN(team, press) };
+    }
+    trace[count++] = (AppTraceEntry_t){ 1000 + BENCH_EVENTS * BENCH_PERIOD_MS, APP_EVENT_TMR_MATCH_END };
+
+    AppStatus_t result;
+    int64_t start_us = host_us();
+    CHECK_OK(app_replay(trace, count, &result));
+    int64_t elapsed_us = host_us() - start_us;
+    CHECK_EQ(result.state, APP_STATE_FINISHED);
+
+    uint32_t ticks = (uint32_t)((uint64_t)BENCH_EVENTS * BENCH_PERIOD_MS / SCORING_TICK_MS);
+    char name[48];
+    snprintf(name, sizeof(name), "%d teams", TEAM_COUNT);
+    printf("%-40s %.0f ns per event and tick, %.2f M/s, %u captures\n", name,
+           elapsed_us * 1000.0 / (count + ticks), (count + ticks) / (double)elapsed_us, result.captures);
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    store_config();
+    test_teams();
+    bench();
+    return 0;
+}
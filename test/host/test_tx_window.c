@@ -0,0 +1,118 @@
+#include "host_test.h"
+#include "host_fakes.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "network.h"
+#include "transport.h"
+#include "storage.h"
+#include "config.h"
+
+/*
+ * The transmit window of modem sleep on the simulated air, with an access
+ * point that beacons every 200 TU rather than the 100 TU of
+ * NETWORK_BEACON_INTERVAL_TU: the station hears the interval from a beacon
+ * once associated and stops sniffing, then every window opens right after a
+ * beacon at the TSF of the access point. Back to the same access point
+ * it keeps the interval without sniffing again. The wait per window is
+ * reported.
+ */
+
+#define AP_INTERVAL_TU      200
+#define WINDOWS             10
+#define WAIT_MS             2000
+
+static void wait_interval(uint16_t interval_tu)
+{
+    NetworkWifiStats_t stats;
+    int64_t start_us = esp_timer_get_time();
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        network_get_wifi_stats(&stats);
+        CHECK(esp_timer_get_time() - start_us < WAIT_MS * 1000);
+    } while(stats.beacon_interval_tu != interval_tu);
+}
+
+// The interval of the access point heard, the radio back to its sleep
+static void test_learn(void)
+{
+    network_wait_connected();
+    wait_interval(AP_INTERVAL_TU);
+
+    int64_t start_us = esp_timer_get_time();
+    while(host_air_sniffing())
+    {
+        vTaskDelay(1);
+        CHECK(esp_timer_get_time() - start_us < WAIT_MS * 1000);
+    }
+}
+
+// Each window right after a beacon at a multiple of the announced interval.
+// The host may wake the test late, a quarter of the interval at most: a
+// window on the 100 TU default falls half an interval off
+static void test_windows(void)
+{
+    const int64_t beacon_us = (int64_t)AP_INTERVAL_TU * 1024;
+    const int64_t late_us = beacon_us / 4;
+    NetworkWifiStats_t before;
+    network_get_wifi_stats(&before);
+
+    int64_t waited_us = 0;
+    for(int i = 0; i < WINDOWS; i++)
+    {
+        // Anywhere between two beacons
+        vTaskDelay(pdMS_TO_TICKS(7 * (i + 1)));
+        int64_t call_us = esp_timer_get_time();
+        network_wait_tx_window();
+        int64_t now_us = esp_timer_get_time();
+        int64_t phase_us = esp_wifi_get_tsf_time(WIFI_IF_STA) % beacon_us;
+        CHECK(phase_us >= NETWORK_TX_WINDOW_OFFSET_US);
+        CHECK(phase_us <= NETWORK_TX_WINDOW_OFFSET_US + late_us);
+        CHECK(now_us - call_us <= beacon_us + NETWORK_TX_WINDOW_OFFSET_US + late_us);
+        waited_us += now_us - call_us;
+    }
+
+    NetworkWifiStats_t after;
+    network_get_wifi_stats(&after);
+    CHECK_EQ(after.tx_windows - before.tx_windows, WINDOWS);
+    REPORT("tx window", "%d TU beacons, %.1f ms wait on average", AP_INTERVAL_TU, waited_us / 1000.0 / WINDOWS);
+}
+
+// Back to the same access point: the interval is kept, no sniffing again
+static void test_reconnect(void)
+{
+    NetworkWifiStats_t before;
+    network_get_wifi_stats(&before);
+    CHECK_OK(network_wifi_reconnect());
+
+    NetworkWifiStats_t after;
+    int64_t start_us = esp_timer_get_time();
+    do
+    {
+        CHECK(!host_air_sniffing());
+        vTaskDelay(1);
+        network_get_wifi_stats(&after);
+        CHECK(esp_timer_get_time() - start_us < WAIT_MS * 1000);
+    } while(after.connects == before.connects);
+    CHECK_EQ(after.beacon_interval_tu, AP_INTERVAL_TU);
+    CHECK(!host_air_sniffing());
+}
+
+int main(void)
+{
+    host_log_set_quiet(true);
+    CHECK_OK(storage_init());
+    host_air_init(1);
+    host_air_set_beacon_interval(AP_INTERVAL_TU);
+    host_air_join(0);
+    CHECK_OK(network_init());
+    CHECK(xTaskCreate(network_task, "network", 4096, NULL, NETWORK_TASK_PRIORITY, NULL) == pdPASS);
+
+    test_learn();
+    test_windows();
+    test_reconnect();
+    return 0;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Check that the DominionNode app image fits both OTA slots.
+
+Reads the app binary of a build and the partition table, prints the headroom
+of each app partition and fails if the image does not fit one, or leaves
+less than --min-free of it, for example:
+
+    idf.py build
+    tools/check_app_size.py build/DominionNode.bin partitions.csv
+
+The build runs it after linking the app, see the project CMakeLists.txt.
+"""
+
+import argparse
+import csv
+import os
+import sys
+
+
+def parse_size(text):
+    text = text.strip()
+    for suffix, scale in (("K", 1024), ("M", 1024 * 1024)):
+        if text.upper().endswith(suffix):
+            return int(text[:-1], 0) * scale
+    return int(text, 0)
+
+
+def app_partitions(path):
+    """(name, size) of the app partitions of a partition table CSV."""
+    partitions = []
+    with open(path, newline="") as table:
+        for row in csv.reader(table):
+            row = [field.strip() for field in row]
+            if not row or row[0].startswith("#") or len(row) < 5:
+                continue
+            if row[1] == "app":
+                partitions.append((row[0], parse_size(row[4])))
+    return partitions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("binary", help="app binary of the build")
+    parser.add_argument("partitions", help="partition table CSV")
+    parser.add_argument("--min-free", type=float, default=5.0, help="minimum free space per slot, in %% (default 5)")
+    args = parser.parse_args()
+
+    image_size = os.path.getsize(args.binary)
+    partitions = app_partitions(args.partitions)
+    if not partitions:
+        print(f"{args.partitions}: no app partition", file=sys.stderr)
+        return 1
+
+    ok = True
+    for name, size in partitions:
+        free = size - image_size
+        free_pct = 100.0 * free / size
+        print(f"{name}: {image_size} of {size} bytes, {free} free ({free_pct:.1f} %)")
+        if free < 0 or free_pct < args.min_free:
+            ok = False
+
+    if not ok:
+        print(f"The app does not fit the slots with {args.min_free:.1f} % free", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
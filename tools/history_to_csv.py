@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Decode the DominionNode match history to CSV.
+
+Reads the "HIST:<hex>" lines printed by history_export_uart() from a serial
+log, or with --image a raw dump of the history partition, for example:
+
+    esptool.py read_flash 0x1E0000 0x20000 history.bin
+    tools/history_to_csv.py --image history.bin > history.csv
+
+Record format: see components/history/include/history.h.
+"""
+
+import argparse
+import csv
+import re
+import struct
+import sys
+
+SECTOR_SIZE = 4096
+PAGE_SIZE = 256
+MAGIC = 0x54534948
+HEADER_SIZE = 8
+PRESSES = ("short", "medium", "long")
+
+
+def varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def record_len(data, pos):
+    """Length of the record at pos, 0 if it is not a whole record."""
+    try:
+        kind = data[pos] & 0xF0
+        end = pos + 1
+        if kind == 0x10:
+            _, end = varint(data, end)
+            end += 2
+            _, end = varint(data, end)
+        elif kind in (0x20, 0x30):
+            _, end = varint(data, end)
+        elif kind == 0x40:
+            team_count = data[end]
+            end += 1
+            for _ in range(1 + 2 * team_count):
+                _, end = varint(data, end)
+        else:
+            return 0
+        return end - pos if end <= len(data) else 0
+    except IndexError:
+        return 0
+
+
+def image_records(image):
+    """Records of a partition dump, oldest sector first."""
+    sectors = []
+    for base in range(0, len(image) - SECTOR_SIZE + 1, SECTOR_SIZE):
+        magic, seq = struct.unpack_from("<II", image, base)
+        if magic == MAGIC:
+            sectors.append((seq, base))
+
+    for _, base in sorted(sectors):
+        sector = image[base:base + SECTOR_SIZE]
+        pos = HEADER_SIZE
+        while pos < SECTOR_SIZE:
+            length = record_len(sector, pos)
+            if length == 0:
+                # Padding up to the next page
+                pos = (pos // PAGE_SIZE + 1) * PAGE_SIZE
+                continue
+            yield sector[pos:pos + length]
+            pos += length
+
+
+def log_records(lines):
+    for line in lines:
+        match = re.search(r"HIST:([0-9a-fA-F]+)", line)
+        if match:
+            yield bytes.fromhex(match.group(1))
+
+
+def decode(records, writer):
+    writer.writerow(["match", "control_point", "game_mode", "time_s", "event", "team", "press", "seconds", "points"])
+    match = None
+    time_ds = 0
+
+    for record in records:
+        kind = record[0] & 0xF0
+        low = record[0] & 0x0F
+
+        if kind == 0x10:
+            number, pos = varint(record, 1)
+            game_mode = record[pos]
+            uptime, _ = varint(record, pos + 2)
+            match = {"number": number, "control_point": low, "game_mode": game_mode}
+            time_ds = 0
+            writer.writerow([number, low, game_mode, "0.0", "start", "", "", uptime, ""])
+            continue
+
+        if match is None:
+            # The start of this match was overwritten by the ring
+            continue
+
+        row = [match["number"], match["control_point"], match["game_mode"]]
+
+        if kind in (0x20, 0x30):
+            delta, _ = varint(record, 1)
+            time_ds += delta
+            if kind == 0x20:
+                team, press = low >> 2, low & 0x03
+                writer.writerow(row + [f"{time_ds / 10:.1f}", "press", team, PRESSES[press], "", ""])
+            else:
+                writer.writerow(row + [f"{time_ds / 10:.1f}", "chord", "", PRESSES[low & 0x03], "", ""])
+
+        elif kind == 0x40:
+            team_count = record[1]
+            delta, pos = varint(record, 2)
+            time_ds += delta
+            writer.writerow(row + [f"{time_ds / 10:.1f}", "end", low - 1 if low else "draw", "", "", ""])
+            for team in range(team_count):
+                seconds, pos = varint(record, pos)
+                points, pos = varint(record, pos)
+                writer.writerow(row + [f"{time_ds / 10:.1f}", "score", team, "", seconds, points])
+            match = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", nargs="?", help="serial log (default stdin) or partition image with --image")
+    parser.add_argument("--image", action="store_true", help="input is a raw dump of the history partition")
+    args = parser.parse_args()
+
+    writer = csv.writer(sys.stdout)
+    if args.image:
+        with open(args.input, "rb") as f:
+            decode(image_records(f.read()), writer)
+    elif args.input:
+        with open(args.input, errors="replace") as f:
+            decode(log_records(f), writer)
+    else:
+        decode(log_records(sys.stdin), writer)
+
+
+if __name__ == "__main__":
+    main()